@@ -45,6 +45,33 @@ enum {
     TPNG_ERROR__PARSE_FAILED,
     TPNG_ERROR__SIZE_MISMATCH,
     TPNG_ERROR__PIXEL_MISMATCH,
+    TPNG_ERROR__STRICT_MISMATCH,
+    TPNG_ERROR__PARALLEL_MISMATCH,
+    TPNG_ERROR__BATCH_MISMATCH,
+    TPNG_ERROR__QUEUE_MISMATCH,
+    TPNG_ERROR__STEP_MISMATCH,
+    TPNG_ERROR__INDEX_MISMATCH,
+    TPNG_ERROR__REGION_MISMATCH,
+    TPNG_ERROR__DOWNSCALE_MISMATCH,
+    TPNG_ERROR__RESAMPLE_MISMATCH,
+    TPNG_ERROR__FLOAT_MISMATCH,
+    TPNG_ERROR__FORMAT_MISMATCH,
+    TPNG_ERROR__PREMULTIPLY_MISMATCH,
+    TPNG_ERROR__PACKED_MISMATCH,
+    TPNG_ERROR__NATIVE_MISMATCH,
+    TPNG_ERROR__BLOCK_MISMATCH,
+    TPNG_ERROR__MIP_MISMATCH,
+    TPNG_ERROR__LAYOUT_MISMATCH,
+    TPNG_ERROR__ORIENTATION_MISMATCH,
+    TPNG_ERROR__LINEAR_MISMATCH,
+    TPNG_ERROR__STORED_MISMATCH,
+    TPNG_ERROR__INFLATE_MISMATCH,
+    TPNG_ERROR__PIPELINE_MISMATCH,
+    TPNG_ERROR__LINEAR_ALPHA_MISMATCH,
+    TPNG_ERROR__WORKING_MISMATCH,
+    TPNG_ERROR__INDEX_CORRUPT_MISMATCH,
+    TPNG_ERROR__ADLER_MISMATCH,
+    TPNG_ERROR__EXCESS_MISMATCH,
 };
 
 char * TPNG_ERROR__STRINGS[] = {
@@ -53,7 +80,34 @@ char * TPNG_ERROR__STRINGS[] = {
     "Cannot read file.",
     "the PNG file data was not successfully parsed.",
     "The width/height of the pixel data does not match the correct size.",
-    "Incorrect pixel data."
+    "Incorrect pixel data.",
+    "Strict mode accepted a corrupt file or rejected a valid one.",
+    "Decoding with the parallel options gave different pixels.",
+    "A batch decode gave a different image or status.",
+    "A queued decode gave a different image or status.",
+    "Decoding in steps gave a different image or status.",
+    "Decoding rows from an index gave different pixels.",
+    "Decoding a region gave different pixels.",
+    "Decoding downscaled gave different pixels.",
+    "Decoding resampled gave different pixels.",
+    "Decoding to floats gave different pixels.",
+    "Decoding to another format gave different pixels.",
+    "Decoding premultiplied gave different pixels.",
+    "Decoding to a 16-bit packed format gave different pixels.",
+    "Decoding native samples gave different pixels.",
+    "Decoding to compressed blocks gave pixels too far off.",
+    "Decoding a mip chain gave different pixels.",
+    "Decoding to a tiled layout put pixels in the wrong place.",
+    "Decoding flipped or rotated put pixels in the wrong place.",
+    "Decoding to linear light gave the wrong values.",
+    "Reading stored blocks in place gave different pixels.",
+    "Inflating in parallel gave different pixels.",
+    "Inflating on a pipeline gave different pixels, or wasn't cancelled.",
+    "Premultiplied linear color wasn't the linear color times alpha.",
+    "The decoder held more than a window of the stream and a few rows.",
+    "Decoding rows from a damaged index gave different pixels.",
+    "A stream with a bad checksum wasn't blanked in every format.",
+    "A stream with a row past the last gave different pixels, or its bad checksum wasn't caught."
 };
 
 
@@ -108,6 +162,1616 @@ static void integrity_check(const char * filenamePNG) {
 }
 
 
+// Decodes in strict mode and checks whether the 
+// file was accepted.
+static void strict_check(const char * filenamePNG, int shouldAccept) {
+    printf("checking strict mode with %s...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w;
+    uint32_t h;
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.strict = 1;
+
+    uint8_t * pixels = tpng_decode(
+        pngdata,
+        pngsize,
+        &w, 
+        &h,
+        &options
+    );
+
+    if ((pixels != NULL) != shouldAccept) {
+        throw_error(TPNG_ERROR__STRICT_MISMATCH);
+    }
+
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes a file whose IDAT stream is only stored blocks, split 
+// mid-row by block headers and IDAT chunks, and compares with 
+// the same image compressed as usual.
+static void stored_check(const char * filenamePNG, const char * compressedPNG) {
+    printf("checking %s against %s...\n", filenamePNG, compressedPNG);
+
+    uint32_t  pngsize, compressedsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+    uint8_t * compresseddata = dump_file_data(compressedPNG, &compressedsize);
+
+    uint32_t w, h, cw, ch;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+    uint8_t * expected = tpng_get_rgba(compresseddata, compressedsize, &cw, &ch);
+    if (!pixels || !expected || w != cw || h != ch || memcmp(pixels, expected, (size_t)w*h*4)) {
+        throw_error(TPNG_ERROR__STORED_MISMATCH);
+    }
+
+    free(expected);
+    free(pixels);
+    free(compresseddata);
+    free(pngdata);
+}
+
+
+// Decodes with parallelExpand on, forced even for small 
+// images, and compares with the plain decode. The inflate 
+// options need larger files: see inflate_check and 
+// pipeline_check.
+static void parallel_check(const char * filenamePNG) {
+    printf("checking parallel decode of %s...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint32_t pw, ph;
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.threads = 4;
+    options.parallelExpand = 1;
+    options.parallelExpandPixels = 1;
+
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+    uint8_t * parallelPixels = tpng_decode(pngdata, pngsize, &pw, &ph, &options);
+
+    if (w != pw || h != ph || 
+        (pixels != NULL) != (parallelPixels != NULL) ||
+        (pixels && memcmp(pixels, parallelPixels, w*h*4))) {
+        throw_error(TPNG_ERROR__PARALLEL_MISMATCH);
+    }
+
+    free(pixels);
+    free(parallelPixels);
+    free(pngdata);
+}
+
+
+// Decodes the files together in a batch, plus one buffer 
+// that isn't a PNG, and compares with decoding each alone.
+static void batch_check(const char ** filenamesPNG, uint32_t count) {
+    printf("checking batch decode of %d files...\n", (int)count);
+
+    tpng_batch_item_t * items = calloc(count+1, sizeof(tpng_batch_item_t));
+    uint32_t i;
+    for(i = 0; i < count; ++i) {
+        items[i].rawData = dump_file_data(filenamesPNG[i], &items[i].rawSize);
+    }
+    items[count].rawData = (const uint8_t*)"not a PNG file";
+    items[count].rawSize = 14;
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.threads = 4;
+    options.parallelExpandPixels = 1;
+
+    if (tpng_decode_batch(items, count+1, &options) != count ||
+        items[count].status != TPNG_STATUS_NOT_PNG ||
+        items[count].rgba != NULL) {
+        throw_error(TPNG_ERROR__BATCH_MISMATCH);
+    }
+
+    for(i = 0; i < count; ++i) {
+        uint32_t w, h;
+        uint8_t * pixels = tpng_get_rgba(items[i].rawData, items[i].rawSize, &w, &h);
+        if (items[i].status != TPNG_STATUS_OK ||
+            w != items[i].w || h != items[i].h ||
+            memcmp(pixels, items[i].rgba, w*h*4)) {
+            throw_error(TPNG_ERROR__BATCH_MISMATCH);
+        }
+        free(pixels);
+        free(items[i].rgba);
+        free((uint8_t*)items[i].rawData);
+    }
+    free(items);
+}
+
+
+// A scheduler that runs no threads: tasks are queued, and 
+// run by whoever waits. It claims 4 workers so that the 
+// parallel paths are taken for inputs large enough to use them.
+typedef struct queued_task_t queued_task_t;
+struct queued_task_t {
+    void (*task)(void *);
+    void * data;
+    queued_task_t * next;
+};
+
+static void * queue_create_group(void * userData) {
+    return calloc(1, sizeof(queued_task_t));
+}
+
+static void queue_submit(void * userData, void * group, void (*task)(void *), void * data) {
+    queued_task_t * head = group;
+    queued_task_t * t = malloc(sizeof(queued_task_t));
+    t->task = task;
+    t->data = data;
+    t->next = head->next;
+    head->next = t;
+}
+
+static void queue_run(queued_task_t * head) {
+    while(head->next) {
+        queued_task_t * t = head->next;
+        head->next = t->next;
+        t->task(t->data);
+        free(t);
+    }
+}
+
+static void queue_wait(void * userData, void * group) {
+    queue_run(group);
+    free(group);
+}
+
+static int queue_get_worker_count(void * userData) {
+    return 4;
+}
+
+// Decodes in a batch on the queue scheduler, with the 
+// parallel options forced on, and compares with the plain 
+// decode.
+static void scheduler_check(const char ** filenamesPNG, uint32_t count) {
+    printf("checking a custom scheduler with %d files...\n", (int)count);
+
+    tpng_scheduler_t scheduler;
+    scheduler.userData = NULL;
+    scheduler.createGroup = queue_create_group;
+    scheduler.submit = queue_submit;
+    scheduler.wait = queue_wait;
+    scheduler.getWorkerCount = queue_get_worker_count;
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.parallelInflate = 1;
+    options.pipeline = 1;
+    options.parallelExpandPixels = 1;
+    options.scheduler = &scheduler;
+
+    tpng_batch_item_t * items = calloc(count, sizeof(tpng_batch_item_t));
+    uint32_t i;
+    for(i = 0; i < count; ++i) {
+        items[i].rawData = dump_file_data(filenamesPNG[i], &items[i].rawSize);
+    }
+    if (tpng_decode_batch(items, count, &options) != count) {
+        throw_error(TPNG_ERROR__PARALLEL_MISMATCH);
+    }
+
+    for(i = 0; i < count; ++i) {
+        uint32_t w, h;
+        uint8_t * pixels = tpng_get_rgba(items[i].rawData, items[i].rawSize, &w, &h);
+        if (w != items[i].w || h != items[i].h ||
+            memcmp(pixels, items[i].rgba, w*h*4)) {
+            throw_error(TPNG_ERROR__PARALLEL_MISMATCH);
+        }
+        free(pixels);
+        free(items[i].rgba);
+        free((uint8_t*)items[i].rawData);
+    }
+    free(items);
+}
+
+
+// Inflates a file large enough to be cut into parts, on the 
+// queue scheduler and on threads, and compares with the plain 
+// decode. Some of the parts start in stored or fixed blocks, 
+// so have to be inflated again once the part before them is 
+// known. Then a byte two thirds in is flipped, which must give 
+// the same result both ways too.
+static void inflate_check(const char * filenamePNG) {
+    printf("checking parallel inflate of %s...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    tpng_scheduler_t scheduler;
+    scheduler.userData = NULL;
+    scheduler.createGroup = queue_create_group;
+    scheduler.submit = queue_submit;
+    scheduler.wait = queue_wait;
+    scheduler.getWorkerCount = queue_get_worker_count;
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.parallelInflate = 1;
+
+    uint8_t * pixels = NULL;
+    uint32_t w, h;
+    int i;
+    for(i = 0; i < 4; ++i) {
+        uint32_t pw, ph;
+        if (i == 2) {
+            pngdata[pngsize/3*2] ^= 1;
+        }
+        if (i % 2 == 0) {
+            free(pixels);
+            pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+            if (i == 0 && !pixels) {
+                throw_error(TPNG_ERROR__INFLATE_MISMATCH);
+            }
+        }
+        options.scheduler = i % 2 ? NULL : &scheduler;
+        options.threads = i % 2 ? 4 : 0;
+        uint8_t * parallelPixels = tpng_decode(pngdata, pngsize, &pw, &ph, &options);
+        if ((pixels != NULL) != (parallelPixels != NULL) || 
+            (pixels && (w != pw || h != ph || memcmp(pixels, parallelPixels, (size_t)w*h*4)))) {
+            throw_error(TPNG_ERROR__INFLATE_MISMATCH);
+        }
+        free(parallelPixels);
+    }
+
+    free(pixels);
+    free(pngdata);
+}
+
+
+// The queue scheduler, keeping the first group made (a 
+// decode queue's) so its tasks can be run by hand. Once a 
+// task is submitted to any other group, request is cancelled.
+typedef struct {
+    queued_task_t * first;
+    tpng_request_t * request;
+} cancelling_scheduler_t;
+
+static void * cancelling_create_group(void * userData) {
+    cancelling_scheduler_t * c = userData;
+    void * group = queue_create_group(NULL);
+    if (!c->first) c->first = group;
+    return group;
+}
+
+static void cancelling_submit(void * userData, void * group, void (*task)(void *), void * data) {
+    cancelling_scheduler_t * c = userData;
+    if (group != c->first && c->request) {
+        tpng_request_cancel(c->request);
+    }
+    queue_submit(NULL, group, task, data);
+}
+
+// Inflates while unfiltering, on threads and on the queue 
+// scheduler (where the reader ends up inflating), and compares 
+// with the plain decode. Then decodes on a queue whose request 
+// is cancelled once its inflate task is submitted, which must 
+// stop the inflate partway.
+static void pipeline_check(const char * filenamePNG) {
+    printf("checking pipelined inflate of %s...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    tpng_scheduler_t scheduler;
+    scheduler.userData = NULL;
+    scheduler.createGroup = queue_create_group;
+    scheduler.submit = queue_submit;
+    scheduler.wait = queue_wait;
+    scheduler.getWorkerCount = queue_get_worker_count;
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.pipeline = 1;
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+    int i;
+    for(i = 0; i < 2; ++i) {
+        uint32_t pw, ph;
+        options.scheduler = i ? NULL : &scheduler;
+        options.threads = i ? 4 : 0;
+        uint8_t * pipelinePixels = tpng_decode(pngdata, pngsize, &pw, &ph, &options);
+        if (!pixels || !pipelinePixels || w != pw || h != ph || 
+            memcmp(pixels, pipelinePixels, (size_t)w*h*4)) {
+            throw_error(TPNG_ERROR__PIPELINE_MISMATCH);
+        }
+        free(pipelinePixels);
+    }
+
+    // with a row past the last in the stream, a bad checksum 
+    // after it still blanks the image
+    uint8_t * damaged = malloc(pngsize);
+    uint32_t at;
+    memcpy(damaged, pngdata, pngsize);
+    damaged[20] = (uint8_t)((h-1) >> 24);
+    damaged[21] = (uint8_t)((h-1) >> 16);
+    damaged[22] = (uint8_t)((h-1) >> 8);
+    damaged[23] = (uint8_t)(h-1);
+    for(at = pngsize - 8; at > 12 && memcmp(damaged + at, "IEND", 4); --at);
+    damaged[at - 9] ^= 1;
+    for(i = 0; i < 2; ++i) {
+        uint32_t pw, ph;
+        size_t p;
+        options.scheduler = i ? NULL : &scheduler;
+        options.threads = i ? 4 : 0;
+        uint8_t * pipelinePixels = tpng_decode(damaged, pngsize, &pw, &ph, &options);
+        if (!pipelinePixels || w != pw || h-1 != ph) {
+            throw_error(TPNG_ERROR__PIPELINE_MISMATCH);
+        }
+        for(p = 0; p < (size_t)w*(h-1)*4; ++p) {
+            if (pipelinePixels[p]) {
+                throw_error(TPNG_ERROR__PIPELINE_MISMATCH);
+            }
+        }
+        free(pipelinePixels);
+    }
+    free(damaged);
+
+    cancelling_scheduler_t cancelling;
+    memset(&cancelling, 0, sizeof(cancelling_scheduler_t));
+    scheduler.userData = &cancelling;
+    scheduler.createGroup = cancelling_create_group;
+    scheduler.submit = cancelling_submit;
+    options.scheduler = &scheduler;
+    options.threads = 0;
+
+    tpng_queue_t * queue = tpng_queue_create(&options);
+    cancelling.request = tpng_queue_submit(queue, pngdata, pngsize, 0, NULL, NULL);
+    queue_run(cancelling.first);
+    if (tpng_request_wait(cancelling.request) != TPNG_STATUS_CANCELLED ||
+        tpng_request_take_rgba(cancelling.request, &w, &h)) {
+        throw_error(TPNG_ERROR__PIPELINE_MISMATCH);
+    }
+    tpng_queue_destroy(queue);
+
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes a few rows or bytes at a time, and compares 
+// with the plain decode.
+static void step_check(const char * filenamePNG, uint32_t maxRows, uint32_t maxBytes) {
+    printf("checking %s in steps of %d rows / %d bytes...\n", filenamePNG, (int)maxRows, (int)maxBytes);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint32_t sw, sh;
+    int steps = 0;
+
+    tpng_decoder_t * decoder = tpng_decoder_create(pngdata, pngsize, NULL);
+    while(tpng_decoder_step(decoder, maxRows, maxBytes)) {
+        steps++;
+    }
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+    uint8_t * steppedPixels = tpng_decoder_take_rgba(decoder, &sw, &sh);
+
+    if (tpng_decoder_get_status(decoder) != TPNG_STATUS_OK ||
+        !steps ||
+        w != sw || h != sh || 
+        !steppedPixels ||
+        memcmp(pixels, steppedPixels, w*h*4)) {
+        throw_error(TPNG_ERROR__STEP_MISMATCH);
+    }
+    tpng_decoder_destroy(decoder);
+
+    free(pixels);
+    free(steppedPixels);
+    free(pngdata);
+}
+
+
+// Decodes the image as is, shrunk, resampled and as BC1, and checks 
+// the decoder held no more than maxWorking bytes besides its 
+// output: a window of the inflated stream and a few rows, 
+// rather than all of either.
+static void working_check(const char * filenamePNG, uint32_t maxWorking) {
+    printf("checking %s is decoded within %d bytes...\n", filenamePNG, (int)maxWorking);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    int i;
+    for(i = 0; i < 4; ++i) {
+        tpng_options_t options;
+        memset(&options, 0, sizeof(tpng_options_t));
+        if (i == 1) {
+            options.downscale = 8;
+        } else if (i == 2) {
+            options.resampleW = 224;
+            options.resampleH = 224;
+        } else if (i == 3) {
+            options.format = TPNG_FORMAT_BC1;
+        }
+        tpng_decoder_t * decoder = tpng_decoder_create(pngdata, pngsize, &options);
+        if (tpng_decoder_get_working_size(decoder)) {
+            throw_error(TPNG_ERROR__WORKING_MISMATCH);
+        }
+        while(tpng_decoder_step(decoder, 0, 4096));
+        uint32_t w, h;
+        if (tpng_decoder_get_status(decoder) != TPNG_STATUS_OK ||
+            !tpng_decoder_get_rgba(decoder, &w, &h) ||
+            tpng_decoder_get_working_size(decoder) > maxWorking) {
+            throw_error(TPNG_ERROR__WORKING_MISMATCH);
+        }
+        tpng_decoder_destroy(decoder);
+    }
+
+    free(pngdata);
+}
+
+
+// Builds an index while decoding, then decodes a few ranges 
+// of rows from it, and compares with the plain decode.
+static void index_check(const char * filenamePNG, uint32_t rowsPerCheckpoint) {
+    printf("checking rows of %s from an index...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint32_t iw, ih;
+    uint8_t * index;
+    uint32_t indexSize;
+
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+    uint8_t * indexedPixels = tpng_decode_indexed(pngdata, pngsize, &iw, &ih, NULL, rowsPerCheckpoint, &index, &indexSize);
+    if (!index || w != iw || h != ih ||
+        memcmp(pixels, indexedPixels, w*h*4)) {
+        throw_error(TPNG_ERROR__INDEX_MISMATCH);
+    }
+
+    uint32_t ranges[][2] = {
+        {0, 1},
+        {rowsPerCheckpoint, rowsPerCheckpoint+1},
+        {h/2-1, h/2+1},
+        {h-3, h}
+    };
+    uint32_t i;
+    for(i = 0; i < 4; ++i) {
+        uint32_t rw;
+        uint32_t y0 = ranges[i][0];
+        uint32_t y1 = ranges[i][1];
+        uint8_t * rows = tpng_decode_rows(pngdata, pngsize, index, indexSize, y0, y1, &rw);
+        if (!rows || rw != w ||
+            memcmp(rows, pixels + y0*w*4, (y1-y0)*w*4)) {
+            throw_error(TPNG_ERROR__INDEX_MISMATCH);
+        }
+        free(rows);
+    }
+
+    free(index);
+    free(pixels);
+    free(indexedPixels);
+    free(pngdata);
+}
+
+
+// Damages the last checkpoint of an index a few bytes at a 
+// time, and checks the last rows still decode as they should, 
+// from an earlier checkpoint or from the first row.
+static void index_corrupt_check(const char * filenamePNG, uint32_t rowsPerCheckpoint) {
+    printf("checking rows of %s from a damaged index...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * index;
+    uint32_t indexSize;
+
+    uint8_t * pixels = tpng_decode_indexed(pngdata, pngsize, &w, &h, NULL, rowsPerCheckpoint, &index, &indexSize);
+    if (!pixels || !index) {
+        throw_error(TPNG_ERROR__INDEX_CORRUPT_MISMATCH);
+    }
+
+    // the last checkpoint holds at least a window and a row
+    uint32_t tail = indexSize / 2 < 32768 ? indexSize / 2 : 32768;
+    uint8_t * damaged = malloc(indexSize);
+    uint32_t seed = 1;
+    int i, j;
+    for(i = 0; i < 64; ++i) {
+        uint32_t rw;
+        memcpy(damaged, index, indexSize);
+        for(j = 0; j <= i % 4; ++j) {
+            seed = seed*1103515245 + 12345;
+            damaged[indexSize - 1 - (seed >> 8) % tail] ^= (uint8_t)(1 << (seed >> 4) % 8);
+        }
+        uint8_t * rows = tpng_decode_rows(pngdata, pngsize, damaged, indexSize, h-3, h, &rw);
+        if (!rows || rw != w ||
+            memcmp(rows, pixels + (h-3)*w*4, 3*w*4)) {
+            throw_error(TPNG_ERROR__INDEX_CORRUPT_MISMATCH);
+        }
+        free(rows);
+    }
+
+    free(damaged);
+    free(index);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes a few rectangles of the image, some of them past 
+// its edges, and compares with the same part of the plain decode.
+static void region_check(const char * filenamePNG) {
+    printf("checking regions of %s...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    uint32_t rects[][4] = {
+        {0, 0, 1, 1},
+        {1, 1, 5, 3},
+        {w/3, h/3, w/3+1, h/3+1},
+        {w/2, h/2, w, h},
+        {w-1, 0, 1, h}
+    };
+    uint32_t i, y;
+    for(i = 0; i < 5; ++i) {
+        uint32_t x0 = rects[i][0];
+        uint32_t y0 = rects[i][1];
+        uint32_t x1 = x0 + rects[i][2] > w ? w : x0 + rects[i][2];
+        uint32_t y1 = y0 + rects[i][3] > h ? h : y0 + rects[i][3];
+        uint32_t rw, rh;
+        uint8_t * region = tpng_decode_region(pngdata, pngsize, x0, y0, rects[i][2], rects[i][3], &rw, &rh, NULL);
+        if (!region || rw != x1 - x0 || rh != y1 - y0) {
+            throw_error(TPNG_ERROR__REGION_MISMATCH);
+        }
+        for(y = y0; y < y1; ++y) {
+            if (memcmp(region + (y-y0)*rw*4, pixels + (y*w + x0)*4, rw*4)) {
+                throw_error(TPNG_ERROR__REGION_MISMATCH);
+            }
+        }
+        free(region);
+    }
+
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image downscaled, and with only some of its passes 
+// if previewPasses isn't 0, then compares with box averages of the 
+// plain decode, where each pixel a pass didn't reach is a copy 
+// of the one it would be shown as in a progressive display.
+static void downscale_check(const char * filenamePNG, int downscale, int previewPasses) {
+    printf("checking %s downscaled by %d with %d passes...\n", filenamePNG, downscale, previewPasses);
+
+    static const uint32_t blockSizes[7][2] = {{1, 1}, {8, 8}, {4, 8}, {4, 4}, {2, 4}, {2, 2}, {1, 2}};
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.downscale = downscale;
+    options.previewPasses = previewPasses;
+
+    uint32_t sw, sh;
+    uint8_t * scaled = tpng_decode(pngdata, pngsize, &sw, &sh, &options);
+    if (!scaled || 
+        sw != (w+downscale-1)/downscale || 
+        sh != (h+downscale-1)/downscale) {
+        throw_error(TPNG_ERROR__DOWNSCALE_MISMATCH);
+    }
+
+    uint32_t blockW = blockSizes[previewPasses][0];
+    uint32_t blockH = blockSizes[previewPasses][1];
+    uint32_t sx, sy, x, y, c;
+    for(sy = 0; sy < sh; ++sy) {
+        for(sx = 0; sx < sw; ++sx) {
+            uint32_t sum[4] = {0, 0, 0, 0};
+            uint32_t count = 0;
+            for(y = sy*downscale; y < (sy+1)*downscale && y < h; ++y) {
+                for(x = sx*downscale; x < (sx+1)*downscale && x < w; ++x) {
+                    const uint8_t * pixel = pixels + ((y/blockH*blockH)*w + x/blockW*blockW)*4;
+                    for(c = 0; c < 4; ++c) sum[c] += pixel[c];
+                    count++;
+                }
+            }
+            for(c = 0; c < 4; ++c) {
+                if (scaled[(sy*sw + sx)*4 + c] != (sum[c] + count/2) / count) {
+                    throw_error(TPNG_ERROR__DOWNSCALE_MISMATCH);
+                }
+            }
+        }
+    }
+
+    free(scaled);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Resamples the image to its own size, which should change nothing, 
+// then to half its size with the area filter, which should be within 
+// rounding of downscaling by 2.
+static void resample_check(const char * filenamePNG) {
+    printf("checking resampling of %s...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.resampleW = w;
+    options.resampleH = h;
+
+    uint32_t rw, rh;
+    int filter;
+    for(filter = TPNG_RESAMPLE_BILINEAR; filter <= TPNG_RESAMPLE_AREA; ++filter) {
+        options.resampleFilter = filter;
+        uint8_t * resampled = tpng_decode(pngdata, pngsize, &rw, &rh, &options);
+        if (!resampled || rw != w || rh != h ||
+            memcmp(resampled, pixels, w*h*4)) {
+            throw_error(TPNG_ERROR__RESAMPLE_MISMATCH);
+        }
+        free(resampled);
+    }
+
+    uint32_t sw, sh, i;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.downscale = 2;
+    uint8_t * scaled = tpng_decode(pngdata, pngsize, &sw, &sh, &options);
+
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.resampleW = w/2;
+    options.resampleH = h/2;
+    options.resampleFilter = TPNG_RESAMPLE_AREA;
+    uint8_t * resampled = tpng_decode(pngdata, pngsize, &rw, &rh, &options);
+    if (!resampled || rw != w/2 || rh != h/2 || sw != rw || sh != rh) {
+        throw_error(TPNG_ERROR__RESAMPLE_MISMATCH);
+    }
+    for(i = 0; i < rw*rh*4; ++i) {
+        if (abs((int)resampled[i] - (int)scaled[i]) > 1) {
+            throw_error(TPNG_ERROR__RESAMPLE_MISMATCH);
+        }
+    }
+
+    free(resampled);
+    free(scaled);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image to normalized floats, planar and not, and 
+// compares with the plain decode. 16-bit images only need to 
+// agree on the top 8 bits.
+static void float_check(const char * filenamePNG, int planar) {
+    printf("checking %s as %s floats...\n", filenamePNG, planar ? "planar" : "interleaved");
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.format = TPNG_FORMAT_FLOAT32;
+    options.planar = planar;
+    options.dropAlpha = planar;
+    int c;
+    for(c = 0; c < 4; ++c) {
+        options.scale[c] = 2.0f;
+        options.bias[c] = -1.0f;
+    }
+
+    uint32_t fw, fh, x, y;
+    uint32_t channels = planar ? 3 : 4;
+    float * floats = (float*)tpng_decode(pngdata, pngsize, &fw, &fh, &options);
+    if (!floats || fw != w || fh != h) {
+        throw_error(TPNG_ERROR__FLOAT_MISMATCH);
+    }
+    for(y = 0; y < h; ++y) {
+        for(x = 0; x < w; ++x) {
+            for(c = 0; c < (int)channels; ++c) {
+                float value = planar ? 
+                    floats[(c*h + y)*w + x] : 
+                    floats[(y*w + x)*channels + c];
+                int sample = (int)((value + 1.0f) / 2.0f * 65535.0f + 0.5f) / 257;
+                if (sample - pixels[(y*w + x)*4 + c] > 1 || pixels[(y*w + x)*4 + c] - sample > 1) {
+                    throw_error(TPNG_ERROR__FLOAT_MISMATCH);
+                }
+            }
+        }
+    }
+
+    free(floats);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image in each 8 and 16-bit format, and compares 
+// with the plain decode, converted. Luma can be off by 1 from 
+// rounding, and 16-bit channels need only agree on the top 8 bits. 
+// Each format must also come out the same decoded in parallel 
+// and by a decoder a row at a time.
+static void format_check(const char * filenamePNG) {
+    printf("checking %s in other formats...\n", filenamePNG);
+
+    static const int formats[] = {
+        TPNG_FORMAT_BGRA8, TPNG_FORMAT_RGB8, TPNG_FORMAT_ARGB8, 
+        TPNG_FORMAT_GRAY8, TPNG_FORMAT_GRAY_ALPHA8, TPNG_FORMAT_RGBA16
+    };
+    // for each format, which RGBA channel each of its channels is 
+    // (-1 for luma), and how many there are
+    static const int channels[][5] = {
+        {2, 1, 0, 3, 4}, {0, 1, 2, 0, 3}, {3, 0, 1, 2, 4}, 
+        {-1, 0, 0, 0, 1}, {-1, 3, 0, 0, 2}, {0, 1, 2, 3, 4}
+    };
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+
+    uint32_t f, i;
+    int c;
+    for(f = 0; f < 6; ++f) {
+        uint32_t fw, fh;
+        int count = channels[f][4];
+        options.format = formats[f];
+        uint8_t * converted = tpng_decode(pngdata, pngsize, &fw, &fh, &options);
+        if (!converted || fw != w || fh != h) {
+            throw_error(TPNG_ERROR__FORMAT_MISMATCH);
+        }
+
+        size_t size = (size_t)w*h*(formats[f] == TPNG_FORMAT_RGBA16 ? 8 : count);
+        uint32_t sw, sh;
+        options.threads = 4;
+        options.parallelExpand = 1;
+        options.parallelExpandPixels = 1;
+        uint8_t * parallel = tpng_decode(pngdata, pngsize, &sw, &sh, &options);
+        options.threads = 0;
+        options.parallelExpand = 0;
+        options.parallelExpandPixels = 0;
+        tpng_decoder_t * decoder = tpng_decoder_create(pngdata, pngsize, &options);
+        while(tpng_decoder_step(decoder, 1, 0));
+        const uint8_t * stepped = tpng_decoder_get_rgba(decoder, &sw, &sh);
+        if (!parallel || !stepped || 
+            memcmp(parallel, converted, size) || 
+            memcmp(stepped, converted, size)) {
+            throw_error(TPNG_ERROR__FORMAT_MISMATCH);
+        }
+        tpng_decoder_destroy(decoder);
+        free(parallel);
+
+        for(i = 0; i < w*h; ++i) {
+            const uint8_t * pixel = pixels + i*4;
+            for(c = 0; c < count; ++c) {
+                int expected = channels[f][c] < 0 ?
+                    (int)(0.299*pixel[0] + 0.587*pixel[1] + 0.114*pixel[2] + 0.5) :
+                    pixel[channels[f][c]];
+                int actual = formats[f] == TPNG_FORMAT_RGBA16 ?
+                    ((uint16_t*)converted)[i*4 + c] >> 8 :
+                    converted[i*count + c];
+                if (actual - expected > 1 || expected - actual > 1 ||
+                    (channels[f][c] >= 0 && actual != expected)) {
+                    throw_error(TPNG_ERROR__FORMAT_MISMATCH);
+                }
+            }
+        }
+        free(converted);
+    }
+
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes an image whose zlib checksum is wrong in the formats 
+// the decoder steps through, and checks each comes out blank, 
+// as RGBA8 does. If damage is set, the checksum is moved from 
+// the last IDAT chunk into one of its own, with a bit flipped, 
+// so nothing but the checksum is left once the rows are in.
+static void adler_check(const char * filenamePNG, int damage) {
+    printf("checking %s with a bad checksum in other formats...\n", filenamePNG);
+
+    static const int formats[] = {
+        TPNG_FORMAT_RGBA8, TPNG_FORMAT_RGB565, TPNG_FORMAT_BC1, TPNG_FORMAT_FLOAT32
+    };
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    if (damage) {
+        uint32_t at = 8, last = 0, length = 0;
+        while(at + 12 <= pngsize && memcmp(pngdata + at + 4, "IEND", 4)) {
+            length = (uint32_t)pngdata[at] << 24 | pngdata[at+1] << 16 | pngdata[at+2] << 8 | pngdata[at+3];
+            if (!memcmp(pngdata + at + 4, "IDAT", 4)) last = at;
+            at += 12 + length;
+        }
+
+        // the adler32 ends the data of the last IDAT chunk; 
+        // CRCs are left as zeros, as they aren't checked
+        length = (uint32_t)pngdata[last] << 24 | pngdata[last+1] << 16 | pngdata[last+2] << 8 | pngdata[last+3];
+        uint32_t end = last + 8 + length;
+        uint8_t * split = calloc(1, pngsize + 12);
+        memcpy(split, pngdata, end - 4);
+        length -= 4;
+        split[last]   = (uint8_t)(length >> 24);
+        split[last+1] = (uint8_t)(length >> 16);
+        split[last+2] = (uint8_t)(length >> 8);
+        split[last+3] = (uint8_t)length;
+        memcpy(split + end + 3, "\4IDAT", 5);
+        memcpy(split + end + 8, pngdata + end - 4, 4);
+        split[end + 11] ^= 1;
+        memcpy(split + end + 16, pngdata + end + 4, pngsize - end - 4);
+        free(pngdata);
+        pngdata = split;
+        pngsize += 12;
+    }
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+
+    uint32_t f;
+    for(f = 0; f < 4; ++f) {
+        uint32_t w, h, sw, sh;
+        options.format = formats[f];
+        uint8_t * pixels = tpng_decode(pngdata, pngsize, &w, &h, &options);
+        tpng_decoder_t * decoder = tpng_decoder_create(pngdata, pngsize, &options);
+        while(tpng_decoder_step(decoder, 1, 0));
+        const uint8_t * stepped = tpng_decoder_get_rgba(decoder, &sw, &sh);
+        size_t size = formats[f] == TPNG_FORMAT_BC1 ? (size_t)((w+3)/4)*((h+3)/4)*8 : 
+            (size_t)w*h*(formats[f] == TPNG_FORMAT_RGB565 ? 2 : formats[f] == TPNG_FORMAT_FLOAT32 ? 16 : 4);
+        if (!pixels || !stepped || sw != w || sh != h) {
+            throw_error(TPNG_ERROR__ADLER_MISMATCH);
+        }
+        size_t i;
+        for(i = 0; i < size; ++i) {
+            if (pixels[i] || stepped[i]) {
+                throw_error(TPNG_ERROR__ADLER_MISMATCH);
+            }
+        }
+        tpng_decoder_destroy(decoder);
+        free(pixels);
+    }
+
+    free(pngdata);
+}
+
+
+// Takes a row off the height in the header, so the stream holds 
+// one more than is read, and checks the rest still decode, one-shot 
+// and stepped. Then damages the checksum, past the row that's left 
+// out, and checks both come out blank.
+static void excess_check(const char * filenamePNG) {
+    printf("checking %s with a row past the last...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+    pngdata[20] = (uint8_t)((h-1) >> 24);
+    pngdata[21] = (uint8_t)((h-1) >> 16);
+    pngdata[22] = (uint8_t)((h-1) >> 8);
+    pngdata[23] = (uint8_t)(h-1);
+
+    int damage;
+    for(damage = 0; damage < 2; ++damage) {
+        uint32_t sw, sh, ew, eh;
+        if (damage) {
+            // the adler32 ends the data of the chunk before IEND
+            uint32_t i;
+            for(i = pngsize - 8; i > 12 && memcmp(pngdata + i, "IEND", 4); --i);
+            pngdata[i - 9] ^= 1;
+        }
+        uint8_t * shorter = tpng_get_rgba(pngdata, pngsize, &ew, &eh);
+        tpng_decoder_t * decoder = tpng_decoder_create(pngdata, pngsize, NULL);
+        while(tpng_decoder_step(decoder, 1, 0));
+        const uint8_t * stepped = tpng_decoder_get_rgba(decoder, &sw, &sh);
+        if (!shorter || !stepped || ew != w || eh != h-1 || sw != w || sh != h-1) {
+            throw_error(TPNG_ERROR__EXCESS_MISMATCH);
+        }
+        size_t i;
+        for(i = 0; i < (size_t)w*(h-1)*4; ++i) {
+            uint8_t expected = damage ? 0 : pixels[i];
+            if (shorter[i] != expected || stepped[i] != expected) {
+                throw_error(TPNG_ERROR__EXCESS_MISMATCH);
+            }
+        }
+        tpng_decoder_destroy(decoder);
+        free(shorter);
+    }
+
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image premultiplied, and compares with 
+// the plain decode multiplied by alpha.
+static void premultiply_check(const char * filenamePNG) {
+    printf("checking %s premultiplied...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.premultiply = 1;
+
+    uint32_t pw, ph;
+    uint8_t * premultiplied = tpng_decode(pngdata, pngsize, &pw, &ph, &options);
+    if (!premultiplied || pw != w || ph != h) {
+        throw_error(TPNG_ERROR__PREMULTIPLY_MISMATCH);
+    }
+
+    uint32_t i;
+    int c;
+    for(i = 0; i < w*h; ++i) {
+        const uint8_t * pixel = pixels + i*4;
+        for(c = 0; c < 4; ++c) {
+            int expected = c == 3 ? pixel[3] : (int)(pixel[c]*pixel[3]/255.0 + 0.5);
+            if (premultiplied[i*4 + c] != expected) {
+                throw_error(TPNG_ERROR__PREMULTIPLY_MISMATCH);
+            }
+        }
+    }
+
+    free(premultiplied);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image premultiplied as 16-bit samples or floats, 
+// and compares with the plain 16-bit decode multiplied by alpha.
+static void premultiply_wide_check(const char * filenamePNG, int format) {
+    printf("checking %s premultiplied as %s...\n", filenamePNG, format == TPNG_FORMAT_FLOAT32 ? "floats" : "16-bit samples");
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.format = TPNG_FORMAT_RGBA16;
+    uint32_t w, h;
+    uint16_t * samples = (uint16_t*)tpng_decode(pngdata, pngsize, &w, &h, &options);
+
+    options.format = format;
+    options.premultiply = 1;
+    uint32_t pw, ph;
+    void * premultiplied = tpng_decode(pngdata, pngsize, &pw, &ph, &options);
+    if (!samples || !premultiplied || pw != w || ph != h) {
+        throw_error(TPNG_ERROR__PREMULTIPLY_MISMATCH);
+    }
+
+    uint32_t i;
+    int c;
+    for(i = 0; i < w*h; ++i) {
+        const uint16_t * pixel = samples + i*4;
+        for(c = 0; c < 4; ++c) {
+            double expected = c == 3 ? pixel[3] : pixel[c]*(double)pixel[3]/65535.0;
+            if (format == TPNG_FORMAT_FLOAT32) {
+                double v = ((float*)premultiplied)[i*4 + c]*65535.0;
+                if (v - expected > 0.51 || expected - v > 0.51) {
+                    throw_error(TPNG_ERROR__PREMULTIPLY_MISMATCH);
+                }
+            } else if (((uint16_t*)premultiplied)[i*4 + c] != (uint16_t)(expected + 0.5)) {
+                throw_error(TPNG_ERROR__PREMULTIPLY_MISMATCH);
+            }
+        }
+    }
+
+    free(premultiplied);
+    free(samples);
+    free(pngdata);
+}
+
+
+// Decodes the image in each 16-bit packed format, and compares 
+// with the plain decode, rounded. With dithering, each channel 
+// must still be one of the two levels around the plain value, 
+// and with diffusion each channel's mean must also stay within 
+// a twentieth of a level of the plain one.
+static void packed_check(const char * filenamePNG, int dither) {
+    printf("checking %s in 16-bit packed formats...\n", filenamePNG);
+
+    static const int formatBits[3][4] = {{5, 6, 5, 0}, {4, 4, 4, 4}, {5, 5, 5, 1}};
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.dither = dither;
+
+    uint32_t f, i;
+    int c;
+    for(f = 0; f < 3; ++f) {
+        uint32_t fw, fh;
+        options.format = TPNG_FORMAT_RGB565 + f;
+        uint16_t * packed = (uint16_t *)tpng_decode(pngdata, pngsize, &fw, &fh, &options);
+        if (!packed || fw != w || fh != h) {
+            throw_error(TPNG_ERROR__PACKED_MISMATCH);
+        }
+        double drift[4] = {0};
+        for(i = 0; i < w*h; ++i) {
+            const uint8_t * pixel = pixels + i*4;
+            int shift = 16;
+            for(c = 0; c < 4; ++c) {
+                int bits = formatBits[f][c];
+                int max = (1 << bits) - 1;
+                if (!bits) continue;
+                shift -= bits;
+                double exact = pixel[c]*max/255.0;
+                int actual = (packed[i] >> shift) & max;
+                drift[c] += actual - exact;
+                if (dither == TPNG_DITHER_NONE || c == 3 ? 
+                    actual != (int)(exact + 0.5) : 
+                    (actual < exact - 1 || actual > exact + 1)) {
+                    throw_error(TPNG_ERROR__PACKED_MISMATCH);
+                }
+            }
+        }
+        for(c = 0; c < 3 && dither == TPNG_DITHER_DIFFUSION; ++c) {
+            if (drift[c] / (w*h) > 0.05 || drift[c] / (w*h) < -0.05) {
+                throw_error(TPNG_ERROR__PACKED_MISMATCH);
+            }
+        }
+        free(packed);
+    }
+
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the native samples of a palette or 1 or 8-bit 
+// gray image, with padded rows, and compares what they 
+// stand for with the plain decode.
+static void native_check(const char * filenamePNG, uint32_t rowAlignment) {
+    printf("checking %s as native samples...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.rowAlignment = rowAlignment;
+
+    tpng_native_format_t format;
+    uint8_t * samples = tpng_decode_native(pngdata, pngsize, &format, &options);
+    if (!samples || format.w != w || format.h != h || 
+        format.stride % rowAlignment || format.stride < format.rowBytes) {
+        throw_error(TPNG_ERROR__NATIVE_MISMATCH);
+    }
+
+    uint32_t x, y;
+    for(y = 0; y < h; ++y) {
+        const uint8_t * row = samples + y*format.stride;
+        for(x = 0; x < w; ++x) {
+            const uint8_t * pixel = pixels + (y*w + x)*4;
+            int match;
+            if (format.colorType == 3) {
+                match = !memcmp(format.palette + row[x]*4, pixel, 4);
+            } else if (format.bitDepth == 1) {
+                match = ((row[x/8] >> (7 - x%8)) & 1)*255 == pixel[0];
+            } else {
+                match = row[x] == pixel[0];
+            }
+            if (!match) {
+                throw_error(TPNG_ERROR__NATIVE_MISMATCH);
+            }
+        }
+    }
+
+    free(samples);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image to BC1 or BC3 blocks, decompresses them, 
+// and compares with the plain decode. Color must be off by 
+// less than maxError on average, and alpha by no more than 
+// half a step between its endpoints.
+static void block_check(const char * filenamePNG, int format, int maxError) {
+    printf("checking %s as compressed blocks...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.format = format;
+
+    uint32_t bw, bh;
+    uint8_t * blocks = tpng_decode(pngdata, pngsize, &bw, &bh, &options);
+    if (!blocks || bw != w || bh != h) {
+        throw_error(TPNG_ERROR__BLOCK_MISMATCH);
+    }
+
+    int blockBytes = format == TPNG_FORMAT_BC1 ? 8 : 16;
+    uint32_t x, y;
+    int c;
+    double error = 0;
+    for(y = 0; y < h; ++y) {
+        for(x = 0; x < w; ++x) {
+            const uint8_t * pixel = pixels + (y*w + x)*4;
+            const uint8_t * block = blocks + ((y/4)*((w+3)/4) + x/4)*blockBytes;
+            const uint8_t * color = block + blockBytes - 8;
+            int i = (y%4)*4 + x%4;
+            int ends[2] = {color[0] | (color[1] << 8), color[2] | (color[3] << 8)};
+            int index = (color[4 + i/4] >> ((i%4)*2)) & 3;
+            for(c = 0; c < 3; ++c) {
+                static const int bits[3] = {5, 6, 5};
+                static const int shifts[3] = {11, 5, 0};
+                int max = (1 << bits[c]) - 1;
+                int end0 = ((ends[0] >> shifts[c]) & max)*255 / max;
+                int end1 = ((ends[1] >> shifts[c]) & max)*255 / max;
+                int value = index == 0 ? end0 : index == 1 ? end1 :
+                            index == 2 ? (2*end0 + end1)/3 : (end0 + 2*end1)/3;
+                error += abs(value - pixel[c]);
+            }
+            if (blockBytes == 16) {
+                int bit = i*3;
+                int level = (((block[2 + bit/8] | (block[3 + bit/8] << 8)) >> (bit%8)) & 7);
+                int alpha = level == 0 ? block[0] : level == 1 ? block[1] :
+                            ((8-level)*block[0] + (level-1)*block[1]) / 7;
+                if (abs(alpha - pixel[3]) > (block[0] - block[1])/14 + 1) {
+                    throw_error(TPNG_ERROR__BLOCK_MISMATCH);
+                }
+            }
+        }
+    }
+    if (error / (w*h*3) >= maxError) {
+        throw_error(TPNG_ERROR__BLOCK_MISMATCH);
+    }
+
+    free(blocks);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image with its mip chain, and compares the 
+// first level with the plain decode, and each level after 
+// with the 2x2 average of the level before.
+static void mip_check(const char * filenamePNG) {
+    printf("checking %s with mipmaps...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.mipmaps = 1;
+
+    uint32_t mw, mh;
+    uint8_t * chain = tpng_decode(pngdata, pngsize, &mw, &mh, &options);
+    if (!chain || mw != w || mh != h || memcmp(chain, pixels, w*h*4)) {
+        throw_error(TPNG_ERROR__MIP_MISMATCH);
+    }
+
+    tpng_mip_chain_t mips;
+    tpng_get_mip_chain(w, h, &mips);
+    if (mips.w[mips.levels-1] != 1 || mips.h[mips.levels-1] != 1) {
+        throw_error(TPNG_ERROR__MIP_MISMATCH);
+    }
+    uint32_t level, x, y;
+    int c;
+    for(level = 1; level < mips.levels; ++level) {
+        uint32_t pw = mips.w[level-1];
+        uint32_t ph = mips.h[level-1];
+        const uint8_t * above = chain + mips.offset[level-1];
+        const uint8_t * below = chain + mips.offset[level];
+        for(y = 0; y < mips.h[level]; ++y) {
+            for(x = 0; x < mips.w[level]; ++x) {
+                uint32_t x0 = x*2, x1 = x*2+1 < pw ? x*2+1 : x*2;
+                uint32_t y0 = ph > 1 ? y*2 : 0, y1 = ph > 1 ? y*2+1 : 0;
+                for(c = 0; c < 4; ++c) {
+                    int sum = above[(y0*pw+x0)*4+c] + above[(y0*pw+x1)*4+c] + 
+                              above[(y1*pw+x0)*4+c] + above[(y1*pw+x1)*4+c];
+                    if (below[(y*mips.w[level]+x)*4+c] != (sum+2)/4) {
+                        throw_error(TPNG_ERROR__MIP_MISMATCH);
+                    }
+                }
+            }
+        }
+    }
+
+    free(chain);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image in a tiled or Z-order layout, and 
+// finds each pixel of the plain decode where it should be.
+static void layout_check(const char * filenamePNG, int layout, uint32_t tileSize) {
+    printf("checking %s in tiles of %d...\n", filenamePNG, (int)tileSize);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.layout = layout;
+    options.tileSize = tileSize;
+
+    uint32_t tw, th;
+    uint8_t * tiled = tpng_decode(pngdata, pngsize, &tw, &th, &options);
+    if (!tiled || tw != w || th != h) {
+        throw_error(TPNG_ERROR__LAYOUT_MISMATCH);
+    }
+
+    uint32_t tilesAcross = (w + tileSize-1) / tileSize;
+    uint32_t x, y;
+    for(y = 0; y < h; ++y) {
+        for(x = 0; x < w; ++x) {
+            uint32_t tx = x % tileSize;
+            uint32_t ty = y % tileSize;
+            uint32_t inTile = ty*tileSize + tx;
+            if (layout == TPNG_LAYOUT_MORTON) {
+                int bit;
+                inTile = 0;
+                for(bit = 0; bit < 8; ++bit) 
+                    inTile |= (((tx >> bit) & 1) << (bit*2)) | (((ty >> bit) & 1) << (bit*2+1));
+            }
+            size_t index = ((size_t)(y / tileSize)*tilesAcross + x / tileSize)*tileSize*tileSize + inTile;
+            if (memcmp(tiled + index*4, pixels + (y*w + x)*4, 4)) {
+                throw_error(TPNG_ERROR__LAYOUT_MISMATCH);
+            }
+        }
+    }
+
+    free(tiled);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Decodes the image flipped or rotated, and finds each pixel 
+// of the plain decode where it should be. If exif isn't 0, an 
+// eXIf chunk with that orientation is added after IHDR, and 
+// the image is decoded with TPNG_ORIENT_EXIF instead.
+static void orientation_check(const char * filenamePNG, int orientation, int exif) {
+    printf("checking %s oriented...\n", filenamePNG);
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    uint32_t w, h;
+    uint8_t * pixels = tpng_get_rgba(pngdata, pngsize, &w, &h);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.orientation = orientation;
+    if (exif) {
+        // big-endian TIFF, with one IFD of just the orientation. 
+        // The CRC is left 0, as it's only checked in strict mode.
+        static const uint8_t chunk[] = {
+            0, 0, 0, 26, 'e', 'X', 'I', 'f',
+            'M', 'M', 0, 42, 0, 0, 0, 8, 
+            0, 1, 
+            0x01, 0x12, 0, 3, 0, 0, 0, 1, 0, 0, 0, 0, 
+            0, 0, 0, 0,
+            0, 0, 0, 0
+        };
+        uint8_t * withExif = malloc(pngsize + sizeof(chunk));
+        memcpy(withExif, pngdata, 33);
+        memcpy(withExif + 33, chunk, sizeof(chunk));
+        // the low byte of the orientation's value
+        withExif[33 + 8 + 10 + 9] = exif;
+        memcpy(withExif + 33 + sizeof(chunk), pngdata + 33, pngsize - 33);
+        free(pngdata);
+        pngdata = withExif;
+        pngsize += sizeof(chunk);
+        options.orientation = TPNG_ORIENT_EXIF;
+        orientation = exif - 1;
+    }
+
+    uint32_t ow, oh;
+    uint8_t * oriented = tpng_decode(pngdata, pngsize, &ow, &oh, &options);
+    int turned = orientation >= TPNG_ORIENT_TRANSPOSE;
+    if (!oriented || ow != (turned ? h : w) || oh != (turned ? w : h)) {
+        throw_error(TPNG_ERROR__ORIENTATION_MISMATCH);
+    }
+
+    uint32_t x, y;
+    for(y = 0; y < h; ++y) {
+        for(x = 0; x < w; ++x) {
+            uint32_t ox = x, oy = y;
+            switch(orientation) {
+              case TPNG_ORIENT_FLIP_X:     ox = w-1-x; break;
+              case TPNG_ORIENT_ROTATE_180: ox = w-1-x; oy = h-1-y; break;
+              case TPNG_ORIENT_FLIP_Y:     oy = h-1-y; break;
+              case TPNG_ORIENT_TRANSPOSE:  ox = y;     oy = x; break;
+              case TPNG_ORIENT_ROTATE_90:  ox = h-1-y; oy = x; break;
+              case TPNG_ORIENT_TRANSVERSE: ox = h-1-y; oy = w-1-x; break;
+              case TPNG_ORIENT_ROTATE_270: ox = y;     oy = w-1-x; break;
+              default:;
+            }
+            if (memcmp(oriented + (oy*ow + ox)*4, pixels + (y*w + x)*4, 4)) {
+                throw_error(TPNG_ERROR__ORIENTATION_MISMATCH);
+            }
+        }
+    }
+
+    free(oriented);
+    free(pixels);
+    free(pngdata);
+}
+
+
+// Returns the value of an IEEE half, for the non-negative 
+// finite ones linear output gives.
+static double linear_half_value(uint16_t half) {
+    int exponent = (half >> 10) & 31;
+    double value = (half & 1023) / 1024.0;
+    if (exponent) value += 1;
+    else exponent = 1;
+    for(; exponent < 15; ++exponent) value /= 2;
+    for(; exponent > 15; --exponent) value *= 2;
+    return value;
+}
+
+
+// Decodes the image to linear floats, and checks each color 
+// against the 16-bit decode put through the image's curve. 
+// For sRGB that's ((v+0.055)/1.055)^2.4 = L, checked as 
+// ((v+0.055)/1.055)^12 = L^5 to need no pow(); a gamma of 1 
+// leaves v as is, and any other gamma below 1 only darkens.
+static void linear_check(const char * filenamePNG, int half) {
+    printf("checking %s as linear %s...\n", filenamePNG, half ? "halves" : "floats");
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.format = TPNG_FORMAT_RGBA16;
+    uint32_t w, h;
+    uint16_t * samples = (uint16_t*)tpng_decode(pngdata, pngsize, &w, &h, &options);
+
+    tpng_decoder_t * decoder = tpng_decoder_create(pngdata, pngsize, &options);
+    tpng_color_info_t info;
+    while(tpng_decoder_step(decoder, 0, 0));
+    if (!samples || !tpng_decoder_get_color_info(decoder, &info)) {
+        throw_error(TPNG_ERROR__LINEAR_MISMATCH);
+    }
+    tpng_decoder_destroy(decoder);
+
+    options.format = half ? TPNG_FORMAT_FLOAT16 : TPNG_FORMAT_FLOAT32;
+    options.linear = 1;
+    uint32_t fw, fh, i;
+    void * floats = tpng_decode(pngdata, pngsize, &fw, &fh, &options);
+    if (!floats || fw != w || fh != h) {
+        throw_error(TPNG_ERROR__LINEAR_MISMATCH);
+    }
+    for(i = 0; i < w*h*4; ++i) {
+        double v = samples[i] / 65535.0;
+        double l = half ? 
+            linear_half_value(((uint16_t*)floats)[i]) :
+            ((float*)floats)[i];
+        double tolerance = half ? 1e-3 : 1e-5;
+        int ok;
+        if (i % 4 == 3 || info.gamma == 1.0f) {
+            ok = l - v < tolerance && v - l < tolerance;
+        } else if (info.srgbIntent >= 0 || info.gamma == 0) {
+            if (v <= 0.04045) {
+                ok = l*12.92 - v < tolerance && v - l*12.92 < tolerance;
+            } else {
+                double a = (v + 0.055) / 1.055;
+                double a12 = a*a*a*a*a*a*a*a*a*a*a*a;
+                double l5 = l*l*l*l*l;
+                ok = a12 - l5 < 5*tolerance*a12 && l5 - a12 < 5*tolerance*a12;
+            }
+        } else {
+            ok = l >= 0 && l <= v + tolerance && (v < 1 || l > 1 - tolerance);
+        }
+        if (!ok) {
+            throw_error(TPNG_ERROR__LINEAR_MISMATCH);
+        }
+    }
+
+    free(floats);
+    free(samples);
+    free(pngdata);
+}
+
+
+// Decodes the image to linear floats, straight and premultiplied, 
+// and checks each premultiplied color is the straight one times 
+// alpha, i.e. alpha is applied after the curve rather than before.
+static void linear_alpha_check(const char * filenamePNG, int half) {
+    printf("checking %s as premultiplied linear %s...\n", filenamePNG, half ? "halves" : "floats");
+
+    uint32_t  pngsize;
+    uint8_t * pngdata = dump_file_data(filenamePNG, &pngsize);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.format = half ? TPNG_FORMAT_FLOAT16 : TPNG_FORMAT_FLOAT32;
+    options.linear = 1;
+    uint32_t w, h, pw, ph, i;
+    void * straight = tpng_decode(pngdata, pngsize, &w, &h, &options);
+    options.premultiply = 1;
+    void * premultiplied = tpng_decode(pngdata, pngsize, &pw, &ph, &options);
+    if (!straight || !premultiplied || pw != w || ph != h) {
+        throw_error(TPNG_ERROR__LINEAR_ALPHA_MISMATCH);
+    }
+    for(i = 0; i < w*h*4; ++i) {
+        double s, a, p;
+        if (half) {
+            s = linear_half_value(((uint16_t*)straight)[i]);
+            a = linear_half_value(((uint16_t*)straight)[i - i%4 + 3]);
+            p = linear_half_value(((uint16_t*)premultiplied)[i]);
+        } else {
+            s = ((float*)straight)[i];
+            a = ((float*)straight)[i - i%4 + 3];
+            p = ((float*)premultiplied)[i];
+        }
+        double expected = i % 4 == 3 ? s : s*a;
+        double tolerance = half ? 2e-3 : 1e-6;
+        if (p - expected > tolerance || expected - p > tolerance) {
+            throw_error(TPNG_ERROR__LINEAR_ALPHA_MISMATCH);
+        }
+    }
+
+    free(premultiplied);
+    free(straight);
+    free(pngdata);
+}
+
+
+// Decodes the files into one NCHW tensor, resampled to 
+// the same size, and compares each slot with the 
+// same file decoded on its own.
+static void tensor_check(const char ** filenamesPNG, uint32_t count) {
+    printf("checking a tensor of %d files...\n", (int)count);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.resampleW = 12;
+    options.resampleH = 9;
+    options.resampleFilter = TPNG_RESAMPLE_AREA;
+    options.format = TPNG_FORMAT_FLOAT16;
+    options.planar = 1;
+    options.threads = 2;
+
+    uint32_t slotSize = 12*9*4*2;
+    uint8_t * tensor = malloc(slotSize*count);
+    tpng_batch_item_t * items = calloc(count, sizeof(tpng_batch_item_t));
+    uint32_t i;
+    for(i = 0; i < count; ++i) {
+        items[i].rawData = dump_file_data(filenamesPNG[i], &items[i].rawSize);
+    }
+    if (tpng_decode_tensor_batch(items, count, &options, tensor) != (int)count) {
+        throw_error(TPNG_ERROR__FLOAT_MISMATCH);
+    }
+    for(i = 0; i < count; ++i) {
+        uint32_t w, h;
+        uint8_t * alone = tpng_decode(items[i].rawData, items[i].rawSize, &w, &h, &options);
+        if (!alone || items[i].rgba || items[i].w != 12 || items[i].h != 9 ||
+            memcmp(alone, tensor + i*slotSize, slotSize)) {
+            throw_error(TPNG_ERROR__FLOAT_MISMATCH);
+        }
+        free(alone);
+        free((uint8_t*)items[i].rawData);
+    }
+    free(items);
+    free(tensor);
+}
+
+
+// Counts finished requests from the queue's callback.
+static void queue_check_callback(tpng_request_t * request, void * userData) {
+    if (!tpng_request_is_finished(request)) {
+        throw_error(TPNG_ERROR__QUEUE_MISMATCH);
+    }
+    (*(int*)userData)++;
+}
+
+// Decodes the files on a background queue at different
+// priorities, cancelling one and releasing another without 
+// waiting, and compares with the plain decode.
+static void queue_check(const char ** filenamesPNG, uint32_t count) {
+    printf("checking a decode queue with %d files...\n", (int)count);
+
+    tpng_options_t options;
+    memset(&options, 0, sizeof(tpng_options_t));
+    options.threads = 2;
+
+    tpng_queue_t * queue = tpng_queue_create(&options);
+    uint8_t ** data = calloc(count, sizeof(uint8_t*));
+    uint32_t * sizes = calloc(count, sizeof(uint32_t));
+    tpng_request_t ** requests = calloc(count, sizeof(tpng_request_t*));
+    int finished = 0;
+    uint32_t i;
+    for(i = 0; i < count; ++i) {
+        data[i] = dump_file_data(filenamesPNG[i], &sizes[i]);
+        requests[i] = tpng_queue_submit(queue, data[i], sizes[i], (int)i, queue_check_callback, &finished);
+    }
+    tpng_request_set_priority(requests[0], (int)count);
+    tpng_request_cancel(requests[1]);
+    tpng_request_release(requests[2]);
+
+    for(i = 0; i < count; ++i) {
+        if (i == 2) continue;
+        uint32_t w, h, qw, qh;
+        int status = tpng_request_wait(requests[i]);
+        uint8_t * pixels = tpng_get_rgba(data[i], sizes[i], &w, &h);
+        uint8_t * queued = tpng_request_take_rgba(requests[i], &qw, &qh);
+        if (i == 1 && status == TPNG_STATUS_CANCELLED && !queued) {
+            free(pixels);
+            continue;
+        }
+        if (status != TPNG_STATUS_OK || !queued ||
+            w != qw || h != qh ||
+            memcmp(pixels, queued, w*h*4)) {
+            throw_error(TPNG_ERROR__QUEUE_MISMATCH);
+        }
+        free(pixels);
+        free(queued);
+        tpng_request_release(requests[i]);
+    }
+    tpng_queue_destroy(queue);
+    if (finished != (int)count) {
+        throw_error(TPNG_ERROR__QUEUE_MISMATCH);
+    }
+
+    for(i = 0; i < count; ++i) {
+        free(data[i]);
+    }
+    free(data);
+    free(sizes);
+    free(requests);
+}
+
+
 static int verify_test(const char * filenamePNG) {
     char * filenameKey = malloc(strlen(filenamePNG) + 256);;
     sprintf(filenameKey, "rawdata/%s.c.data", filenamePNG);
@@ -318,6 +1982,140 @@ int main() {
     integrity_check("crashers/huge_tIME_chunk.png");
     integrity_check("crashers/huge_zTXt_chunk.png");
 
+    strict_check("crashers/badcrc.png", 0);
+    strict_check("rgb-8.png", 1);
+    strict_check("interlace-8-rgba.png", 1);
+
+    stored_check("stored-gray-filtern.png", "gray-filtern.png");
+    stored_check("stored-interlace-8-rgba.png", "interlace-8-rgba.png");
+
+    parallel_check("rgb-16.png");
+    parallel_check("palette-4-tRNS.png");
+    parallel_check("gray-filtern.png");
+    parallel_check("gray-filter1.png");
+    parallel_check("gray-filter4.png");
+    parallel_check("interlace-16-rgb.png");
+    parallel_check("interlace-2-palette.png");
+
+    step_check("rgb-16.png", 3, 0);
+    step_check("gray-filtern.png", 0, 100);
+    step_check("interlace-8-rgba.png", 2, 64);
+    step_check("interlace-medium.png", 0, 1000);
+    step_check("large-rgb-8.png", 0, 5000);
+    working_check("large-rgb-8.png", 131072);
+
+    index_check("rgb-16.png", 5);
+    index_check("gray-filtern.png", 4);
+    index_check("average-b.png", 64);
+    index_check("large-rgb-8.png", 50);
+    index_corrupt_check("rgb-16.png", 5);
+    index_corrupt_check("large-rgb-8.png", 50);
+
+    region_check("average-b.png");
+    region_check("gray-filtern.png");
+    region_check("interlace-medium.png");
+    region_check("interlace-1-palette.png");
+    region_check("interlace-2-grayscale.png");
+    region_check("interlace-16-rgba.png");
+
+    downscale_check("average-b.png", 8, 0);
+    downscale_check("gray-filtern.png", 2, 0);
+    downscale_check("interlace-medium.png", 4, 0);
+    downscale_check("interlace-8-rgba.png", 8, 1);
+    downscale_check("interlace-2-grayscale.png", 2, 5);
+    downscale_check("interlace-medium.png", 1, 3);
+
+    resample_check("average-b.png");
+    resample_check("interlace-8-rgba.png");
+
+    format_check("average-b.png");
+    format_check("rgb-16.png");
+    format_check("interlace-4-palette.png");
+    adler_check("crashers/badadler.png", 0);
+    adler_check("rgb-8.png", 1);
+    adler_check("large-rgb-8.png", 1);
+    adler_check("interlace-4-palette.png", 1);
+    excess_check("rgb-8.png");
+    excess_check("large-rgb-8.png");
+    format_check("interlace-16-rgba.png");
+    format_check("gray-alpha-16.png");
+
+    premultiply_check("rgb-alpha-8.png");
+    premultiply_check("gray-alpha-16.png");
+    premultiply_check("palette-4-tRNS.png");
+    premultiply_check("interlace-8-rgba.png");
+    premultiply_check("rgb-8-tRNS.png");
+    premultiply_wide_check("gray-alpha-16.png", TPNG_FORMAT_RGBA16);
+    premultiply_wide_check("rgb-alpha-16.png", TPNG_FORMAT_RGBA16);
+    premultiply_wide_check("rgb-alpha-16.png", TPNG_FORMAT_FLOAT32);
+    premultiply_wide_check("interlace-16-rgba.png", TPNG_FORMAT_FLOAT32);
+
+    packed_check("average-b.png", TPNG_DITHER_NONE);
+    packed_check("rgb-alpha-8.png", TPNG_DITHER_NONE);
+    packed_check("interlace-8-rgba.png", TPNG_DITHER_ORDERED);
+    packed_check("interlace-8-rgba.png", TPNG_DITHER_DIFFUSION);
+    packed_check("rgb-alpha-8.png", TPNG_DITHER_DIFFUSION);
+    packed_check("large-rgb-8.png", TPNG_DITHER_DIFFUSION);
+
+    native_check("palette-8-tRNS.png", 1);
+    native_check("interlace-8-palette.png", 16);
+    native_check("interlace-bw.png", 4);
+    native_check("interlace-8-grayscale.png", 8);
+
+    block_check("rgb-8.png", TPNG_FORMAT_BC1, 4);
+    block_check("interlace-medium.png", TPNG_FORMAT_BC1, 10);
+    block_check("rgb-alpha-8.png", TPNG_FORMAT_BC3, 10);
+
+    mip_check("average-b.png");
+    mip_check("interlace-medium.png");
+    mip_check("rgb-alpha-8.png");
+
+    layout_check("average-b.png", TPNG_LAYOUT_TILED, 4);
+    layout_check("interlace-medium.png", TPNG_LAYOUT_TILED, 8);
+    layout_check("rgb-alpha-8.png", TPNG_LAYOUT_MORTON, 16);
+
+    orientation_check("average-b.png", TPNG_ORIENT_FLIP_Y, 0);
+    orientation_check("interlace-medium.png", TPNG_ORIENT_ROTATE_90, 0);
+    orientation_check("rgb-alpha-8.png", TPNG_ORIENT_TRANSVERSE, 0);
+    orientation_check("rgb-alpha-8.png", 0, 8);
+    orientation_check("palette-4-tRNS.png", 0, 3);
+
+    linear_check("rgb-8-sRGB.png", 0);
+    linear_check("rgb-16-sRGB.png", 0);
+    linear_check("rgb-alpha-16-linear.png", 0);
+    linear_check("palette-4-1.8-tRNS.png", 0);
+    linear_check("interlace-16-rgba.png", 1);
+    linear_check("rgb-alpha-8.png", 1);
+    linear_alpha_check("rgb-alpha-8.png", 0);
+    linear_alpha_check("rgb-alpha-16-linear.png", 0);
+    linear_alpha_check("palette-4-1.8-tRNS.png", 0);
+    linear_alpha_check("gray-alpha-16.png", 1);
+    float_check("average-b.png", 0);
+    float_check("rgb-16.png", 1);
+    float_check("interlace-16-rgba.png", 0);
+
+    const char * tensorFiles[] = {
+        "average-b.png",
+        "interlace-medium.png",
+        "palette-4-tRNS.png"
+    };
+    tensor_check(tensorFiles, 3);
+
+    {
+        const char * batch[] = {
+            "rgb-16.png",
+            "palette-4-tRNS.png",
+            "interlace-8-rgba.png",
+            "gray-alpha-16.png",
+            "average-a.png"
+        };
+        batch_check(batch, 5);
+        scheduler_check(batch, 5);
+        queue_check(batch, 5);
+    }
+    inflate_check("large-rgb-8.png");
+    pipeline_check("large-rgb-8.png");
+
     verify_test("average-a.png");
     verify_test("average-b.png");
     verify_test("important.png");
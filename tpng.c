@@ -54,6 +54,19 @@ extern "C" {
 //  1 -> big endian
 #define TPNG_ENDIANNESS -1
 
+// Hardware CRC-32 for strict mode.
+//  0 -> always use the portable (slice-by-8) CRC-32.
+//  1 -> use PCLMULQDQ (x86, detected at runtime) or the 
+//       ARMv8 CRC32 instructions (if enabled for the compiler)
+//       when available.
+#define TPNG_HARDWARE_CRC 1
+
+// Threads for the parallel options.
+//  0 -> no threads. Parallel options run on the calling thread.
+//  1 -> use pthreads (Win32 threads on Windows). 
+//       Link with -pthread where needed.
+#define TPNG_THREADS 1
+
 ////////////////
 ////////////////
 
@@ -68,6 +81,19 @@ extern "C" {
 // Needed for tPNG
 #include <string.h>
 #include <stdlib.h>
+#if TPNG_THREADS
+    #ifdef _WIN32
+        // condition variables need Vista
+        #if !defined(_WIN32_WINNT) || (_WIN32_WINNT < 0x0600)
+            #undef  _WIN32_WINNT
+            #define _WIN32_WINNT 0x0600
+        #endif
+        #include <windows.h>
+    #else
+        #include <pthread.h>
+        #include <unistd.h>
+    #endif
+#endif
 //
 
 
@@ -150,8 +176,8 @@ typedef struct {
     // The custom data of the chunk, of length "length"
     const uint8_t * data;
 
-    // The CRC. Not used by this implementation.
-    int crc; 
+    // The CRC of the type and data. Only checked in strict mode.
+    uint32_t crc; 
 } tpng_chunk_t;
 
 
@@ -161,6 +187,150 @@ typedef struct {
 } tpng_header_t;
 
 
+// A run of bytes within the raw PNG file data.
+typedef struct {
+    // Start of the bytes.
+    const uint8_t * data;
+
+    // Number of bytes.
+    uint32_t length;
+} tpng_span_t;
+
+
+// Threads, locks and condition variables, for the parallel options.
+#if TPNG_THREADS
+    // What a new thread runs.
+    typedef struct {
+        void (*fn)(void *);
+        void * data;
+    } tpng_thread_call_t;
+
+    #ifdef _WIN32
+        typedef HANDLE             tpng_thread_t;
+        typedef CRITICAL_SECTION   tpng_mutex_t;
+        typedef CONDITION_VARIABLE tpng_cond_t;
+
+        static DWORD WINAPI tpng_thread_entry(LPVOID data) {
+            tpng_thread_call_t call = *(tpng_thread_call_t*)data;
+            TPNG_FREE(data);
+            call.fn(call.data);
+            return 0;
+        }
+        static int tpng_thread_create(tpng_thread_t * thread, tpng_thread_call_t * call) {
+            *thread = CreateThread(NULL, 0, tpng_thread_entry, call, 0, NULL);
+            return *thread != NULL;
+        }
+        static void tpng_thread_join(tpng_thread_t thread) {
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+        }
+
+        static void tpng_mutex_init(tpng_mutex_t * m)    {InitializeCriticalSection(m);}
+        static void tpng_mutex_destroy(tpng_mutex_t * m) {DeleteCriticalSection(m);}
+        static void tpng_mutex_lock(tpng_mutex_t * m)    {EnterCriticalSection(m);}
+        static void tpng_mutex_unlock(tpng_mutex_t * m)  {LeaveCriticalSection(m);}
+
+        static void tpng_cond_init(tpng_cond_t * c)                   {InitializeConditionVariable(c);}
+        static void tpng_cond_destroy(tpng_cond_t * c)                {}
+        static void tpng_cond_wait(tpng_cond_t * c, tpng_mutex_t * m) {SleepConditionVariableCS(c, m, INFINITE);}
+        static void tpng_cond_signal(tpng_cond_t * c)                 {WakeConditionVariable(c);}
+        static void tpng_cond_broadcast(tpng_cond_t * c)              {WakeAllConditionVariable(c);}
+    #else
+        typedef pthread_t       tpng_thread_t;
+        typedef pthread_mutex_t tpng_mutex_t;
+        typedef pthread_cond_t  tpng_cond_t;
+
+        static void * tpng_thread_entry(void * data) {
+            tpng_thread_call_t call = *(tpng_thread_call_t*)data;
+            TPNG_FREE(data);
+            call.fn(call.data);
+            return NULL;
+        }
+        static int tpng_thread_create(tpng_thread_t * thread, tpng_thread_call_t * call) {
+            return pthread_create(thread, NULL, tpng_thread_entry, call) == 0;
+        }
+        static void tpng_thread_join(tpng_thread_t thread) {
+            pthread_join(thread, NULL);
+        }
+
+        static void tpng_mutex_init(tpng_mutex_t * m)    {pthread_mutex_init(m, NULL);}
+        static void tpng_mutex_destroy(tpng_mutex_t * m) {pthread_mutex_destroy(m);}
+        static void tpng_mutex_lock(tpng_mutex_t * m)    {pthread_mutex_lock(m);}
+        static void tpng_mutex_unlock(tpng_mutex_t * m)  {pthread_mutex_unlock(m);}
+
+        static void tpng_cond_init(tpng_cond_t * c)                   {pthread_cond_init(c, NULL);}
+        static void tpng_cond_destroy(tpng_cond_t * c)                {pthread_cond_destroy(c);}
+        static void tpng_cond_wait(tpng_cond_t * c, tpng_mutex_t * m) {pthread_cond_wait(c, m);}
+        static void tpng_cond_signal(tpng_cond_t * c)                 {pthread_cond_signal(c);}
+        static void tpng_cond_broadcast(tpng_cond_t * c)              {pthread_cond_broadcast(c);}
+    #endif
+
+    // Starts a thread running fn(data). Returns 0 if the thread couldn't be made.
+    static int tpng_thread_start(tpng_thread_t * thread, void (*fn)(void *), void * data) {
+        tpng_thread_call_t * call = TPNG_MALLOC(sizeof(tpng_thread_call_t));
+        call->fn = fn;
+        call->data = data;
+        if (!tpng_thread_create(thread, call)) {
+            TPNG_FREE(call);
+            return 0;
+        }
+        return 1;
+    }
+#else
+    // Without threads, locks and waits do nothing: everything 
+    // happens on the one thread, in order.
+    typedef int tpng_mutex_t;
+    typedef int tpng_cond_t;
+    static void tpng_mutex_init(tpng_mutex_t * m)                 {}
+    static void tpng_mutex_destroy(tpng_mutex_t * m)              {}
+    static void tpng_mutex_lock(tpng_mutex_t * m)                 {}
+    static void tpng_mutex_unlock(tpng_mutex_t * m)               {}
+    static void tpng_cond_init(tpng_cond_t * c)                   {}
+    static void tpng_cond_destroy(tpng_cond_t * c)                {}
+    static void tpng_cond_wait(tpng_cond_t * c, tpng_mutex_t * m) {}
+    static void tpng_cond_broadcast(tpng_cond_t * c)              {}
+#endif
+
+
+// Lock-free access for values shared between threads. 
+// Loads acquire, stores release.
+#if defined(__GNUC__) || defined(__clang__)
+    #define TPNG_ATOMIC_LOAD(__ptr__)          __atomic_load_n(__ptr__, __ATOMIC_ACQUIRE)
+    #define TPNG_ATOMIC_STORE(__ptr__, __val__) __atomic_store_n(__ptr__, __val__, __ATOMIC_RELEASE)
+#else
+    // MSVC gives volatile accesses acquire / release semantics.
+    #define TPNG_ATOMIC_LOAD(__ptr__)          (*(volatile size_t *)(__ptr__))
+    #define TPNG_ATOMIC_STORE(__ptr__, __val__) (*(volatile size_t *)(__ptr__) = (__val__))
+#endif
+
+
+// Storage with a separate value per thread.
+#ifdef _MSC_VER
+    #define TPNG_THREAD_LOCAL __declspec(thread)
+#else
+    #define TPNG_THREAD_LOCAL __thread
+#endif
+
+
+
+// A work-stealing thread pool; the default tpng_scheduler_t.
+typedef struct tpng_pool_t tpng_pool_t;
+
+
+// Working memory that a batch reuses between images.
+typedef struct tpng_scratch_t tpng_scratch_t;
+struct tpng_scratch_t {
+    // Buffer for the inflated IDAT stream.
+    uint8_t * inflated;
+
+    // Allocated size of inflated.
+    size_t inflatedCapacity;
+
+    // The next unused scratch of the batch.
+    tpng_scratch_t * next;
+};
+
+
 // RGB palette color.
 typedef struct {
     // Red component. 0 - 255.
@@ -228,15 +398,126 @@ typedef struct {
 
 
 
-    // Appended IDAT data, raw and assembled.
-    uint8_t * idata;
+    // IDAT chunk data, in file order. These point into 
+    // the raw file data: IDAT is never copied.
+    tpng_span_t * idat;
+
+    // The number of IDAT chunks.
+    uint32_t nidat;
+
+    // The allocated number of spans in idat.
+    uint32_t idatCapacity;
+
+    // Whether to verify chunk CRCs.
+    int strict;
+
+    // Set when the file is found to be corrupt in strict mode.
+    // No further chunks are processed.
+    int corrupt;
+
+    // Number of threads that parallel work may use.
+    int threads;
+
+    // Where parallel work runs. If NULL, a pool of 
+    // threads is made when first needed.
+    const tpng_scheduler_t * scheduler;
+
+    // The pool made for this image, if any.
+    tpng_pool_t * pool;
+
+    // If not NULL, reusable working memory.
+    tpng_scratch_t * scratch;
+
+    // If not NULL, set nonzero (from any thread) to abandon the decode.
+    const size_t * cancel;
+
+    // Whether to inflate on multiple threads.
+    int parallelInflate;
+
+    // Whether to inflate on its own thread alongside the row loop.
+    int pipeline;
+
+    // Whether to expand rows to RGBA on multiple threads.
+    int parallelExpand;
+
+    // Fewest pixels an image needs for parallelExpand to be used.
+    uint32_t parallelExpandPixels;
+
+    // How much to shrink the image by while decoding: 1, 2, 4 or 8.
+    int downscale;
+
+    // If not 0, the number of adam7 passes to decode.
+    int previewPasses;
+
+    // If not 0, the size to resample the image to, and how.
+    uint32_t resampleW;
+    uint32_t resampleH;
+    int resampleFilter;
+
+    // The format to output, and for float formats, its layout 
+    // and what each channel is multiplied by and added to.
+    int format;
+    int planar;
+    int dropAlpha;
+    float scale[4];
+    float bias[4];
 
-    // The number of bytes in the raw data section.
-    uint32_t idataLength;
+    // If not NULL, where the output is written, instead 
+    // of a buffer made for it.
+    uint8_t * output;
+
+    // Whether color is multiplied by alpha when expanded.
+    int premultiply;
+
+    // How the 16-bit packed formats are dithered.
+    int dither;
+
+    // What rows of TPNG_FORMAT_NATIVE are padded to.
+    uint32_t rowAlignment;
+
+    // Bytes per pixel of rgba when the image is decoded in one 
+    // go: 4 for RGBA8, else the size in the format it's converted to.
+    int pixelBytes;
+
+    // Whether the output is the mip chain.
+    int mipmaps;
+
+    // Whether rgba is left for tpng_decoder_t to make once every 
+    // chunk is read, as it often needs less, or none at all.
+    int stepped;
+
+    // How pixels are laid out in the output, and in what tiles.
+    int layout;
+    uint32_t tileSize;
+
+    // How the output is flipped or rotated, and the EXIF 
+    // orientation from the eXIf chunk (1 to 8, or 0 if none).
+    int orientation;
+    int exifOrientation;
+
+    // Whether float formats are in linear light.
+    int linear;
+
+    // Whether float formats in linear light multiply color by 
+    // alpha once it's linear, in place of premultiply.
+    int premultiplyLinear;
+
+    // The color space chunks: the gamma from gAMA (0 if none), 
+    // the intent from sRGB (-1 if none), and the white point 
+    // and primaries from cHRM, if hasChromaticities.
+    float gamma;
+    int srgbIntent;
+    int hasChromaticities;
+    float chromaticities[8];
 } tpng_image_t;
 
 
 
+// Default fewest pixels for parallelExpand.
+#define TPNG_PARALLEL_EXPAND_PIXELS (1 << 18)
+
+
+
 // Populates a raw chunk from the given data iterator.
 static void tpng_read_chunk(tpng_image_t *, tpng_iter_t *, tpng_chunk_t * chunk); 
 
@@ -244,12 +525,55 @@ static void tpng_read_chunk(tpng_image_t *, tpng_iter_t *, tpng_chunk_t * chunk)
 static void tpng_process_chunk(tpng_image_t * image, tpng_chunk_t * chunk);
 
 // Initializes the image.
-static void tpng_image_init(tpng_image_t *, uint32_t rawLen);
+static void tpng_image_init(tpng_image_t *);
 
 // Cleans up any working data needed for computation from init
 // or chunk processing.
 static void tpng_image_cleanup(tpng_image_t *);
 
+// Returns whether the decode has been cancelled.
+static int tpng_image_is_cancelled(const tpng_image_t * image) {
+    return image->cancel && TPNG_ATOMIC_LOAD(image->cancel);
+}
+
+// Decodes the image a row at a time, as a tpng_decoder_t does.
+// Used when the full size image isn't wanted in the end.
+static uint8_t * tpng_decode_image_stepped(
+    tpng_image_t * image,
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    uint32_t * w,
+    uint32_t * h,
+    int * status
+);
+
+// Updates a running CRC-32 (as used by PNG chunks) with 
+// the given bytes. Start with 0.
+static uint32_t tpng_crc32(uint32_t crc, const uint8_t * data, uint32_t len);
+
+// Returns the number of processors available.
+static int tpng_get_processor_count();
+
+// Calls task() on each of the count tasks, which are stride bytes apart,
+// on the scheduler (the calling thread if NULL).
+// Returns once every task is finished.
+static void tpng_parallel_run(const tpng_scheduler_t * scheduler, void (*task)(void *), void * tasks, size_t stride, int count);
+
+// Returns the number of threads the scheduler runs tasks on.
+// 1 if NULL.
+static int tpng_scheduler_get_worker_count(const tpng_scheduler_t * scheduler);
+
+// Creates a pool of the given number of workers (including 
+// a thread that waits on it). Returns NULL if threads aren't 
+// available.
+static tpng_pool_t * tpng_pool_create(int workers);
+
+// Returns the pool as a scheduler.
+static const tpng_scheduler_t * tpng_pool_get_scheduler(tpng_pool_t * pool);
+
+// Stops the pool's threads and frees it.
+static void tpng_pool_destroy(tpng_pool_t * pool);
+
 
 
 
@@ -272,179 +596,938 @@ uint8_t * tpng_get_rgba(
 
     // Pointer to an editable uint32_t for image height.
     uint32_t * h
+) {
+    return tpng_decode(rawData, rawSize, w, h, NULL);
+}
+
+
+// Returns the bytes of a pixel in the format, if it's RGBA8 or 
+// converted to from RGBA a pixel at a time, so it can be written 
+// as the image is decoded in one go. Else returns 0.
+static int tpng_format_get_pixel_bytes(int format) {
+    switch(format) {
+      case TPNG_FORMAT_RGBA8:       return 4;
+      case TPNG_FORMAT_BGRA8:       return 4;
+      case TPNG_FORMAT_RGB8:        return 3;
+      case TPNG_FORMAT_ARGB8:       return 4;
+      case TPNG_FORMAT_GRAY8:       return 1;
+      case TPNG_FORMAT_GRAY_ALPHA8: return 2;
+      case TPNG_FORMAT_RGBA16:      return 8;
+      default:                      return 0;
+    }
+}
+
+
+// Applies the given options to a freshly initialized image.
+static void tpng_image_apply_options(tpng_image_t * image, const tpng_options_t * options) {
+    image->strict = options->strict;
+    image->threads = options->threads;
+    image->parallelInflate = options->parallelInflate;
+    image->pipeline = options->pipeline;
+    image->parallelExpand = options->parallelExpand;
+    if (options->parallelExpandPixels) {
+        image->parallelExpandPixels = options->parallelExpandPixels;
+    }
+    if (image->threads <= 0) {
+        image->threads = tpng_get_processor_count();
+    }
+    if (options->downscale == 2 || options->downscale == 4 || options->downscale == 8) {
+        image->downscale = options->downscale;
+    }
+    if (options->previewPasses > 0 && options->previewPasses < 7) {
+        image->previewPasses = options->previewPasses;
+    }
+    if (options->resampleW && options->resampleH) {
+        image->resampleW = options->resampleW;
+        image->resampleH = options->resampleH;
+        image->resampleFilter = options->resampleFilter;
+    }
+    image->premultiply = options->premultiply != 0;
+    if (options->format > TPNG_FORMAT_RGBA8 && options->format <= TPNG_FORMAT_BC3) {
+        image->format = options->format;
+    }
+    if (tpng_format_get_pixel_bytes(image->format)) {
+        image->pixelBytes = tpng_format_get_pixel_bytes(image->format);
+    }
+    if (options->dither > TPNG_DITHER_NONE && options->dither <= TPNG_DITHER_DIFFUSION) {
+        image->dither = options->dither;
+    }
+    if (options->rowAlignment) {
+        image->rowAlignment = options->rowAlignment;
+    }
+    image->mipmaps = options->mipmaps && image->format == TPNG_FORMAT_RGBA8;
+    if (options->layout > TPNG_LAYOUT_LINEAR && options->layout <= TPNG_LAYOUT_MORTON) {
+        image->layout = options->layout;
+    }
+    if (options->tileSize >= 4 && options->tileSize <= 256 && !(options->tileSize & (options->tileSize-1))) {
+        image->tileSize = options->tileSize;
+    }
+    if (options->orientation > TPNG_ORIENT_NONE && options->orientation <= TPNG_ORIENT_EXIF) {
+        image->orientation = options->orientation;
+    }
+    image->linear = options->linear != 0;
+    if (image->linear && image->premultiply && 
+        (image->format == TPNG_FORMAT_FLOAT32 || image->format == TPNG_FORMAT_FLOAT16)) {
+        // color is multiplied by alpha after the curve, not before
+        image->premultiply = 0;
+        image->premultiplyLinear = 1;
+    }
+    if (options->format == TPNG_FORMAT_FLOAT32 || options->format == TPNG_FORMAT_FLOAT16) {
+        int i;
+        int scaled = 0;
+        image->planar = options->planar;
+        image->dropAlpha = options->dropAlpha;
+        for(i = 0; i < 4; ++i) {
+            if (options->scale[i] != 0) scaled = 1;
+            image->bias[i] = options->bias[i];
+        }
+        for(i = 0; i < 4 && scaled; ++i) {
+            image->scale[i] = options->scale[i];
+        }
+    }
+    #if TPNG_THREADS
+        image->scheduler = options->scheduler;
+    #endif
+}
+
+
+// Returns where the image's parallel work runs, making 
+// a pool for it if needed. NULL if it all runs here.
+static const tpng_scheduler_t * tpng_image_get_scheduler(tpng_image_t * image) {
+    if (!image->scheduler && image->threads > 1 && !image->pool) {
+        image->pool = tpng_pool_create(image->threads);
+        if (image->pool)
+            image->scheduler = tpng_pool_get_scheduler(image->pool);
+    }
+    return image->scheduler;
+}
+
+
+// Reads the universal PNG header. Returns whether it's valid.
+static int tpng_read_header(tpng_iter_t * iter) {
+    TPNG_BEGIN(iter);
+    tpng_header_t header = TPNG_READ(tpng_header_t);
+    return 
+        header.bytes[0] == 137 &&
+        header.bytes[1] == 80 &&
+        header.bytes[2] == 78 &&
+        header.bytes[3] == 71 &&
+        
+        header.bytes[4] == 13 &&
+        header.bytes[5] == 10 &&
+        header.bytes[6] == 26 &&
+        header.bytes[7] == 10;
+}
+
+
+// Decodes the PNG file into the configured image.
+// Returns the rgba buffer, or NULL with status set
+// to why.
+static uint8_t * tpng_decode_image(
+    tpng_image_t * image,
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    uint32_t * w,
+    uint32_t * h,
+    int * status
 ) {
     *w = 0;
     *h = 0;
     
+    // shrunk images are decoded as their rows come out
+    if (image->downscale > 1 || image->previewPasses || image->resampleW || !tpng_format_get_pixel_bytes(image->format) || image->mipmaps || image->layout || image->orientation) {
+        return tpng_decode_image_stepped(image, rawData, rawSize, w, h, status);
+    }
 
     tpng_chunk_t chunk;
-    tpng_image_t image;
-    tpng_image_init(&image, rawSize);
-
-
     tpng_iter_t * iter = tpng_iter_create(rawData, rawSize);
-    TPNG_BEGIN(iter);
     
     // universal PNG header
-    {
-        tpng_header_t header = TPNG_READ(tpng_header_t);
-        if (header.bytes[0] != 137 ||
-            header.bytes[1] != 80 ||
-            header.bytes[2] != 78 ||
-            header.bytes[3] != 71 ||
-            
-            header.bytes[4] != 13 ||
-            header.bytes[5] != 10 ||
-            header.bytes[6] != 26 ||
-            header.bytes[7] != 10
-        ) {
-            // not a PNG!
-            tpng_image_cleanup(&image);
-            tpng_iter_destroy(iter);
-            return 0;
-        }    
+    if (!tpng_read_header(iter)) {
+        // not a PNG!
+        tpng_image_cleanup(image);
+        tpng_iter_destroy(iter);
+        *status = TPNG_STATUS_NOT_PNG;
+        return 0;
     }
 
     
     // next read chunks
-    tpng_read_chunk(&image, iter, &chunk); 
-    tpng_process_chunk(&image, &chunk);
+    tpng_read_chunk(image, iter, &chunk); 
+    if (!image->corrupt)
+        tpng_process_chunk(image, &chunk);
     
-    while(strcmp(chunk.type, "IEND")) {
-        tpng_read_chunk(&image, iter, &chunk); 
-        tpng_process_chunk(&image, &chunk);
+    while(strcmp(chunk.type, "IEND") && !image->corrupt && !tpng_image_is_cancelled(image)) {
+        tpng_read_chunk(image, iter, &chunk); 
+        if (!image->corrupt)
+            tpng_process_chunk(image, &chunk);
     }
       
     tpng_iter_destroy(iter);
 
+    // strict mode: a bad chunk invalidates the whole image.
+    if (image->corrupt) {
+        tpng_image_cleanup(image);
+        TPNG_FREE(image->rgba);
+        *status = TPNG_STATUS_CORRUPT;
+        return 0;
+    }
+
+    // a cancelled decode is incomplete.
+    if (tpng_image_is_cancelled(image)) {
+        tpng_image_cleanup(image);
+        TPNG_FREE(image->rgba);
+        *status = TPNG_STATUS_CANCELLED;
+        return 0;
+    }
       
     // return processed image
-    *w = image.w;
-    *h = image.h;
-    tpng_image_cleanup(&image);
-    return image.rgba;
+    *w = image->w;
+    *h = image->h;
+    *status = image->rgba ? TPNG_STATUS_OK : TPNG_STATUS_NO_IMAGE;
+    tpng_image_cleanup(image);
+    return image->rgba;
       
 }
 
 
+uint8_t * tpng_decode(
+    // raw byte data of the PNG file.
+    const uint8_t * rawData,
 
+    // Length of the raw data.
+    uint32_t        rawSize,
 
 
+    // Pointer to an editable uint32_t for image width.
+    uint32_t * w, 
 
+    // Pointer to an editable uint32_t for image height.
+    uint32_t * h,
 
+    // Options, or NULL for defaults.
+    const tpng_options_t * options
+) {
+    int status;
+    tpng_image_t image;
+    tpng_image_init(&image);
+    if (options) {
+        tpng_image_apply_options(&image, options);
+    }
+    return tpng_decode_image(&image, rawData, rawSize, w, h, &status);
+}
 
 
 
+// Shared state of a tpng_decode_batch() call.
+typedef struct {
+    const tpng_options_t * options;
+    const tpng_scheduler_t * scheduler;
 
+    // Scratch no image is using right now.
+    tpng_scratch_t * unusedScratch;
+    tpng_mutex_t lock;
 
+    // If not NULL, where each item's output goes, 
+    // slotSize bytes apart, in the order of items.
+    uint8_t * tensor;
+    size_t slotSize;
+    tpng_batch_item_t * items;
+} tpng_batch_t;
 
-static int32_t tpng_read_integer(tpng_image_t * img, tpng_iter_t * iter) {
-    const uint8_t * src = tpng_iter_advance(iter, sizeof(int32_t));
-    if (!src) return 0;
-    int i;
-    char * data = (char*)&i;
-    if (img->littleEndian) {
-        data[0] = src[3];
-        data[1] = src[2];
-        data[2] = src[1];
-        data[3] = src[0];                
-    } else {
-        data[0] = src[0];
-        data[1] = src[1];
-        data[2] = src[2];
-        data[3] = src[3];                
-    }
-    return i;
+// One image of a batch, as a task.
+typedef struct {
+    tpng_batch_item_t * item;
+    tpng_batch_t * batch;
+
+    // Width * height from IHDR, used to start large images first.
+    uint64_t pixels;
+} tpng_batch_job_t;
+
+static int tpng_batch_job_compare(const void * a, const void * b) {
+    uint64_t pa = ((const tpng_batch_job_t *)a)->pixels;
+    uint64_t pb = ((const tpng_batch_job_t *)b)->pixels;
+    return pa < pb ? 1 : (pa > pb ? -1 : 0);
 }
 
-static uint32_t tpng_read_uinteger(tpng_image_t * img, tpng_iter_t * iter) {
-    const uint8_t * src = tpng_iter_advance(iter, sizeof(int32_t));
-    if (!src) return 0;
-    uint32_t i;
-    char * data = (char*)&i;
-    if (img->littleEndian) {
-        data[0] = src[3];
-        data[1] = src[2];
-        data[2] = src[1];
-        data[3] = src[0];                
+static void tpng_batch_job_run(void * data) {
+    tpng_batch_job_t * job = data;
+    tpng_batch_t * batch = job->batch;
+    tpng_batch_item_t * item = job->item;
+    tpng_image_t image;
+    tpng_image_init(&image);
+    if (batch->options) {
+        tpng_image_apply_options(&image, batch->options);
+    }
+
+    // every image shares the batch's scheduler; 
+    // big ones are split into bands
+    image.scheduler = batch->scheduler;
+    image.threads = 1;
+    image.parallelExpand = 1;
+
+    // there are never more scratches than images at once
+    tpng_mutex_lock(&batch->lock);
+    image.scratch = batch->unusedScratch;
+    if (image.scratch) 
+        batch->unusedScratch = image.scratch->next;
+    tpng_mutex_unlock(&batch->lock);
+    if (!image.scratch) 
+        image.scratch = TPNG_CALLOC(1, sizeof(tpng_scratch_t));
+    tpng_scratch_t * scratch = image.scratch;
+
+    if (batch->tensor) {
+        image.output = batch->tensor + (item - batch->items)*batch->slotSize;
+        tpng_decode_image(&image, item->rawData, item->rawSize, &item->w, &item->h, &item->status);
     } else {
-        data[0] = src[0];
-        data[1] = src[1];
-        data[2] = src[2];
-        data[3] = src[3];                
+        item->rgba = tpng_decode_image(&image, item->rawData, item->rawSize, &item->w, &item->h, &item->status);
     }
-    return i;
+
+    tpng_mutex_lock(&batch->lock);
+    scratch->next = batch->unusedScratch;
+    batch->unusedScratch = scratch;
+    tpng_mutex_unlock(&batch->lock);
 }
 
 
+// Decodes a batch, into the tensor if it isn't NULL.
+static int tpng_decode_batch_into(
+    tpng_batch_item_t * items,
+    uint32_t count,
+    const tpng_options_t * options,
+    uint8_t * tensor,
+    size_t slotSize
+) {
+    uint32_t i;
+    int decoded = 0;
+    int threads = options ? options->threads : 0;
+    if (threads <= 0) threads = tpng_get_processor_count();
+    if (threads > count) threads = count;
+    if (!count) return 0;
+
+    tpng_batch_t batch;
+    tpng_pool_t * pool = NULL;
+    batch.options = options;
+    batch.scheduler = NULL;
+    batch.unusedScratch = NULL;
+    batch.tensor = tensor;
+    batch.slotSize = slotSize;
+    batch.items = items;
+    tpng_mutex_init(&batch.lock);
+    #if TPNG_THREADS
+        if (options && options->scheduler) {
+            batch.scheduler = options->scheduler;
+        } else {
+            pool = tpng_pool_create(threads);
+            if (pool) 
+                batch.scheduler = tpng_pool_get_scheduler(pool);
+        }
+    #endif
 
-static void tpng_read_chunk(tpng_image_t * image, tpng_iter_t * iter, tpng_chunk_t * chunk) {
-    TPNG_BEGIN(iter);
-    memset(chunk, 0, sizeof(tpng_chunk_t));
-    chunk->length = tpng_read_uinteger(image, iter);
-    chunk->type[0] = TPNG_READ(char);
-    chunk->type[1] = TPNG_READ(char);
-    chunk->type[2] = TPNG_READ(char);
-    chunk->type[3] = TPNG_READ(char);
-    chunk->type[4] = 0;
-    chunk->data = TPNG_READ_N(chunk->length);
-    // chunkLength was lying! could not read as much as it said...
-    if (!chunk->data) {
-        chunk->length = 0;
+    // size the images by their header, so the largest start first
+    tpng_batch_job_t * jobs = TPNG_CALLOC(count, sizeof(tpng_batch_job_t));
+    for(i = 0; i < count; ++i) {
+        const uint8_t * raw = items[i].rawData;
+        jobs[i].item = items+i;
+        jobs[i].batch = &batch;
+        if (raw && items[i].rawSize >= 24 && !memcmp(raw+12, "IHDR", 4)) {
+            uint64_t w = ((uint32_t)raw[16] << 24) | (raw[17] << 16) | (raw[18] << 8) | raw[19];
+            uint64_t h = ((uint32_t)raw[20] << 24) | (raw[21] << 16) | (raw[22] << 8) | raw[23];
+            jobs[i].pixels = w*h;
+        }
+        items[i].rgba = NULL;
+        items[i].w = 0;
+        items[i].h = 0;
+        items[i].status = TPNG_STATUS_NOT_PNG;
     }
-    chunk->crc  = tpng_read_integer(image, iter); // crc 
-    
-    if (chunk->type[0] == 0 &&
-        chunk->type[1] == 0 &&
-        chunk->type[2] == 0 &&
-        chunk->type[3] == 0) {
-        // corruption or early EOF.
-        // mark with auto-end chunk
-        chunk->type[0] = 'I';   
-        chunk->type[1] = 'E';   
-        chunk->type[2] = 'N';   
-        chunk->type[3] = 'D';   
+    qsort(jobs, count, sizeof(tpng_batch_job_t), tpng_batch_job_compare);
+
+    tpng_parallel_run(batch.scheduler, tpng_batch_job_run, jobs, sizeof(tpng_batch_job_t), count);
+
+    if (pool) 
+        tpng_pool_destroy(pool);
+    tpng_mutex_destroy(&batch.lock);
+    while(batch.unusedScratch) {
+        tpng_scratch_t * next = batch.unusedScratch->next;
+        TPNG_FREE(batch.unusedScratch->inflated);
+        TPNG_FREE(batch.unusedScratch);
+        batch.unusedScratch = next;
     }
-}
 
-static void tpng_image_init(tpng_image_t * image, uint32_t rawlen) {
-    image->idataLength = 0;
-    image->idata = TPNG_MALLOC(rawlen); // idata is NEVER longer than the raw files size.
-    image->rgba = 0;
-    image->colorType = -1;
-    image->colorDepth = 0;
-    image->transparentGray = -1;
-    image->transparentRed = -1;
-    int i;
-    for(i = 0; i < TPNG_PALETTE_LIMIT; ++i) {
-        image->palette[i].a = 255;
+    for(i = 0; i < count; ++i) {
+        if (items[i].status == TPNG_STATUS_OK) {
+            decoded++;
+        } else if (tensor) {
+            memset(tensor + i*slotSize, 0, slotSize);
+        }
     }
-    #if (TPNG_ENDIANNESS == -1)
-        image->littleEndian = 1;
-        image->littleEndian = *((char*)(&image->littleEndian));
-    #elif (TPNG_ENDIANNESS == 0)
-        image->littleEndian = 1;
-    #else
-        image->littleEndian = 0;
-    #endif
+    TPNG_FREE(jobs);
+    return decoded;
 }
 
 
-static void tpng_expand_row(tpng_image_t * image, const uint8_t * row, uint8_t * expanded, int rowPixelWidth) {
-    uint32_t i;
-    uint32_t bitCount = image->colorDepth*rowPixelWidth;
-    int iter;
-    int palette;
-    int rawVal, rawG, rawB;
-    switch(image->colorType) {
-      // grayscale!
-      case 0:
-        switch(image->colorDepth) {
-          case 1:
-            for(i = 0; i < bitCount; ++i, expanded+=4) {
-                // raw val is: the i'thbit, starting from MSB
-                rawVal = ((row[i/8] >> (7 - i%8)) & 1);
-                *expanded   = rawVal * 255; 
+int tpng_decode_batch(
+    tpng_batch_item_t * items,
+    uint32_t count,
+    const tpng_options_t * options
+) {
+    return tpng_decode_batch_into(items, count, options, NULL, 0);
+}
+
+
+int tpng_decode_tensor_batch(
+    tpng_batch_item_t * items,
+    uint32_t count,
+    const tpng_options_t * options,
+    void * tensor
+) {
+    size_t slotSize;
+    if (!options || !tensor || !options->resampleW || !options->resampleH || options->layout ||
+        (options->format != TPNG_FORMAT_FLOAT32 && options->format != TPNG_FORMAT_FLOAT16))
+        return 0;
+    slotSize = (size_t)options->resampleW*options->resampleH*
+        (options->dropAlpha ? 3 : 4)*
+        (options->format == TPNG_FORMAT_FLOAT32 ? 4 : 2);
+    return tpng_decode_batch_into(items, count, options, tensor, slotSize);
+}
+
+
+
+
+struct tpng_queue_t {
+    // The options every request is decoded with.
+    tpng_options_t options;
+
+    // Where requests are decoded. NULL if they're 
+    // decoded as they're submitted.
+    const tpng_scheduler_t * scheduler;
+
+    // If not NULL, the pool made for the queue.
+    tpng_pool_t * pool;
+
+    // The scheduler group of every request's task.
+    void * group;
+
+    // Guards everything below and every request's state.
+    tpng_mutex_t lock;
+
+    // Broadcast whenever a request finishes.
+    tpng_cond_t finished;
+
+    // Requests that haven't started, in no particular order.
+    tpng_request_t ** pending;
+    uint32_t npending;
+    uint32_t pendingCapacity;
+
+    // Every request not yet freed.
+    tpng_request_t * requests;
+
+    // Given to the next request, to keep equal priorities in order.
+    uint64_t nextSequence;
+};
+
+struct tpng_request_t {
+    // The queue the request was submitted to.
+    tpng_queue_t * queue;
+
+    // The PNG file to decode.
+    const uint8_t * rawData;
+    uint32_t rawSize;
+
+    // Higher priorities start first, then lower sequences.
+    int priority;
+    uint64_t sequence;
+
+    // Called once finished, if not NULL.
+    tpng_request_callback_t callback;
+    void * userData;
+
+    // Set nonzero to stop the decode. Read by the decoding thread.
+    size_t cancelled;
+
+    // Set nonzero once the result below is ready.
+    size_t finished;
+
+    // Whether the owner let go of the request, 
+    // and whether its callback is running.
+    int released;
+    int inCallback;
+
+    // The result.
+    uint8_t * rgba;
+    uint32_t w;
+    uint32_t h;
+    int status;
+
+    // Links of the queue's requests list.
+    tpng_request_t * prev;
+    tpng_request_t * next;
+};
+
+
+// Unlinks and frees a request. Needs the queue lock.
+static void tpng_request_free(tpng_request_t * request) {
+    tpng_queue_t * queue = request->queue;
+    if (request->prev) 
+        request->prev->next = request->next;
+    else 
+        queue->requests = request->next;
+    if (request->next) 
+        request->next->prev = request->prev;
+    TPNG_FREE(request->rgba);
+    TPNG_FREE(request);
+}
+
+
+// A scheduler task: decodes the most urgent pending request.
+// Cancelled requests go first, since they finish right away.
+static void tpng_queue_task(void * data) {
+    tpng_queue_t * queue = data;
+    tpng_request_t * request;
+    uint32_t i, best = 0;
+
+    tpng_mutex_lock(&queue->lock);
+    for(i = 1; i < queue->npending; ++i) {
+        tpng_request_t * a = queue->pending[i];
+        tpng_request_t * b = queue->pending[best];
+        int ca = TPNG_ATOMIC_LOAD(&a->cancelled) != 0;
+        int cb = TPNG_ATOMIC_LOAD(&b->cancelled) != 0;
+        if (ca != cb ? ca : 
+            (a->priority != b->priority ? a->priority > b->priority : a->sequence < b->sequence))
+            best = i;
+    }
+    request = queue->pending[best];
+    queue->pending[best] = queue->pending[--queue->npending];
+    tpng_mutex_unlock(&queue->lock);
+
+    
+    if (TPNG_ATOMIC_LOAD(&request->cancelled)) {
+        request->status = TPNG_STATUS_CANCELLED;
+    } else {
+        tpng_image_t image;
+        tpng_image_init(&image);
+        tpng_image_apply_options(&image, &queue->options);
+
+        // the request's own parallel work shares the queue's scheduler
+        image.scheduler = queue->scheduler;
+        image.threads = 1;
+        image.cancel = &request->cancelled;
+        request->rgba = tpng_decode_image(&image, request->rawData, request->rawSize, &request->w, &request->h, &request->status);
+    }
+
+
+    tpng_mutex_lock(&queue->lock);
+    TPNG_ATOMIC_STORE(&request->finished, 1);
+    tpng_cond_broadcast(&queue->finished);
+    if (!request->callback) {
+        if (request->released) 
+            tpng_request_free(request);
+        tpng_mutex_unlock(&queue->lock);
+        return;
+    }
+    request->inCallback = 1;
+    tpng_mutex_unlock(&queue->lock);
+
+    // the callback may release the request, which is then freed here
+    request->callback(request, request->userData);
+    tpng_mutex_lock(&queue->lock);
+    request->inCallback = 0;
+    if (request->released) 
+        tpng_request_free(request);
+    tpng_mutex_unlock(&queue->lock);
+}
+
+
+tpng_queue_t * tpng_queue_create(const tpng_options_t * options) {
+    tpng_queue_t * queue = TPNG_CALLOC(1, sizeof(tpng_queue_t));
+    if (!queue) return NULL;
+    if (options) 
+        queue->options = *options;
+
+    tpng_mutex_init(&queue->lock);
+    tpng_cond_init(&queue->finished);
+    #if TPNG_THREADS
+        if (options && options->scheduler) {
+            queue->scheduler = options->scheduler;
+        } else {
+            int threads = queue->options.threads;
+            if (threads <= 0) threads = tpng_get_processor_count();
+
+            // the pool's first worker is whoever waits on it, 
+            // which here is only tpng_queue_destroy()
+            queue->pool = tpng_pool_create(threads+1);
+            if (queue->pool) 
+                queue->scheduler = tpng_pool_get_scheduler(queue->pool);
+        }
+        if (queue->scheduler) 
+            queue->group = queue->scheduler->createGroup(queue->scheduler->userData);
+    #endif
+    return queue;
+}
+
+
+void tpng_queue_destroy(tpng_queue_t * queue) {
+    tpng_request_t * request;
+    if (!queue) return;
+
+    tpng_mutex_lock(&queue->lock);
+    for(request = queue->requests; request; request = request->next) {
+        TPNG_ATOMIC_STORE(&request->cancelled, 1);
+    }
+    tpng_mutex_unlock(&queue->lock);
+
+    if (queue->scheduler) 
+        queue->scheduler->wait(queue->scheduler->userData, queue->group);
+    if (queue->pool) 
+        tpng_pool_destroy(queue->pool);
+
+    while(queue->requests) {
+        tpng_request_free(queue->requests);
+    }
+    tpng_cond_destroy(&queue->finished);
+    tpng_mutex_destroy(&queue->lock);
+    TPNG_FREE(queue->pending);
+    TPNG_FREE(queue);
+}
+
+
+tpng_request_t * tpng_queue_submit(
+    tpng_queue_t * queue,
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    int priority,
+    tpng_request_callback_t callback,
+    void * userData
+) {
+    tpng_request_t * request = TPNG_CALLOC(1, sizeof(tpng_request_t));
+    if (!request) return NULL;
+    request->queue = queue;
+    request->rawData = rawData;
+    request->rawSize = rawSize;
+    request->priority = priority;
+    request->callback = callback;
+    request->userData = userData;
+    request->status = TPNG_STATUS_NOT_PNG;
+
+    tpng_mutex_lock(&queue->lock);
+    if (queue->npending == queue->pendingCapacity) {
+        uint32_t capacity = queue->pendingCapacity ? queue->pendingCapacity*2 : 16;
+        tpng_request_t ** pending = TPNG_MALLOC(capacity * sizeof(tpng_request_t *));
+        if (!pending) {
+            tpng_mutex_unlock(&queue->lock);
+            TPNG_FREE(request);
+            return NULL;
+        }
+        if (queue->npending)
+            memcpy(pending, queue->pending, queue->npending * sizeof(tpng_request_t *));
+        TPNG_FREE(queue->pending);
+        queue->pending = pending;
+        queue->pendingCapacity = capacity;
+    }
+    request->sequence = queue->nextSequence++;
+    queue->pending[queue->npending++] = request;
+    request->next = queue->requests;
+    if (queue->requests) 
+        queue->requests->prev = request;
+    queue->requests = request;
+    tpng_mutex_unlock(&queue->lock);
+
+    // each task takes whichever request is most urgent once it runs
+    if (queue->scheduler) 
+        queue->scheduler->submit(queue->scheduler->userData, queue->group, tpng_queue_task, queue);
+    else 
+        tpng_queue_task(queue);
+    return request;
+}
+
+
+void tpng_request_set_priority(tpng_request_t * request, int priority) {
+    tpng_mutex_lock(&request->queue->lock);
+    request->priority = priority;
+    tpng_mutex_unlock(&request->queue->lock);
+}
+
+
+void tpng_request_cancel(tpng_request_t * request) {
+    TPNG_ATOMIC_STORE(&request->cancelled, 1);
+}
+
+
+int tpng_request_is_finished(const tpng_request_t * request) {
+    return TPNG_ATOMIC_LOAD(&request->finished) != 0;
+}
+
+
+int tpng_request_wait(tpng_request_t * request) {
+    tpng_queue_t * queue = request->queue;
+    tpng_mutex_lock(&queue->lock);
+    while(!request->finished) {
+        tpng_cond_wait(&queue->finished, &queue->lock);
+    }
+    tpng_mutex_unlock(&queue->lock);
+    return request->status;
+}
+
+
+uint8_t * tpng_request_take_rgba(tpng_request_t * request, uint32_t * w, uint32_t * h) {
+    uint8_t * rgba;
+    *w = 0;
+    *h = 0;
+    if (!tpng_request_is_finished(request)) 
+        return NULL;
+    tpng_mutex_lock(&request->queue->lock);
+    rgba = request->rgba;
+    request->rgba = NULL;
+    if (rgba) {
+        *w = request->w;
+        *h = request->h;
+    }
+    tpng_mutex_unlock(&request->queue->lock);
+    return rgba;
+}
+
+
+void tpng_request_release(tpng_request_t * request) {
+    tpng_queue_t * queue = request->queue;
+    tpng_mutex_lock(&queue->lock);
+    TPNG_ATOMIC_STORE(&request->cancelled, 1);
+    if (request->finished && !request->inCallback) 
+        tpng_request_free(request);
+    else 
+        request->released = 1;
+    tpng_mutex_unlock(&queue->lock);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+static int32_t tpng_read_integer(tpng_image_t * img, tpng_iter_t * iter) {
+    const uint8_t * src = tpng_iter_advance(iter, sizeof(int32_t));
+    if (!src) return 0;
+    int i;
+    char * data = (char*)&i;
+    if (img->littleEndian) {
+        data[0] = src[3];
+        data[1] = src[2];
+        data[2] = src[1];
+        data[3] = src[0];                
+    } else {
+        data[0] = src[0];
+        data[1] = src[1];
+        data[2] = src[2];
+        data[3] = src[3];                
+    }
+    return i;
+}
+
+static uint32_t tpng_read_uinteger(tpng_image_t * img, tpng_iter_t * iter) {
+    const uint8_t * src = tpng_iter_advance(iter, sizeof(int32_t));
+    if (!src) return 0;
+    uint32_t i;
+    char * data = (char*)&i;
+    if (img->littleEndian) {
+        data[0] = src[3];
+        data[1] = src[2];
+        data[2] = src[1];
+        data[3] = src[0];                
+    } else {
+        data[0] = src[0];
+        data[1] = src[1];
+        data[2] = src[2];
+        data[3] = src[3];                
+    }
+    return i;
+}
+
+
+
+static void tpng_read_chunk(tpng_image_t * image, tpng_iter_t * iter, tpng_chunk_t * chunk) {
+    TPNG_BEGIN(iter);
+    memset(chunk, 0, sizeof(tpng_chunk_t));
+    chunk->length = tpng_read_uinteger(image, iter);
+    chunk->type[0] = TPNG_READ(char);
+    chunk->type[1] = TPNG_READ(char);
+    chunk->type[2] = TPNG_READ(char);
+    chunk->type[3] = TPNG_READ(char);
+    chunk->type[4] = 0;
+    chunk->data = TPNG_READ_N(chunk->length);
+    // chunkLength was lying! could not read as much as it said...
+    if (!chunk->data) {
+        chunk->length = 0;
+    }
+    chunk->crc  = tpng_read_uinteger(image, iter); // crc 
+
+    if (image->strict) {
+        uint32_t crc = tpng_crc32(0, (const uint8_t*)chunk->type, 4);
+        crc = tpng_crc32(crc, chunk->data, chunk->length);
+        if (crc != chunk->crc) {
+            image->corrupt = 1;
+        }
+    }
+    
+    if (chunk->type[0] == 0 &&
+        chunk->type[1] == 0 &&
+        chunk->type[2] == 0 &&
+        chunk->type[3] == 0) {
+        // corruption or early EOF.
+        // mark with auto-end chunk
+        chunk->type[0] = 'I';   
+        chunk->type[1] = 'E';   
+        chunk->type[2] = 'N';   
+        chunk->type[3] = 'D';   
+    }
+}
+
+static void tpng_image_init(tpng_image_t * image) {
+    image->idat = NULL;
+    image->nidat = 0;
+    image->idatCapacity = 0;
+    image->rgba = 0;
+    image->colorType = -1;
+    image->colorDepth = 0;
+    image->transparentGray = -1;
+    image->transparentRed = -1;
+    image->strict = 0;
+    image->corrupt = 0;
+    image->threads = 1;
+    image->scheduler = NULL;
+    image->pool = NULL;
+    image->scratch = NULL;
+    image->cancel = NULL;
+    image->parallelInflate = 0;
+    image->pipeline = 0;
+    image->parallelExpand = 0;
+    image->parallelExpandPixels = TPNG_PARALLEL_EXPAND_PIXELS;
+    image->downscale = 1;
+    image->previewPasses = 0;
+    image->resampleW = 0;
+    image->resampleH = 0;
+    image->resampleFilter = TPNG_RESAMPLE_BILINEAR;
+    image->format = TPNG_FORMAT_RGBA8;
+    image->planar = 0;
+    image->dropAlpha = 0;
+    image->output = NULL;
+    image->premultiply = 0;
+    image->dither = TPNG_DITHER_NONE;
+    image->rowAlignment = 1;
+    image->pixelBytes = 4;
+    image->stepped = 0;
+    image->mipmaps = 0;
+    image->layout = TPNG_LAYOUT_LINEAR;
+    image->tileSize = 8;
+    image->orientation = TPNG_ORIENT_NONE;
+    image->exifOrientation = 0;
+    image->linear = 0;
+    image->premultiplyLinear = 0;
+    image->gamma = 0;
+    image->srgbIntent = -1;
+    image->hasChromaticities = 0;
+    int i;
+    for(i = 0; i < 4; ++i) {
+        image->scale[i] = 1;
+        image->bias[i] = 0;
+    }
+    for(i = 0; i < TPNG_PALETTE_LIMIT; ++i) {
+        image->palette[i].a = 255;
+    }
+    #if (TPNG_ENDIANNESS == -1)
+        image->littleEndian = 1;
+        image->littleEndian = *((char*)(&image->littleEndian));
+    #elif (TPNG_ENDIANNESS == 0)
+        image->littleEndian = 1;
+    #else
+        image->littleEndian = 0;
+    #endif
+}
+
+
+// Multiplies a channel by alpha, both out of 255, 
+// rounding to the nearest value.
+static uint8_t tpng_premultiply(int channel, int alpha) {
+    uint32_t t = channel*alpha + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+
+// Same as tpng_premultiply(), but out of 65535.
+static uint16_t tpng_premultiply_wide(uint32_t channel, uint32_t alpha) {
+    uint32_t t = channel*alpha + 32768;
+    return (t + (t >> 16)) >> 16;
+}
+
+
+// Multiplies the palette by alpha once, so that palette 
+// images don't need to do so per pixel.
+static void tpng_image_premultiply_palette(tpng_image_t * image) {
+    uint32_t i;
+    if (!image->premultiply || image->colorType != 3) return;
+    for(i = 0; i < TPNG_PALETTE_LIMIT; ++i) {
+        image->palette[i].r = tpng_premultiply(image->palette[i].r, image->palette[i].a);
+        image->palette[i].g = tpng_premultiply(image->palette[i].g, image->palette[i].a);
+        image->palette[i].b = tpng_premultiply(image->palette[i].b, image->palette[i].a);
+    }
+}
+
+
+// Multiplies an expanded row's color by its alpha.
+static void tpng_premultiply_row(tpng_image_t * image, uint8_t * expanded, int rowPixelWidth) {
+    int i;
+    switch(image->colorType) {
+      // alpha is only ever 0 or 255, so only 
+      // transparent pixels change
+      case 0:
+      case 2:
+        if (image->transparentGray == -1 && image->transparentRed == -1) break;
+        for(i = 0; i < rowPixelWidth; ++i, expanded+=4) {
+            if (!expanded[3]) {
+                expanded[0] = 0;
+                expanded[1] = 0;
+                expanded[2] = 0;
+            }
+        }
+        break;
+
+      case 4:
+      case 6:
+        for(i = 0; i < rowPixelWidth; ++i, expanded+=4) {
+            if (expanded[3] == 255) continue;
+            expanded[0] = tpng_premultiply(expanded[0], expanded[3]);
+            expanded[1] = tpng_premultiply(expanded[1], expanded[3]);
+            expanded[2] = tpng_premultiply(expanded[2], expanded[3]);
+        }
+        break;
+
+      // palettes are multiplied ahead of time
+      default:;
+    }
+}
+
+
+static void tpng_expand_row(tpng_image_t * image, const uint8_t * row, uint8_t * expanded, int rowPixelWidth) {
+    uint8_t * start = expanded;
+    uint32_t i;
+    uint32_t bitCount = image->colorDepth*rowPixelWidth;
+    int iter;
+    int palette;
+    int rawVal, rawG, rawB;
+    switch(image->colorType) {
+      // grayscale!
+      case 0:
+        switch(image->colorDepth) {
+          case 1:
+            for(i = 0; i < bitCount; ++i, expanded+=4) {
+                // raw val is: the i'thbit, starting from MSB
+                rawVal = ((row[i/8] >> (7 - i%8)) & 1);
+                *expanded   = rawVal * 255; 
                 expanded[1] = *expanded;
                 expanded[2] = *expanded;
                 expanded[3] = 255;
@@ -493,7 +1576,7 @@ static void tpng_expand_row(tpng_image_t * image, const uint8_t * row, uint8_t *
             break;
           case 16:
             for(i = 0; i < bitCount; i+=16, expanded+=4) {
-                rawVal = (0xff*row[i/8]+row[i/8+1]);
+                rawVal = (row[i/8] << 8) + row[i/8+1];
                 *expanded = row[i/8]; 
                 expanded[1] = *expanded;
                 expanded[2] = *expanded;
@@ -532,9 +1615,9 @@ static void tpng_expand_row(tpng_image_t * image, const uint8_t * row, uint8_t *
             break;
           case 16:
             for(i = 0; i < rowPixelWidth; ++i, iter+=4) {
-                rawVal = row[i*6]  *0xff + row[i*6+1];
-                rawG =   row[i*6+2]*0xff + row[i*6+3];
-                rawB =   row[i*6+4]*0xff + row[i*6+5];
+                rawVal = (row[i*6] << 8) + row[i*6+1];
+                rawG =   (row[i*6+2] << 8) + row[i*6+3];
+                rawB =   (row[i*6+4] << 8) + row[i*6+5];
 
                 expanded[iter]   = row[i*6]; 
                 expanded[iter+1] = row[i*6+2]; 
@@ -648,24 +1731,169 @@ static void tpng_expand_row(tpng_image_t * image, const uint8_t * row, uint8_t *
 
       default:;
     }
+    if (image->premultiply) {
+        tpng_premultiply_row(image, start, rowPixelWidth);
+    }
 }
 
 
-static int tpng_paeth_predictor(int a, int b, int c) {
-    int p = a + b - c;// checked, no overflow
-    int pa = abs(p-a);// checked, no overflow
-    int pb = abs(p-b);// checked, no overflow
-    int pc = abs(p-c);// checked, no overflow
-
-    if      (pa <= pb && pa <= pc) return a;
-    else if (pb <= pc)             return b;
-    else                           return c;
-}
-
+// Same as tpng_expand_row(), but for 16-bit images, 
+// keeping all 16 bits of each channel.
+static void tpng_expand_row_wide(tpng_image_t * image, const uint8_t * row, uint16_t * expanded, int rowPixelWidth) {
+    uint16_t * start = expanded;
+    int i;
+    int rawVal, rawG, rawB;
+    switch(image->colorType) {
+      // grayscale!
+      case 0:
+        for(i = 0; i < rowPixelWidth; ++i, expanded+=4, row+=2) {
+            rawVal = (row[0] << 8) + row[1];
+            expanded[0] = (row[0] << 8) | row[1];
+            expanded[1] = expanded[0];
+            expanded[2] = expanded[0];
+            expanded[3] = image->transparentGray == rawVal ? 0 : 0xffff;
+        }
+        break;
 
+      // plain RGB!
+      case 2:
+        for(i = 0; i < rowPixelWidth; ++i, expanded+=4, row+=6) {
+            rawVal = (row[0] << 8) + row[1];
+            rawG =   (row[2] << 8) + row[3];
+            rawB =   (row[4] << 8) + row[5];
+            expanded[0] = (row[0] << 8) | row[1];
+            expanded[1] = (row[2] << 8) | row[3];
+            expanded[2] = (row[4] << 8) | row[5];
+            expanded[3] = 0xffff;
+            if (image->transparentRed   == rawVal &&
+                image->transparentGreen == rawG &&
+                image->transparentBlue  == rawB) {
+                expanded[3] = 0;
+            }
+        }
+        break;
+
+      // grayscale + alpha!
+      case 4:
+        for(i = 0; i < rowPixelWidth; ++i, expanded+=4, row+=4) {
+            expanded[0] = (row[0] << 8) | row[1];
+            expanded[1] = expanded[0];
+            expanded[2] = expanded[0];
+            expanded[3] = (row[2] << 8) | row[3];
+        }
+        break;
+
+      // RGBA!
+      case 6:
+        for(i = 0; i < rowPixelWidth; ++i, expanded+=4, row+=8) {
+            expanded[0] = (row[0] << 8) | row[1];
+            expanded[1] = (row[2] << 8) | row[3];
+            expanded[2] = (row[4] << 8) | row[5];
+            expanded[3] = (row[6] << 8) | row[7];
+        }
+        break;
+
+      default:;
+    }
+
+    // tRNS alpha is only 0 or 0xffff, which this leaves exact
+    if (image->premultiply && (image->colorType == 4 || image->colorType == 6 || 
+        image->transparentGray != -1 || image->transparentRed != -1)) {
+        for(i = 0; i < rowPixelWidth; ++i, start+=4) {
+            if (start[3] == 0xffff) continue;
+            start[0] = tpng_premultiply_wide(start[0], start[3]);
+            start[1] = tpng_premultiply_wide(start[1], start[3]);
+            start[2] = tpng_premultiply_wide(start[2], start[3]);
+        }
+    }
+}
+
+
+// Converts count pixels of RGBA to a format with the channels 
+// of each pixel together, a byte each or 16 bits for RGBA16.
+static void tpng_convert_row(int format, const uint8_t * in, uint8_t * out, uint32_t count) {
+    uint32_t x;
+    switch(format) {
+      case TPNG_FORMAT_BGRA8:
+        for(x = 0; x < count; ++x, in += 4, out += 4) {
+            out[0] = in[2];
+            out[1] = in[1];
+            out[2] = in[0];
+            out[3] = in[3];
+        }
+        break;
+      case TPNG_FORMAT_RGB8:
+        for(x = 0; x < count; ++x, in += 4, out += 3) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+        }
+        break;
+      case TPNG_FORMAT_ARGB8:
+        for(x = 0; x < count; ++x, in += 4, out += 4) {
+            out[0] = in[3];
+            out[1] = in[0];
+            out[2] = in[1];
+            out[3] = in[2];
+        }
+        break;
+      case TPNG_FORMAT_GRAY8:
+        for(x = 0; x < count; ++x, in += 4, out += 1) {
+            out[0] = (uint8_t)((77*in[0] + 150*in[1] + 29*in[2] + 128) >> 8);
+        }
+        break;
+      case TPNG_FORMAT_GRAY_ALPHA8:
+        for(x = 0; x < count; ++x, in += 4, out += 2) {
+            out[0] = (uint8_t)((77*in[0] + 150*in[1] + 29*in[2] + 128) >> 8);
+            out[1] = in[3];
+        }
+        break;
+      case TPNG_FORMAT_RGBA16: {
+        uint16_t * wide = (uint16_t *)out;
+        for(x = 0; x < count*4; ++x) 
+            wide[x] = in[x]*257;
+        break;
+      }
+      default:
+        memcpy(out, in, (size_t)count*4);
+    }
+}
+
+
+// Expands the unfiltered row into out, in the image's format 
+// if it's converted to as the image is decoded in one go. 
+// expanded holds a row of RGBA on the way, unless the format 
+// is RGBA8 or is RGBA16 from a 16-bit image.
+static void tpng_image_expand_row(tpng_image_t * image, const uint8_t * row, uint8_t * out, uint8_t * expanded, int rowPixelWidth) {
+    if (image->format == TPNG_FORMAT_RGBA8 || !tpng_format_get_pixel_bytes(image->format)) {
+        tpng_expand_row(image, row, out, rowPixelWidth);
+    } else if (image->format == TPNG_FORMAT_RGBA16 && image->colorDepth == 16) {
+        tpng_expand_row_wide(image, row, (uint16_t *)out, rowPixelWidth);
+    } else {
+        tpng_expand_row(image, row, expanded, rowPixelWidth);
+        tpng_convert_row(image->format, expanded, out, rowPixelWidth);
+    }
+}
+
+
+static int tpng_paeth_predictor(int a, int b, int c) {
+    int p = a + b - c;// checked, no overflow
+    int pa = abs(p-a);// checked, no overflow
+    int pb = abs(p-b);// checked, no overflow
+    int pc = abs(p-c);// checked, no overflow
+
+    if      (pa <= pb && pa <= pc) return a;
+    else if (pb <= pc)             return b;
+    else                           return c;
+}
+
+
+// Removes the filter from the filtered bytes in src, 
+// writing the raw scanline to thisRow. src may be thisRow.
 static void tpng_unfilter_row(
     tpng_image_t  * image, 
     uint8_t       * thisRow,
+    const uint8_t * src,
     const uint8_t * prevRow,
     uint32_t        rowBytes,
     int             Bpp,
@@ -673,37 +1901,42 @@ static void tpng_unfilter_row(
 ) {
     uint32_t i;
     switch(filter) {
-      case 0: // no filtering 
-        break;
       case 1: // Sub 
+        for(i = 0; i < Bpp; ++i) {
+            thisRow[i] = src[i];
+        }
         for(i = Bpp; i < rowBytes; ++i) {
-            thisRow[i] = thisRow[i] + thisRow[i-Bpp];
+            thisRow[i] = src[i] + thisRow[i-Bpp];
         }
         break;
       case 2: // Up
         for(i = 0; i < rowBytes; ++i) {
-            thisRow[i] = thisRow[i] + prevRow[i];
+            thisRow[i] = src[i] + prevRow[i];
         }
         break;
 
       case 3: //average
         for(i = 0; i < Bpp; ++i) {
-            thisRow[i] = thisRow[i] + (int)((0 + prevRow[i])/2.0);
+            thisRow[i] = src[i] + (int)((0 + prevRow[i])/2.0);
         }
         for(i = Bpp; i < rowBytes; ++i) {
-            thisRow[i] = thisRow[i] + (int)((thisRow[i-Bpp] + prevRow[i])/2.0);
+            thisRow[i] = src[i] + (int)((thisRow[i-Bpp] + prevRow[i])/2.0);
         }
         break;   
 
       case 4: //paeth
         for(i = 0; i < Bpp; ++i) {           
-            thisRow[i] = thisRow[i] + tpng_paeth_predictor(0, prevRow[i], 0);
+            thisRow[i] = src[i] + tpng_paeth_predictor(0, prevRow[i], 0);
         }
         for(i = Bpp; i < rowBytes; ++i) {
-            thisRow[i] = thisRow[i] + tpng_paeth_predictor(thisRow[i-Bpp], prevRow[i], prevRow[i-Bpp]);
+            thisRow[i] = src[i] + tpng_paeth_predictor(thisRow[i-Bpp], prevRow[i], prevRow[i-Bpp]);
         }
         break;
-      default:;
+
+      case 0: // no filtering 
+      default:
+        if (thisRow != src)
+            memcpy(thisRow, src, rowBytes);
     }      
 }
 
@@ -838,6 +2071,7 @@ static int tpng_adam7_subpixel_to_pixel(
     return x + y*image->w;
 }
 
+// passRgbaRow is in the image's format, image.pixelBytes a pixel.
 static void tpng_adam7_pass_row_to_image(
     const uint8_t * passRgbaRow,
     tpng_image_t * image,
@@ -847,10 +2081,15 @@ static void tpng_adam7_pass_row_to_image(
 ) {
     uint32_t i;
     int pixel;
+    size_t pixelBytes = image->pixelBytes;
     for(i = 0; i < rowWidth; ++i) {
         pixel = tpng_adam7_subpixel_to_pixel(image, i, subrow, pass);
-        // should be fine; theyre aligned to 32bit boundaries.
-        (*(uint32_t*)(image->rgba+(pixel*4))) = (*(uint32_t*)(passRgbaRow+(i*4))); 
+        if (pixelBytes == 4) {
+            // should be fine; theyre aligned to 32bit boundaries.
+            (*(uint32_t*)(image->rgba+(pixel*4))) = (*(uint32_t*)(passRgbaRow+(i*4))); 
+        } else {
+            memcpy(image->rgba+pixel*pixelBytes, passRgbaRow+i*pixelBytes, pixelBytes);
+        }
     }
     
 }
@@ -892,96 +2131,709 @@ static int tpng_adam7_get_pass_height(tpng_image_t * image, int pass) {
 
 
 
-static void tpng_adam7_decode(
+// Returns the number of bytes the IDAT stream should inflate to:
+// every scanline (of every pass) and its filter byte.
+static size_t tpng_get_inflated_size(tpng_image_t * image) {
+    size_t size = 0;
+    int pass, passWidth;
+    if (image->w <= 0 || image->h <= 0) return 0;
+    if (image->interlaceMethod == 1) {
+        for(pass = 0; pass < 7; ++pass) {
+            passWidth = tpng_adam7_get_pass_width(image, pass);
+            if (passWidth == 0) continue;
+            size += (size_t)tpng_adam7_get_pass_height(image, pass) * 
+                    (tpng_get_bytes_per_row(image, passWidth)+1);
+        }
+        return size;
+    }
+    return (size_t)image->h * (tpng_get_bytes_per_row(image, image->w)+1);
+}
+
+
+
+static uint32_t tpng_adler32(uint32_t adler, const uint8_t * data, uint32_t len) {
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+    uint32_t i, block;
+    while(len) {
+        // largest n where 255n(n+1)/2 + (n+1)(65520) fits 32 bits
+        block = len < 5552 ? len : 5552;
+        for(i = 0; i < block; ++i) {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+        data += block;
+        len  -= block;
+    }
+    return (s2 << 16) | s1;
+}
+
+
+
+
+// Reader for zlib streams that consist only of stored 
+// (uncompressed) deflate blocks. Such streams need no inflating:
+// scanlines are returned straight from the IDAT chunks, and are only 
+// copied when a block header or chunk boundary splits them.
+typedef struct {
+    // IDAT chunks.
+    const tpng_span_t * spans;
+
+    // Number of IDAT chunks.
+    uint32_t nspans;
+
+    // The current IDAT chunk.
+    uint32_t span;
+
+    // Read position within the current IDAT chunk.
+    uint32_t offset;
+
+    // Bytes left in the current stored block.
+    uint32_t blockLeft;
+
+    // Whether the current stored block is the last one.
+    int final;
+
+    // Running adler32 of the uncompressed bytes.
+    uint32_t adler;
+
+    // Space to assemble split reads.
+    uint8_t * staging;
+} tpng_stored_t;
+
+
+// Reads the next byte of the stream. -1 on end of stream.
+static int tpng_stored_byte(tpng_stored_t * s) {
+    while(s->span < s->nspans && s->offset == s->spans[s->span].length) {
+        s->span++;
+        s->offset = 0;
+    }
+    if (s->span >= s->nspans) return -1;
+    return s->spans[s->span].data[s->offset++];
+}
+
+// Reads the header of the next deflate block. 
+// Returns 0 if its not a valid stored block.
+static int tpng_stored_block_header(tpng_stored_t * s) {
+    int header = tpng_stored_byte(s);
+    int len0 = tpng_stored_byte(s);
+    int len1 = tpng_stored_byte(s);
+    int nlen0 = tpng_stored_byte(s);
+    int nlen1 = tpng_stored_byte(s);
+
+    // BTYPE of 00 is stored. Since every block before this one 
+    // was stored too, the header always starts on a byte boundary.
+    if (header < 0 || (header & 6) || nlen1 < 0) return 0;
+    if ((len0 ^ nlen0) != 0xff || (len1 ^ nlen1) != 0xff) return 0;
+    s->final = header & 1;
+    s->blockLeft = len0 | (len1 << 8);
+    return 1;
+}
+
+// Skips the remaining bytes of the current block, 
+// updating the checksum. Returns 0 if the stream ends early.
+static int tpng_stored_skip_block(tpng_stored_t * s) {
+    uint32_t n;
+    while(s->blockLeft) {
+        if (tpng_stored_byte(s) < 0) return 0;
+        s->offset--;
+        n = s->spans[s->span].length - s->offset;
+        if (n > s->blockLeft) n = s->blockLeft;
+        s->adler = tpng_adler32(s->adler, s->spans[s->span].data + s->offset, n);
+        s->offset += n;
+        s->blockLeft -= n;
+    }
+    return 1;
+}
+
+
+// Checks whether the IDAT stream is made of only stored blocks, 
+// and if so, prepares the reader at the first uncompressed byte.
+// Only block headers are visited. Returns 0 if the stream needs inflating.
+static int tpng_stored_init(tpng_stored_t * s, const tpng_span_t * spans, uint32_t nspans) {
+    int cmf, flg, i;
+    memset(s, 0, sizeof(tpng_stored_t));
+    s->spans = spans;
+    s->nspans = nspans;
+
+    // zlib header: deflate, no preset dictionary.
+    cmf = tpng_stored_byte(s);
+    flg = tpng_stored_byte(s);
+    if (flg < 0 || (cmf & 15) != 8 || (flg & 32) || (cmf*256 + flg) % 31) return 0;
+
+    do {
+        if (!tpng_stored_block_header(s)) return 0;
+        while(s->blockLeft) {
+            if (tpng_stored_byte(s) < 0) return 0;
+            s->offset--;
+            if (s->spans[s->span].length - s->offset >= s->blockLeft) {
+                s->offset += s->blockLeft;
+                s->blockLeft = 0;
+            } else {
+                s->blockLeft -= s->spans[s->span].length - s->offset;
+                s->offset = s->spans[s->span].length;
+            }
+        }
+    } while(!s->final);
+
+    // adler32 must be present too, else its truncated
+    for(i = 0; i < 4; ++i) {
+        if (tpng_stored_byte(s) < 0) return 0;
+    }
+
+    // rewind to the start of the stream
+    s->span = 0;
+    s->offset = 0;
+    s->final = 0;
+    s->adler = 1;
+    tpng_stored_byte(s);
+    tpng_stored_byte(s);
+    return 1;
+}
+
+// Returns the next len uncompressed bytes, or NULL if the stream ends first.
+// The bytes are returned in-place when they are contiguous in the file.
+static const uint8_t * tpng_stored_read(tpng_stored_t * s, uint32_t len) {
+    const uint8_t * out;
+    uint32_t copied = 0;
+    uint32_t n;
+    if (s->blockLeft >= len && s->span < s->nspans && s->spans[s->span].length - s->offset >= len) {
+        out = s->spans[s->span].data + s->offset;
+        s->offset += len;
+        s->blockLeft -= len;
+        s->adler = tpng_adler32(s->adler, out, len);
+        return out;
+    }
+
+    while(copied < len) {
+        if (!s->blockLeft) {
+            if (s->final || !tpng_stored_block_header(s)) return NULL;
+            continue;
+        }
+        if (tpng_stored_byte(s) < 0) return NULL;
+        s->offset--;
+        n = s->spans[s->span].length - s->offset;
+        if (n > s->blockLeft)   n = s->blockLeft;
+        if (n > len - copied)   n = len - copied;
+        memcpy(s->staging + copied, s->spans[s->span].data + s->offset, n);
+        s->offset += n;
+        s->blockLeft -= n;
+        copied += n;
+    }
+    s->adler = tpng_adler32(s->adler, s->staging, len);
+    return s->staging;
+}
+
+// Checksums any bytes that weren't read and checks the adler32 
+// of the stream. Returns whether it matches.
+static int tpng_stored_finish(tpng_stored_t * s) {
+    uint32_t expected = 0;
+    int i, c;
+    for(;;) {
+        if (!tpng_stored_skip_block(s)) return 0;
+        if (s->final) break;
+        if (!tpng_stored_block_header(s)) return 0;
+    }
+    for(i = 0; i < 4; ++i) {
+        if ((c = tpng_stored_byte(s)) < 0) return 0;
+        expected = (expected << 8) | c;
+    }
+    return expected == s->adler;
+}
+
+
+
+// An IDAT stream being inflated on another thread, from TINFL.
+typedef struct tinfl_pipe tinfl_pipe;
+
+// Starts inflating the spans as a task of the scheduler. Returns NULL 
+// if the stream is too small to be worth it or there's no scheduler.
+// Inflating stops early once *pCancel (if given) is nonzero.
+static tinfl_pipe * tinfl_pipe_start(const tpng_span_t * spans, uint32_t nspans, size_t expectedLen, const tpng_scheduler_t * scheduler, const size_t * pCancel);
+
+// Waits until the first end bytes are inflated and returns the 
+// output buffer, or NULL if the stream stopped short of end.
+static const uint8_t * tinfl_pipe_wait(tinfl_pipe * pipe, size_t end);
+
+// Waits for the inflating task and frees the pipe. 
+// Returns 0 if the stream was corrupt.
+static int tinfl_pipe_finish(tinfl_pipe * pipe);
+
+
+
+// Where the filtered scanlines of the image come from.
+typedef struct {
+    // The inflated IDAT stream.
+    tpng_iter_t * iter;
+
+    // If not NULL, the uncompressed IDAT stream, used instead of iter.
+    tpng_stored_t * stored;
+
+    // If not NULL, the IDAT stream being inflated alongside, used instead of iter.
+    tinfl_pipe * pipe;
+
+    // Bytes of the pipe's output already read.
+    size_t pipeRead;
+
+    // If not NULL, the whole inflated stream that iter reads.
+    const uint8_t * inflated;
+    size_t inflatedLength;
+
+    // If not NULL, no more rows are given once this is nonzero.
+    const size_t * cancel;
+} tpng_rows_t;
+
+// Returns the next len bytes of scanline data, or NULL if 
+// there is not enough data left.
+static const uint8_t * tpng_rows_next(tpng_rows_t * rows, uint32_t len) {
+    if (rows->cancel && TPNG_ATOMIC_LOAD(rows->cancel))
+        return NULL;
+    if (rows->stored) 
+        return tpng_stored_read(rows->stored, len);
+    if (rows->pipe) {
+        const uint8_t * out = tinfl_pipe_wait(rows->pipe, rows->pipeRead + len);
+        if (!out) return NULL;
+        out += rows->pipeRead;
+        rows->pipeRead += len;
+        return out;
+    }
+    return tpng_iter_advance(rows->iter, len);
+}
+
+
+
+
+// Unfilters, expands and scatters one adam7 pass, reading 
+// its rows from the given source.
+static void tpng_adam7_decode_pass(
     tpng_image_t * image, 
-    tpng_iter_t * iter,
-    int Bpp  
+    tpng_rows_t * rows,
+    int Bpp,
+    int pass
 ) {
-    TPNG_BEGIN(iter);
-    uint32_t rowBytes = tpng_get_bytes_per_row(image, image->w);
+    // the width and height for the pass.
+    int passWidth  = tpng_adam7_get_pass_width(image, pass);
+    int passHeight = tpng_adam7_get_pass_height(image, pass);
+    int passRowBytes;
+    int row;
+    uint8_t * swap;
+
+    if (passWidth == 0) return;
+    passRowBytes = tpng_get_bytes_per_row(image, passWidth);
 
     // row bytes of the above row, filter byte discarded
     // Before initialized, is 0.
-    uint8_t * prevRow = TPNG_CALLOC(1, rowBytes);
+    uint8_t * prevRow = TPNG_CALLOC(1, passRowBytes);
     // row bytes of the current row, filter byte discarded
-    uint8_t * thisRow = TPNG_CALLOC(1, rowBytes);
+    uint8_t * thisRow = TPNG_CALLOC(1, passRowBytes);
 
     // Expanded raw row, where each RGBA pixel is given 
     // the raw value within 
-    uint8_t * rowExpanded = TPNG_CALLOC(4, image->w);
+    uint8_t * rowExpanded = TPNG_CALLOC(4, passWidth);
+
+    // The expanded row in the image's format, if it isn't RGBA8.
+    uint8_t * rowConverted = image->format == TPNG_FORMAT_RGBA8 ? 
+        rowExpanded : 
+        TPNG_CALLOC(image->pixelBytes, passWidth);
+        
+    for(row = 0; row < passHeight; ++row) {
+        const uint8_t * readN = tpng_rows_next(rows, passRowBytes+1);
+        // abort read of IDAT
+        if (!readN) break;
+
+  
+        // remove the filter from the bytes in the row 
+        tpng_unfilter_row(image, thisRow, readN+1, prevRow, passRowBytes, Bpp, readN[0]);
+
+        // finally: get scanlines from data
+        tpng_image_expand_row(image, thisRow, rowConverted, rowExpanded, passWidth);
+
 
+        tpng_adam7_pass_row_to_image(
+            rowConverted,
+            image,
+            row, // row within the complete pass image
+            passWidth,
+            pass
+        );
+        
+        
+        // save raw previous scanline            
+        swap = prevRow;
+        prevRow = thisRow;
+        thisRow = swap;
+    }
+
+    TPNG_FREE(prevRow);
+    TPNG_FREE(thisRow);
+    if (rowConverted != rowExpanded) 
+        TPNG_FREE(rowConverted);
+    TPNG_FREE(rowExpanded);
+}
+
+
+// One adam7 pass for tpng_adam7_decode_pass_task().
+typedef struct {
+    tpng_image_t * image;
+    int Bpp;
+    int pass;
+
+    // The pass's filtered rows, as far as they were inflated.
+    const uint8_t * data;
+    size_t length;
+} tpng_adam7_pass_t;
+
+static void tpng_adam7_decode_pass_task(void * data) {
+    tpng_adam7_pass_t * p = data;
+    tpng_rows_t rows;
+    memset(&rows, 0, sizeof(tpng_rows_t));
+    rows.iter = tpng_iter_create(p->data, p->length);
+    rows.cancel = p->image->cancel;
+    tpng_adam7_decode_pass(p->image, &rows, p->Bpp, p->pass);
+    tpng_iter_destroy(rows.iter);
+}
 
 
+static void tpng_adam7_decode(
+    tpng_image_t * image, 
+    tpng_rows_t * rows,
+    int Bpp  
+) {
     // each pass is an independent subimage that correspond 
     // to pixels within the final image, separated in 8x8 
     // chunks.
     int pass;
 
-    // the width and height for the pass.
-    int passWidth;
-    int passHeight;
-    int passRowBytes;
-    int row;
-
-    
+    // With the whole stream inflated, each pass's rows can be 
+    // found up front. Passes write disjoint pixels, so they 
+    // are decoded at once, largest (last) first.
+    const tpng_scheduler_t * scheduler = NULL;
+    if (
+        rows->inflated &&
+        image->parallelExpand && 
+        (image->threads > 1 || image->scheduler) &&
+        (uint64_t)image->w*image->h >= image->parallelExpandPixels
+    ) {
+        scheduler = tpng_image_get_scheduler(image);
+    }
 
+    if (tpng_scheduler_get_worker_count(scheduler) > 1) {
+        tpng_adam7_pass_t passes[7];
+        size_t offset = 0;
+        for(pass = 0; pass < 7; ++pass) {
+            int passWidth = tpng_adam7_get_pass_width(image, pass);
+            tpng_adam7_pass_t * p = passes + 6 - pass;
+            size_t size = passWidth ? 
+                (size_t)tpng_adam7_get_pass_height(image, pass) * (tpng_get_bytes_per_row(image, passWidth)+1) :
+                0;
+            p->image = image;
+            p->Bpp = Bpp;
+            p->pass = pass;
+            p->data = NULL;
+            p->length = 0;
+            if (offset < rows->inflatedLength) {
+                p->data = rows->inflated + offset;
+                p->length = rows->inflatedLength - offset < size ? rows->inflatedLength - offset : size;
+            }
+            offset += size;
+        }
+        tpng_parallel_run(scheduler, tpng_adam7_decode_pass_task, passes, sizeof(tpng_adam7_pass_t), 7);
+        return;
+    }
 
     for(pass = 0; pass < 7; ++pass) {
-        memset(prevRow, 0, rowBytes);
-        
-        // first, we need how many rows / bytes consist of this row.
-        passWidth  = tpng_adam7_get_pass_width(image, pass);
-        passHeight = tpng_adam7_get_pass_height(image, pass);
-        
-        if (passWidth == 0) continue;
-        passRowBytes  = tpng_get_bytes_per_row(image, passWidth);
-        
-        for(row = 0; row < passHeight; ++row) {
-            int filter = TPNG_READ(uint8_t);
-            const void * readN = TPNG_READ_N(passRowBytes);
-            // abort read of IDAT
-            if (!readN) break;
-            memcpy(thisRow, readN, passRowBytes);
-    
-      
-            // remove the filter from the bytes in the row 
-            tpng_unfilter_row(image, thisRow, prevRow, passRowBytes, Bpp, filter);
+        tpng_adam7_decode_pass(image, rows, Bpp, pass);
+    }
+}
 
-            // finally: get scanlines from data
-            tpng_expand_row(image, thisRow, rowExpanded, passWidth);
 
 
-            tpng_adam7_pass_row_to_image(
-                rowExpanded,
-                image,
-                row, // row within the complete pass image
-                passWidth,
-                pass
-            );
-            
-            
-            // save raw previous scanline            
-            memcpy(prevRow, thisRow, rowBytes);
-        }
+// One band of rows for tpng_expand_band().
+typedef struct {
+    tpng_image_t * image;
+
+    // The first unfiltered row of the band.
+    const uint8_t * unfiltered;
+
+    // Bytes per unfiltered row.
+    uint32_t rowBytes;
+
+    // The first image row of the band.
+    uint32_t first;
+
+    // Number of rows in the band.
+    uint32_t count;
+} tpng_band_t;
+
+static void tpng_expand_band(void * data) {
+    tpng_band_t * band = data;
+    tpng_image_t * image = band->image;
+    uint8_t * expanded = image->format == TPNG_FORMAT_RGBA8 ? NULL : TPNG_MALLOC((size_t)image->w*4);
+    uint32_t i;
+    for(i = 0; i < band->count && !tpng_image_is_cancelled(image); ++i) {
+        tpng_image_expand_row(
+            image, 
+            band->unfiltered + i*band->rowBytes, 
+            image->rgba + (size_t)(band->first+i)*image->w*image->pixelBytes, 
+            expanded,
+            image->w
+        );
     }
+    TPNG_FREE(expanded);
+}
 
-    
+// A run of rows for tpng_decode_segment(). Its first row 
+// doesn't depend on the one above it.
+typedef struct {
+    tpng_image_t * image;
+    int Bpp;
+
+    // The first filtered row of the segment, filter byte included.
+    const uint8_t * filtered;
+
+    // Bytes per unfiltered row.
+    uint32_t rowBytes;
+
+    // The first image row of the segment.
+    uint32_t first;
+
+    // Number of rows in the segment.
+    uint32_t count;
+} tpng_segment_t;
+
+static void tpng_decode_segment(void * data) {
+    tpng_segment_t * segment = data;
+    tpng_image_t * image = segment->image;
+    uint32_t rowBytes = segment->rowBytes;
+    // the first row is None or Sub (or the top row), so 
+    // zeros serve as the row above.
+    uint8_t * prevRow = TPNG_CALLOC(1, rowBytes);
+    uint8_t * thisRow = TPNG_CALLOC(1, rowBytes);
+    uint8_t * expanded = image->format == TPNG_FORMAT_RGBA8 ? NULL : TPNG_MALLOC((size_t)image->w*4);
+    uint8_t * swap;
+    uint32_t i;
+    for(i = 0; i < segment->count && !tpng_image_is_cancelled(image); ++i) {
+        const uint8_t * readN = segment->filtered + (size_t)i*(rowBytes+1);
+        tpng_unfilter_row(image, thisRow, readN+1, prevRow, rowBytes, segment->Bpp, readN[0]);
+        tpng_image_expand_row(image, thisRow, image->rgba + (size_t)(segment->first+i)*image->w*image->pixelBytes, expanded, image->w);
+        swap = prevRow;
+        prevRow = thisRow;
+        thisRow = swap;
+    }
     TPNG_FREE(prevRow);
     TPNG_FREE(thisRow);
-    TPNG_FREE(rowExpanded);
-    
+    TPNG_FREE(expanded);
+}
+
+// Decodes a non-interlaced image whose whole stream is inflated.
+// Rows filtered with None or Sub don't need the row above, so the 
+// image is split at them into segments, each unfiltered and 
+// expanded on its own thread. Returns 0 without decoding if there 
+// are too few such rows to keep every thread busy.
+static int tpng_decode_segmented(
+    tpng_image_t * image, 
+    tpng_rows_t * rows,
+    int Bpp,
+    const tpng_scheduler_t * scheduler
+) {
+    uint32_t rowBytes = tpng_get_bytes_per_row(image, image->w);
+    uint32_t rowCount = image->h;
+    if (rows->inflatedLength / (rowBytes+1) < rowCount) 
+        rowCount = rows->inflatedLength / (rowBytes+1);
+    if (!rowCount) return 1;
+
+    // a few segments per thread so uneven threads still finish together
+    uint32_t maxSegments = tpng_scheduler_get_worker_count(scheduler)*4;
+    uint32_t target = (rowCount + maxSegments - 1) / maxSegments;
+    tpng_segment_t * segments = TPNG_MALLOC(sizeof(tpng_segment_t)*(maxSegments+1));
+    uint32_t count = 0;
+    uint32_t row, first = 0;
+    for(row = 1; row <= rowCount; ++row) {
+        int filter = row < rowCount ? rows->inflated[(size_t)row*(rowBytes+1)] : 0;
+        if (row == rowCount || (row - first >= target && (filter == 0 || filter == 1))) {
+            segments[count].image = image;
+            segments[count].Bpp = Bpp;
+            segments[count].filtered = rows->inflated + (size_t)first*(rowBytes+1);
+            segments[count].rowBytes = rowBytes;
+            segments[count].first = first;
+            segments[count].count = row - first;
+            count++;
+            first = row;
+        }
+    }
+    if (count < maxSegments/4) {
+        TPNG_FREE(segments);
+        return 0;
+    }
+    tpng_parallel_run(scheduler, tpng_decode_segment, segments, sizeof(tpng_segment_t), count);
+    TPNG_FREE(segments);
+    return 1;
+}
+
+
+// Decodes a non-interlaced image by unfiltering every row 
+// into one buffer, then expanding bands of those rows 
+// straight into rgba on several threads.
+static void tpng_decode_banded(
+    tpng_image_t * image, 
+    tpng_rows_t * rows,
+    int Bpp
+) {
+    const tpng_scheduler_t * scheduler = tpng_image_get_scheduler(image);
+    if (rows->inflated && tpng_decode_segmented(image, rows, Bpp, scheduler)) 
+        return;
+
+    uint32_t rowBytes = tpng_get_bytes_per_row(image, image->w);
+    uint8_t * unfiltered = TPNG_MALLOC((size_t)rowBytes*image->h);
+    uint8_t * zeroRow = TPNG_CALLOC(1, rowBytes);
+    uint32_t row;
+
+    // unfiltering depends on the row above, so it stays serial.
+    for(row = 0; row < image->h; ++row) {
+        const uint8_t * readN = tpng_rows_next(rows, rowBytes+1);
+        // abort read of IDAT
+        if (!readN) break;
+
+        tpng_unfilter_row(
+            image, 
+            unfiltered + (size_t)row*rowBytes, 
+            readN+1, 
+            row ? unfiltered + (size_t)(row-1)*rowBytes : zeroRow, 
+            rowBytes, 
+            Bpp, 
+            readN[0]
+        );
+    }
+    TPNG_FREE(zeroRow);
+
+    // a few bands per thread so uneven threads still finish together
+    uint32_t bandCount = tpng_scheduler_get_worker_count(scheduler)*4;
+    if (bandCount > row) bandCount = row;
+    if (bandCount) {
+        tpng_band_t * bands = TPNG_MALLOC(sizeof(tpng_band_t)*bandCount);
+        uint32_t i;
+        for(i = 0; i < bandCount; ++i) {
+            bands[i].image = image;
+            bands[i].rowBytes = rowBytes;
+            bands[i].first = (uint32_t)(((uint64_t)row*i) / bandCount);
+            bands[i].count = (uint32_t)(((uint64_t)row*(i+1)) / bandCount) - bands[i].first;
+            bands[i].unfiltered = unfiltered + (size_t)bands[i].first*rowBytes;
+        }
+        tpng_parallel_run(scheduler, tpng_expand_band, bands, sizeof(tpng_band_t), bandCount);
+        TPNG_FREE(bands);
+    }
+    TPNG_FREE(unfiltered);
 }
 
 
 
-// zlib decompression, from TINFL
-static void *tinfl_decompress_mem_to_heap(
-    const void *pSrc_buf, 
-    size_t src_buf_len, 
-    size_t *pOut_len, 
-    int flags
+// zlib decompression, from TINFL.
+// Inflates the zlib stream split across the given spans 
+// into a new buffer of at most expectedLen bytes.
+// If scheduler is not NULL, large streams may be inflated in parallel.
+// Fails early once *pCancel (if given) is nonzero.
+static uint8_t * tinfl_decompress_spans_to_heap(
+    const tpng_span_t * spans,
+    uint32_t nspans,
+    size_t expectedLen,
+    size_t * pOut_len,
+    const tpng_scheduler_t * scheduler,
+    const size_t * pCancel
+);
+
+// Inflates the zlib stream split across the given spans
+// into pOut, which holds outLen bytes. Returns the inflated
+// size, or TINFL_DECOMPRESS_MEM_TO_MEM_FAILED.
+#define TINFL_DECOMPRESS_MEM_TO_MEM_FAILED ((size_t)(-1))
+static size_t tinfl_decompress_spans_to_mem(
+    const tpng_span_t * spans,
+    uint32_t nspans,
+    uint8_t * pOut,
+    size_t outLen,
+    const size_t * pCancel
 );
 
+// Inflates the zlib stream split across the given spans 
+// into pOut, which holds outLen bytes, a few bytes at a time.
+typedef struct tinfl_stream tinfl_stream;
+static tinfl_stream * tinfl_stream_create(const tpng_span_t * spans, uint32_t nspans, uint8_t * pOut, size_t outLen);
+
+// Inflates at most maxOut more bytes. Returns 0 while there's 
+// more to inflate, 1 once done, or 2 if the stream is corrupt.
+static int tinfl_stream_step(tinfl_stream * stream, size_t maxOut);
+
+// Once all of pOut is inflated, reads on to the end of the 
+// stream, so its adler32 is checked. Output past pOut is only 
+// inflated for the adler32, and is ignored. Returns 1 if it 
+// matched, or 2 if the stream is corrupt or pCancel is set.
+static int tinfl_stream_finish(tinfl_stream * stream, const size_t * pCancel);
+
+// Returns the number of bytes inflated so far.
+static size_t tinfl_stream_get_length(const tinfl_stream * stream);
+
+// Returns whether the stream has stopped: 1 if done, 2 if corrupt.
+static int tinfl_stream_get_finished(const tinfl_stream * stream);
+
+// Returns the size of a saved stream state.
+static size_t tinfl_stream_get_state_size();
+
+// Saves the inflate state to pState, as if the output began 
+// windowLen bytes before where it is now, and where in the 
+// spans the stream is reading.
+static void tinfl_stream_save(const tinfl_stream * stream, size_t windowLen, uint8_t * pState, uint32_t * pSpan, uint32_t * pSpanOfs);
+
+// Returns whether a saved state, as read back from an index, 
+// is one tinfl_stream_save() could have written for these 
+// spans, so it can be resumed without reading out of bounds.
+static int tinfl_stream_can_resume(const tpng_span_t * spans, uint32_t nspans, const uint8_t * pState, uint32_t span, uint32_t spanOfs, size_t windowLen);
+
+// Creates a stream that continues from a saved state. pOut 
+// must already begin with the windowLen bytes of output before 
+// it. Returns NULL if the span position is out of range.
+static tinfl_stream * tinfl_stream_resume(const tpng_span_t * spans, uint32_t nspans, const uint8_t * pState, uint32_t span, uint32_t spanOfs, uint8_t * pOut, size_t windowLen, size_t outLen);
+
+// Drops the first discard bytes of output, moving the rest to 
+// the start of pOut, so the stream needs only a window of it.
+static void tinfl_stream_slide(tinfl_stream * stream, size_t discard);
+
+static void tinfl_stream_destroy(tinfl_stream * stream);
+
+// Returns the orientation tag (1 to 8) of the EXIF data in 
+// an eXIf chunk, or 0 if there isn't a valid one.
+static int tpng_exif_get_orientation(const uint8_t * data, uint32_t length) {
+    int little;
+    uint32_t ifd, count, i;
+    if (length < 8) return 0;
+    if (data[0] == 'I' && data[1] == 'I') little = 1;
+    else if (data[0] == 'M' && data[1] == 'M') little = 0;
+    else return 0;
+
+    #define TPNG_EXIF_16(__at__) (little ? data[__at__] | (data[(__at__)+1] << 8) : (data[__at__] << 8) | data[(__at__)+1])
+    #define TPNG_EXIF_32(__at__) (little ? \
+        (uint32_t)TPNG_EXIF_16(__at__) | ((uint32_t)TPNG_EXIF_16((__at__)+2) << 16) : \
+        ((uint32_t)TPNG_EXIF_16(__at__) << 16) | (uint32_t)TPNG_EXIF_16((__at__)+2))
+
+    // the first IFD, and its 12-byte entries
+    ifd = TPNG_EXIF_32(4);
+    if (ifd > length - 2) return 0;
+    count = TPNG_EXIF_16(ifd);
+    for(i = 0; i < count && ifd + 2 + (i+1)*12 <= length; ++i) {
+        uint32_t entry = ifd + 2 + i*12;
+        // tag 0x0112, a SHORT
+        if (TPNG_EXIF_16(entry) == 0x0112 && TPNG_EXIF_16(entry+2) == 3) {
+            int orientation = TPNG_EXIF_16(entry+8);
+            return orientation >= 1 && orientation <= 8 ? orientation : 0;
+        }
+    }
+    return 0;
+
+    #undef TPNG_EXIF_16
+    #undef TPNG_EXIF_32
+}
+
+
 static void tpng_process_chunk(tpng_image_t * image, tpng_chunk_t * chunk) {
 
     // Header. SHOULD always be first.
@@ -997,7 +2849,8 @@ static void tpng_process_chunk(tpng_image_t * image, tpng_chunk_t * chunk) {
         image->filterMethod    = TPNG_READ(char);
         image->interlaceMethod = TPNG_READ(char);
         
-        image->rgba = TPNG_CALLOC(4, image->w*image->h);
+        if (!image->stepped)
+            image->rgba = TPNG_CALLOC(image->pixelBytes, (size_t)image->w*image->h);
 
         tpng_iter_destroy(iter);
 
@@ -1020,8 +2873,20 @@ static void tpng_process_chunk(tpng_image_t * image, tpng_chunk_t * chunk) {
     // Raw image data. We never process independently, we 
     // always assemble.
     } else if (!strcmp(chunk->type, "IDAT")) {
-        memcpy(image->idata+image->idataLength, chunk->data, chunk->length);         
-        image->idataLength += chunk->length;
+        if (!chunk->length) return;
+        if (image->nidat == image->idatCapacity) {
+            uint32_t newCapacity = image->idatCapacity ? image->idatCapacity*2 : 8;
+            tpng_span_t * newIdat = TPNG_MALLOC(sizeof(tpng_span_t)*newCapacity);
+            if (image->nidat) {
+                memcpy(newIdat, image->idat, sizeof(tpng_span_t)*image->nidat);
+                TPNG_FREE(image->idat);
+            }
+            image->idat = newIdat;
+            image->idatCapacity = newCapacity;
+        }
+        image->idat[image->nidat].data   = chunk->data;
+        image->idat[image->nidat].length = chunk->length;
+        image->nidat++;
 
     // Simple transparency!
     } else if (!strcmp(chunk->type, "tRNS")) {
@@ -1038,16 +2903,42 @@ static void tpng_process_chunk(tpng_image_t * image, tpng_chunk_t * chunk) {
         // grayscale
         } else if (image->colorType == 0) {
             // network byte order!
-            image->transparentGray = TPNG_READ(uint8_t)*0xff + TPNG_READ(uint8_t);
+            image->transparentGray  = TPNG_READ(uint8_t) << 8;
+            image->transparentGray |= TPNG_READ(uint8_t);
 
         // 
         } else if (image->colorType == 2) {
-            image->transparentRed   = TPNG_READ(uint8_t)*0xff + TPNG_READ(uint8_t);
-            image->transparentGreen = TPNG_READ(uint8_t)*0xff + TPNG_READ(uint8_t);
-            image->transparentBlue  = TPNG_READ(uint8_t)*0xff + TPNG_READ(uint8_t);            
+            image->transparentRed    = TPNG_READ(uint8_t) << 8;
+            image->transparentRed   |= TPNG_READ(uint8_t);
+            image->transparentGreen  = TPNG_READ(uint8_t) << 8;
+            image->transparentGreen |= TPNG_READ(uint8_t);
+            image->transparentBlue   = TPNG_READ(uint8_t) << 8;
+            image->transparentBlue  |= TPNG_READ(uint8_t);
         }
         tpng_iter_destroy(iter);        
 
+    // Color space, for linear output
+    } else if (!strcmp(chunk->type, "gAMA")) {
+        tpng_iter_t * iter = tpng_iter_create(chunk->data, chunk->length);
+        image->gamma = tpng_read_integer(image, iter) / 100000.0f;
+        tpng_iter_destroy(iter);        
+
+    } else if (!strcmp(chunk->type, "sRGB")) {
+        if (chunk->length >= 1) 
+            image->srgbIntent = chunk->data[0];
+
+    } else if (!strcmp(chunk->type, "cHRM")) {
+        tpng_iter_t * iter = tpng_iter_create(chunk->data, chunk->length);
+        int i;
+        for(i = 0; i < 8; ++i) 
+            image->chromaticities[i] = tpng_read_integer(image, iter) / 100000.0f;
+        image->hasChromaticities = chunk->length >= 32;
+        tpng_iter_destroy(iter);        
+
+    // Orientation, for TPNG_ORIENT_EXIF
+    } else if (!strcmp(chunk->type, "eXIf")) {
+        image->exifOrientation = tpng_exif_get_orientation(chunk->data, chunk->length);
+
     } else if (!strcmp(chunk->type, "IEND")) {
         // compression mode is the current and only accepted type.
         if (image->compression != 0) return;
@@ -1056,17 +2947,70 @@ static void tpng_process_chunk(tpng_image_t * image, tpng_chunk_t * chunk) {
         // in an invalid order.
         if (!image->rgba) return;
 
+        tpng_image_premultiply_palette(image);
+
         // now safe to work with IDAT input
-        // first: decompress (inflate)
-        size_t rawUncompLen;
-        void * rawUncomp = tinfl_decompress_mem_to_heap(
-            image->idata, 
-            image->idataLength, 
-            &rawUncompLen, 
-            1 // actually contains zlib header
-        );
-        tpng_iter_t * iter = tpng_iter_create(rawUncomp, rawUncompLen);
-        TPNG_BEGIN(iter);        
+        // first: decompress (inflate). Streams of only stored
+        // blocks are already uncompressed, so they're read in place.
+        tpng_rows_t rows;
+        tpng_stored_t stored;
+        uint8_t * rawUncomp = NULL;
+        rows.iter = NULL;
+        rows.stored = NULL;
+        rows.pipe = NULL;
+        rows.pipeRead = 0;
+        rows.inflated = NULL;
+        rows.inflatedLength = 0;
+        rows.cancel = image->cancel;
+        if (tpng_stored_init(&stored, image->idat, image->nidat)) {
+            stored.staging = TPNG_MALLOC(tpng_get_bytes_per_row(image, image->w)+1);
+            rows.stored = &stored;
+        } else if (
+            image->pipeline && 
+            !image->parallelInflate &&
+            (image->threads > 1 || image->scheduler) &&
+            (rows.pipe = tinfl_pipe_start(image->idat, image->nidat, tpng_get_inflated_size(image), tpng_image_get_scheduler(image), image->cancel))
+        ) {
+            // rows are read as they're inflated
+        } else if (image->scratch && !image->parallelInflate) {
+            // inflate into the worker's buffer, kept for the next image
+            size_t inflatedSize = tpng_get_inflated_size(image);
+            size_t rawUncompLen = TINFL_DECOMPRESS_MEM_TO_MEM_FAILED;
+            if (image->scratch->inflatedCapacity < inflatedSize) {
+                TPNG_FREE(image->scratch->inflated);
+                image->scratch->inflated = TPNG_MALLOC(inflatedSize);
+                image->scratch->inflatedCapacity = image->scratch->inflated ? inflatedSize : 0;
+            }
+            if (inflatedSize && image->scratch->inflated) {
+                rawUncompLen = tinfl_decompress_spans_to_mem(
+                    image->idat,
+                    image->nidat,
+                    image->scratch->inflated,
+                    inflatedSize,
+                    image->cancel
+                );
+            }
+            if (rawUncompLen == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED) {
+                rows.iter = tpng_iter_create(NULL, 0);
+            } else {
+                rows.iter = tpng_iter_create(image->scratch->inflated, rawUncompLen);
+                rows.inflated = image->scratch->inflated;
+                rows.inflatedLength = rawUncompLen;
+            }
+        } else {
+            size_t rawUncompLen;
+            rawUncomp = tinfl_decompress_spans_to_heap(
+                image->idat, 
+                image->nidat, 
+                tpng_get_inflated_size(image),
+                &rawUncompLen,
+                image->parallelInflate ? tpng_image_get_scheduler(image) : NULL,
+                image->cancel
+            );
+            rows.iter = tpng_iter_create(rawUncomp, rawUncompLen);
+            rows.inflated = rawUncomp;
+            rows.inflatedLength = rawUncompLen;
+        }
 
         
         
@@ -1075,7 +3019,14 @@ static void tpng_process_chunk(tpng_image_t * image, tpng_chunk_t * chunk) {
         uint32_t row = 0;
         int Bpp = tpng_get_bytes_per_pixel(image);
         
-        if (image->interlaceMethod == 0) {
+        if (
+            image->interlaceMethod == 0 && 
+            image->parallelExpand && 
+            (image->threads > 1 || image->scheduler) &&
+            (uint64_t)image->w*image->h >= image->parallelExpandPixels
+        ) {
+            tpng_decode_banded(image, &rows, Bpp);
+        } else if (image->interlaceMethod == 0) {
             uint32_t rowBytes = tpng_get_bytes_per_row(image, image->w);
 
             // row bytes of the above row, filter byte discarded
@@ -1083,550 +3034,3580 @@ static void tpng_process_chunk(tpng_image_t * image, tpng_chunk_t * chunk) {
             uint8_t * prevRow = TPNG_CALLOC(1, rowBytes);
             // row bytes of the current row, filter byte discarded
             uint8_t * thisRow = TPNG_CALLOC(1, rowBytes);
+            uint8_t * swap;
 
 
             // Expanded raw row, where each RGBA pixel is given 
             // the raw value within 
             uint8_t * rowExpanded = TPNG_CALLOC(4, image->w);
             for(row = 0; row < image->h; ++row) {
-                int filter = TPNG_READ(uint8_t);
-                const void * readN = TPNG_READ_N(rowBytes);
+                const uint8_t * readN = tpng_rows_next(&rows, rowBytes+1);
                 // abort read of IDAT
                 if (!readN) break;
-                memcpy(thisRow, readN, rowBytes);
         
           
                 // remove the filter from the bytes in the row 
-                tpng_unfilter_row(image, thisRow, prevRow, rowBytes, Bpp, filter);
-
-                // finally: get scanlines from data
-                tpng_expand_row(image, thisRow, rowExpanded, image->w);
-                
-                memcpy(
-                    image->rgba + row*image->w*4, 
-                    rowExpanded,
-                    4 * (image->w)
+                tpng_unfilter_row(image, thisRow, readN+1, prevRow, rowBytes, Bpp, readN[0]);
+
+                // finally: get scanlines from data, in the image's format
+                tpng_image_expand_row(
+                    image, 
+                    thisRow, 
+                    image->rgba + (size_t)row*image->w*image->pixelBytes, 
+                    rowExpanded, 
+                    image->w
                 );
                     
                 // save raw previous scanline            
-                memcpy(prevRow, thisRow, rowBytes);
+                swap = prevRow;
+                prevRow = thisRow;
+                thisRow = swap;
             }
             TPNG_FREE(thisRow);
             TPNG_FREE(prevRow);
             TPNG_FREE(rowExpanded);
             // adam7..
         } else if (image->interlaceMethod == 1) {
-            tpng_adam7_decode(image, iter, Bpp);        
+            tpng_adam7_decode(image, &rows, Bpp);        
         }            
-        tpng_iter_destroy(iter);        
-        TPNG_FREE(rawUncomp);
+
+        if (rows.stored) {
+            // same as a failed inflate: the checksum covers the whole stream.
+            if (!tpng_stored_finish(&stored)) {
+                memset(image->rgba, 0, (size_t)image->pixelBytes*image->w*image->h);
+            }
+            TPNG_FREE(stored.staging);
+        } else if (rows.pipe) {
+            // a failed inflate shows nothing, as when inflated up front.
+            if (!tinfl_pipe_finish(rows.pipe)) {
+                memset(image->rgba, 0, (size_t)image->pixelBytes*image->w*image->h);
+            }
+        } else {
+            tpng_iter_destroy(rows.iter);        
+            TPNG_FREE(rawUncomp);
+        }
     }
 }
 
 
 
 static void tpng_image_cleanup(tpng_image_t * image) {
-    TPNG_FREE(image->idata);
+    TPNG_FREE(image->idat);
+    if (image->pool)
+        tpng_pool_destroy(image->pool);
 }
 
 
 
 
+// time-sliced decoding
+///////////////
 
+// How one axis of the image is resampled. Output pixel o is the 
+// sum of source pixels [first[o], first[o]+taps[o]), each times 
+// its weight from weights + o*maxTaps. Source pixel s is part of 
+// output pixels [outFirst[s], outEnd[s]).
+typedef struct {
+    uint32_t * first;
+    uint32_t * taps;
+    uint32_t maxTaps;
+    float * weights;
+    uint32_t * outFirst;
+    uint32_t * outEnd;
+} tpng_resample_axis_t;
+
+
+// Works out the weights of an axis of sourceSize pixels 
+// resampled to size. Returns 0 if out of memory.
+static int tpng_resample_axis_init(tpng_resample_axis_t * axis, uint32_t sourceSize, uint32_t size, int filter) {
+    double scale = (double)sourceSize / size;
+    uint32_t o, s, t;
+    axis->maxTaps = filter == TPNG_RESAMPLE_AREA && scale > 1 ? (uint32_t)scale + 2 : 2;
+    axis->first = TPNG_MALLOC(sizeof(uint32_t)*size);
+    axis->taps = TPNG_MALLOC(sizeof(uint32_t)*size);
+    axis->weights = TPNG_CALLOC(sizeof(float), (size_t)size*axis->maxTaps);
+    axis->outFirst = TPNG_CALLOC(sizeof(uint32_t), sourceSize);
+    axis->outEnd = TPNG_CALLOC(sizeof(uint32_t), sourceSize);
+    if (!axis->first || !axis->taps || !axis->weights || !axis->outFirst || !axis->outEnd)
+        return 0;
+
+    for(o = 0; o < size; ++o) {
+        float * weights = axis->weights + (size_t)o*axis->maxTaps;
+        if (filter == TPNG_RESAMPLE_AREA) {
+            // the share of [lo, hi) each source pixel covers
+            double lo = o*scale;
+            double hi = (o+1)*scale;
+            uint32_t end = (uint32_t)hi;
+            if (end < hi && end < sourceSize) end++;
+            axis->first[o] = (uint32_t)lo;
+            axis->taps[o] = end - axis->first[o];
+            for(t = 0; t < axis->taps[o]; ++t) {
+                double left = axis->first[o] + t;
+                double right = left + 1;
+                if (left < lo) left = lo;
+                if (right > hi) right = hi;
+                weights[t] = (float)((right - left) / (hi - lo));
+            }
+        } else {
+            // between the 2 source pixels nearest to the center
+            double center = (o + 0.5)*scale - 0.5;
+            double fraction;
+            if (center < 0) center = 0;
+            if (center > sourceSize-1) center = sourceSize-1;
+            axis->first[o] = (uint32_t)center;
+            fraction = center - axis->first[o];
+            if (fraction > 0 && axis->first[o]+1 < sourceSize) {
+                axis->taps[o] = 2;
+                weights[0] = (float)(1 - fraction);
+                weights[1] = (float)fraction;
+            } else {
+                axis->taps[o] = 1;
+                weights[0] = 1;
+            }
+        }
 
+        for(t = 0; t < axis->taps[o]; ++t) {
+            s = axis->first[o] + t;
+            if (axis->outEnd[s] == 0) 
+                axis->outFirst[s] = o;
+            axis->outEnd[s] = o+1;
+        }
+    }
+    return 1;
+}
 
+static void tpng_resample_axis_cleanup(tpng_resample_axis_t * axis) {
+    TPNG_FREE(axis->first);
+    TPNG_FREE(axis->taps);
+    TPNG_FREE(axis->weights);
+    TPNG_FREE(axis->outFirst);
+    TPNG_FREE(axis->outEnd);
+}
 
+// Returns the weight of source pixel s in output pixel o.
+static float tpng_resample_axis_get_weight(const tpng_resample_axis_t * axis, uint32_t o, uint32_t s) {
+    return axis->weights[(size_t)o*axis->maxTaps + s - axis->first[o]];
+}
 
 
 
+// What a tpng_decoder_t does on its next step.
+enum {
+    // Reading chunks, up to IEND.
+    TPNG_DECODER_STAGE__CHUNKS,
 
+    // Inflating, unfiltering and expanding rows.
+    TPNG_DECODER_STAGE__ROWS,
 
-// tpng iterator helper class
-///////////////
-struct tpng_iter_t {
-    // Raw data, read-only.
-    const uint8_t * data;
-
-    // (safe) size of the read-only buffer
-    uint32_t        size;
+    // Finished; status is final.
+    TPNG_DECODER_STAGE__DONE
+};
 
-    // where we are within the iterator.
-    uint32_t        iter;
+struct tpng_decoder_t {
+    // The image being decoded.
+    tpng_image_t image;
 
-    // buffers saved to process invalid requests.
-    uint8_t **      errors;
+    // The raw file, and an iterator reading it a chunk at a time.
+    const uint8_t * rawData;
+    uint32_t rawSize;
+    tpng_iter_t * iter;
 
-    // Number of error buffers.
-    uint32_t        nerrors;
-};
+    // One of TPNG_DECODER_STAGE__*.
+    int stage;
 
-tpng_iter_t * tpng_iter_create(const uint8_t * data, uint32_t size) {
-    tpng_iter_t * out = TPNG_CALLOC(1, sizeof(tpng_iter_t));
-    out->data = data;
-    out->size = size;
-    out->iter = 0;
-    
-    out->nerrors = 0;
-    out->errors = NULL;
-    return out;
-}
+    // One of TPNG_STATUS_*, once done.
+    int status;
 
-void tpng_iter_destroy(tpng_iter_t * t) { 
-    uint32_t i;
-    for(i = 0; i < t->nerrors; ++i) {
-        TPNG_FREE(t->errors[i]);
-    }
-    TPNG_FREE(t->errors);
-    TPNG_FREE(t);
-}
+    // The inflated stream, filled in as rows need it. Only the 
+    // last TPNG_INDEX_WINDOW bytes read and the row after are 
+    // kept, sliding back to the start once inflatedCapacity is full.
+    uint8_t * inflated;
+    size_t inflatedCapacity;
+    tinfl_stream * stream;
 
-#ifdef TPNG_REPORT_ERROR
-    #include <stdio.h>
-#endif
+    // Bytes of inflated already unfiltered.
+    size_t read;
 
-const void * tpng_iter_advance(tpng_iter_t * t, uint32_t size) {
-    if (!size) return NULL;
-    if (t->iter + size <= t->size) {
-        const void * out = t->data+t->iter;     
-        t->iter+=size;   
-        return out;
-    } 
-    return NULL;
-}
+    // The bytes of everything but the output made for the 
+    // decode, for tpng_decoder_get_working_size().
+    size_t workingSize;
 
-const void * tpng_iter_advance_guaranteed(tpng_iter_t * t, uint32_t size) {
-    const void * data = tpng_iter_advance(t, size);
-    if (!data) {
-        // no partial requests. 
-        // An entire empty buffer is returned for bad requests.
-        #ifdef TPNG_REPORT_ERROR
-            printf("tPNG: WARNING: Request denied to read %d bytes, which is %d bytes past %p\n", size, (size + t->iter) - t->size, t->data); 
-        #endif
-        void * newError = TPNG_CALLOC(1, size);
-        void * newErrorArray = TPNG_MALLOC(sizeof(void*)*(t->nerrors+1));
-        if (t->nerrors) {
-            memcpy(newErrorArray, t->errors, sizeof(void*)*t->nerrors);
-            TPNG_FREE(t->errors);
-        }
-        t->errors = newErrorArray;
-        t->errors[t->nerrors] = newError;
-        t->nerrors++;
-        return newError;
-    } else {
-        return data;
-    }
-}
+    // Bytes per complete pixel.
+    int Bpp;
 
+    // The adam7 pass (0 if not interlaced), and its size.
+    int pass;
+    int passWidth;
+    int passHeight;
+    int passRowBytes;
 
-///////////////
+    // The next row within the pass.
+    int row;
 
+    // Unfiltered previous and current rows, and the current 
+    // one as RGBA. Sized for the widest pass.
+    uint8_t * prevRow;
+    uint8_t * thisRow;
+    uint8_t * rowExpanded;
+
+    // Room to expand a row from a byte boundary.
+    uint8_t * spare;
+
+    // The part of the image decoded: columns [firstColumn, endColumn) 
+    // of rows [firstRow, endRow), which is all image.rgba holds. 
+    // Unless region is set, this becomes the whole image.
+    int region;
+    uint32_t firstColumn;
+    uint32_t endColumn;
+    uint32_t firstRow;
+    uint32_t endRow;
+
+    // The rows and columns of the pass inside the region.
+    int passFirstRow;
+    int passEndRow;
+    int passFirstColumn;
+    int passEndColumn;
+
+    // The size of image.rgba: the region, after downscaling.
+    uint32_t outW;
+    uint32_t outH;
+
+    // log2 of image.downscale.
+    int shift;
+
+    // The size of the image that each decoded pixel stands 
+    // for, which is only more than 1 when previewing passes.
+    int blockW;
+    int blockH;
+
+    // When downscaling, sums of the pixels of each channel for 
+    // accumulatorRows rows of image.rgba, which wrap around.
+    uint16_t * accumulator;
+    uint32_t accumulatorRows;
+
+    // When resampling, how each axis of the region maps to image.rgba.
+    tpng_resample_axis_t resampleX;
+    tpng_resample_axis_t resampleY;
+
+    // When resampling, a row of the region already resampled 
+    // across, and weighted sums for resampleRows rows of 
+    // image.rgba, which wrap around. Rows before flushedRows 
+    // are finished.
+    float * resampleRow;
+    float * resampleSums;
+    uint32_t resampleRows;
+    uint32_t flushedRows;
+
+    // Whether the region needs resampling: resampleW by resampleH 
+    // isn't already its size.
+    int resample;
+
+    // Whether 16-bit images are kept at 16 bits a channel in 
+    // rowExpanded and image.rgba, for formats that can hold 
+    // them. pixelBytes is then 8, not 4.
+    int wide;
+    int pixelBytes;
+
+    // Where pixels go if image.format isn't RGBA8. image.rgba is 
+    // then only used to put interlaced images together. Made by 
+    // the decoder, unless image.output was given.
+    uint8_t * output;
+
+    // The number of channels of output, and the bytes of each.
+    // Only float formats can have planes.
+    int outputChannels;
+    int outputChannelBytes;
+
+    // For float formats, the value of each channel for each 
+    // 8-bit sample, as a float and as a half float.
+    float floatTable[4*256];
+    uint16_t halfTable[4*256];
+
+    // For linear float formats of wide images, the linear 
+    // value of each 16-bit sample.
+    float * linearTable;
+
+    // For TPNG_FORMAT_NATIVE, the bytes from one row of 
+    // output to the next.
+    size_t nativeStride;
+
+    // With mipmaps, where each level of output is.
+    tpng_mip_chain_t mips;
+
+    // For tiled layouts, the last tileSize rows of output, 
+    // until they're made into a row of tiles. If oriented, 
+    // where rows are converted before they're written.
+    uint8_t * strip;
+
+    // How the output is flipped or rotated: one of 
+    // TPNG_ORIENT_*, but never TPNG_ORIENT_EXIF.
+    int orientation;
+
+    // For block formats, the last 4 rows of RGBA, 
+    // until they're made into a row of blocks.
+    uint8_t * blockRows;
+
+    // For error diffusion, the error carried to this row and 
+    // the next, 16 times over, with a pixel of room each side.
+    int * ditherError;
+
+    // If not NULL, the index to start the rows from.
+    const uint8_t * resumeIndex;
+    uint32_t resumeIndexSize;
+
+    // If not 0, the index being built gets a checkpoint 
+    // every this many rows.
+    uint32_t checkpointRows;
+    uint32_t nextCheckpoint;
+
+    // The index being built.
+    uint8_t * index;
+    size_t indexSize;
+    size_t indexCapacity;
+};
 
 
 
 
+// checkpoint index
+///////////////
 
+// An index starts with this header, followed by its 
+// checkpoints. Every field is in the byte order of the 
+// machine that built it.
+typedef struct {
+    // TPNG_INDEX_MAGIC
+    char magic[8];
 
+    // The size of a saved inflate state. Differs 
+    // between builds and platforms.
+    uint32_t stateSize;
 
-/////////////////////
-/////// BEGIN TINFL 
-///
-/**************************************************************************
- *
- * Copyright 2013-2014 RAD Game Tools and Valve Software
- * Copyright 2010-2014 Rich Geldreich and Tenacious Software LLC
- * All Rights Reserved.
- *
- * Permission is hereby granted, free of charge, to any person obtaining a copy
- * of this software and associated documentation files (the "Software"), to deal
- * in the Software without restriction, including without limitation the rights
- * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
- * copies of the Software, and to permit persons to whom the Software is
- * furnished to do so, subject to the following conditions:
- *
- * The above copyright notice and this permission notice shall be included in
- * all copies or substantial portions of the Software.
- *
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
- * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
- * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
- * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
- * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
- * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
- * THE SOFTWARE.
- *
- **************************************************************************/
+    // The size of the PNG file, and the CRC of its IHDR chunk.
+    uint32_t fileSize;
+    uint32_t fileCrc;
 
+    // Bytes per unfiltered row.
+    uint32_t rowBytes;
 
+    // The number of checkpoints.
+    uint32_t count;
+} tpng_index_header_t;
 
-/* Decompression flags used by tinfl_decompress(). */
-/* TINFL_FLAG_PARSE_ZLIB_HEADER: If set, the input has a valid zlib header and ends with an adler32 checksum (it's a valid zlib stream). Otherwise, the input is a raw deflate stream. */
-/* TINFL_FLAG_HAS_MORE_INPUT: If set, there are more input bytes available beyond the end of the supplied input buffer. If clear, the input buffer contains all remaining input. */
-/* TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF: If set, the output buffer is large enough to hold the entire decompressed stream. If clear, the output buffer is at least the size of the dictionary (typically 32KB). */
-/* TINFL_FLAG_COMPUTE_ADLER32: Force adler-32 checksum computation of the decompressed bytes. */
-enum
-{
-    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
-    TINFL_FLAG_HAS_MORE_INPUT = 2,
-    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
-    TINFL_FLAG_COMPUTE_ADLER32 = 8
-};
+// Each checkpoint is this, followed by the saved inflate 
+// state, the window, then the unfiltered row before row.
+typedef struct {
+    // The row inflated from here.
+    uint32_t row;
 
+    // Which IDAT chunk, and where in it, inflating resumes.
+    uint32_t span;
+    uint32_t spanOffset;
 
+    // The bytes of inflated data saved from before the row.
+    uint32_t windowLength;
 
+    // The CRC of the fields above, the state, the window 
+    // and the row, so a damaged checkpoint isn't resumed.
+    uint32_t crc;
+} tpng_checkpoint_t;
 
+#define TPNG_INDEX_MAGIC "tPNGidx2"
 
-struct tinfl_decompressor_tag;
-typedef struct tinfl_decompressor_tag tinfl_decompressor;
+// Inflate never looks further back than this.
+#define TPNG_INDEX_WINDOW 32768
 
 
+// Returns the fileCrc of an index: the CRC of the IHDR chunk.
+static uint32_t tpng_index_get_file_crc(const uint8_t * rawData, uint32_t rawSize) {
+    if (rawSize < 33) return 0;
+    return tpng_crc32(0, rawData+12, 17);
+}
 
 
+// Appends bytes to the index being built.
+static void tpng_decoder_index_write(tpng_decoder_t * decoder, const void * data, size_t size) {
+    if (decoder->indexSize + size > decoder->indexCapacity) {
+        size_t capacity = decoder->indexCapacity ? decoder->indexCapacity*2 : 65536;
+        while(capacity < decoder->indexSize + size) capacity *= 2;
+        uint8_t * index = TPNG_MALLOC(capacity);
+        if (decoder->indexSize)
+            memcpy(index, decoder->index, decoder->indexSize);
+        TPNG_FREE(decoder->index);
+        decoder->index = index;
+        decoder->indexCapacity = capacity;
+    }
+    memcpy(decoder->index + decoder->indexSize, data, size);
+    decoder->indexSize += size;
+}
 
-/* Max size of LZ dictionary. */
-#define TINFL_LZ_DICT_SIZE 32768
 
-/* Return status. */
-typedef enum {
-    /* This flags indicates the inflator needs 1 or more input bytes to make forward progress, but the caller is indicating that no more are available. The compressed data */
-    /* is probably corrupted. If you call the inflator again with more bytes it'll try to continue processing the input but this is a BAD sign (either the data is corrupted or you called it incorrectly). */
-    /* If you call it again with no input you'll just get TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS again. */
-    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+// Saves a checkpoint before the current row, which has 
+// none of its bytes inflated yet.
+static void tpng_decoder_index_checkpoint(tpng_decoder_t * decoder) {
+    tpng_checkpoint_t checkpoint;
+    tpng_index_header_t * header;
+    size_t windowLength = decoder->read < TPNG_INDEX_WINDOW ? decoder->read : TPNG_INDEX_WINDOW;
+    size_t stateSize = tinfl_stream_get_state_size();
+    uint8_t * state = TPNG_MALLOC(stateSize);
+    checkpoint.row = decoder->row;
+    checkpoint.windowLength = (uint32_t)windowLength;
+    tinfl_stream_save(decoder->stream, windowLength, state, &checkpoint.span, &checkpoint.spanOffset);
+    checkpoint.crc = tpng_crc32(0, (const uint8_t *)&checkpoint, offsetof(tpng_checkpoint_t, crc));
+    checkpoint.crc = tpng_crc32(checkpoint.crc, state, (uint32_t)stateSize);
+    checkpoint.crc = tpng_crc32(checkpoint.crc, decoder->inflated + decoder->read - windowLength, (uint32_t)windowLength);
+    checkpoint.crc = tpng_crc32(checkpoint.crc, decoder->prevRow, decoder->passRowBytes);
+
+    tpng_decoder_index_write(decoder, &checkpoint, sizeof(tpng_checkpoint_t));
+    tpng_decoder_index_write(decoder, state, stateSize);
+    tpng_decoder_index_write(decoder, decoder->inflated + decoder->read - windowLength, windowLength);
+    tpng_decoder_index_write(decoder, decoder->prevRow, decoder->passRowBytes);
+    TPNG_FREE(state);
+
+    header = (tpng_index_header_t *)decoder->index;
+    header->count++;
+}
 
-    /* This flag indicates that one or more of the input parameters was obviously bogus. (You can try calling it again, but if you get this error the calling code is wrong.) */
-    TINFL_STATUS_BAD_PARAM = -3,
 
-    /* This flags indicate the inflator is finished but the adler32 check of the uncompressed data didn't match. If you call it again it'll return TINFL_STATUS_DONE. */
-    TINFL_STATUS_ADLER32_MISMATCH = -2,
+// Finds the last checkpoint of the index at or before 
+// row. Returns NULL if there's none, if the index 
+// doesn't belong to the image, or if the checkpoint's 
+// CRC doesn't match.
+static const tpng_checkpoint_t * tpng_index_find(
+    const uint8_t * index, 
+    uint32_t indexSize, 
+    uint32_t rowBytes, 
+    uint32_t fileSize, 
+    uint32_t fileCrc, 
+    uint32_t row
+) {
+    const tpng_checkpoint_t * found = NULL;
+    tpng_index_header_t header;
+    size_t stateSize = tinfl_stream_get_state_size();
+    size_t offset = sizeof(tpng_index_header_t);
+    uint32_t i;
+    if (!index || indexSize < sizeof(tpng_index_header_t)) return NULL;
+    memcpy(&header, index, sizeof(tpng_index_header_t));
+    if (memcmp(header.magic, TPNG_INDEX_MAGIC, 8) || 
+        header.stateSize != stateSize ||
+        header.fileSize != fileSize ||
+        header.fileCrc != fileCrc ||
+        header.rowBytes != rowBytes) 
+        return NULL;
+
+    // checkpoints are in row order, and are read in place.
+    for(i = 0; i < header.count; ++i) {
+        tpng_checkpoint_t checkpoint;
+        size_t size;
+        if (offset + sizeof(tpng_checkpoint_t) > indexSize) return NULL;
+        memcpy(&checkpoint, index + offset, sizeof(tpng_checkpoint_t));
+        size = sizeof(tpng_checkpoint_t) + stateSize + (size_t)checkpoint.windowLength + rowBytes;
+        if (checkpoint.windowLength > TPNG_INDEX_WINDOW || offset + size > indexSize) return NULL;
+        if (checkpoint.row > row) break;
+        found = (const tpng_checkpoint_t *)(index + offset);
+        offset += size;
+    }
 
-    /* This flags indicate the inflator has somehow failed (bad code, corrupted input, etc.). If you call it again without resetting via tinfl_init() it it'll just keep on returning the same status failure code. */
-    TINFL_STATUS_FAILED = -1,
+    if (found) {
+        tpng_checkpoint_t checkpoint;
+        uint32_t crc;
+        memcpy(&checkpoint, found, sizeof(tpng_checkpoint_t));
+        crc = tpng_crc32(0, (const uint8_t *)&checkpoint, offsetof(tpng_checkpoint_t, crc));
+        crc = tpng_crc32(crc, (const uint8_t *)(found+1), (uint32_t)(stateSize + checkpoint.windowLength + rowBytes));
+        if (crc != checkpoint.crc) return NULL;
+    }
+    return found;
+}
 
-    /* Any status code less than TINFL_STATUS_DONE must indicate a failure. */
 
-    /* This flag indicates the inflator has returned every byte of uncompressed data that it can, has consumed every byte that it needed, has successfully reached the end of the deflate stream, and */
-    /* if zlib headers and adler32 checking enabled that it has successfully checked the uncompressed data's adler32. If you call it again you'll just get TINFL_STATUS_DONE over and over again. */
-    TINFL_STATUS_DONE = 0,
+// Returns the bytes from one row of TPNG_FORMAT_NATIVE to the next.
+static size_t tpng_image_get_native_stride(const tpng_image_t * image) {
+    size_t rowBytes = tpng_get_bytes_per_row((tpng_image_t *)image, image->w);
+    return (rowBytes + image->rowAlignment - 1) / image->rowAlignment * image->rowAlignment;
+}
 
-    /* This flag indicates the inflator MUST have more input data (even 1 byte) before it can make any more forward progress, or you need to clear the TINFL_FLAG_HAS_MORE_INPUT */
-    /* flag on the next call if you don't have any more source data. If the source data was somehow corrupted it's also possible (but unlikely) for the inflator to keep on demanding input to */
-    /* proceed, so be sure to properly set the TINFL_FLAG_HAS_MORE_INPUT flag. */
-    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
 
-    /* This flag indicates the inflator definitely has 1 or more bytes of uncompressed data available, but it cannot write this data into the output buffer. */
-    /* Note if the source compressed data was corrupted it's possible for the inflator to return a lot of uncompressed data to the caller. I've been assuming you know how much uncompressed data to expect */
-    /* (either exact or worst case) and will stop calling the inflator and fail after receiving too much. In pure streaming scenarios where you have no idea how many bytes to expect this may not be possible */
-    /* so I may need to add some code to address this. */
-    TINFL_STATUS_HAS_MORE_OUTPUT = 2
-} tinfl_status;
+// Returns the number of bytes of image.rgba.
+static size_t tpng_decoder_get_rgba_size(const tpng_decoder_t * decoder) {
+    return (size_t)decoder->pixelBytes*decoder->outW*decoder->outH;
+}
 
-/* Initializes the decompressor to its initial state. */
-#define tinfl_init(r)     \
-    do                    \
-    {                     \
-        (r)->m_state = 0; \
-    }                     \
-    while(0)
-#define tinfl_get_adler32(r) (r)->m_check_adler32
 
-/* Main low-level decompressor coroutine function. This is the only function actually needed for decompression. All the other functions are just high-level helpers for improved usability. */
-/* This is a universal API, i.e. it can be used as a building block to build any desired higher level decompression API. In the limit case, it can be called once per every byte input or output. */
-static tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size, uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size, const uint32_t decomp_flags);
+// Returns the number of bytes of output.
+static size_t tpng_decoder_get_output_size(const tpng_decoder_t * decoder) {
+    if (decoder->image.format == TPNG_FORMAT_NATIVE) 
+        return decoder->nativeStride*decoder->outH;
+    if (decoder->image.mipmaps) 
+        return decoder->mips.size;
+    if (decoder->strip && !decoder->orientation) {
+        size_t tileSize = decoder->image.tileSize;
+        return ((decoder->outW + tileSize-1) / tileSize)*((decoder->outH + tileSize-1) / tileSize)*
+            tileSize*tileSize*decoder->outputChannels*decoder->outputChannelBytes;
+    }
+    if (decoder->image.format == TPNG_FORMAT_BC1 || decoder->image.format == TPNG_FORMAT_BC3) 
+        return (size_t)((decoder->outW+3)/4)*((decoder->outH+3)/4)*(decoder->image.format == TPNG_FORMAT_BC1 ? 8 : 16);
+    return (size_t)decoder->outputChannels*decoder->outputChannelBytes*decoder->outW*decoder->outH;
+}
 
-/* Internal/private bits follow. */
-enum
-{
-    TINFL_MAX_HUFF_TABLES = 3,
-    TINFL_MAX_HUFF_SYMBOLS_0 = 288,
-    TINFL_MAX_HUFF_SYMBOLS_1 = 32,
-    TINFL_MAX_HUFF_SYMBOLS_2 = 19,
-    TINFL_FAST_LOOKUP_BITS = 10,
-    TINFL_FAST_LOOKUP_SIZE = 1 << TINFL_FAST_LOOKUP_BITS
-};
 
-typedef struct
-{
-    uint8_t m_code_size[TINFL_MAX_HUFF_SYMBOLS_0];
-    int16_t m_look_up[TINFL_FAST_LOOKUP_SIZE], m_tree[TINFL_MAX_HUFF_SYMBOLS_0 * 2];
-} tinfl_huff_table;
+// Allocates zeroed memory for the decode, counted 
+// toward the decoder's working size.
+static void * tpng_decoder_calloc(tpng_decoder_t * decoder, size_t count, size_t size) {
+    void * bytes = TPNG_CALLOC(count, size);
+    if (bytes) decoder->workingSize += count*size;
+    return bytes;
+}
 
-#define TINFL_USE_64BIT_BITBUF 0
 
-#if TINFL_USE_64BIT_BITBUF
-typedef uint64_t tinfl_bit_buf_t;
-#define TINFL_BITBUF_SIZE (64)
-#else
-typedef uint32_t tinfl_bit_buf_t;
-#define TINFL_BITBUF_SIZE (32)
-#endif
+// Returns the IEEE half float nearest to the float.
+static uint16_t tpng_float_to_half(float value) {
+    union { float f; uint32_t u; } bits;
+    uint32_t sign, mantissa, half, rest, halfway;
+    int exponent, shift;
+    bits.f = value;
+    sign = (bits.u >> 16) & 0x8000;
+    exponent = (int)((bits.u >> 23) & 0xff);
+    mantissa = bits.u & 0x7fffff;
+
+    // infinity and NaN
+    if (exponent == 0xff) 
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    exponent = exponent - 127 + 15;
+    if (exponent >= 31) 
+        return sign | 0x7c00;
+
+    if (exponent <= 0) {
+        // too small for a normal half: subnormal, or 0
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+    } else {
+        mantissa |= (uint32_t)exponent << 23;
+        shift = 13;
+    }
 
-struct tinfl_decompressor_tag
-{
-    uint32_t m_state, m_num_bits, m_zhdr0, m_zhdr1, m_z_adler32, m_final, m_type, m_check_adler32, m_dist, m_counter, m_num_extra, m_table_sizes[TINFL_MAX_HUFF_TABLES];
-    tinfl_bit_buf_t m_bit_buf;
-    size_t m_dist_from_out_buf_start;
-    tinfl_huff_table m_tables[TINFL_MAX_HUFF_TABLES];
-    uint8_t m_raw_header[4], m_len_codes[TINFL_MAX_HUFF_SYMBOLS_0 + TINFL_MAX_HUFF_SYMBOLS_1 + 137];
-};
+    // rounded to nearest, ties to even. Rounding up 
+    // can carry into the exponent, which is still right.
+    half = mantissa >> shift;
+    rest = mantissa & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) half++;
+    return sign | half;
+}
 
 
+// Writes row oy of output from a row of RGBA, for the 
+// 16-bit packed formats, dithering color if asked to.
+static void tpng_decoder_store_row_dithered(tpng_decoder_t * decoder, uint32_t oy, const uint8_t * row) {
+    // the bits of red, green, blue and alpha
+    static const int formatBits[3][4] = {{5, 6, 5, 0}, {4, 4, 4, 4}, {5, 5, 5, 1}};
+    static const int bayer[4][4] = {
+        { 0,  8,  2, 10},
+        {12,  4, 14,  6},
+        { 3, 11,  1,  9},
+        {15,  7, 13,  5}
+    };
+    const int * bits = formatBits[decoder->image.format - TPNG_FORMAT_RGB565];
+    uint16_t * out = (uint16_t *)decoder->output + (size_t)oy*decoder->outW;
+    size_t stride = ((size_t)decoder->outW+2)*4;
+    int * thisError = NULL;
+    int * nextError = NULL;
+    const uint8_t * in = row;
+    int shift, value, error, max, q;
+    uint32_t x;
+    int c;
+    if (decoder->ditherError) {
+        thisError = decoder->ditherError + (oy & 1)*stride;
+        nextError = decoder->ditherError + ((oy+1) & 1)*stride;
+        memset(nextError, 0, sizeof(int)*stride);
+    }
 
+    for(x = 0; x < decoder->outW; ++x, in += 4, ++out) {
+        uint16_t pixel = 0;
+        shift = 16;
+        for(c = 0; c < 3; ++c) {
+            max = (1 << bits[c]) - 1;
+            shift -= bits[c];
+            switch(decoder->image.dither) {
+              case TPNG_DITHER_ORDERED:
+                q = (in[c]*max*32 + (2*bayer[oy & 3][x & 3] + 1)*255) / (255*32);
+                break;
+
+              // the quantized value's error is spread 7/16 to the 
+              // right, and 3/16, 5/16 and 1/16 below
+              case TPNG_DITHER_DIFFUSION:
+                value = in[c] + thisError[(x+1)*4+c] / 16;
+                if (value < 0) value = 0;
+                if (value > 255) value = 255;
+                q = (value*max + 127) / 255;
+                error = value - (q*255 + max/2) / max;
+                thisError[(x+2)*4+c] += error*7;
+                nextError[ x   *4+c] += error*3;
+                nextError[(x+1)*4+c] += error*5;
+                nextError[(x+2)*4+c] += error;
+                break;
+
+              default:
+                q = (in[c]*max + 127) / 255;
+            }
+            pixel |= q << shift;
+        }
+        if (bits[3]) {
+            max = (1 << bits[3]) - 1;
+            pixel |= (in[3]*max + 127) / 255;
+        }
+        *out = pixel;
+    }
+}
 
 
+// Returns the 5:6:5 color nearest to 8-bit RGB.
+static uint16_t tpng_bc_pack_565(int r, int g, int b) {
+    return (uint16_t)((((r*31 + 127) / 255) << 11) | (((g*63 + 127) / 255) << 5) | ((b*31 + 127) / 255));
+}
 
 
+// Expands a 5:6:5 color back to 8-bit RGB.
+static void tpng_bc_unpack_565(uint16_t color, int * rgb) {
+    rgb[0] = ((color >> 11) & 31)*255 / 31;
+    rgb[1] = ((color >> 5) & 63)*255 / 63;
+    rgb[2] = (color & 31)*255 / 31;
+}
 
 
-// topaz addition: import of macros from miniz
-#define TINFL_MIN(a, b) (((a) < (b)) ? (a) : (b))
-#define TINFL_MAX(a, b) (((a) > (b)) ? (a) : (b))
-#define TINFL_CLEAR_OBJ(obj) memset(&(obj), 0, sizeof(obj))
-#define TINFL_READ_LE16(p) ((uint32_t)(((const uint8_t *)(p))[0]) | ((uint32_t)(((const uint8_t *)(p))[1]) << 8U))
-#define TINFL_READ_LE32(p) ((uint32_t)(((const uint8_t *)(p))[0]) | ((uint32_t)(((const uint8_t *)(p))[1]) << 8U) | ((uint32_t)(((const uint8_t *)(p))[2]) << 16U) | ((uint32_t)(((const uint8_t *)(p))[3]) << 24U))
-#define TINFL_READ_LE64(p) (((uint64_t)TINFL_READ_LE32(p)) | (((uint64_t)TINFL_READ_LE32((const uint8_t *)(p) + sizeof(uint32_t))) << 32U))
+// Encodes the color of a 4x4 block of RGBA as 8 bytes of BC1, 
+// always in its 4-color mode. The endpoints are the corners 
+// of the colors' bounding box, inset a little and flipped 
+// to the diagonal the colors lie along, as fast encoders do.
+static void tpng_bc_encode_color(const uint8_t * block, uint8_t * out) {
+    int low[3] = {255, 255, 255};
+    int high[3] = {0, 0, 0};
+    int center[3];
+    int palette[4][3];
+    int covariance[3] = {0, 0, 0};
+    uint16_t color0, color1;
+    uint32_t indices = 0;
+    int i, c, j;
+    for(i = 0; i < 16; ++i) {
+        for(c = 0; c < 3; ++c) {
+            if (block[i*4+c] < low[c]) low[c] = block[i*4+c];
+            if (block[i*4+c] > high[c]) high[c] = block[i*4+c];
+        }
+    }
 
+    // which way red and blue go as green goes up
+    for(c = 0; c < 3; ++c) 
+        center[c] = (low[c] + high[c]) / 2;
+    for(i = 0; i < 16; ++i) {
+        int green = block[i*4+1] - center[1];
+        covariance[0] += (block[i*4  ] - center[0])*green;
+        covariance[2] += (block[i*4+2] - center[2])*green;
+    }
+    for(c = 0; c < 3; ++c) {
+        int inset = (high[c] - low[c]) / 16;
+        low[c] += inset;
+        high[c] -= inset;
+    }
+    for(c = 0; c < 3; c += 2) {
+        if (covariance[c] < 0) {
+            int swap = low[c];
+            low[c] = high[c];
+            high[c] = swap;
+        }
+    }
 
+    color0 = tpng_bc_pack_565(high[0], high[1], high[2]);
+    color1 = tpng_bc_pack_565(low[0], low[1], low[2]);
+    if (color0 < color1) {
+        uint16_t swap = color0;
+        color0 = color1;
+        color1 = swap;
+    }
+    if (color0 != color1) {
+        tpng_bc_unpack_565(color0, palette[0]);
+        tpng_bc_unpack_565(color1, palette[1]);
+        for(c = 0; c < 3; ++c) {
+            palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+        }
+        for(i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestDistance = 0x7fffffff;
+            for(j = 0; j < 4; ++j) {
+                int distance = 0;
+                for(c = 0; c < 3; ++c) 
+                    distance += (block[i*4+c] - palette[j][c])*(block[i*4+c] - palette[j][c]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+            indices |= (uint32_t)best << (i*2);
+        }
+    }
 
+    out[0] = color0 & 0xff;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xff;
+    out[3] = color1 >> 8;
+    out[4] = indices & 0xff;
+    out[5] = (indices >> 8) & 0xff;
+    out[6] = (indices >> 16) & 0xff;
+    out[7] = indices >> 24;
+}
 
-/* ------------------- Low-level Decompression (completely independent from all compression API's) */
 
-#define TINFL_MEMCPY(d, s, l) memcpy(d, s, l)
-#define TINFL_MEMSET(p, c, l) memset(p, c, l)
-
-#define TINFL_CR_BEGIN  \
-    switch (r->m_state) \
-    {                   \
-        case 0:
-#define TINFL_CR_RETURN(state_index, result) \
-    do                                       \
-    {                                        \
-        status = result;                     \
-        r->m_state = state_index;            \
-        goto common_exit;                    \
-        case state_index:;                   \
-    }                                        \
-    while(0)
-#define TINFL_CR_RETURN_FOREVER(state_index, result) \
-    do                                               \
-    {                                                \
-        for (;;)                                     \
-        {                                            \
-            TINFL_CR_RETURN(state_index, result);    \
-        }                                            \
-    }                                                \
-    while(0)
-#define TINFL_CR_FINISH }
-
-#define TINFL_GET_BYTE(state_index, c)                                                                                                                           \
-    do                                                                                                                                                           \
-    {                                                                                                                                                            \
-        while (pIn_buf_cur >= pIn_buf_end)                                                                                                                       \
-        {                                                                                                                                                        \
-            TINFL_CR_RETURN(state_index, (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS); \
-        }                                                                                                                                                        \
-        c = *pIn_buf_cur++;                                                                                                                                      \
-    }                                                                                                                                                            \
-    while(0)
+// Encodes the alpha of a 4x4 block of RGBA as 8 bytes of BC3, 
+// in its 8-level mode between the lowest and highest alpha.
+static void tpng_bc_encode_alpha(const uint8_t * block, uint8_t * out) {
+    int low = 255;
+    int high = 0;
+    uint64_t indices = 0;
+    int i;
+    for(i = 0; i < 16; ++i) {
+        if (block[i*4+3] < low) low = block[i*4+3];
+        if (block[i*4+3] > high) high = block[i*4+3];
+    }
+    if (high != low) {
+        for(i = 0; i < 16; ++i) {
+            // the step from high toward low, where 0 is high 
+            // (index 0) and 7 is low (index 1)
+            int step = ((high - block[i*4+3])*14 + (high - low)) / ((high - low)*2);
+            uint64_t index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+            indices |= index << (i*3);
+        }
+    }
+    out[0] = high;
+    out[1] = low;
+    for(i = 0; i < 6; ++i) 
+        out[2+i] = (indices >> (i*8)) & 0xff;
+}
 
-#define TINFL_NEED_BITS(state_index, n)                \
-    do                                                 \
-    {                                                  \
-        uint32_t c;                                     \
-        TINFL_GET_BYTE(state_index, c);                \
-        bit_buf |= (((tinfl_bit_buf_t)c) << num_bits); \
-        num_bits += 8;                                 \
-    } while (num_bits < (uint32_t)(n))
-#define TINFL_SKIP_BITS(state_index, n)      \
-    do                                       \
-    {                                        \
-        if (num_bits < (uint32_t)(n))         \
-        {                                    \
-            TINFL_NEED_BITS(state_index, n); \
-        }                                    \
-        bit_buf >>= (n);                     \
-        num_bits -= (n);                     \
-    }                                        \
-    while(0)
-#define TINFL_GET_BITS(state_index, b, n)    \
-    do                                       \
-    {                                        \
-        if (num_bits < (uint32_t)(n))         \
-        {                                    \
-            TINFL_NEED_BITS(state_index, n); \
-        }                                    \
-        b = bit_buf & ((1 << (n)) - 1);      \
-        bit_buf >>= (n);                     \
-        num_bits -= (n);                     \
-    }                                        \
-    while(0)
 
-/* TINFL_HUFF_BITBUF_FILL() is only used rarely, when the number of bytes remaining in the input buffer falls below 2. */
-/* It reads just enough bytes from the input stream that are needed to decode the next Huffman code (and absolutely no more). It works by trying to fully decode a */
-/* Huffman code by using whatever bits are currently present in the bit buffer. If this fails, it reads another byte, and tries again until it succeeds or until the */
-/* bit buffer contains >=15 bits (deflate's max. Huffman code size). */
-#define TINFL_HUFF_BITBUF_FILL(state_index, pHuff)                             \
-    do                                                                         \
-    {                                                                          \
-        temp = (pHuff)->m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)];     \
-        if (temp >= 0)                                                         \
-        {                                                                      \
-            code_len = temp >> 9;                                              \
-            if ((code_len) && (num_bits >= code_len))                          \
-                break;                                                         \
-        }                                                                      \
-        else if (num_bits > TINFL_FAST_LOOKUP_BITS)                            \
-        {                                                                      \
-            code_len = TINFL_FAST_LOOKUP_BITS;                                 \
-            do                                                                 \
-            {                                                                  \
-                temp = (pHuff)->m_tree[~temp + ((bit_buf >> code_len++) & 1)]; \
-            } while ((temp < 0) && (num_bits >= (code_len + 1)));              \
-            if (temp >= 0)                                                     \
-                break;                                                         \
-        }                                                                      \
-        TINFL_GET_BYTE(state_index, c);                                        \
-        bit_buf |= (((tinfl_bit_buf_t)c) << num_bits);                         \
-        num_bits += 8;                                                         \
-    } while (num_bits < 15);
+// Keeps row oy of RGBA, then once 4 rows are kept (or the 
+// image ends), writes them to output as a row of blocks.
+static void tpng_decoder_store_row_blocks(tpng_decoder_t * decoder, uint32_t oy, const uint8_t * row) {
+    int blockBytes = decoder->image.format == TPNG_FORMAT_BC1 ? 8 : 16;
+    size_t rowSize = (size_t)decoder->outW*4;
+    uint8_t block[64];
+    uint8_t * out;
+    uint32_t bx, x;
+    int i, j, rows;
+    memcpy(decoder->blockRows + (oy & 3)*rowSize, row, rowSize);
+    if ((oy & 3) != 3 && oy+1 != decoder->outH) return;
+
+    rows = (oy & 3) + 1;
+    out = decoder->output + (size_t)(oy / 4)*((decoder->outW+3)/4)*blockBytes;
+    for(bx = 0; bx < decoder->outW; bx += 4, out += blockBytes) {
+        // edges repeat the last row and column
+        for(j = 0; j < 4; ++j) {
+            const uint8_t * blockRow = decoder->blockRows + (j < rows ? j : rows-1)*rowSize;
+            for(i = 0; i < 4; ++i) {
+                x = bx + i < decoder->outW ? bx + i : decoder->outW-1;
+                memcpy(block + (j*4+i)*4, blockRow + x*4, 4);
+            }
+        }
+        if (blockBytes == 16) {
+            tpng_bc_encode_alpha(block, out);
+            tpng_bc_encode_color(block, out + 8);
+        } else {
+            tpng_bc_encode_color(block, out);
+        }
+    }
+}
 
-/* TINFL_HUFF_DECODE() decodes the next Huffman coded symbol. It's more complex than you would initially expect because the zlib API expects the decompressor to never read */
-/* beyond the final byte of the deflate stream. (In other words, when this macro wants to read another byte from the input, it REALLY needs another byte in order to fully */
-/* decode the next Huffman code.) Handling this properly is particularly important on raw deflate (non-zlib) streams, which aren't followed by a byte aligned adler-32. */
-/* The slow path is only executed at the very end of the input buffer. */
-/* v1.16: The original macro handled the case at the very end of the passed-in input buffer, but we also need to handle the case where the user passes in 1+zillion bytes */
-/* following the deflate data and our non-conservative read-ahead path won't kick in here on this code. This is much trickier. */
-#define TINFL_HUFF_DECODE(state_index, sym, pHuff)                                                                                  \
-    do                                                                                                                              \
-    {                                                                                                                               \
-        int temp;                                                                                                                   \
-        uint32_t code_len, c;                                                                                                        \
-        if (num_bits < 15)                                                                                                          \
-        {                                                                                                                           \
-            if ((pIn_buf_end - pIn_buf_cur) < 2)                                                                                    \
-            {                                                                                                                       \
-                TINFL_HUFF_BITBUF_FILL(state_index, pHuff);                                                                         \
-            }                                                                                                                       \
-            else                                                                                                                    \
-            {                                                                                                                       \
-                bit_buf |= (((tinfl_bit_buf_t)pIn_buf_cur[0]) << num_bits) | (((tinfl_bit_buf_t)pIn_buf_cur[1]) << (num_bits + 8)); \
-                pIn_buf_cur += 2;                                                                                                   \
-                num_bits += 16;                                                                                                     \
-            }                                                                                                                       \
-        }                                                                                                                           \
-        if ((temp = (pHuff)->m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)]) >= 0)                                               \
-            code_len = temp >> 9, temp &= 511;                                                                                      \
-        else                                                                                                                        \
-        {                                                                                                                           \
-            code_len = TINFL_FAST_LOOKUP_BITS;                                                                                      \
-            do                                                                                                                      \
-            {                                                                                                                       \
-                temp = (pHuff)->m_tree[~temp + ((bit_buf >> code_len++) & 1)];                                                      \
-            } while (temp < 0);                                                                                                     \
-        }                                                                                                                           \
-        sym = temp;                                                                                                                 \
-        bit_buf >>= code_len;                                                                                                       \
-        num_bits -= code_len;                                                                                                       \
-    }                                                                                                                               \
-    while(0)
 
-tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size, uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size, const uint32_t decomp_flags)
-{
-    static const int s_length_base[31] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0 };
-    static const int s_length_extra[31] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 0, 0 };
-    static const int s_dist_base[32] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 0, 0 };
-    static const int s_dist_extra[32] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
-    static const uint8_t s_length_dezigzag[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
-    static const int s_min_table_sizes[3] = { 257, 1, 4 };
+// Writes row oy of the image to the first level of the mip 
+// chain. Each time that finishes a pair of rows of a level, 
+// the row of the next level they make is written from them.
+static void tpng_decoder_store_row_mips(tpng_decoder_t * decoder, uint32_t oy, const uint8_t * row) {
+    const tpng_mip_chain_t * mips = &decoder->mips;
+    uint32_t level, x, y;
+    int c;
+    memcpy(decoder->output + (size_t)oy*decoder->outW*4, row, (size_t)decoder->outW*4);
+
+    y = oy;
+    for(level = 0; level+1 < mips->levels; ++level) {
+        uint32_t w = mips->w[level];
+        const uint8_t * bottom = decoder->output + mips->offset[level] + (size_t)y*w*4;
+        const uint8_t * top = bottom;
+        uint8_t * out;
+
+        // a level 1 pixel tall pairs its row with itself
+        if (mips->h[level] > 1) {
+            if (!(y & 1)) break;
+            top = bottom - (size_t)w*4;
+        }
+        y /= 2;
+        out = decoder->output + mips->offset[level+1] + (size_t)y*mips->w[level+1]*4;
+        for(x = 0; x < mips->w[level+1]; ++x) {
+            uint32_t x0 = x*2;
+            uint32_t x1 = x0+1 < w ? x0+1 : x0;
+            for(c = 0; c < 4; ++c) {
+                out[x*4+c] = (top[x0*4+c] + top[x1*4+c] + bottom[x0*4+c] + bottom[x1*4+c] + 2) >> 2;
+            }
+        }
+    }
+}
 
-    tinfl_status status = TINFL_STATUS_FAILED;
-    uint32_t num_bits, dist, counter, num_extra;
-    tinfl_bit_buf_t bit_buf;
-    const uint8_t *pIn_buf_cur = pIn_buf_next, *const pIn_buf_end = pIn_buf_next + *pIn_buf_size;
-    uint8_t *pOut_buf_cur = pOut_buf_next, *const pOut_buf_end = pOut_buf_next + *pOut_buf_size;
-    size_t out_buf_size_mask = (decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF) ? (size_t)-1 : ((pOut_buf_next - pOut_buf_start) + *pOut_buf_size) - 1, dist_from_out_buf_start;
 
-    /* Ensure the output buffer's size is a power of 2, unless the output buffer is large enough to hold the entire output file (in which case it doesn't matter). */
-    if (((out_buf_size_mask + 1) & out_buf_size_mask) || (pOut_buf_next < pOut_buf_start))
-    {
-        *pIn_buf_size = *pOut_buf_size = 0;
-        return TINFL_STATUS_BAD_PARAM;
+// Writes row oy of output from a row of RGBA, for formats 
+// with the channels of each pixel together.
+static void tpng_decoder_store_row_packed(tpng_decoder_t * decoder, uint32_t oy, const uint8_t * row) {
+    uint8_t * out = decoder->output + (size_t)oy*decoder->outW*decoder->outputChannels*decoder->outputChannelBytes;
+    switch(decoder->image.format) {
+      case TPNG_FORMAT_RGBA16:
+        if (decoder->wide) 
+            memcpy(out, row, (size_t)decoder->outW*8);
+        else 
+            tpng_convert_row(decoder->image.format, row, out, decoder->outW);
+        break;
+      case TPNG_FORMAT_BGRA8:
+      case TPNG_FORMAT_RGB8:
+      case TPNG_FORMAT_ARGB8:
+      case TPNG_FORMAT_GRAY8:
+      case TPNG_FORMAT_GRAY_ALPHA8:
+        tpng_convert_row(decoder->image.format, row, out, decoder->outW);
+        break;
+      case TPNG_FORMAT_RGB565:
+      case TPNG_FORMAT_RGBA4444:
+      case TPNG_FORMAT_RGBA5551:
+        tpng_decoder_store_row_dithered(decoder, oy, row);
+        break;
+      case TPNG_FORMAT_BC1:
+      case TPNG_FORMAT_BC3:
+        tpng_decoder_store_row_blocks(decoder, oy, row);
+        break;
+      case TPNG_FORMAT_RGBA8:
+        if (decoder->image.mipmaps)
+            tpng_decoder_store_row_mips(decoder, oy, row);
+        else
+            memcpy(out, row, (size_t)decoder->outW*4);
+        break;
+      default:;
     }
+}
 
-    num_bits = r->m_num_bits;
-    bit_buf = r->m_bit_buf;
-    dist = r->m_dist;
-    counter = r->m_counter;
-    num_extra = r->m_num_extra;
-    dist_from_out_buf_start = r->m_dist_from_out_buf_start;
-    TINFL_CR_BEGIN
 
-    bit_buf = num_bits = dist = counter = num_extra = r->m_zhdr0 = r->m_zhdr1 = 0;
-    r->m_z_adler32 = r->m_check_adler32 = 1;
-    if (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER)
-    {
-        TINFL_GET_BYTE(1, r->m_zhdr0);
-        TINFL_GET_BYTE(2, r->m_zhdr1);
-        counter = (((r->m_zhdr0 * 256 + r->m_zhdr1) % 31 != 0) || (r->m_zhdr1 & 32) || ((r->m_zhdr0 & 15) != 8));
-        if (!(decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF))
-            counter |= (((1U << (8U + (r->m_zhdr0 >> 4))) > 32768U) || ((out_buf_size_mask + 1) < (size_t)(1U << (8U + (r->m_zhdr0 >> 4)))));
-        if (counter)
-        {
-            TINFL_CR_RETURN_FOREVER(36, TINFL_STATUS_FAILED);
-        }
+// Writes row oy of output from a row of RGBA, which is 16 bits 
+// a channel if the decoder is wide, with rows one after another.
+static void tpng_decoder_store_row_linear(tpng_decoder_t * decoder, uint32_t oy, const uint8_t * row) {
+    const tpng_image_t * image = &decoder->image;
+    size_t channelStride, pixelStride, start;
+    uint32_t x;
+    int c;
+    if (image->format != TPNG_FORMAT_FLOAT32 && image->format != TPNG_FORMAT_FLOAT16) {
+        tpng_decoder_store_row_packed(decoder, oy, row);
+        return;
+    }
+    if (image->planar) {
+        channelStride = (size_t)decoder->outW*decoder->outH;
+        pixelStride = 1;
+        start = (size_t)oy*decoder->outW;
+    } else {
+        channelStride = 1;
+        pixelStride = decoder->outputChannels;
+        start = (size_t)oy*decoder->outW*decoder->outputChannels;
     }
 
-    do
-    {
-        TINFL_GET_BITS(3, r->m_final, 3);
-        r->m_type = r->m_final >> 1;
-        if (r->m_type == 0)
-        {
-            TINFL_SKIP_BITS(5, num_bits & 7);
-            for (counter = 0; counter < 4; ++counter)
-            {
-                if (num_bits)
-                    TINFL_GET_BITS(6, r->m_raw_header[counter], 8);
-                else
-                    TINFL_GET_BYTE(7, r->m_raw_header[counter]);
+    for(c = 0; c < decoder->outputChannels; ++c) {
+        if (decoder->wide && decoder->linearTable && c < 3) {
+            const uint16_t * in = (const uint16_t *)row + c;
+            const uint16_t * alpha = (const uint16_t *)row + 3;
+            float scale = image->scale[c];
+            float bias = image->bias[c];
+            if (image->premultiplyLinear) {
+                float * out = (float *)decoder->output + start + c*channelStride;
+                uint16_t * outHalf = (uint16_t *)decoder->output + start + c*channelStride;
+                for(x = 0; x < decoder->outW; ++x, out += pixelStride, outHalf += pixelStride, in += 4, alpha += 4) {
+                    float v = decoder->linearTable[*in]*(*alpha / 65535.0f)*scale + bias;
+                    if (image->format == TPNG_FORMAT_FLOAT32) 
+                        *out = v;
+                    else 
+                        *outHalf = tpng_float_to_half(v);
+                }
+            } else if (image->format == TPNG_FORMAT_FLOAT32) {
+                float * out = (float *)decoder->output + start + c*channelStride;
+                for(x = 0; x < decoder->outW; ++x, out += pixelStride, in += 4) 
+                    *out = decoder->linearTable[*in]*scale + bias;
+            } else {
+                uint16_t * out = (uint16_t *)decoder->output + start + c*channelStride;
+                for(x = 0; x < decoder->outW; ++x, out += pixelStride, in += 4) 
+                    *out = tpng_float_to_half(decoder->linearTable[*in]*scale + bias);
             }
-            if ((counter = (r->m_raw_header[0] | (r->m_raw_header[1] << 8))) != (uint32_t)(0xFFFF ^ (r->m_raw_header[2] | (r->m_raw_header[3] << 8))))
-            {
-                TINFL_CR_RETURN_FOREVER(39, TINFL_STATUS_FAILED);
+        } else if (decoder->wide) {
+            const uint16_t * in = (const uint16_t *)row + c;
+            float scale = image->scale[c] / 65535.0f;
+            float bias = image->bias[c];
+            if (image->format == TPNG_FORMAT_FLOAT32) {
+                float * out = (float *)decoder->output + start + c*channelStride;
+                for(x = 0; x < decoder->outW; ++x, out += pixelStride, in += 4) 
+                    *out = *in*scale + bias;
+            } else {
+                uint16_t * out = (uint16_t *)decoder->output + start + c*channelStride;
+                for(x = 0; x < decoder->outW; ++x, out += pixelStride, in += 4) 
+                    *out = tpng_float_to_half(*in*scale + bias);
             }
-            while ((counter) && (num_bits))
-            {
-                TINFL_GET_BITS(51, dist, 8);
-                while (pOut_buf_cur >= pOut_buf_end)
-                {
-                    TINFL_CR_RETURN(52, TINFL_STATUS_HAS_MORE_OUTPUT);
-                }
-                *pOut_buf_cur++ = (uint8_t)dist;
-                counter--;
+        } else if (image->premultiplyLinear && c < 3) {
+            // the table's linear color, then multiplied by alpha
+            const uint8_t * in = row + c;
+            const uint8_t * alpha = row + 3;
+            const float * table = decoder->floatTable + c*256;
+            float bias = image->bias[c];
+            float * out = (float *)decoder->output + start + c*channelStride;
+            uint16_t * outHalf = (uint16_t *)decoder->output + start + c*channelStride;
+            for(x = 0; x < decoder->outW; ++x, out += pixelStride, outHalf += pixelStride, in += 4, alpha += 4) {
+                float v = (table[*in] - bias)*(*alpha / 255.0f) + bias;
+                if (image->format == TPNG_FORMAT_FLOAT32) 
+                    *out = v;
+                else 
+                    *outHalf = tpng_float_to_half(v);
             }
-            while (counter)
-            {
-                size_t n;
-                while (pOut_buf_cur >= pOut_buf_end)
-                {
-                    TINFL_CR_RETURN(9, TINFL_STATUS_HAS_MORE_OUTPUT);
-                }
-                while (pIn_buf_cur >= pIn_buf_end)
-                {
-                    TINFL_CR_RETURN(38, (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS);
-                }
-                n = TINFL_MIN(TINFL_MIN((size_t)(pOut_buf_end - pOut_buf_cur), (size_t)(pIn_buf_end - pIn_buf_cur)), counter);
-                TINFL_MEMCPY(pOut_buf_cur, pIn_buf_cur, n);
-                pIn_buf_cur += n;
-                pOut_buf_cur += n;
-                counter -= (uint32_t)n;
+        } else {
+            const uint8_t * in = row + c;
+            if (image->format == TPNG_FORMAT_FLOAT32) {
+                const float * table = decoder->floatTable + c*256;
+                float * out = (float *)decoder->output + start + c*channelStride;
+                for(x = 0; x < decoder->outW; ++x, out += pixelStride, in += 4) 
+                    *out = table[*in];
+            } else {
+                const uint16_t * table = decoder->halfTable + c*256;
+                uint16_t * out = (uint16_t *)decoder->output + start + c*channelStride;
+                for(x = 0; x < decoder->outW; ++x, out += pixelStride, in += 4) 
+                    *out = table[*in];
             }
         }
-        else if (r->m_type == 3)
-        {
-            TINFL_CR_RETURN_FOREVER(10, TINFL_STATUS_FAILED);
+    }
+}
+
+
+// Returns v with a 0 bit put above each of its low 8 bits.
+static uint32_t tpng_morton_spread(uint32_t v) {
+    v = (v | (v << 4)) & 0x0f0f;
+    v = (v | (v << 2)) & 0x3333;
+    v = (v | (v << 1)) & 0x5555;
+    return v;
+}
+
+
+// Writes the rows of strip to output as row ty of tiles.
+static void tpng_decoder_store_tiles(tpng_decoder_t * decoder, uint32_t ty) {
+    uint32_t tileSize = decoder->image.tileSize;
+    uint32_t tilesAcross = (decoder->outW + tileSize-1) / tileSize;
+    size_t pixelSize = (size_t)decoder->outputChannels*decoder->outputChannelBytes;
+    uint32_t rows = decoder->outH - ty*tileSize < tileSize ? decoder->outH - ty*tileSize : tileSize;
+    uint8_t * out = decoder->output + (size_t)ty*tilesAcross*tileSize*tileSize*pixelSize;
+    uint32_t tx, x, y, columns;
+    for(tx = 0; tx < tilesAcross; ++tx, out += tileSize*tileSize*pixelSize) {
+        const uint8_t * in = decoder->strip + (size_t)tx*tileSize*pixelSize;
+        columns = decoder->outW - tx*tileSize < tileSize ? decoder->outW - tx*tileSize : tileSize;
+        switch(decoder->image.layout) {
+          case TPNG_LAYOUT_TILED:
+            for(y = 0; y < rows; ++y) 
+                memcpy(out + y*tileSize*pixelSize, in + y*decoder->outW*pixelSize, columns*pixelSize);
+            break;
+          case TPNG_LAYOUT_MORTON:
+            for(y = 0; y < rows; ++y) {
+                uint32_t spreadY = tpng_morton_spread(y) << 1;
+                for(x = 0; x < columns; ++x) 
+                    memcpy(out + (spreadY | tpng_morton_spread(x))*pixelSize, in + (y*decoder->outW + x)*pixelSize, pixelSize);
+            }
+            break;
+          default:;
         }
-        else
-        {
-            if (r->m_type == 1)
+    }
+}
+
+
+// Writes row oy of output, converted in the strip, to 
+// where the decoder's orientation puts it.
+static void tpng_decoder_store_row_oriented(tpng_decoder_t * decoder, uint32_t oy) {
+    size_t pixelSize = (size_t)decoder->outputChannels*decoder->outputChannelBytes;
+    const uint8_t * in = decoder->strip + (oy & 3)*decoder->outW*pixelSize;
+    uint32_t w = decoder->outW;
+    uint32_t h = decoder->outH;
+    uint32_t x0, y0, x;
+    int64_t stepX = 0, stepY = 0;
+    uint8_t * out;
+
+    // where the first pixel goes, which way the rest go, 
+    // and how wide the oriented output is
+    uint32_t outW = decoder->orientation >= TPNG_ORIENT_TRANSPOSE ? h : w;
+    switch(decoder->orientation) {
+      case TPNG_ORIENT_FLIP_X:      x0 = w-1;    y0 = oy;     stepX = -1; break;
+      case TPNG_ORIENT_ROTATE_180:  x0 = w-1;    y0 = h-1-oy; stepX = -1; break;
+      case TPNG_ORIENT_FLIP_Y:      x0 = 0;      y0 = h-1-oy; stepX =  1; break;
+      case TPNG_ORIENT_TRANSPOSE:   x0 = oy;     y0 = 0;      stepY =  1; break;
+      case TPNG_ORIENT_ROTATE_90:   x0 = h-1-oy; y0 = 0;      stepY =  1; break;
+      case TPNG_ORIENT_TRANSVERSE:  x0 = h-1-oy; y0 = w-1;    stepY = -1; break;
+      case TPNG_ORIENT_ROTATE_270:  x0 = oy;     y0 = w-1;    stepY = -1; break;
+      default:                      x0 = 0;      y0 = oy;     stepX =  1; break;
+    }
+    if (stepX == 1) {
+        memcpy(decoder->output + (size_t)y0*outW*pixelSize, in, w*pixelSize);
+        return;
+    }
+    for(x = 0; x < w; ++x, in += pixelSize) {
+        out = decoder->output + (size_t)((y0 + stepY*x)*outW + x0 + stepX*x)*pixelSize;
+        memcpy(out, in, pixelSize);
+    }
+}
+
+
+// Writes row oy of output from a row of RGBA, which is 16 bits 
+// a channel if the decoder is wide. For tiled layouts, the row 
+// is kept in the strip until a whole row of tiles can be written 
+// in order. Does nothing unless there's an output besides image.rgba.
+static void tpng_decoder_store_row(tpng_decoder_t * decoder, uint32_t oy, const uint8_t * row) {
+    uint8_t * output = decoder->output;
+    uint32_t tileSize = decoder->image.tileSize;
+    if (!output) return;
+    if (!decoder->strip) {
+        tpng_decoder_store_row_linear(decoder, oy, row);
+        return;
+    }
+    if (decoder->orientation) {
+        decoder->output = decoder->strip;
+        tpng_decoder_store_row_linear(decoder, oy & 3, row);
+        decoder->output = output;
+        tpng_decoder_store_row_oriented(decoder, oy);
+        return;
+    }
+
+    // tiles are a multiple of 4 rows, so dithering is 
+    // the same as if the row were oy
+    decoder->output = decoder->strip;
+    tpng_decoder_store_row_linear(decoder, oy % tileSize, row);
+    decoder->output = output;
+    if (oy % tileSize == tileSize-1 || oy+1 == decoder->outH) 
+        tpng_decoder_store_tiles(decoder, oy / tileSize);
+}
+
+
+// Returns base to the power of exponent, for base > 0, 
+// without needing the math library: e^(exponent * ln(base)).
+static double tpng_pow(double base, double exponent) {
+    double s, s2, term, ln, x, r, result;
+    int exponent2 = 0;
+    int i, k;
+    if (base <= 0) return 0;
+
+    // base = m * 2^exponent2, with m in [1, 2), and 
+    // ln(m) = 2 atanh((m-1)/(m+1))
+    while(base >= 2) { base /= 2; exponent2++; }
+    while(base < 1)  { base *= 2; exponent2--; }
+    s = (base - 1) / (base + 1);
+    s2 = s*s;
+    term = s;
+    ln = 0;
+    for(i = 1; i < 40; i += 2) {
+        ln += term / i;
+        term *= s2;
+    }
+    ln = 2*ln + exponent2*0.69314718055994530942;
+
+    // e^x = 2^k * e^r, with r small enough for the series
+    x = exponent*ln;
+    k = (int)(x / 0.69314718055994530942);
+    r = x - k*0.69314718055994530942;
+    result = 1;
+    term = 1;
+    for(i = 1; i < 30; ++i) {
+        term *= r / i;
+        result += term;
+    }
+    for(; k > 0; --k) result *= 2;
+    for(; k < 0; ++k) result /= 2;
+    return result;
+}
+
+
+// Returns the linear light of an encoded sample from 0 to 1: 
+// with the sRGB curve if the image is sRGB or says nothing, 
+// else undoing the gamma from gAMA.
+static float tpng_image_to_linear(const tpng_image_t * image, double value) {
+    if (image->srgbIntent >= 0 || image->gamma <= 0) {
+        if (value <= 0.04045) return (float)(value / 12.92);
+        return (float)tpng_pow((value + 0.055) / 1.055, 2.4);
+    }
+    return (float)tpng_pow(value, 1.0 / image->gamma);
+}
+
+
+// Sets up output for image.format, if it isn't RGBA8. 
+// Returns 0 if out of memory.
+static int tpng_decoder_start_output(tpng_decoder_t * decoder) {
+    tpng_image_t * image = &decoder->image;
+    int c, i;
+    switch(image->format) {
+      case TPNG_FORMAT_RGBA8: 
+        if (!image->mipmaps && !image->layout && !decoder->orientation) return 1;
+        decoder->outputChannels = 4;
+        decoder->outputChannelBytes = 1;
+        if (image->mipmaps)
+            tpng_get_mip_chain(decoder->outW, decoder->outH, &decoder->mips);
+        break;
+      case TPNG_FORMAT_FLOAT32:
+        decoder->outputChannels = image->dropAlpha ? 3 : 4;
+        decoder->outputChannelBytes = 4;
+        break;
+      case TPNG_FORMAT_FLOAT16:
+        decoder->outputChannels = image->dropAlpha ? 3 : 4;
+        decoder->outputChannelBytes = 2;
+        break;
+      case TPNG_FORMAT_RGB8:        decoder->outputChannels = 3; decoder->outputChannelBytes = 1; break;
+      case TPNG_FORMAT_GRAY8:       decoder->outputChannels = 1; decoder->outputChannelBytes = 1; break;
+      case TPNG_FORMAT_GRAY_ALPHA8: decoder->outputChannels = 2; decoder->outputChannelBytes = 1; break;
+      case TPNG_FORMAT_RGBA16:      decoder->outputChannels = 4; decoder->outputChannelBytes = 2; break;
+      case TPNG_FORMAT_NATIVE:
+        decoder->nativeStride = tpng_image_get_native_stride(image);
+        break;
+      case TPNG_FORMAT_BC1:
+      case TPNG_FORMAT_BC3:
+        decoder->blockRows = tpng_decoder_calloc(decoder, 16, decoder->outW);
+        if (!decoder->blockRows) return 0;
+        break;
+      case TPNG_FORMAT_RGB565:
+      case TPNG_FORMAT_RGBA4444:
+      case TPNG_FORMAT_RGBA5551:
+        decoder->outputChannels = 1;
+        decoder->outputChannelBytes = 2;
+        if (image->dither == TPNG_DITHER_DIFFUSION) {
+            decoder->ditherError = tpng_decoder_calloc(decoder, 2*((size_t)decoder->outW+2)*4, sizeof(int));
+            if (!decoder->ditherError) return 0;
+        }
+        break;
+      default:                      decoder->outputChannels = 4; decoder->outputChannelBytes = 1; break;
+    }
+    for(c = 0; c < 4; ++c) {
+        for(i = 0; i < 256; ++i) {
+            decoder->floatTable[c*256+i] = i*(image->scale[c] / 255.0f) + image->bias[c];
+            decoder->halfTable[c*256+i] = tpng_float_to_half(decoder->floatTable[c*256+i]);
+        }
+    }
+    if (image->linear && (image->format == TPNG_FORMAT_FLOAT32 || image->format == TPNG_FORMAT_FLOAT16)) {
+        // alpha is already linear
+        float linear[256];
+        for(i = 0; i < 256; ++i) 
+            linear[i] = tpng_image_to_linear(image, i / 255.0);
+        for(c = 0; c < 3; ++c) {
+            for(i = 0; i < 256; ++i) {
+                decoder->floatTable[c*256+i] = linear[i]*image->scale[c] + image->bias[c];
+                decoder->halfTable[c*256+i] = tpng_float_to_half(decoder->floatTable[c*256+i]);
+            }
+        }
+        if (decoder->wide) {
+            decoder->linearTable = tpng_decoder_calloc(decoder, sizeof(float), 65536);
+            if (!decoder->linearTable) return 0;
+            for(i = 0; i < 65536; ++i) 
+                decoder->linearTable[i] = tpng_image_to_linear(image, i / 65535.0);
+        }
+    }
+    if (image->layout && !image->mipmaps && !image->planar && 
+        image->format != TPNG_FORMAT_NATIVE && image->format != TPNG_FORMAT_BC1 && image->format != TPNG_FORMAT_BC3) {
+        // rows are kept until there's a row of tiles
+        decoder->strip = tpng_decoder_calloc(decoder, (size_t)decoder->outputChannels*decoder->outputChannelBytes*image->tileSize, decoder->outW);
+        if (!decoder->strip) return 0;
+    } else if (decoder->orientation) {
+        // rows are converted here, then written to where they go. 
+        // Dithering depends on the row mod 4, so 4 are kept.
+        decoder->strip = tpng_decoder_calloc(decoder, (size_t)decoder->outputChannels*decoder->outputChannelBytes*4, decoder->outW);
+        if (!decoder->strip) return 0;
+    }
+    decoder->output = image->output;
+    if (!decoder->output)
+        decoder->output = TPNG_CALLOC(1, tpng_decoder_get_output_size(decoder));
+    return decoder->output != NULL;
+}
+
+
+// Adds the pixel at (x, y) of the image, standing for a block 
+// of blockW by blockH pixels, to the output: either to 
+// image.rgba, or to the sums for the output pixels it's in.
+static void tpng_decoder_put_pixel(tpng_decoder_t * decoder, uint32_t x, uint32_t y, const uint8_t * pixel) {
+    int64_t x0 = (int64_t)x - decoder->firstColumn;
+    int64_t y0 = (int64_t)y - decoder->firstRow;
+    int64_t x1 = x0 + decoder->blockW;
+    int64_t y1 = y0 + decoder->blockH;
+    int64_t size = (int64_t)1 << decoder->shift;
+    int64_t ox, oy;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > decoder->endColumn - decoder->firstColumn) x1 = decoder->endColumn - decoder->firstColumn;
+    if (y1 > decoder->endRow - decoder->firstRow) y1 = decoder->endRow - decoder->firstRow;
+
+    for(oy = y0 >> decoder->shift; oy <= (y1-1) >> decoder->shift; ++oy) {
+        int64_t top = oy*size > y0 ? oy*size : y0;
+        int64_t bottom = (oy+1)*size < y1 ? (oy+1)*size : y1;
+        for(ox = x0 >> decoder->shift; ox <= (x1-1) >> decoder->shift; ++ox) {
+            int64_t left = ox*size > x0 ? ox*size : x0;
+            int64_t right = (ox+1)*size < x1 ? (ox+1)*size : x1;
+            if (decoder->accumulator) {
+                uint16_t * sum = decoder->accumulator + ((oy % decoder->accumulatorRows)*decoder->outW + ox)*4;
+                uint16_t count = (uint16_t)((right - left)*(bottom - top));
+                sum[0] += pixel[0]*count;
+                sum[1] += pixel[1]*count;
+                sum[2] += pixel[2]*count;
+                sum[3] += pixel[3]*count;
+            } else {
+                memcpy(decoder->image.rgba + ((size_t)oy*decoder->outW + ox)*decoder->pixelBytes, pixel, decoder->pixelBytes);
+            }
+        }
+    }
+}
+
+
+// Averages the sums for output rows [first, end) into image.rgba, 
+// then clears them for reuse.
+static void tpng_decoder_flush_rows(tpng_decoder_t * decoder, uint32_t first, uint32_t end) {
+    uint32_t regionW = decoder->endColumn - decoder->firstColumn;
+    uint32_t regionH = decoder->endRow - decoder->firstRow;
+    uint32_t size = 1 << decoder->shift;
+    uint32_t ox, oy;
+    int c;
+    if (!decoder->accumulator) return;
+    for(oy = first; oy < end; ++oy) {
+        uint16_t * sum = decoder->accumulator + (size_t)(oy % decoder->accumulatorRows)*decoder->outW*4;
+        uint8_t * out = decoder->output ? decoder->rowExpanded : decoder->image.rgba + (size_t)oy*decoder->outW*4;
+        uint32_t boxH = regionH - oy*size < size ? regionH - oy*size : size;
+        for(ox = 0; ox < decoder->outW; ++ox) {
+            uint32_t boxW = regionW - ox*size < size ? regionW - ox*size : size;
+            uint32_t count = boxW*boxH;
+            for(c = 0; c < 4; ++c) {
+                out[ox*4+c] = (uint8_t)((sum[ox*4+c] + count/2) / count);
+                sum[ox*4+c] = 0;
+            }
+        }
+        tpng_decoder_store_row(decoder, oy, out);
+    }
+}
+
+
+// Outputs where pixel (x, row) of the current pass is in the image.
+static void tpng_decoder_get_pixel(tpng_decoder_t * decoder, int x, int row, uint32_t * imageX, uint32_t * imageY) {
+    int pixel;
+    if (decoder->image.interlaceMethod == 0) {
+        *imageX = x;
+        *imageY = row;
+        return;
+    }
+    pixel = tpng_adam7_subpixel_to_pixel(&decoder->image, x, row, decoder->pass);
+    *imageX = pixel % decoder->image.w;
+    *imageY = pixel / decoder->image.w;
+}
+
+
+// Copies the unfiltered row to output as is, or for 
+// interlaced images, each of its pixels to where it goes.
+static void tpng_decoder_store_native_row(tpng_decoder_t * decoder) {
+    const tpng_image_t * image = &decoder->image;
+    int depth = image->colorDepth;
+    uint32_t x, y;
+    int i;
+    if (image->interlaceMethod == 0) {
+        memcpy(decoder->output + decoder->row*decoder->nativeStride, decoder->thisRow, decoder->passRowBytes);
+        return;
+    }
+
+    for(i = decoder->passFirstColumn; i < decoder->passEndColumn; ++i) {
+        uint8_t * out;
+        tpng_decoder_get_pixel(decoder, i, decoder->row, &x, &y);
+        out = decoder->output + y*decoder->nativeStride;
+        if (depth < 8) {
+            // sub-byte pixels go from the high bits down
+            int mask = (1 << depth) - 1;
+            int from = 8 - depth - (i*depth) % 8;
+            int to = 8 - depth - (x*depth) % 8;
+            int value = (decoder->thisRow[i*depth/8] >> from) & mask;
+            out[x*depth/8] = (out[x*depth/8] & ~(mask << to)) | (value << to);
+        } else {
+            memcpy(out + x*decoder->Bpp, decoder->thisRow + i*decoder->Bpp, decoder->Bpp);
+        }
+    }
+}
+
+
+// Expands pixels [x0, x1) of an unfiltered row. Pixels smaller 
+// than a byte can only be read from a byte boundary, so those 
+// rows are expanded from there into spare, then copied over.
+static void tpng_expand_row_span(tpng_image_t * image, const uint8_t * row, uint8_t * expanded, uint8_t * spare, int x0, int x1) {
+    if (image->colorDepth < 8) {
+        int perByte = 8 / image->colorDepth;
+        int skip = x0 % perByte;
+        if (skip) {
+            tpng_expand_row(image, row + x0/perByte, spare, x1 - x0 + skip);
+            memcpy(expanded, spare + skip*4, (size_t)(x1 - x0)*4);
+        } else {
+            tpng_expand_row(image, row + x0/perByte, expanded, x1 - x0);
+        }
+    } else {
+        tpng_expand_row(image, row + (size_t)x0*tpng_get_bytes_per_pixel(image), expanded, x1 - x0);
+    }
+}
+
+
+// Expands the pass's columns of thisRow into out, 
+// at 16 bits a channel if the decoder is wide.
+static void tpng_decoder_expand_row(tpng_decoder_t * decoder, uint8_t * out) {
+    if (decoder->wide) {
+        tpng_expand_row_wide(
+            &decoder->image, 
+            decoder->thisRow + (size_t)decoder->passFirstColumn*decoder->Bpp, 
+            (uint16_t *)out, 
+            decoder->passEndColumn - decoder->passFirstColumn
+        );
+    } else {
+        tpng_expand_row_span(&decoder->image, decoder->thisRow, out, decoder->spare, decoder->passFirstColumn, decoder->passEndColumn);
+    }
+}
+
+
+// Finishes decoding with the given status.
+static void tpng_decoder_finish(tpng_decoder_t * decoder, int status) {
+    decoder->stage = TPNG_DECODER_STAGE__DONE;
+    decoder->status = status;
+    if (status != TPNG_STATUS_OK) {
+        TPNG_FREE(decoder->image.rgba);
+        decoder->image.rgba = NULL;
+        if (decoder->output != decoder->image.output)
+            TPNG_FREE(decoder->output);
+        decoder->output = NULL;
+    }
+}
+
+
+// Writes the resampled sums for output rows [first, end) 
+// to image.rgba, then clears them for reuse.
+static void tpng_decoder_resample_flush_rows(tpng_decoder_t * decoder, uint32_t first, uint32_t end) {
+    uint32_t oy;
+    size_t i;
+    if (!decoder->resampleSums) return;
+    for(oy = first; oy < end; ++oy) {
+        float * sum = decoder->resampleSums + (size_t)(oy % decoder->resampleRows)*decoder->outW*4;
+        uint8_t * out = decoder->output ? decoder->rowExpanded : decoder->image.rgba + (size_t)oy*decoder->outW*4;
+        for(i = 0; i < (size_t)decoder->outW*4; ++i) {
+            float value = sum[i] + 0.5f;
+            out[i] = value >= 255 ? 255 : (uint8_t)value;
+            sum[i] = 0;
+        }
+        tpng_decoder_store_row(decoder, oy, out);
+    }
+}
+
+
+// Resamples row y of the region across, adds it to the output 
+// rows it's part of, then writes out the rows it finishes.
+static void tpng_decoder_resample_row(tpng_decoder_t * decoder, uint32_t y, const uint8_t * row) {
+    const tpng_resample_axis_t * axisX = &decoder->resampleX;
+    const tpng_resample_axis_t * axisY = &decoder->resampleY;
+    float * across = decoder->resampleRow;
+    uint32_t ox, oy, t;
+    size_t i;
+
+    for(ox = 0; ox < decoder->outW; ++ox) {
+        const float * weights = axisX->weights + (size_t)ox*axisX->maxTaps;
+        const uint8_t * pixel = row + (size_t)axisX->first[ox]*4;
+        float r = 0, g = 0, b = 0, a = 0;
+        for(t = 0; t < axisX->taps[ox]; ++t, pixel += 4) {
+            r += weights[t]*pixel[0];
+            g += weights[t]*pixel[1];
+            b += weights[t]*pixel[2];
+            a += weights[t]*pixel[3];
+        }
+        across[ox*4  ] = r;
+        across[ox*4+1] = g;
+        across[ox*4+2] = b;
+        across[ox*4+3] = a;
+    }
+
+    for(oy = axisY->outFirst[y]; oy < axisY->outEnd[y]; ++oy) {
+        float weight = tpng_resample_axis_get_weight(axisY, oy, y);
+        float * sum = decoder->resampleSums + (size_t)(oy % decoder->resampleRows)*decoder->outW*4;
+        for(i = 0; i < (size_t)decoder->outW*4; ++i)
+            sum[i] += weight*across[i];
+    }
+
+    // rows whose last source row this was
+    oy = decoder->flushedRows;
+    while(oy < decoder->outH && axisY->first[oy] + axisY->taps[oy] <= y+1) oy++;
+    tpng_decoder_resample_flush_rows(decoder, decoder->flushedRows, oy);
+    decoder->flushedRows = oy;
+}
+
+
+// Adds the pixel at (x, y) of the image, standing for a block 
+// of blockW by blockH pixels, to the resampled sums.
+static void tpng_decoder_resample_pixel(tpng_decoder_t * decoder, uint32_t x, uint32_t y, const uint8_t * pixel) {
+    const tpng_resample_axis_t * axisX = &decoder->resampleX;
+    const tpng_resample_axis_t * axisY = &decoder->resampleY;
+    uint32_t x0 = x < decoder->firstColumn ? 0 : x - decoder->firstColumn;
+    uint32_t y0 = y < decoder->firstRow ? 0 : y - decoder->firstRow;
+    uint32_t x1 = x + decoder->blockW - decoder->firstColumn;
+    uint32_t y1 = y + decoder->blockH - decoder->firstRow;
+    uint32_t sx, sy, ox, oy;
+    if (x1 > decoder->endColumn - decoder->firstColumn) x1 = decoder->endColumn - decoder->firstColumn;
+    if (y1 > decoder->endRow - decoder->firstRow) y1 = decoder->endRow - decoder->firstRow;
+
+    for(sy = y0; sy < y1; ++sy) {
+        for(oy = axisY->outFirst[sy]; oy < axisY->outEnd[sy]; ++oy) {
+            float weightY = tpng_resample_axis_get_weight(axisY, oy, sy);
+            float * sum = decoder->resampleSums + (size_t)(oy % decoder->resampleRows)*decoder->outW*4;
+            for(sx = x0; sx < x1; ++sx) {
+                for(ox = axisX->outFirst[sx]; ox < axisX->outEnd[sx]; ++ox) {
+                    float weight = weightY*tpng_resample_axis_get_weight(axisX, ox, sx);
+                    sum[ox*4  ] += weight*pixel[0];
+                    sum[ox*4+1] += weight*pixel[1];
+                    sum[ox*4+2] += weight*pixel[2];
+                    sum[ox*4+3] += weight*pixel[3];
+                }
+            }
+        }
+    }
+}
+
+
+// Finishes showing nothing, as a failed inflate does 
+// when inflated up front.
+static void tpng_decoder_finish_blank(tpng_decoder_t * decoder) {
+    if (decoder->image.rgba)
+        memset(decoder->image.rgba, 0, tpng_decoder_get_rgba_size(decoder));
+    if (decoder->output)
+        memset(decoder->output, 0, tpng_decoder_get_output_size(decoder));
+    tpng_decoder_finish(decoder, TPNG_STATUS_OK);
+}
+
+
+// Finishes once no more rows are coming, averaging 
+// what's been added of an interlaced image.
+static void tpng_decoder_finish_rows(tpng_decoder_t * decoder) {
+    uint32_t oy;
+    if (decoder->image.interlaceMethod != 0) {
+        tpng_decoder_flush_rows(decoder, 0, decoder->outH);
+        tpng_decoder_resample_flush_rows(decoder, 0, decoder->outH);
+        if (!decoder->accumulator && !decoder->resampleSums && decoder->image.rgba) {
+            for(oy = 0; oy < decoder->outH; ++oy) 
+                tpng_decoder_store_row(decoder, oy, decoder->image.rgba + (size_t)oy*decoder->outW*decoder->pixelBytes);
+        }
+    }
+
+    // The checksum covers the whole stream, so as when 
+    // inflated up front, a bad one blanks the image. A 
+    // region stops short of it, and isn't checked.
+    if (!decoder->region && tinfl_stream_finish(decoder->stream, decoder->image.cancel) == 2) {
+        tpng_decoder_finish_blank(decoder);
+        return;
+    }
+    tpng_decoder_finish(decoder, TPNG_STATUS_OK);
+}
+
+
+// Sets up the pass the decoder is on. Returns 0 
+// if there are no passes left.
+static int tpng_decoder_start_pass(tpng_decoder_t * decoder) {
+    tpng_image_t * image = &decoder->image;
+    for(;;) {
+        if (image->interlaceMethod == 0) {
+            if (decoder->pass > 0) return 0;
+            decoder->passWidth = image->w;
+            decoder->passHeight = image->h;
+        } else {
+            if (decoder->pass > 6) return 0;
+            if (image->previewPasses && decoder->pass >= image->previewPasses) return 0;
+            decoder->passWidth = tpng_adam7_get_pass_width(image, decoder->pass);
+            decoder->passHeight = decoder->passWidth ? tpng_adam7_get_pass_height(image, decoder->pass) : 0;
+        }
+        decoder->row = 0;
+        if (decoder->passWidth && decoder->passHeight) break;
+        decoder->pass++;
+    }
+    decoder->passRowBytes = tpng_get_bytes_per_row(image, decoder->passWidth);
+    memset(decoder->prevRow, 0, decoder->passRowBytes);
+
+    // pass rows and columns are in the same order as in the image
+    if (image->interlaceMethod == 0) {
+        decoder->passFirstRow = decoder->firstRow;
+        decoder->passEndRow = decoder->endRow;
+        decoder->passFirstColumn = decoder->firstColumn;
+        decoder->passEndColumn = decoder->endColumn;
+    } else {
+        uint32_t x, y;
+        int i;
+        decoder->passFirstRow = decoder->passHeight;
+        decoder->passEndRow = decoder->passHeight;
+        for(i = decoder->passHeight-1; i >= 0; --i) {
+            tpng_decoder_get_pixel(decoder, 0, i, &x, &y);
+            if (y >= decoder->endRow) decoder->passEndRow = i;
+            if ((uint64_t)y + decoder->blockH > decoder->firstRow) decoder->passFirstRow = i;
+        }
+        decoder->passFirstColumn = decoder->passWidth;
+        decoder->passEndColumn = decoder->passWidth;
+        for(i = decoder->passWidth-1; i >= 0; --i) {
+            tpng_decoder_get_pixel(decoder, i, 0, &x, &y);
+            if (x >= decoder->endColumn) decoder->passEndColumn = i;
+            if ((uint64_t)x + decoder->blockW > decoder->firstColumn) decoder->passFirstColumn = i;
+        }
+        // nothing of the pass is in the region, so all of it is skipped
+        if (decoder->passFirstRow >= decoder->passEndRow || decoder->passFirstColumn >= decoder->passEndColumn)
+            decoder->passEndRow = 0;
+    }
+    return 1;
+}
+
+
+// Sets up inflating once every chunk has been read, 
+// as the IEND chunk would.
+static void tpng_decoder_start_rows(tpng_decoder_t * decoder) {
+    tpng_image_t * image = &decoder->image;
+    size_t inflatedSize, windowedSize;
+    uint32_t rowBytes;
+    // rgba isn't made yet, so a missing IHDR chunk shows as no size
+    if (image->compression != 0 || !image->w || !image->h || 
+        (image->interlaceMethod != 0 && image->interlaceMethod != 1)) {
+        tpng_decoder_finish(decoder, image->w && image->h ? TPNG_STATUS_OK : TPNG_STATUS_NO_IMAGE);
+        return;
+    }
+
+    // native samples are always the whole image, as is
+    if (image->format == TPNG_FORMAT_NATIVE) {
+        decoder->region = 0;
+        image->downscale = 1;
+        image->previewPasses = 0;
+        image->resampleW = 0;
+        image->resampleH = 0;
+    }
+
+    // the region is clipped to the image
+    if (!decoder->region) {
+        decoder->firstColumn = 0;
+        decoder->firstRow = 0;
+        decoder->endColumn = image->w;
+        decoder->endRow = image->h;
+    }
+    if (decoder->endColumn > (uint32_t)image->w) decoder->endColumn = image->w;
+    if (decoder->endRow > (uint32_t)image->h) decoder->endRow = image->h;
+    if (decoder->firstColumn >= decoder->endColumn || decoder->firstRow >= decoder->endRow) {
+        tpng_decoder_finish(decoder, TPNG_STATUS_NO_IMAGE);
+        return;
+    }
+
+    tpng_image_premultiply_palette(image);
+
+    // after k adam7 passes, the decoded pixels form a grid 
+    // with cells of these sizes
+    decoder->blockW = 1;
+    decoder->blockH = 1;
+    if (image->interlaceMethod != 0 && image->previewPasses) {
+        static const int blockSizes[6][2] = {{8, 8}, {4, 8}, {4, 4}, {2, 4}, {2, 2}, {1, 2}};
+        decoder->blockW = blockSizes[image->previewPasses-1][0];
+        decoder->blockH = blockSizes[image->previewPasses-1][1];
+    }
+    decoder->shift = image->downscale == 8 ? 3 : (image->downscale == 4 ? 2 : (image->downscale == 2 ? 1 : 0));
+    if (image->resampleW) 
+        decoder->shift = 0;
+    decoder->outW = ((decoder->endColumn - decoder->firstColumn - 1) >> decoder->shift) + 1;
+    decoder->outH = ((decoder->endRow - decoder->firstRow - 1) >> decoder->shift) + 1;
+    if (image->resampleW) {
+        decoder->resample = image->resampleW != decoder->outW || image->resampleH != decoder->outH;
+        decoder->outW = image->resampleW;
+        decoder->outH = image->resampleH;
+    }
+    decoder->wide = 
+        image->colorDepth == 16 && !decoder->shift && !decoder->resample && (
+            image->format == TPNG_FORMAT_FLOAT32 || 
+            image->format == TPNG_FORMAT_FLOAT16 || 
+            image->format == TPNG_FORMAT_RGBA16
+        );
+    decoder->pixelBytes = decoder->wide ? 8 : 4;
+
+    inflatedSize = tpng_get_inflated_size(image);
+    rowBytes = tpng_get_bytes_per_row(image, image->w);
+    decoder->prevRow = tpng_decoder_calloc(decoder, 1, rowBytes);
+    decoder->thisRow = tpng_decoder_calloc(decoder, 1, rowBytes);
+    // also where output rows are put together, which can be wider
+    decoder->rowExpanded = tpng_decoder_calloc(decoder, 8, (uint32_t)image->w > decoder->outW ? (uint32_t)image->w : decoder->outW);
+    decoder->spare = tpng_decoder_calloc(decoder, 4, image->w+8);
+    decoder->Bpp = tpng_get_bytes_per_pixel(image);
+    decoder->pass = 0;
+    decoder->read = 0;
+    if (!decoder->prevRow || !decoder->thisRow || !decoder->rowExpanded || !decoder->spare) {
+        tpng_decoder_finish(decoder, TPNG_STATUS_NO_IMAGE);
+        return;
+    }
+    if (!tpng_decoder_start_pass(decoder)) {
+        tpng_decoder_finish(decoder, TPNG_STATUS_OK);
+        return;
+    }
+    // orientation only applies to rows of whole pixels
+    decoder->orientation = image->orientation;
+    if (image->orientation == TPNG_ORIENT_EXIF) 
+        decoder->orientation = image->exifOrientation ? image->exifOrientation-1 : TPNG_ORIENT_NONE;
+    if (image->mipmaps || image->planar || image->layout || image->format == TPNG_FORMAT_NATIVE || 
+        image->format == TPNG_FORMAT_BC1 || image->format == TPNG_FORMAT_BC3) 
+        decoder->orientation = TPNG_ORIENT_NONE;
+
+    if (image->format != TPNG_FORMAT_RGBA8 || image->mipmaps || image->layout || decoder->orientation) {
+        // image.rgba is only needed to put interlaced rows together
+        TPNG_FREE(image->rgba);
+        image->rgba = NULL;
+        if (!tpng_decoder_start_output(decoder)) {
+            tpng_decoder_finish(decoder, TPNG_STATUS_NO_IMAGE);
+            return;
+        }
+        if (image->interlaceMethod != 0 && !decoder->shift && !decoder->resample && image->format != TPNG_FORMAT_NATIVE) {
+            image->rgba = tpng_decoder_calloc(decoder, 1, tpng_decoder_get_rgba_size(decoder));
+            if (!image->rgba) {
+                tpng_decoder_finish(decoder, TPNG_STATUS_NO_IMAGE);
+                return;
+            }
+        }
+    } else {
+        image->rgba = TPNG_CALLOC(1, tpng_decoder_get_rgba_size(decoder));
+    }
+    if (decoder->resample) {
+        uint32_t regionH = decoder->endRow - decoder->firstRow;
+        uint32_t end = 0;
+        uint32_t flushed = 0;
+        uint32_t y;
+        if (!tpng_resample_axis_init(&decoder->resampleX, decoder->endColumn - decoder->firstColumn, decoder->outW, image->resampleFilter) ||
+            !tpng_resample_axis_init(&decoder->resampleY, regionH, decoder->outH, image->resampleFilter)) {
+            tpng_decoder_finish(decoder, TPNG_STATUS_NO_IMAGE);
+            return;
+        }
+
+        // rows come out in order unless interlaced, so only the 
+        // most output rows any one row is added to before the 
+        // earliest of them is finished need to be kept
+        decoder->resampleRows = decoder->outH;
+        if (image->interlaceMethod == 0) {
+            decoder->resampleRows = 1;
+            for(y = 0; y < regionH; ++y) {
+                if (decoder->resampleY.outEnd[y] > end) 
+                    end = decoder->resampleY.outEnd[y];
+                if (end - flushed > decoder->resampleRows) 
+                    decoder->resampleRows = end - flushed;
+                while(flushed < decoder->outH && decoder->resampleY.first[flushed] + decoder->resampleY.taps[flushed] <= y+1) 
+                    flushed++;
+            }
+        }
+        decoder->resampleRow = tpng_decoder_calloc(decoder, sizeof(float)*4, decoder->outW);
+        decoder->resampleSums = tpng_decoder_calloc(decoder, sizeof(float)*4, (size_t)decoder->outW*decoder->resampleRows);
+        if (!decoder->resampleRow || !decoder->resampleSums) {
+            tpng_decoder_finish(decoder, TPNG_STATUS_NO_IMAGE);
+            return;
+        }
+    }
+    if (decoder->shift) {
+        // rows come out in order unless interlaced
+        decoder->accumulatorRows = image->interlaceMethod == 0 ? 1 : decoder->outH;
+        decoder->accumulator = tpng_decoder_calloc(decoder, sizeof(uint16_t)*4, (size_t)decoder->outW*decoder->accumulatorRows);
+        if (!decoder->accumulator) {
+            tpng_decoder_finish(decoder, TPNG_STATUS_NO_IMAGE);
+            return;
+        }
+    }
+    if (image->previewPasses && image->interlaceMethod != 0) {
+        // only the passes decoded are inflated
+        int pass;
+        inflatedSize = 0;
+        for(pass = 0; pass < image->previewPasses; ++pass) {
+            uint32_t passWidth = tpng_adam7_get_pass_width(image, pass);
+            if (passWidth)
+                inflatedSize += (size_t)tpng_adam7_get_pass_height(image, pass)*(tpng_get_bytes_per_row(image, passWidth)+1);
+        }
+    }
+
+    // Enough to slide the window back only every TPNG_INDEX_WINDOW 
+    // bytes, with room for a row past it.
+    windowedSize = TPNG_INDEX_WINDOW*2 + (size_t)rowBytes+1;
+
+    if (decoder->region && image->interlaceMethod == 0) {
+        // Inflating starts from the closest checkpoint 
+        // before the region, and stops at its last row.
+        const tpng_checkpoint_t * checkpoint;
+        tpng_checkpoint_t start;
+
+        checkpoint = tpng_index_find(
+            decoder->resumeIndex, 
+            decoder->resumeIndexSize, 
+            rowBytes, 
+            decoder->rawSize,
+            tpng_index_get_file_crc(decoder->rawData, decoder->rawSize),
+            decoder->firstRow
+        );
+        memset(&start, 0, sizeof(tpng_checkpoint_t));
+        if (checkpoint) 
+            memcpy(&start, checkpoint, sizeof(tpng_checkpoint_t));
+
+        // a state that couldn't have been saved is as good as no checkpoint
+        if (checkpoint && !tinfl_stream_can_resume(
+                image->idat, image->nidat, 
+                (const uint8_t *)(checkpoint+1), start.span, start.spanOffset, start.windowLength)) {
+            checkpoint = NULL;
+            memset(&start, 0, sizeof(tpng_checkpoint_t));
+        }
+        inflatedSize = start.windowLength + (size_t)(decoder->endRow - start.row)*(rowBytes+1);
+        decoder->inflatedCapacity = inflatedSize < windowedSize ? inflatedSize : windowedSize;
+        decoder->inflated = tpng_decoder_calloc(decoder, 1, decoder->inflatedCapacity);
+        if (checkpoint && decoder->inflated) {
+            const uint8_t * state = (const uint8_t *)(checkpoint+1);
+            const uint8_t * window = state + tinfl_stream_get_state_size();
+            memcpy(decoder->inflated, window, start.windowLength);
+            memcpy(decoder->prevRow, window + start.windowLength, rowBytes);
+            decoder->stream = tinfl_stream_resume(
+                image->idat, image->nidat, 
+                state, start.span, start.spanOffset, 
+                decoder->inflated, start.windowLength, inflatedSize
+            );
+            decoder->row = start.row;
+            decoder->read = start.windowLength;
+        } else if (decoder->inflated) {
+            decoder->stream = tinfl_stream_create(image->idat, image->nidat, decoder->inflated, inflatedSize);
+        }
+    } else {
+        decoder->inflatedCapacity = inflatedSize < windowedSize ? inflatedSize : windowedSize;
+        decoder->inflated = tpng_decoder_calloc(decoder, 1, decoder->inflatedCapacity ? decoder->inflatedCapacity : 1);
+        if (decoder->inflated)
+            decoder->stream = tinfl_stream_create(image->idat, image->nidat, decoder->inflated, inflatedSize);
+    }
+
+    if ((!image->rgba && !decoder->output) || !decoder->stream) {
+        tpng_decoder_finish(decoder, TPNG_STATUS_NO_IMAGE);
+        return;
+    }
+    decoder->stage = TPNG_DECODER_STAGE__ROWS;
+}
+
+
+// Creates a decoder for an image that has had 
+// nothing but its options set yet.
+static tpng_decoder_t * tpng_decoder_create_image(
+    const tpng_image_t * image,
+    const uint8_t * rawData,
+    uint32_t rawSize
+) {
+    tpng_decoder_t * decoder = TPNG_CALLOC(1, sizeof(tpng_decoder_t));
+    if (!decoder) return NULL;
+    decoder->image = *image;
+    decoder->image.stepped = 1;
+    decoder->rawData = rawData;
+    decoder->rawSize = rawSize;
+    decoder->iter = tpng_iter_create(rawData, rawSize);
+    decoder->stage = TPNG_DECODER_STAGE__CHUNKS;
+    decoder->status = TPNG_STATUS_OK;
+    if (!tpng_read_header(decoder->iter)) {
+        tpng_decoder_finish(decoder, TPNG_STATUS_NOT_PNG);
+    }
+    return decoder;
+}
+
+
+tpng_decoder_t * tpng_decoder_create(
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    const tpng_options_t * options
+) {
+    tpng_image_t image;
+    tpng_image_init(&image);
+    if (options) {
+        tpng_image_apply_options(&image, options);
+    }
+    return tpng_decoder_create_image(&image, rawData, rawSize);
+}
+
+
+static uint8_t * tpng_decode_image_stepped(
+    tpng_image_t * image,
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    uint32_t * w,
+    uint32_t * h,
+    int * status
+) {
+    uint8_t * rgba;
+    tpng_decoder_t * decoder = tpng_decoder_create_image(image, rawData, rawSize);
+    if (!decoder) {
+        *status = TPNG_STATUS_NO_IMAGE;
+        return NULL;
+    }
+
+    // steps are kept short enough to notice a cancel
+    while(tpng_decoder_step(decoder, 64, 0)) {
+        if (tpng_image_is_cancelled(&decoder->image)) {
+            tpng_decoder_finish(decoder, TPNG_STATUS_CANCELLED);
+            break;
+        }
+    }
+
+    *status = decoder->status;
+    rgba = tpng_decoder_take_rgba(decoder, w, h);
+    if (!rgba && *status == TPNG_STATUS_OK) 
+        *status = TPNG_STATUS_NO_IMAGE;
+    tpng_decoder_destroy(decoder);
+    return rgba;
+}
+
+
+int tpng_decoder_step(
+    tpng_decoder_t * decoder,
+    uint32_t maxRows,
+    uint32_t maxBytes
+) {
+    tpng_image_t * image = &decoder->image;
+    uint32_t rows = 0;
+    size_t bytes = 0;
+
+    // Chunks are only skipped over, except in strict mode, 
+    // where their CRC counts against the budget.
+    while(decoder->stage == TPNG_DECODER_STAGE__CHUNKS) {
+        tpng_chunk_t chunk;
+        if (maxBytes && bytes >= maxBytes) return 1;
+        tpng_read_chunk(image, decoder->iter, &chunk);
+        if (image->strict) bytes += chunk.length;
+        if (image->corrupt) {
+            tpng_decoder_finish(decoder, TPNG_STATUS_CORRUPT);
+        } else if (!strcmp(chunk.type, "IEND")) {
+            tpng_decoder_start_rows(decoder);
+        } else {
+            tpng_process_chunk(image, &chunk);
+        }
+    }
+
+    while(decoder->stage == TPNG_DECODER_STAGE__ROWS) {
+        size_t need = decoder->read + decoder->passRowBytes + 1;
+        size_t have = tinfl_stream_get_length(decoder->stream);
+        const uint8_t * readN;
+        uint8_t * swap;
+        if (maxRows && rows >= maxRows) return 1;
+
+        // the rest of the pass is past the region
+        if (decoder->row >= decoder->passEndRow) {
+            decoder->read += (size_t)(decoder->passHeight - decoder->row)*(decoder->passRowBytes+1);
+            decoder->pass++;
+            if (!tpng_decoder_start_pass(decoder)) 
+                tpng_decoder_finish_rows(decoder);
+            continue;
+        }
+
+        if (decoder->checkpointRows && image->interlaceMethod == 0 && decoder->row == decoder->nextCheckpoint) {
+            if (have == decoder->read && !tinfl_stream_get_finished(decoder->stream))
+                tpng_decoder_index_checkpoint(decoder);
+            decoder->nextCheckpoint += decoder->checkpointRows;
+        }
+
+        // inflate just enough for the row, within the budget
+        if (have < need) {
+            size_t amount;
+            if (need > decoder->inflatedCapacity) {
+                // drop what's been read, but for the window 
+                // the rest of the stream can still refer to
+                size_t keep = decoder->read < have ? decoder->read : have;
+                size_t discard = keep > TPNG_INDEX_WINDOW ? keep - TPNG_INDEX_WINDOW : 0;
+                tinfl_stream_slide(decoder->stream, discard);
+                decoder->read -= discard;
+                need -= discard;
+                have -= discard;
+            }
+            amount = need - have;
+            if (amount > decoder->inflatedCapacity - have) amount = decoder->inflatedCapacity - have;
+            if (maxBytes) {
+                if (bytes >= maxBytes) return 1;
+                if (amount > maxBytes - bytes) amount = maxBytes - bytes;
+            }
+            int finished = tinfl_stream_step(decoder->stream, amount);
+            bytes += tinfl_stream_get_length(decoder->stream) - have;
+            if (finished == 2) {
+                // a failed inflate shows nothing, as when inflated up front; 
+                // a bad checksum is caught after the last row.
+                tpng_decoder_finish_blank(decoder);
+                break;
+            }
+            if (tinfl_stream_get_length(decoder->stream) < need) {
+                // the stream ended early: the remaining rows stay blank.
+                if (finished) tpng_decoder_finish_rows(decoder);
+                continue;
+            }
+        }
+
+        readN = decoder->inflated + decoder->read;
+        tpng_unfilter_row(image, decoder->thisRow, readN+1, decoder->prevRow, decoder->passRowBytes, decoder->Bpp, readN[0]);
+        if (decoder->row < decoder->passFirstRow) {
+            // above the region: only needed to unfilter the next row
+        } else if (image->format == TPNG_FORMAT_NATIVE) {
+            tpng_decoder_store_native_row(decoder);
+        } else if (decoder->resampleSums) {
+            uint32_t x, y;
+            int i;
+            tpng_decoder_expand_row(decoder, decoder->rowExpanded);
+            if (image->interlaceMethod == 0) {
+                tpng_decoder_resample_row(decoder, decoder->row - decoder->firstRow, decoder->rowExpanded);
+            } else {
+                for(i = decoder->passFirstColumn; i < decoder->passEndColumn; ++i) {
+                    tpng_decoder_get_pixel(decoder, i, decoder->row, &x, &y);
+                    tpng_decoder_resample_pixel(decoder, x, y, decoder->rowExpanded + (i - decoder->passFirstColumn)*4);
+                }
+            }
+        } else if (image->interlaceMethod == 0 && !decoder->shift) {
+            if (decoder->output) {
+                tpng_decoder_expand_row(decoder, decoder->rowExpanded);
+                tpng_decoder_store_row(decoder, decoder->row - decoder->firstRow, decoder->rowExpanded);
+            } else {
+                tpng_decoder_expand_row(decoder, image->rgba + (size_t)(decoder->row - decoder->firstRow)*decoder->outW*4);
+            }
+        } else if (image->interlaceMethod == 0) {
+            // the row is added to the sums of one output row
+            uint32_t regionRow = decoder->row - decoder->firstRow;
+            const uint8_t * pixel = decoder->rowExpanded;
+            int i;
+            tpng_decoder_expand_row(decoder, decoder->rowExpanded);
+            for(i = 0; i < decoder->passEndColumn - decoder->passFirstColumn; ++i, pixel += 4) {
+                uint16_t * sum = decoder->accumulator + (i >> decoder->shift)*4;
+                sum[0] += pixel[0];
+                sum[1] += pixel[1];
+                sum[2] += pixel[2];
+                sum[3] += pixel[3];
+            }
+
+            // the last row of a box has been added in
+            if (((regionRow+1) >> decoder->shift) != (regionRow >> decoder->shift) || (uint32_t)decoder->row+1 == decoder->endRow)
+                tpng_decoder_flush_rows(decoder, regionRow >> decoder->shift, (regionRow >> decoder->shift)+1);
+        } else {
+            uint32_t x, y;
+            int i;
+            tpng_decoder_expand_row(decoder, decoder->rowExpanded);
+            for(i = decoder->passFirstColumn; i < decoder->passEndColumn; ++i) {
+                tpng_decoder_get_pixel(decoder, i, decoder->row, &x, &y);
+                tpng_decoder_put_pixel(decoder, x, y, decoder->rowExpanded + (i - decoder->passFirstColumn)*decoder->pixelBytes);
+            }
+        }
+        swap = decoder->prevRow;
+        decoder->prevRow = decoder->thisRow;
+        decoder->thisRow = swap;
+        decoder->read = need;
+        rows++;
+
+        if (++decoder->row == decoder->passHeight) {
+            decoder->pass++;
+            if (!tpng_decoder_start_pass(decoder)) 
+                tpng_decoder_finish_rows(decoder);
+        }
+    }
+    return 0;
+}
+
+
+int tpng_decoder_get_status(const tpng_decoder_t * decoder) {
+    return decoder->status;
+}
+
+
+void tpng_decoder_set_region(tpng_decoder_t * decoder, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (decoder->stage != TPNG_DECODER_STAGE__CHUNKS) return;
+    decoder->region = 1;
+    decoder->firstColumn = x;
+    decoder->firstRow = y;
+    decoder->endColumn = w > UINT32_MAX - x ? UINT32_MAX : x + w;
+    decoder->endRow = h > UINT32_MAX - y ? UINT32_MAX : y + h;
+}
+
+
+const uint8_t * tpng_decoder_get_rgba(const tpng_decoder_t * decoder, uint32_t * w, uint32_t * h) {
+    // the size of the region isn't known until every chunk is read
+    if (decoder->stage == TPNG_DECODER_STAGE__CHUNKS || (!decoder->image.rgba && !decoder->output)) {
+        *w = 0;
+        *h = 0;
+        return NULL;
+    }
+    *w = decoder->outW;
+    *h = decoder->outH;
+    if (decoder->orientation >= TPNG_ORIENT_TRANSPOSE) {
+        *w = decoder->outH;
+        *h = decoder->outW;
+    }
+    return decoder->output ? decoder->output : decoder->image.rgba;
+}
+
+
+uint8_t * tpng_decoder_take_rgba(tpng_decoder_t * decoder, uint32_t * w, uint32_t * h) {
+    uint8_t * rgba;
+    if (decoder->stage != TPNG_DECODER_STAGE__DONE) {
+        *w = 0;
+        *h = 0;
+        return NULL;
+    }
+    rgba = (uint8_t *)tpng_decoder_get_rgba(decoder, w, h);
+    if (decoder->output) 
+        decoder->output = NULL;
+    else
+        decoder->image.rgba = NULL;
+    return rgba;
+}
+
+
+size_t tpng_decoder_get_working_size(const tpng_decoder_t * decoder) {
+    return decoder->workingSize;
+}
+
+
+void tpng_decoder_destroy(tpng_decoder_t * decoder) {
+    if (!decoder) return;
+    if (decoder->stream) 
+        tinfl_stream_destroy(decoder->stream);
+    TPNG_FREE(decoder->inflated);
+    TPNG_FREE(decoder->prevRow);
+    TPNG_FREE(decoder->thisRow);
+    TPNG_FREE(decoder->rowExpanded);
+    TPNG_FREE(decoder->spare);
+    TPNG_FREE(decoder->accumulator);
+    TPNG_FREE(decoder->resampleRow);
+    TPNG_FREE(decoder->resampleSums);
+    TPNG_FREE(decoder->ditherError);
+    TPNG_FREE(decoder->blockRows);
+    TPNG_FREE(decoder->strip);
+    TPNG_FREE(decoder->linearTable);
+    tpng_resample_axis_cleanup(&decoder->resampleX);
+    tpng_resample_axis_cleanup(&decoder->resampleY);
+    TPNG_FREE(decoder->index);
+    TPNG_FREE(decoder->image.rgba);
+    if (decoder->output != decoder->image.output)
+        TPNG_FREE(decoder->output);
+    tpng_iter_destroy(decoder->iter);
+    tpng_image_cleanup(&decoder->image);
+    TPNG_FREE(decoder);
+}
+
+
+
+uint8_t * tpng_decode_indexed(
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    uint32_t * w,
+    uint32_t * h,
+    const tpng_options_t * options,
+    uint32_t rowsPerCheckpoint,
+    uint8_t ** index,
+    uint32_t * indexSize
+) {
+    tpng_decoder_t * decoder = tpng_decoder_create(rawData, rawSize, options);
+    tpng_index_header_t header;
+    uint8_t * rgba;
+    *index = NULL;
+    *indexSize = 0;
+    if (!decoder) {
+        *w = 0;
+        *h = 0;
+        return NULL;
+    }
+
+    memset(&header, 0, sizeof(tpng_index_header_t));
+    memcpy(header.magic, TPNG_INDEX_MAGIC, 8);
+    header.stateSize = (uint32_t)tinfl_stream_get_state_size();
+    header.fileSize = rawSize;
+    header.fileCrc = tpng_index_get_file_crc(rawData, rawSize);
+    tpng_decoder_index_write(decoder, &header, sizeof(tpng_index_header_t));
+    decoder->checkpointRows = rowsPerCheckpoint ? rowsPerCheckpoint : 1;
+    decoder->nextCheckpoint = decoder->checkpointRows;
+
+    while(tpng_decoder_step(decoder, 0, 0));
+
+    rgba = tpng_decoder_take_rgba(decoder, w, h);
+    if (rgba && decoder->image.interlaceMethod == 0) {
+        ((tpng_index_header_t *)decoder->index)->rowBytes = decoder->passRowBytes;
+        *index = decoder->index;
+        *indexSize = (uint32_t)decoder->indexSize;
+        decoder->index = NULL;
+    }
+    tpng_decoder_destroy(decoder);
+    return rgba;
+}
+
+
+uint8_t * tpng_decode_rows(
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    const uint8_t * index,
+    uint32_t indexSize,
+    uint32_t y0,
+    uint32_t y1,
+    uint32_t * w
+) {
+    tpng_decoder_t * decoder;
+    uint32_t h;
+    uint8_t * rgba;
+    *w = 0;
+    if (y1 <= y0) return NULL;
+    decoder = tpng_decoder_create(rawData, rawSize, NULL);
+    if (!decoder) return NULL;
+    tpng_decoder_set_region(decoder, 0, y0, UINT32_MAX, y1 - y0);
+    decoder->resumeIndex = index;
+    decoder->resumeIndexSize = indexSize;
+
+    while(tpng_decoder_step(decoder, 0, 0));
+
+    rgba = tpng_decoder_take_rgba(decoder, w, &h);
+    tpng_decoder_destroy(decoder);
+
+    // rows past the bottom of the image aren't clipped off here
+    if (rgba && h != y1 - y0) {
+        TPNG_FREE(rgba);
+        rgba = NULL;
+        *w = 0;
+    }
+    return rgba;
+}
+
+
+uint8_t * tpng_decode_region(
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    uint32_t x,
+    uint32_t y,
+    uint32_t w,
+    uint32_t h,
+    uint32_t * regionW,
+    uint32_t * regionH,
+    const tpng_options_t * options
+) {
+    tpng_decoder_t * decoder;
+    uint8_t * rgba;
+    *regionW = 0;
+    *regionH = 0;
+    decoder = tpng_decoder_create(rawData, rawSize, options);
+    if (!decoder) return NULL;
+    tpng_decoder_set_region(decoder, x, y, w, h);
+
+    while(tpng_decoder_step(decoder, 0, 0));
+
+    rgba = tpng_decoder_take_rgba(decoder, regionW, regionH);
+    tpng_decoder_destroy(decoder);
+    return rgba;
+}
+
+
+int tpng_decoder_get_color_info(const tpng_decoder_t * decoder, tpng_color_info_t * info) {
+    const tpng_image_t * image = &decoder->image;
+    if (decoder->stage == TPNG_DECODER_STAGE__CHUNKS) return 0;
+    info->gamma = image->gamma;
+    info->srgbIntent = image->srgbIntent;
+    info->hasChromaticities = image->hasChromaticities;
+    info->whiteX = image->chromaticities[0];
+    info->whiteY = image->chromaticities[1];
+    info->redX   = image->chromaticities[2];
+    info->redY   = image->chromaticities[3];
+    info->greenX = image->chromaticities[4];
+    info->greenY = image->chromaticities[5];
+    info->blueX  = image->chromaticities[6];
+    info->blueY  = image->chromaticities[7];
+    return 1;
+}
+
+
+void tpng_get_mip_chain(uint32_t w, uint32_t h, tpng_mip_chain_t * chain) {
+    memset(chain, 0, sizeof(tpng_mip_chain_t));
+    for(;;) {
+        chain->w[chain->levels] = w;
+        chain->h[chain->levels] = h;
+        chain->offset[chain->levels] = chain->size;
+        chain->size += (size_t)w*h*4;
+        chain->levels++;
+        if ((w == 1 && h == 1) || chain->levels == TPNG_MIP_LIMIT) break;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+}
+
+
+int tpng_decoder_get_native_format(const tpng_decoder_t * decoder, tpng_native_format_t * format) {
+    const tpng_image_t * image = &decoder->image;
+    uint32_t i;
+    if (decoder->stage == TPNG_DECODER_STAGE__CHUNKS || image->colorType < 0) return 0;
+    memset(format, 0, sizeof(tpng_native_format_t));
+    format->w = image->w;
+    format->h = image->h;
+    format->colorType = image->colorType;
+    format->bitDepth = image->colorDepth;
+    format->rowBytes = tpng_get_bytes_per_row((tpng_image_t *)image, image->w);
+    format->stride = tpng_image_get_native_stride(image);
+    if (image->colorType == 3) {
+        format->paletteSize = image->nPalette;
+        for(i = 0; i < image->nPalette; ++i) {
+            format->palette[i*4  ] = image->palette[i].r;
+            format->palette[i*4+1] = image->palette[i].g;
+            format->palette[i*4+2] = image->palette[i].b;
+            format->palette[i*4+3] = image->palette[i].a;
+        }
+    }
+    format->transparent[0] = image->colorType == 0 ? image->transparentGray : 
+                             image->colorType == 2 ? image->transparentRed : -1;
+    format->transparent[1] = image->colorType == 2 && image->transparentRed != -1 ? image->transparentGreen : -1;
+    format->transparent[2] = image->colorType == 2 && image->transparentRed != -1 ? image->transparentBlue : -1;
+    return 1;
+}
+
+
+uint8_t * tpng_decode_native(
+    const uint8_t * rawData,
+    uint32_t rawSize,
+    tpng_native_format_t * format,
+    const tpng_options_t * options
+) {
+    tpng_options_t native;
+    tpng_decoder_t * decoder;
+    uint8_t * samples;
+    uint32_t w, h;
+    if (options) 
+        native = *options;
+    else 
+        memset(&native, 0, sizeof(tpng_options_t));
+    native.format = TPNG_FORMAT_NATIVE;
+    memset(format, 0, sizeof(tpng_native_format_t));
+
+    decoder = tpng_decoder_create(rawData, rawSize, &native);
+    if (!decoder) return NULL;
+    while(tpng_decoder_step(decoder, 0, 0));
+
+    samples = tpng_decoder_take_rgba(decoder, &w, &h);
+    if (samples) 
+        tpng_decoder_get_native_format(decoder, format);
+    tpng_decoder_destroy(decoder);
+    return samples;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+// tpng iterator helper class
+///////////////
+struct tpng_iter_t {
+    // Raw data, read-only.
+    const uint8_t * data;
+
+    // (safe) size of the read-only buffer
+    uint32_t        size;
+
+    // where we are within the iterator.
+    uint32_t        iter;
+
+    // buffers saved to process invalid requests.
+    uint8_t **      errors;
+
+    // Number of error buffers.
+    uint32_t        nerrors;
+};
+
+tpng_iter_t * tpng_iter_create(const uint8_t * data, uint32_t size) {
+    tpng_iter_t * out = TPNG_CALLOC(1, sizeof(tpng_iter_t));
+    out->data = data;
+    out->size = size;
+    out->iter = 0;
+    
+    out->nerrors = 0;
+    out->errors = NULL;
+    return out;
+}
+
+void tpng_iter_destroy(tpng_iter_t * t) { 
+    uint32_t i;
+    for(i = 0; i < t->nerrors; ++i) {
+        TPNG_FREE(t->errors[i]);
+    }
+    TPNG_FREE(t->errors);
+    TPNG_FREE(t);
+}
+
+#ifdef TPNG_REPORT_ERROR
+    #include <stdio.h>
+#endif
+
+const void * tpng_iter_advance(tpng_iter_t * t, uint32_t size) {
+    if (!size) return NULL;
+    if (t->iter + size <= t->size) {
+        const void * out = t->data+t->iter;     
+        t->iter+=size;   
+        return out;
+    } 
+    return NULL;
+}
+
+const void * tpng_iter_advance_guaranteed(tpng_iter_t * t, uint32_t size) {
+    const void * data = tpng_iter_advance(t, size);
+    if (!data) {
+        // no partial requests. 
+        // An entire empty buffer is returned for bad requests.
+        #ifdef TPNG_REPORT_ERROR
+            printf("tPNG: WARNING: Request denied to read %d bytes, which is %d bytes past %p\n", size, (size + t->iter) - t->size, t->data); 
+        #endif
+        void * newError = TPNG_CALLOC(1, size);
+        void * newErrorArray = TPNG_MALLOC(sizeof(void*)*(t->nerrors+1));
+        if (t->nerrors) {
+            memcpy(newErrorArray, t->errors, sizeof(void*)*t->nerrors);
+            TPNG_FREE(t->errors);
+        }
+        t->errors = newErrorArray;
+        t->errors[t->nerrors] = newError;
+        t->nerrors++;
+        return newError;
+    } else {
+        return data;
+    }
+}
+
+
+///////////////
+
+
+
+
+
+
+// threads
+///////////////
+static int tpng_get_processor_count() {
+    #if TPNG_THREADS && defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+    #elif TPNG_THREADS && defined(_SC_NPROCESSORS_ONLN)
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? (int)count : 1;
+    #else
+        return 1;
+    #endif
+}
+
+
+#if TPNG_THREADS
+// Tasks that someone is waiting on. Guarded by the pool lock.
+typedef struct {
+    // Tasks not finished yet.
+    uint32_t pending;
+} tpng_group_t;
+
+// A task queued on a pool.
+typedef struct {
+    void (*fn)(void *);
+    void * data;
+
+    // Counted down once the task is finished.
+    tpng_group_t * group;
+} tpng_task_t;
+
+// A worker's double-ended queue of tasks, as a ring.
+// The owner takes from the front; idle workers steal 
+// from the back.
+typedef struct {
+    tpng_task_t * tasks;
+    uint32_t first;
+    uint32_t count;
+    uint32_t capacity;
+} tpng_deque_t;
+
+// Tasks are whole images or bands of rows, so one lock 
+// over every deque is not contended.
+struct tpng_pool_t {
+    tpng_mutex_t lock;
+
+    // Signaled when tasks are queued, a group finishes, or 
+    // the pool stops.
+    tpng_cond_t wake;
+
+    // One deque per worker. Worker 0 is whichever thread 
+    // is waiting on the pool.
+    tpng_deque_t * deques;
+    int workers;
+
+    // The threads running workers 1 and up.
+    tpng_thread_t * threads;
+    int * started;
+
+    // Where the next task from outside the pool is queued.
+    int nextDeque;
+
+    // Set once the workers should exit.
+    int stop;
+
+    // This pool as a tpng_scheduler_t.
+    tpng_scheduler_t scheduler;
+};
+
+// A thread's identity within a pool.
+typedef struct {
+    tpng_pool_t * pool;
+    int worker;
+} tpng_pool_member_t;
+
+// The pool worker the current thread is running, if any.
+static TPNG_THREAD_LOCAL tpng_pool_member_t * tpngPoolMember = NULL;
+
+
+static void tpng_deque_grow(tpng_deque_t * d) {
+    uint32_t capacity = d->capacity ? d->capacity*2 : 16;
+    tpng_task_t * tasks = TPNG_MALLOC(sizeof(tpng_task_t)*capacity);
+    uint32_t i;
+    for(i = 0; i < d->count; ++i) {
+        tasks[i] = d->tasks[(d->first+i) % d->capacity];
+    }
+    TPNG_FREE(d->tasks);
+    d->tasks = tasks;
+    d->first = 0;
+    d->capacity = capacity;
+}
+
+static void tpng_deque_push_front(tpng_deque_t * d, tpng_task_t task) {
+    if (d->count == d->capacity) tpng_deque_grow(d);
+    d->first = (d->first + d->capacity - 1) % d->capacity;
+    d->tasks[d->first] = task;
+    d->count++;
+}
+
+static void tpng_deque_push_back(tpng_deque_t * d, tpng_task_t task) {
+    if (d->count == d->capacity) tpng_deque_grow(d);
+    d->tasks[(d->first + d->count) % d->capacity] = task;
+    d->count++;
+}
+
+// Returns the worker index of the current thread, or -1 
+// if it isn't running a task of this pool.
+static int tpng_pool_get_member(tpng_pool_t * pool) {
+    return (tpngPoolMember && tpngPoolMember->pool == pool) ? tpngPoolMember->worker : -1;
+}
+
+// Takes a task for the worker: from the front of its own
+// deque, else from the back of another's.
+// Pool lock must be held.
+static int tpng_pool_take(tpng_pool_t * pool, int worker, tpng_task_t * task) {
+    tpng_deque_t * own = pool->deques+worker;
+    int i;
+    if (own->count) {
+        *task = own->tasks[own->first];
+        own->first = (own->first+1) % own->capacity;
+        own->count--;
+        return 1;
+    }
+    for(i = 1; i < pool->workers; ++i) {
+        tpng_deque_t * victim = pool->deques + (worker+i) % pool->workers;
+        if (victim->count) {
+            victim->count--;
+            *task = victim->tasks[(victim->first + victim->count) % victim->capacity];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Runs a taken task outside the lock, as the given worker. 
+// Pool lock must be held.
+static void tpng_pool_execute(tpng_pool_t * pool, int worker, tpng_task_t * task) {
+    tpng_pool_member_t member;
+    tpng_pool_member_t * outer = tpngPoolMember;
+    member.pool = pool;
+    member.worker = worker;
+
+    tpng_mutex_unlock(&pool->lock);
+    tpngPoolMember = &member;
+    task->fn(task->data);
+    tpngPoolMember = outer;
+    tpng_mutex_lock(&pool->lock);
+    if (--task->group->pending == 0) 
+        tpng_cond_broadcast(&pool->wake);
+}
+
+// Loop of every worker but worker 0.
+static void tpng_pool_worker(void * data) {
+    tpng_pool_member_t * member = data;
+    tpng_pool_t * pool = member->pool;
+    tpng_task_t task;
+    tpng_mutex_lock(&pool->lock);
+    while(!pool->stop) {
+        if (tpng_pool_take(pool, member->worker, &task)) 
+            tpng_pool_execute(pool, member->worker, &task);
+        else
+            tpng_cond_wait(&pool->wake, &pool->lock);
+    }
+    tpng_mutex_unlock(&pool->lock);
+}
+
+
+// tpng_scheduler_t functions of the pool.
+static void * tpng_pool_create_group(void * userData) {
+    tpng_group_t * group = TPNG_MALLOC(sizeof(tpng_group_t));
+    group->pending = 0;
+    return group;
+}
+
+static void tpng_pool_submit(void * userData, void * group, void (*fn)(void *), void * data) {
+    tpng_pool_t * pool = userData;
+    int worker = tpng_pool_get_member(pool);
+    tpng_task_t task;
+    task.fn = fn;
+    task.data = data;
+    task.group = group;
+
+    tpng_mutex_lock(&pool->lock);
+    task.group->pending++;
+    if (worker >= 0) {
+        // a task's own subtasks run next on its worker, 
+        // unless another worker steals them first
+        tpng_deque_push_front(pool->deques+worker, task);
+    } else {
+        // from outside: dealt out in order, so every 
+        // worker starts with one of the first tasks
+        tpng_deque_push_back(pool->deques+pool->nextDeque, task);
+        pool->nextDeque = (pool->nextDeque+1) % pool->workers;
+    }
+    tpng_cond_broadcast(&pool->wake);
+    tpng_mutex_unlock(&pool->lock);
+}
+
+static void tpng_pool_wait(void * userData, void * groupData) {
+    tpng_pool_t * pool = userData;
+    tpng_group_t * group = groupData;
+    int worker = tpng_pool_get_member(pool);
+    tpng_task_t task;
+    if (worker < 0) worker = 0;
+
+    // runs tasks meanwhile, so waiting never idles a worker
+    tpng_mutex_lock(&pool->lock);
+    while(group->pending) {
+        if (tpng_pool_take(pool, worker, &task)) 
+            tpng_pool_execute(pool, worker, &task);
+        else
+            tpng_cond_wait(&pool->wake, &pool->lock);
+    }
+    tpng_mutex_unlock(&pool->lock);
+    TPNG_FREE(group);
+}
+
+static int tpng_pool_get_worker_count(void * userData) {
+    return ((tpng_pool_t*)userData)->workers;
+}
+
+
+static tpng_pool_t * tpng_pool_create(int workers) {
+    tpng_pool_t * pool;
+    tpng_pool_member_t * members;
+    int i;
+    if (workers < 2) return NULL;
+    pool = TPNG_MALLOC(sizeof(tpng_pool_t) + sizeof(tpng_pool_member_t)*workers);
+    members = (tpng_pool_member_t*)(pool+1);
+    tpng_mutex_init(&pool->lock);
+    tpng_cond_init(&pool->wake);
+    pool->deques = TPNG_CALLOC(workers, sizeof(tpng_deque_t));
+    pool->workers = workers;
+    pool->threads = TPNG_MALLOC(sizeof(tpng_thread_t)*workers);
+    pool->started = TPNG_CALLOC(workers, sizeof(int));
+    pool->nextDeque = 0;
+    pool->stop = 0;
+    pool->scheduler.userData = pool;
+    pool->scheduler.createGroup = tpng_pool_create_group;
+    pool->scheduler.submit = tpng_pool_submit;
+    pool->scheduler.wait = tpng_pool_wait;
+    pool->scheduler.getWorkerCount = tpng_pool_get_worker_count;
+
+    // worker 0's tasks are run by whoever waits on the 
+    // pool, or stolen: nothing is stranded if a thread 
+    // can't be started.
+    for(i = 1; i < workers; ++i) {
+        members[i].pool = pool;
+        members[i].worker = i;
+        pool->started[i] = tpng_thread_start(pool->threads+i, tpng_pool_worker, members+i);
+    }
+    return pool;
+}
+
+static const tpng_scheduler_t * tpng_pool_get_scheduler(tpng_pool_t * pool) {
+    return &pool->scheduler;
+}
+
+static void tpng_pool_destroy(tpng_pool_t * pool) {
+    int i;
+    tpng_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    tpng_cond_broadcast(&pool->wake);
+    tpng_mutex_unlock(&pool->lock);
+    for(i = 1; i < pool->workers; ++i) {
+        if (pool->started[i])
+            tpng_thread_join(pool->threads[i]);
+        TPNG_FREE(pool->deques[i].tasks);
+    }
+    TPNG_FREE(pool->deques[0].tasks);
+    TPNG_FREE(pool->deques);
+    TPNG_FREE(pool->threads);
+    TPNG_FREE(pool->started);
+    tpng_cond_destroy(&pool->wake);
+    tpng_mutex_destroy(&pool->lock);
+    TPNG_FREE(pool);
+}
+#else
+// Without threads, there are no pools.
+static tpng_pool_t * tpng_pool_create(int workers) {
+    return NULL;
+}
+static const tpng_scheduler_t * tpng_pool_get_scheduler(tpng_pool_t * pool) {
+    return NULL;
+}
+static void tpng_pool_destroy(tpng_pool_t * pool) {}
+#endif
+
+
+static int tpng_scheduler_get_worker_count(const tpng_scheduler_t * scheduler) {
+    return scheduler ? scheduler->getWorkerCount(scheduler->userData) : 1;
+}
+
+
+static void tpng_parallel_run(const tpng_scheduler_t * scheduler, void (*task)(void *), void * tasks, size_t stride, int count) {
+    int i;
+    if (count > 1 && tpng_scheduler_get_worker_count(scheduler) > 1) {
+        void * group = scheduler->createGroup(scheduler->userData);
+        for(i = 0; i < count; ++i) {
+            scheduler->submit(scheduler->userData, group, task, (uint8_t*)tasks + i*stride);
+        }
+        scheduler->wait(scheduler->userData, group);
+        return;
+    }
+    for(i = 0; i < count; ++i) {
+        task((uint8_t*)tasks + i*stride);
+    }
+}
+
+///////////////
+
+
+
+
+
+
+// CRC-32 
+///////////////
+// Slice-by-8 tables for the PNG CRC-32 (reflected polynomial 0xedb88320).
+// TPNG_CRC_TABLE[0] is the usual byte-wise table; TPNG_CRC_TABLE[k] 
+// advances a byte through k more zero bytes.
+static const uint32_t TPNG_CRC_TABLE[8][256] = {
+  {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+  },
+  {
+    0x00000000, 0x191b3141, 0x32366282, 0x2b2d53c3, 0x646cc504, 0x7d77f445,
+    0x565aa786, 0x4f4196c7, 0xc8d98a08, 0xd1c2bb49, 0xfaefe88a, 0xe3f4d9cb,
+    0xacb54f0c, 0xb5ae7e4d, 0x9e832d8e, 0x87981ccf, 0x4ac21251, 0x53d92310,
+    0x78f470d3, 0x61ef4192, 0x2eaed755, 0x37b5e614, 0x1c98b5d7, 0x05838496,
+    0x821b9859, 0x9b00a918, 0xb02dfadb, 0xa936cb9a, 0xe6775d5d, 0xff6c6c1c,
+    0xd4413fdf, 0xcd5a0e9e, 0x958424a2, 0x8c9f15e3, 0xa7b24620, 0xbea97761,
+    0xf1e8e1a6, 0xe8f3d0e7, 0xc3de8324, 0xdac5b265, 0x5d5daeaa, 0x44469feb,
+    0x6f6bcc28, 0x7670fd69, 0x39316bae, 0x202a5aef, 0x0b07092c, 0x121c386d,
+    0xdf4636f3, 0xc65d07b2, 0xed705471, 0xf46b6530, 0xbb2af3f7, 0xa231c2b6,
+    0x891c9175, 0x9007a034, 0x179fbcfb, 0x0e848dba, 0x25a9de79, 0x3cb2ef38,
+    0x73f379ff, 0x6ae848be, 0x41c51b7d, 0x58de2a3c, 0xf0794f05, 0xe9627e44,
+    0xc24f2d87, 0xdb541cc6, 0x94158a01, 0x8d0ebb40, 0xa623e883, 0xbf38d9c2,
+    0x38a0c50d, 0x21bbf44c, 0x0a96a78f, 0x138d96ce, 0x5ccc0009, 0x45d73148,
+    0x6efa628b, 0x77e153ca, 0xbabb5d54, 0xa3a06c15, 0x888d3fd6, 0x91960e97,
+    0xded79850, 0xc7cca911, 0xece1fad2, 0xf5facb93, 0x7262d75c, 0x6b79e61d,
+    0x4054b5de, 0x594f849f, 0x160e1258, 0x0f152319, 0x243870da, 0x3d23419b,
+    0x65fd6ba7, 0x7ce65ae6, 0x57cb0925, 0x4ed03864, 0x0191aea3, 0x188a9fe2,
+    0x33a7cc21, 0x2abcfd60, 0xad24e1af, 0xb43fd0ee, 0x9f12832d, 0x8609b26c,
+    0xc94824ab, 0xd05315ea, 0xfb7e4629, 0xe2657768, 0x2f3f79f6, 0x362448b7,
+    0x1d091b74, 0x04122a35, 0x4b53bcf2, 0x52488db3, 0x7965de70, 0x607eef31,
+    0xe7e6f3fe, 0xfefdc2bf, 0xd5d0917c, 0xcccba03d, 0x838a36fa, 0x9a9107bb,
+    0xb1bc5478, 0xa8a76539, 0x3b83984b, 0x2298a90a, 0x09b5fac9, 0x10aecb88,
+    0x5fef5d4f, 0x46f46c0e, 0x6dd93fcd, 0x74c20e8c, 0xf35a1243, 0xea412302,
+    0xc16c70c1, 0xd8774180, 0x9736d747, 0x8e2de606, 0xa500b5c5, 0xbc1b8484,
+    0x71418a1a, 0x685abb5b, 0x4377e898, 0x5a6cd9d9, 0x152d4f1e, 0x0c367e5f,
+    0x271b2d9c, 0x3e001cdd, 0xb9980012, 0xa0833153, 0x8bae6290, 0x92b553d1,
+    0xddf4c516, 0xc4eff457, 0xefc2a794, 0xf6d996d5, 0xae07bce9, 0xb71c8da8,
+    0x9c31de6b, 0x852aef2a, 0xca6b79ed, 0xd37048ac, 0xf85d1b6f, 0xe1462a2e,
+    0x66de36e1, 0x7fc507a0, 0x54e85463, 0x4df36522, 0x02b2f3e5, 0x1ba9c2a4,
+    0x30849167, 0x299fa026, 0xe4c5aeb8, 0xfdde9ff9, 0xd6f3cc3a, 0xcfe8fd7b,
+    0x80a96bbc, 0x99b25afd, 0xb29f093e, 0xab84387f, 0x2c1c24b0, 0x350715f1,
+    0x1e2a4632, 0x07317773, 0x4870e1b4, 0x516bd0f5, 0x7a468336, 0x635db277,
+    0xcbfad74e, 0xd2e1e60f, 0xf9ccb5cc, 0xe0d7848d, 0xaf96124a, 0xb68d230b,
+    0x9da070c8, 0x84bb4189, 0x03235d46, 0x1a386c07, 0x31153fc4, 0x280e0e85,
+    0x674f9842, 0x7e54a903, 0x5579fac0, 0x4c62cb81, 0x8138c51f, 0x9823f45e,
+    0xb30ea79d, 0xaa1596dc, 0xe554001b, 0xfc4f315a, 0xd7626299, 0xce7953d8,
+    0x49e14f17, 0x50fa7e56, 0x7bd72d95, 0x62cc1cd4, 0x2d8d8a13, 0x3496bb52,
+    0x1fbbe891, 0x06a0d9d0, 0x5e7ef3ec, 0x4765c2ad, 0x6c48916e, 0x7553a02f,
+    0x3a1236e8, 0x230907a9, 0x0824546a, 0x113f652b, 0x96a779e4, 0x8fbc48a5,
+    0xa4911b66, 0xbd8a2a27, 0xf2cbbce0, 0xebd08da1, 0xc0fdde62, 0xd9e6ef23,
+    0x14bce1bd, 0x0da7d0fc, 0x268a833f, 0x3f91b27e, 0x70d024b9, 0x69cb15f8,
+    0x42e6463b, 0x5bfd777a, 0xdc656bb5, 0xc57e5af4, 0xee530937, 0xf7483876,
+    0xb809aeb1, 0xa1129ff0, 0x8a3fcc33, 0x9324fd72
+  },
+  {
+    0x00000000, 0x01c26a37, 0x0384d46e, 0x0246be59, 0x0709a8dc, 0x06cbc2eb,
+    0x048d7cb2, 0x054f1685, 0x0e1351b8, 0x0fd13b8f, 0x0d9785d6, 0x0c55efe1,
+    0x091af964, 0x08d89353, 0x0a9e2d0a, 0x0b5c473d, 0x1c26a370, 0x1de4c947,
+    0x1fa2771e, 0x1e601d29, 0x1b2f0bac, 0x1aed619b, 0x18abdfc2, 0x1969b5f5,
+    0x1235f2c8, 0x13f798ff, 0x11b126a6, 0x10734c91, 0x153c5a14, 0x14fe3023,
+    0x16b88e7a, 0x177ae44d, 0x384d46e0, 0x398f2cd7, 0x3bc9928e, 0x3a0bf8b9,
+    0x3f44ee3c, 0x3e86840b, 0x3cc03a52, 0x3d025065, 0x365e1758, 0x379c7d6f,
+    0x35dac336, 0x3418a901, 0x3157bf84, 0x3095d5b3, 0x32d36bea, 0x331101dd,
+    0x246be590, 0x25a98fa7, 0x27ef31fe, 0x262d5bc9, 0x23624d4c, 0x22a0277b,
+    0x20e69922, 0x2124f315, 0x2a78b428, 0x2bbade1f, 0x29fc6046, 0x283e0a71,
+    0x2d711cf4, 0x2cb376c3, 0x2ef5c89a, 0x2f37a2ad, 0x709a8dc0, 0x7158e7f7,
+    0x731e59ae, 0x72dc3399, 0x7793251c, 0x76514f2b, 0x7417f172, 0x75d59b45,
+    0x7e89dc78, 0x7f4bb64f, 0x7d0d0816, 0x7ccf6221, 0x798074a4, 0x78421e93,
+    0x7a04a0ca, 0x7bc6cafd, 0x6cbc2eb0, 0x6d7e4487, 0x6f38fade, 0x6efa90e9,
+    0x6bb5866c, 0x6a77ec5b, 0x68315202, 0x69f33835, 0x62af7f08, 0x636d153f,
+    0x612bab66, 0x60e9c151, 0x65a6d7d4, 0x6464bde3, 0x662203ba, 0x67e0698d,
+    0x48d7cb20, 0x4915a117, 0x4b531f4e, 0x4a917579, 0x4fde63fc, 0x4e1c09cb,
+    0x4c5ab792, 0x4d98dda5, 0x46c49a98, 0x4706f0af, 0x45404ef6, 0x448224c1,
+    0x41cd3244, 0x400f5873, 0x4249e62a, 0x438b8c1d, 0x54f16850, 0x55330267,
+    0x5775bc3e, 0x56b7d609, 0x53f8c08c, 0x523aaabb, 0x507c14e2, 0x51be7ed5,
+    0x5ae239e8, 0x5b2053df, 0x5966ed86, 0x58a487b1, 0x5deb9134, 0x5c29fb03,
+    0x5e6f455a, 0x5fad2f6d, 0xe1351b80, 0xe0f771b7, 0xe2b1cfee, 0xe373a5d9,
+    0xe63cb35c, 0xe7fed96b, 0xe5b86732, 0xe47a0d05, 0xef264a38, 0xeee4200f,
+    0xeca29e56, 0xed60f461, 0xe82fe2e4, 0xe9ed88d3, 0xebab368a, 0xea695cbd,
+    0xfd13b8f0, 0xfcd1d2c7, 0xfe976c9e, 0xff5506a9, 0xfa1a102c, 0xfbd87a1b,
+    0xf99ec442, 0xf85cae75, 0xf300e948, 0xf2c2837f, 0xf0843d26, 0xf1465711,
+    0xf4094194, 0xf5cb2ba3, 0xf78d95fa, 0xf64fffcd, 0xd9785d60, 0xd8ba3757,
+    0xdafc890e, 0xdb3ee339, 0xde71f5bc, 0xdfb39f8b, 0xddf521d2, 0xdc374be5,
+    0xd76b0cd8, 0xd6a966ef, 0xd4efd8b6, 0xd52db281, 0xd062a404, 0xd1a0ce33,
+    0xd3e6706a, 0xd2241a5d, 0xc55efe10, 0xc49c9427, 0xc6da2a7e, 0xc7184049,
+    0xc25756cc, 0xc3953cfb, 0xc1d382a2, 0xc011e895, 0xcb4dafa8, 0xca8fc59f,
+    0xc8c97bc6, 0xc90b11f1, 0xcc440774, 0xcd866d43, 0xcfc0d31a, 0xce02b92d,
+    0x91af9640, 0x906dfc77, 0x922b422e, 0x93e92819, 0x96a63e9c, 0x976454ab,
+    0x9522eaf2, 0x94e080c5, 0x9fbcc7f8, 0x9e7eadcf, 0x9c381396, 0x9dfa79a1,
+    0x98b56f24, 0x99770513, 0x9b31bb4a, 0x9af3d17d, 0x8d893530, 0x8c4b5f07,
+    0x8e0de15e, 0x8fcf8b69, 0x8a809dec, 0x8b42f7db, 0x89044982, 0x88c623b5,
+    0x839a6488, 0x82580ebf, 0x801eb0e6, 0x81dcdad1, 0x8493cc54, 0x8551a663,
+    0x8717183a, 0x86d5720d, 0xa9e2d0a0, 0xa820ba97, 0xaa6604ce, 0xaba46ef9,
+    0xaeeb787c, 0xaf29124b, 0xad6fac12, 0xacadc625, 0xa7f18118, 0xa633eb2f,
+    0xa4755576, 0xa5b73f41, 0xa0f829c4, 0xa13a43f3, 0xa37cfdaa, 0xa2be979d,
+    0xb5c473d0, 0xb40619e7, 0xb640a7be, 0xb782cd89, 0xb2cddb0c, 0xb30fb13b,
+    0xb1490f62, 0xb08b6555, 0xbbd72268, 0xba15485f, 0xb853f606, 0xb9919c31,
+    0xbcde8ab4, 0xbd1ce083, 0xbf5a5eda, 0xbe9834ed
+  },
+  {
+    0x00000000, 0xb8bc6765, 0xaa09c88b, 0x12b5afee, 0x8f629757, 0x37def032,
+    0x256b5fdc, 0x9dd738b9, 0xc5b428ef, 0x7d084f8a, 0x6fbde064, 0xd7018701,
+    0x4ad6bfb8, 0xf26ad8dd, 0xe0df7733, 0x58631056, 0x5019579f, 0xe8a530fa,
+    0xfa109f14, 0x42acf871, 0xdf7bc0c8, 0x67c7a7ad, 0x75720843, 0xcdce6f26,
+    0x95ad7f70, 0x2d111815, 0x3fa4b7fb, 0x8718d09e, 0x1acfe827, 0xa2738f42,
+    0xb0c620ac, 0x087a47c9, 0xa032af3e, 0x188ec85b, 0x0a3b67b5, 0xb28700d0,
+    0x2f503869, 0x97ec5f0c, 0x8559f0e2, 0x3de59787, 0x658687d1, 0xdd3ae0b4,
+    0xcf8f4f5a, 0x7733283f, 0xeae41086, 0x525877e3, 0x40edd80d, 0xf851bf68,
+    0xf02bf8a1, 0x48979fc4, 0x5a22302a, 0xe29e574f, 0x7f496ff6, 0xc7f50893,
+    0xd540a77d, 0x6dfcc018, 0x359fd04e, 0x8d23b72b, 0x9f9618c5, 0x272a7fa0,
+    0xbafd4719, 0x0241207c, 0x10f48f92, 0xa848e8f7, 0x9b14583d, 0x23a83f58,
+    0x311d90b6, 0x89a1f7d3, 0x1476cf6a, 0xaccaa80f, 0xbe7f07e1, 0x06c36084,
+    0x5ea070d2, 0xe61c17b7, 0xf4a9b859, 0x4c15df3c, 0xd1c2e785, 0x697e80e0,
+    0x7bcb2f0e, 0xc377486b, 0xcb0d0fa2, 0x73b168c7, 0x6104c729, 0xd9b8a04c,
+    0x446f98f5, 0xfcd3ff90, 0xee66507e, 0x56da371b, 0x0eb9274d, 0xb6054028,
+    0xa4b0efc6, 0x1c0c88a3, 0x81dbb01a, 0x3967d77f, 0x2bd27891, 0x936e1ff4,
+    0x3b26f703, 0x839a9066, 0x912f3f88, 0x299358ed, 0xb4446054, 0x0cf80731,
+    0x1e4da8df, 0xa6f1cfba, 0xfe92dfec, 0x462eb889, 0x549b1767, 0xec277002,
+    0x71f048bb, 0xc94c2fde, 0xdbf98030, 0x6345e755, 0x6b3fa09c, 0xd383c7f9,
+    0xc1366817, 0x798a0f72, 0xe45d37cb, 0x5ce150ae, 0x4e54ff40, 0xf6e89825,
+    0xae8b8873, 0x1637ef16, 0x048240f8, 0xbc3e279d, 0x21e91f24, 0x99557841,
+    0x8be0d7af, 0x335cb0ca, 0xed59b63b, 0x55e5d15e, 0x47507eb0, 0xffec19d5,
+    0x623b216c, 0xda874609, 0xc832e9e7, 0x708e8e82, 0x28ed9ed4, 0x9051f9b1,
+    0x82e4565f, 0x3a58313a, 0xa78f0983, 0x1f336ee6, 0x0d86c108, 0xb53aa66d,
+    0xbd40e1a4, 0x05fc86c1, 0x1749292f, 0xaff54e4a, 0x322276f3, 0x8a9e1196,
+    0x982bbe78, 0x2097d91d, 0x78f4c94b, 0xc048ae2e, 0xd2fd01c0, 0x6a4166a5,
+    0xf7965e1c, 0x4f2a3979, 0x5d9f9697, 0xe523f1f2, 0x4d6b1905, 0xf5d77e60,
+    0xe762d18e, 0x5fdeb6eb, 0xc2098e52, 0x7ab5e937, 0x680046d9, 0xd0bc21bc,
+    0x88df31ea, 0x3063568f, 0x22d6f961, 0x9a6a9e04, 0x07bda6bd, 0xbf01c1d8,
+    0xadb46e36, 0x15080953, 0x1d724e9a, 0xa5ce29ff, 0xb77b8611, 0x0fc7e174,
+    0x9210d9cd, 0x2aacbea8, 0x38191146, 0x80a57623, 0xd8c66675, 0x607a0110,
+    0x72cfaefe, 0xca73c99b, 0x57a4f122, 0xef189647, 0xfdad39a9, 0x45115ecc,
+    0x764dee06, 0xcef18963, 0xdc44268d, 0x64f841e8, 0xf92f7951, 0x41931e34,
+    0x5326b1da, 0xeb9ad6bf, 0xb3f9c6e9, 0x0b45a18c, 0x19f00e62, 0xa14c6907,
+    0x3c9b51be, 0x842736db, 0x96929935, 0x2e2efe50, 0x2654b999, 0x9ee8defc,
+    0x8c5d7112, 0x34e11677, 0xa9362ece, 0x118a49ab, 0x033fe645, 0xbb838120,
+    0xe3e09176, 0x5b5cf613, 0x49e959fd, 0xf1553e98, 0x6c820621, 0xd43e6144,
+    0xc68bceaa, 0x7e37a9cf, 0xd67f4138, 0x6ec3265d, 0x7c7689b3, 0xc4caeed6,
+    0x591dd66f, 0xe1a1b10a, 0xf3141ee4, 0x4ba87981, 0x13cb69d7, 0xab770eb2,
+    0xb9c2a15c, 0x017ec639, 0x9ca9fe80, 0x241599e5, 0x36a0360b, 0x8e1c516e,
+    0x866616a7, 0x3eda71c2, 0x2c6fde2c, 0x94d3b949, 0x090481f0, 0xb1b8e695,
+    0xa30d497b, 0x1bb12e1e, 0x43d23e48, 0xfb6e592d, 0xe9dbf6c3, 0x516791a6,
+    0xccb0a91f, 0x740cce7a, 0x66b96194, 0xde0506f1
+  },
+  {
+    0x00000000, 0x3d6029b0, 0x7ac05360, 0x47a07ad0, 0xf580a6c0, 0xc8e08f70,
+    0x8f40f5a0, 0xb220dc10, 0x30704bc1, 0x0d106271, 0x4ab018a1, 0x77d03111,
+    0xc5f0ed01, 0xf890c4b1, 0xbf30be61, 0x825097d1, 0x60e09782, 0x5d80be32,
+    0x1a20c4e2, 0x2740ed52, 0x95603142, 0xa80018f2, 0xefa06222, 0xd2c04b92,
+    0x5090dc43, 0x6df0f5f3, 0x2a508f23, 0x1730a693, 0xa5107a83, 0x98705333,
+    0xdfd029e3, 0xe2b00053, 0xc1c12f04, 0xfca106b4, 0xbb017c64, 0x866155d4,
+    0x344189c4, 0x0921a074, 0x4e81daa4, 0x73e1f314, 0xf1b164c5, 0xccd14d75,
+    0x8b7137a5, 0xb6111e15, 0x0431c205, 0x3951ebb5, 0x7ef19165, 0x4391b8d5,
+    0xa121b886, 0x9c419136, 0xdbe1ebe6, 0xe681c256, 0x54a11e46, 0x69c137f6,
+    0x2e614d26, 0x13016496, 0x9151f347, 0xac31daf7, 0xeb91a027, 0xd6f18997,
+    0x64d15587, 0x59b17c37, 0x1e1106e7, 0x23712f57, 0x58f35849, 0x659371f9,
+    0x22330b29, 0x1f532299, 0xad73fe89, 0x9013d739, 0xd7b3ade9, 0xead38459,
+    0x68831388, 0x55e33a38, 0x124340e8, 0x2f236958, 0x9d03b548, 0xa0639cf8,
+    0xe7c3e628, 0xdaa3cf98, 0x3813cfcb, 0x0573e67b, 0x42d39cab, 0x7fb3b51b,
+    0xcd93690b, 0xf0f340bb, 0xb7533a6b, 0x8a3313db, 0x0863840a, 0x3503adba,
+    0x72a3d76a, 0x4fc3feda, 0xfde322ca, 0xc0830b7a, 0x872371aa, 0xba43581a,
+    0x9932774d, 0xa4525efd, 0xe3f2242d, 0xde920d9d, 0x6cb2d18d, 0x51d2f83d,
+    0x167282ed, 0x2b12ab5d, 0xa9423c8c, 0x9422153c, 0xd3826fec, 0xeee2465c,
+    0x5cc29a4c, 0x61a2b3fc, 0x2602c92c, 0x1b62e09c, 0xf9d2e0cf, 0xc4b2c97f,
+    0x8312b3af, 0xbe729a1f, 0x0c52460f, 0x31326fbf, 0x7692156f, 0x4bf23cdf,
+    0xc9a2ab0e, 0xf4c282be, 0xb362f86e, 0x8e02d1de, 0x3c220dce, 0x0142247e,
+    0x46e25eae, 0x7b82771e, 0xb1e6b092, 0x8c869922, 0xcb26e3f2, 0xf646ca42,
+    0x44661652, 0x79063fe2, 0x3ea64532, 0x03c66c82, 0x8196fb53, 0xbcf6d2e3,
+    0xfb56a833, 0xc6368183, 0x74165d93, 0x49767423, 0x0ed60ef3, 0x33b62743,
+    0xd1062710, 0xec660ea0, 0xabc67470, 0x96a65dc0, 0x248681d0, 0x19e6a860,
+    0x5e46d2b0, 0x6326fb00, 0xe1766cd1, 0xdc164561, 0x9bb63fb1, 0xa6d61601,
+    0x14f6ca11, 0x2996e3a1, 0x6e369971, 0x5356b0c1, 0x70279f96, 0x4d47b626,
+    0x0ae7ccf6, 0x3787e546, 0x85a73956, 0xb8c710e6, 0xff676a36, 0xc2074386,
+    0x4057d457, 0x7d37fde7, 0x3a978737, 0x07f7ae87, 0xb5d77297, 0x88b75b27,
+    0xcf1721f7, 0xf2770847, 0x10c70814, 0x2da721a4, 0x6a075b74, 0x576772c4,
+    0xe547aed4, 0xd8278764, 0x9f87fdb4, 0xa2e7d404, 0x20b743d5, 0x1dd76a65,
+    0x5a7710b5, 0x67173905, 0xd537e515, 0xe857cca5, 0xaff7b675, 0x92979fc5,
+    0xe915e8db, 0xd475c16b, 0x93d5bbbb, 0xaeb5920b, 0x1c954e1b, 0x21f567ab,
+    0x66551d7b, 0x5b3534cb, 0xd965a31a, 0xe4058aaa, 0xa3a5f07a, 0x9ec5d9ca,
+    0x2ce505da, 0x11852c6a, 0x562556ba, 0x6b457f0a, 0x89f57f59, 0xb49556e9,
+    0xf3352c39, 0xce550589, 0x7c75d999, 0x4115f029, 0x06b58af9, 0x3bd5a349,
+    0xb9853498, 0x84e51d28, 0xc34567f8, 0xfe254e48, 0x4c059258, 0x7165bbe8,
+    0x36c5c138, 0x0ba5e888, 0x28d4c7df, 0x15b4ee6f, 0x521494bf, 0x6f74bd0f,
+    0xdd54611f, 0xe03448af, 0xa794327f, 0x9af41bcf, 0x18a48c1e, 0x25c4a5ae,
+    0x6264df7e, 0x5f04f6ce, 0xed242ade, 0xd044036e, 0x97e479be, 0xaa84500e,
+    0x4834505d, 0x755479ed, 0x32f4033d, 0x0f942a8d, 0xbdb4f69d, 0x80d4df2d,
+    0xc774a5fd, 0xfa148c4d, 0x78441b9c, 0x4524322c, 0x028448fc, 0x3fe4614c,
+    0x8dc4bd5c, 0xb0a494ec, 0xf704ee3c, 0xca64c78c
+  },
+  {
+    0x00000000, 0xcb5cd3a5, 0x4dc8a10b, 0x869472ae, 0x9b914216, 0x50cd91b3,
+    0xd659e31d, 0x1d0530b8, 0xec53826d, 0x270f51c8, 0xa19b2366, 0x6ac7f0c3,
+    0x77c2c07b, 0xbc9e13de, 0x3a0a6170, 0xf156b2d5, 0x03d6029b, 0xc88ad13e,
+    0x4e1ea390, 0x85427035, 0x9847408d, 0x531b9328, 0xd58fe186, 0x1ed33223,
+    0xef8580f6, 0x24d95353, 0xa24d21fd, 0x6911f258, 0x7414c2e0, 0xbf481145,
+    0x39dc63eb, 0xf280b04e, 0x07ac0536, 0xccf0d693, 0x4a64a43d, 0x81387798,
+    0x9c3d4720, 0x57619485, 0xd1f5e62b, 0x1aa9358e, 0xebff875b, 0x20a354fe,
+    0xa6372650, 0x6d6bf5f5, 0x706ec54d, 0xbb3216e8, 0x3da66446, 0xf6fab7e3,
+    0x047a07ad, 0xcf26d408, 0x49b2a6a6, 0x82ee7503, 0x9feb45bb, 0x54b7961e,
+    0xd223e4b0, 0x197f3715, 0xe82985c0, 0x23755665, 0xa5e124cb, 0x6ebdf76e,
+    0x73b8c7d6, 0xb8e41473, 0x3e7066dd, 0xf52cb578, 0x0f580a6c, 0xc404d9c9,
+    0x4290ab67, 0x89cc78c2, 0x94c9487a, 0x5f959bdf, 0xd901e971, 0x125d3ad4,
+    0xe30b8801, 0x28575ba4, 0xaec3290a, 0x659ffaaf, 0x789aca17, 0xb3c619b2,
+    0x35526b1c, 0xfe0eb8b9, 0x0c8e08f7, 0xc7d2db52, 0x4146a9fc, 0x8a1a7a59,
+    0x971f4ae1, 0x5c439944, 0xdad7ebea, 0x118b384f, 0xe0dd8a9a, 0x2b81593f,
+    0xad152b91, 0x6649f834, 0x7b4cc88c, 0xb0101b29, 0x36846987, 0xfdd8ba22,
+    0x08f40f5a, 0xc3a8dcff, 0x453cae51, 0x8e607df4, 0x93654d4c, 0x58399ee9,
+    0xdeadec47, 0x15f13fe2, 0xe4a78d37, 0x2ffb5e92, 0xa96f2c3c, 0x6233ff99,
+    0x7f36cf21, 0xb46a1c84, 0x32fe6e2a, 0xf9a2bd8f, 0x0b220dc1, 0xc07ede64,
+    0x46eaacca, 0x8db67f6f, 0x90b34fd7, 0x5bef9c72, 0xdd7beedc, 0x16273d79,
+    0xe7718fac, 0x2c2d5c09, 0xaab92ea7, 0x61e5fd02, 0x7ce0cdba, 0xb7bc1e1f,
+    0x31286cb1, 0xfa74bf14, 0x1eb014d8, 0xd5ecc77d, 0x5378b5d3, 0x98246676,
+    0x852156ce, 0x4e7d856b, 0xc8e9f7c5, 0x03b52460, 0xf2e396b5, 0x39bf4510,
+    0xbf2b37be, 0x7477e41b, 0x6972d4a3, 0xa22e0706, 0x24ba75a8, 0xefe6a60d,
+    0x1d661643, 0xd63ac5e6, 0x50aeb748, 0x9bf264ed, 0x86f75455, 0x4dab87f0,
+    0xcb3ff55e, 0x006326fb, 0xf135942e, 0x3a69478b, 0xbcfd3525, 0x77a1e680,
+    0x6aa4d638, 0xa1f8059d, 0x276c7733, 0xec30a496, 0x191c11ee, 0xd240c24b,
+    0x54d4b0e5, 0x9f886340, 0x828d53f8, 0x49d1805d, 0xcf45f2f3, 0x04192156,
+    0xf54f9383, 0x3e134026, 0xb8873288, 0x73dbe12d, 0x6eded195, 0xa5820230,
+    0x2316709e, 0xe84aa33b, 0x1aca1375, 0xd196c0d0, 0x5702b27e, 0x9c5e61db,
+    0x815b5163, 0x4a0782c6, 0xcc93f068, 0x07cf23cd, 0xf6999118, 0x3dc542bd,
+    0xbb513013, 0x700de3b6, 0x6d08d30e, 0xa65400ab, 0x20c07205, 0xeb9ca1a0,
+    0x11e81eb4, 0xdab4cd11, 0x5c20bfbf, 0x977c6c1a, 0x8a795ca2, 0x41258f07,
+    0xc7b1fda9, 0x0ced2e0c, 0xfdbb9cd9, 0x36e74f7c, 0xb0733dd2, 0x7b2fee77,
+    0x662adecf, 0xad760d6a, 0x2be27fc4, 0xe0beac61, 0x123e1c2f, 0xd962cf8a,
+    0x5ff6bd24, 0x94aa6e81, 0x89af5e39, 0x42f38d9c, 0xc467ff32, 0x0f3b2c97,
+    0xfe6d9e42, 0x35314de7, 0xb3a53f49, 0x78f9ecec, 0x65fcdc54, 0xaea00ff1,
+    0x28347d5f, 0xe368aefa, 0x16441b82, 0xdd18c827, 0x5b8cba89, 0x90d0692c,
+    0x8dd55994, 0x46898a31, 0xc01df89f, 0x0b412b3a, 0xfa1799ef, 0x314b4a4a,
+    0xb7df38e4, 0x7c83eb41, 0x6186dbf9, 0xaada085c, 0x2c4e7af2, 0xe712a957,
+    0x15921919, 0xdececabc, 0x585ab812, 0x93066bb7, 0x8e035b0f, 0x455f88aa,
+    0xc3cbfa04, 0x089729a1, 0xf9c19b74, 0x329d48d1, 0xb4093a7f, 0x7f55e9da,
+    0x6250d962, 0xa90c0ac7, 0x2f987869, 0xe4c4abcc
+  },
+  {
+    0x00000000, 0xa6770bb4, 0x979f1129, 0x31e81a9d, 0xf44f2413, 0x52382fa7,
+    0x63d0353a, 0xc5a73e8e, 0x33ef4e67, 0x959845d3, 0xa4705f4e, 0x020754fa,
+    0xc7a06a74, 0x61d761c0, 0x503f7b5d, 0xf64870e9, 0x67de9cce, 0xc1a9977a,
+    0xf0418de7, 0x56368653, 0x9391b8dd, 0x35e6b369, 0x040ea9f4, 0xa279a240,
+    0x5431d2a9, 0xf246d91d, 0xc3aec380, 0x65d9c834, 0xa07ef6ba, 0x0609fd0e,
+    0x37e1e793, 0x9196ec27, 0xcfbd399c, 0x69ca3228, 0x582228b5, 0xfe552301,
+    0x3bf21d8f, 0x9d85163b, 0xac6d0ca6, 0x0a1a0712, 0xfc5277fb, 0x5a257c4f,
+    0x6bcd66d2, 0xcdba6d66, 0x081d53e8, 0xae6a585c, 0x9f8242c1, 0x39f54975,
+    0xa863a552, 0x0e14aee6, 0x3ffcb47b, 0x998bbfcf, 0x5c2c8141, 0xfa5b8af5,
+    0xcbb39068, 0x6dc49bdc, 0x9b8ceb35, 0x3dfbe081, 0x0c13fa1c, 0xaa64f1a8,
+    0x6fc3cf26, 0xc9b4c492, 0xf85cde0f, 0x5e2bd5bb, 0x440b7579, 0xe27c7ecd,
+    0xd3946450, 0x75e36fe4, 0xb044516a, 0x16335ade, 0x27db4043, 0x81ac4bf7,
+    0x77e43b1e, 0xd19330aa, 0xe07b2a37, 0x460c2183, 0x83ab1f0d, 0x25dc14b9,
+    0x14340e24, 0xb2430590, 0x23d5e9b7, 0x85a2e203, 0xb44af89e, 0x123df32a,
+    0xd79acda4, 0x71edc610, 0x4005dc8d, 0xe672d739, 0x103aa7d0, 0xb64dac64,
+    0x87a5b6f9, 0x21d2bd4d, 0xe47583c3, 0x42028877, 0x73ea92ea, 0xd59d995e,
+    0x8bb64ce5, 0x2dc14751, 0x1c295dcc, 0xba5e5678, 0x7ff968f6, 0xd98e6342,
+    0xe86679df, 0x4e11726b, 0xb8590282, 0x1e2e0936, 0x2fc613ab, 0x89b1181f,
+    0x4c162691, 0xea612d25, 0xdb8937b8, 0x7dfe3c0c, 0xec68d02b, 0x4a1fdb9f,
+    0x7bf7c102, 0xdd80cab6, 0x1827f438, 0xbe50ff8c, 0x8fb8e511, 0x29cfeea5,
+    0xdf879e4c, 0x79f095f8, 0x48188f65, 0xee6f84d1, 0x2bc8ba5f, 0x8dbfb1eb,
+    0xbc57ab76, 0x1a20a0c2, 0x8816eaf2, 0x2e61e146, 0x1f89fbdb, 0xb9fef06f,
+    0x7c59cee1, 0xda2ec555, 0xebc6dfc8, 0x4db1d47c, 0xbbf9a495, 0x1d8eaf21,
+    0x2c66b5bc, 0x8a11be08, 0x4fb68086, 0xe9c18b32, 0xd82991af, 0x7e5e9a1b,
+    0xefc8763c, 0x49bf7d88, 0x78576715, 0xde206ca1, 0x1b87522f, 0xbdf0599b,
+    0x8c184306, 0x2a6f48b2, 0xdc27385b, 0x7a5033ef, 0x4bb82972, 0xedcf22c6,
+    0x28681c48, 0x8e1f17fc, 0xbff70d61, 0x198006d5, 0x47abd36e, 0xe1dcd8da,
+    0xd034c247, 0x7643c9f3, 0xb3e4f77d, 0x1593fcc9, 0x247be654, 0x820cede0,
+    0x74449d09, 0xd23396bd, 0xe3db8c20, 0x45ac8794, 0x800bb91a, 0x267cb2ae,
+    0x1794a833, 0xb1e3a387, 0x20754fa0, 0x86024414, 0xb7ea5e89, 0x119d553d,
+    0xd43a6bb3, 0x724d6007, 0x43a57a9a, 0xe5d2712e, 0x139a01c7, 0xb5ed0a73,
+    0x840510ee, 0x22721b5a, 0xe7d525d4, 0x41a22e60, 0x704a34fd, 0xd63d3f49,
+    0xcc1d9f8b, 0x6a6a943f, 0x5b828ea2, 0xfdf58516, 0x3852bb98, 0x9e25b02c,
+    0xafcdaab1, 0x09baa105, 0xfff2d1ec, 0x5985da58, 0x686dc0c5, 0xce1acb71,
+    0x0bbdf5ff, 0xadcafe4b, 0x9c22e4d6, 0x3a55ef62, 0xabc30345, 0x0db408f1,
+    0x3c5c126c, 0x9a2b19d8, 0x5f8c2756, 0xf9fb2ce2, 0xc813367f, 0x6e643dcb,
+    0x982c4d22, 0x3e5b4696, 0x0fb35c0b, 0xa9c457bf, 0x6c636931, 0xca146285,
+    0xfbfc7818, 0x5d8b73ac, 0x03a0a617, 0xa5d7ada3, 0x943fb73e, 0x3248bc8a,
+    0xf7ef8204, 0x519889b0, 0x6070932d, 0xc6079899, 0x304fe870, 0x9638e3c4,
+    0xa7d0f959, 0x01a7f2ed, 0xc400cc63, 0x6277c7d7, 0x539fdd4a, 0xf5e8d6fe,
+    0x647e3ad9, 0xc209316d, 0xf3e12bf0, 0x55962044, 0x90311eca, 0x3646157e,
+    0x07ae0fe3, 0xa1d90457, 0x579174be, 0xf1e67f0a, 0xc00e6597, 0x66796e23,
+    0xa3de50ad, 0x05a95b19, 0x34414184, 0x92364a30
+  },
+  {
+    0x00000000, 0xccaa009e, 0x4225077d, 0x8e8f07e3, 0x844a0efa, 0x48e00e64,
+    0xc66f0987, 0x0ac50919, 0xd3e51bb5, 0x1f4f1b2b, 0x91c01cc8, 0x5d6a1c56,
+    0x57af154f, 0x9b0515d1, 0x158a1232, 0xd92012ac, 0x7cbb312b, 0xb01131b5,
+    0x3e9e3656, 0xf23436c8, 0xf8f13fd1, 0x345b3f4f, 0xbad438ac, 0x767e3832,
+    0xaf5e2a9e, 0x63f42a00, 0xed7b2de3, 0x21d12d7d, 0x2b142464, 0xe7be24fa,
+    0x69312319, 0xa59b2387, 0xf9766256, 0x35dc62c8, 0xbb53652b, 0x77f965b5,
+    0x7d3c6cac, 0xb1966c32, 0x3f196bd1, 0xf3b36b4f, 0x2a9379e3, 0xe639797d,
+    0x68b67e9e, 0xa41c7e00, 0xaed97719, 0x62737787, 0xecfc7064, 0x205670fa,
+    0x85cd537d, 0x496753e3, 0xc7e85400, 0x0b42549e, 0x01875d87, 0xcd2d5d19,
+    0x43a25afa, 0x8f085a64, 0x562848c8, 0x9a824856, 0x140d4fb5, 0xd8a74f2b,
+    0xd2624632, 0x1ec846ac, 0x9047414f, 0x5ced41d1, 0x299dc2ed, 0xe537c273,
+    0x6bb8c590, 0xa712c50e, 0xadd7cc17, 0x617dcc89, 0xeff2cb6a, 0x2358cbf4,
+    0xfa78d958, 0x36d2d9c6, 0xb85dde25, 0x74f7debb, 0x7e32d7a2, 0xb298d73c,
+    0x3c17d0df, 0xf0bdd041, 0x5526f3c6, 0x998cf358, 0x1703f4bb, 0xdba9f425,
+    0xd16cfd3c, 0x1dc6fda2, 0x9349fa41, 0x5fe3fadf, 0x86c3e873, 0x4a69e8ed,
+    0xc4e6ef0e, 0x084cef90, 0x0289e689, 0xce23e617, 0x40ace1f4, 0x8c06e16a,
+    0xd0eba0bb, 0x1c41a025, 0x92cea7c6, 0x5e64a758, 0x54a1ae41, 0x980baedf,
+    0x1684a93c, 0xda2ea9a2, 0x030ebb0e, 0xcfa4bb90, 0x412bbc73, 0x8d81bced,
+    0x8744b5f4, 0x4beeb56a, 0xc561b289, 0x09cbb217, 0xac509190, 0x60fa910e,
+    0xee7596ed, 0x22df9673, 0x281a9f6a, 0xe4b09ff4, 0x6a3f9817, 0xa6959889,
+    0x7fb58a25, 0xb31f8abb, 0x3d908d58, 0xf13a8dc6, 0xfbff84df, 0x37558441,
+    0xb9da83a2, 0x7570833c, 0x533b85da, 0x9f918544, 0x111e82a7, 0xddb48239,
+    0xd7718b20, 0x1bdb8bbe, 0x95548c5d, 0x59fe8cc3, 0x80de9e6f, 0x4c749ef1,
+    0xc2fb9912, 0x0e51998c, 0x04949095, 0xc83e900b, 0x46b197e8, 0x8a1b9776,
+    0x2f80b4f1, 0xe32ab46f, 0x6da5b38c, 0xa10fb312, 0xabcaba0b, 0x6760ba95,
+    0xe9efbd76, 0x2545bde8, 0xfc65af44, 0x30cfafda, 0xbe40a839, 0x72eaa8a7,
+    0x782fa1be, 0xb485a120, 0x3a0aa6c3, 0xf6a0a65d, 0xaa4de78c, 0x66e7e712,
+    0xe868e0f1, 0x24c2e06f, 0x2e07e976, 0xe2ade9e8, 0x6c22ee0b, 0xa088ee95,
+    0x79a8fc39, 0xb502fca7, 0x3b8dfb44, 0xf727fbda, 0xfde2f2c3, 0x3148f25d,
+    0xbfc7f5be, 0x736df520, 0xd6f6d6a7, 0x1a5cd639, 0x94d3d1da, 0x5879d144,
+    0x52bcd85d, 0x9e16d8c3, 0x1099df20, 0xdc33dfbe, 0x0513cd12, 0xc9b9cd8c,
+    0x4736ca6f, 0x8b9ccaf1, 0x8159c3e8, 0x4df3c376, 0xc37cc495, 0x0fd6c40b,
+    0x7aa64737, 0xb60c47a9, 0x3883404a, 0xf42940d4, 0xfeec49cd, 0x32464953,
+    0xbcc94eb0, 0x70634e2e, 0xa9435c82, 0x65e95c1c, 0xeb665bff, 0x27cc5b61,
+    0x2d095278, 0xe1a352e6, 0x6f2c5505, 0xa386559b, 0x061d761c, 0xcab77682,
+    0x44387161, 0x889271ff, 0x825778e6, 0x4efd7878, 0xc0727f9b, 0x0cd87f05,
+    0xd5f86da9, 0x19526d37, 0x97dd6ad4, 0x5b776a4a, 0x51b26353, 0x9d1863cd,
+    0x1397642e, 0xdf3d64b0, 0x83d02561, 0x4f7a25ff, 0xc1f5221c, 0x0d5f2282,
+    0x079a2b9b, 0xcb302b05, 0x45bf2ce6, 0x89152c78, 0x50353ed4, 0x9c9f3e4a,
+    0x121039a9, 0xdeba3937, 0xd47f302e, 0x18d530b0, 0x965a3753, 0x5af037cd,
+    0xff6b144a, 0x33c114d4, 0xbd4e1337, 0x71e413a9, 0x7b211ab0, 0xb78b1a2e,
+    0x39041dcd, 0xf5ae1d53, 0x2c8e0fff, 0xe0240f61, 0x6eab0882, 0xa201081c,
+    0xa8c40105, 0x646e019b, 0xeae10678, 0x264b06e6
+  }
+};
+
+
+// Portable CRC: 8 bytes per step.
+static uint32_t tpng_crc32_slice8(uint32_t crc, const uint8_t * data, size_t len) {
+    uint32_t lo, hi;
+    while(len >= 8) {
+        lo = crc ^ ((uint32_t)data[0]       | ((uint32_t)data[1] << 8) |
+                   ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        hi =        (uint32_t)data[4]       | ((uint32_t)data[5] << 8) |
+                   ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+        crc = TPNG_CRC_TABLE[7][ lo        & 0xff] ^
+              TPNG_CRC_TABLE[6][(lo >> 8)  & 0xff] ^
+              TPNG_CRC_TABLE[5][(lo >> 16) & 0xff] ^
+              TPNG_CRC_TABLE[4][ lo >> 24        ] ^
+              TPNG_CRC_TABLE[3][ hi        & 0xff] ^
+              TPNG_CRC_TABLE[2][(hi >> 8)  & 0xff] ^
+              TPNG_CRC_TABLE[1][(hi >> 16) & 0xff] ^
+              TPNG_CRC_TABLE[0][ hi >> 24        ];
+        data += 8;
+        len  -= 8;
+    }
+    while(len--) {
+        crc = TPNG_CRC_TABLE[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+
+
+#if TPNG_HARDWARE_CRC && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TPNG_CRC_PCLMUL
+#include <immintrin.h>
+
+// Carry-less multiplication folding (Intel, "Fast CRC Computation for 
+// Generic Polynomials Using PCLMULQDQ Instruction"). 
+// Needs len >= 64 and len a multiple of 16. crc is NOT pre/post inverted.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t tpng_crc32_pclmul(uint32_t crc, const uint8_t * data, size_t len) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+    const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    data += 64;
+    len  -= 64;
+
+    // fold 4 lanes in parallel, 64 bytes at a time
+    x0 = k1k2;
+    while(len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(data + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(data + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(data + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(data + 0x30)));
+        data += 64;
+        len  -= 64;
+    }
+
+    // fold the 4 lanes into one
+    x0 = k3k4;
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // remaining 16 byte blocks
+    while(len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i*)data);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        data += 16;
+        len  -= 16;
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+#elif TPNG_HARDWARE_CRC && defined(__ARM_FEATURE_CRC32) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define TPNG_CRC_ARMV8
+#include <arm_acle.h>
+
+// ARMv8 CRC32 instructions use the same polynomial as PNG.
+// crc is NOT pre/post inverted.
+static uint32_t tpng_crc32_armv8(uint32_t crc, const uint8_t * data, size_t len) {
+    uint64_t v;
+    while(len >= 8) {
+        memcpy(&v, data, 8);
+        crc = __crc32d(crc, v);
+        data += 8;
+        len  -= 8;
+    }
+    while(len--) {
+        crc = __crc32b(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+
+
+static uint32_t tpng_crc32(uint32_t crc, const uint8_t * data, uint32_t len) {
+    crc = ~crc;
+    #if defined(TPNG_CRC_PCLMUL)
+        if (len >= 64 && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+            uint32_t folded = len & ~15u;
+            crc  = tpng_crc32_pclmul(crc, data, folded);
+            data += folded;
+            len  -= folded;
+        }
+    #elif defined(TPNG_CRC_ARMV8)
+        return ~tpng_crc32_armv8(crc, data, len);
+    #endif
+    return ~tpng_crc32_slice8(crc, data, len);
+}
+
+///////////////
+
+
+
+
+
+
+/////////////////////
+/////// BEGIN TINFL 
+///
+/**************************************************************************
+ *
+ * Copyright 2013-2014 RAD Game Tools and Valve Software
+ * Copyright 2010-2014 Rich Geldreich and Tenacious Software LLC
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/* Decompression flags used by tinfl_decompress(). */
+/* TINFL_FLAG_PARSE_ZLIB_HEADER: If set, the input has a valid zlib header and ends with an adler32 checksum (it's a valid zlib stream). Otherwise, the input is a raw deflate stream. */
+/* TINFL_FLAG_HAS_MORE_INPUT: If set, there are more input bytes available beyond the end of the supplied input buffer. If clear, the input buffer contains all remaining input. */
+/* TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF: If set, the output buffer is large enough to hold the entire decompressed stream. If clear, the output buffer is at least the size of the dictionary (typically 32KB). */
+/* TINFL_FLAG_COMPUTE_ADLER32: Force adler-32 checksum computation of the decompressed bytes. */
+enum
+{
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+
+
+
+
+struct tinfl_decompressor_tag;
+typedef struct tinfl_decompressor_tag tinfl_decompressor;
+
+
+
+
+
+/* Max size of LZ dictionary. */
+#define TINFL_LZ_DICT_SIZE 32768
+
+/* Return status. */
+typedef enum {
+    /* This flags indicates the inflator needs 1 or more input bytes to make forward progress, but the caller is indicating that no more are available. The compressed data */
+    /* is probably corrupted. If you call the inflator again with more bytes it'll try to continue processing the input but this is a BAD sign (either the data is corrupted or you called it incorrectly). */
+    /* If you call it again with no input you'll just get TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS again. */
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+
+    /* This flag indicates that one or more of the input parameters was obviously bogus. (You can try calling it again, but if you get this error the calling code is wrong.) */
+    TINFL_STATUS_BAD_PARAM = -3,
+
+    /* This flags indicate the inflator is finished but the adler32 check of the uncompressed data didn't match. If you call it again it'll return TINFL_STATUS_DONE. */
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+
+    /* This flags indicate the inflator has somehow failed (bad code, corrupted input, etc.). If you call it again without resetting via tinfl_init() it it'll just keep on returning the same status failure code. */
+    TINFL_STATUS_FAILED = -1,
+
+    /* Any status code less than TINFL_STATUS_DONE must indicate a failure. */
+
+    /* This flag indicates the inflator has returned every byte of uncompressed data that it can, has consumed every byte that it needed, has successfully reached the end of the deflate stream, and */
+    /* if zlib headers and adler32 checking enabled that it has successfully checked the uncompressed data's adler32. If you call it again you'll just get TINFL_STATUS_DONE over and over again. */
+    TINFL_STATUS_DONE = 0,
+
+    /* This flag indicates the inflator MUST have more input data (even 1 byte) before it can make any more forward progress, or you need to clear the TINFL_FLAG_HAS_MORE_INPUT */
+    /* flag on the next call if you don't have any more source data. If the source data was somehow corrupted it's also possible (but unlikely) for the inflator to keep on demanding input to */
+    /* proceed, so be sure to properly set the TINFL_FLAG_HAS_MORE_INPUT flag. */
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+
+    /* This flag indicates the inflator definitely has 1 or more bytes of uncompressed data available, but it cannot write this data into the output buffer. */
+    /* Note if the source compressed data was corrupted it's possible for the inflator to return a lot of uncompressed data to the caller. I've been assuming you know how much uncompressed data to expect */
+    /* (either exact or worst case) and will stop calling the inflator and fail after receiving too much. In pure streaming scenarios where you have no idea how many bytes to expect this may not be possible */
+    /* so I may need to add some code to address this. */
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+/* Initializes the decompressor to its initial state. */
+#define tinfl_init(r)     \
+    do                    \
+    {                     \
+        (r)->m_state = 0; \
+    }                     \
+    while(0)
+#define tinfl_get_adler32(r) (r)->m_check_adler32
+
+/* Main low-level decompressor coroutine function. This is the only function actually needed for decompression. All the other functions are just high-level helpers for improved usability. */
+/* This is a universal API, i.e. it can be used as a building block to build any desired higher level decompression API. In the limit case, it can be called once per every byte input or output. */
+static tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size, uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size, const uint32_t decomp_flags);
+
+/* Internal/private bits follow. */
+enum
+{
+    TINFL_MAX_HUFF_TABLES = 3,
+    TINFL_MAX_HUFF_SYMBOLS_0 = 288,
+    TINFL_MAX_HUFF_SYMBOLS_1 = 32,
+    TINFL_MAX_HUFF_SYMBOLS_2 = 19,
+    TINFL_FAST_LOOKUP_BITS = 10,
+    TINFL_FAST_LOOKUP_SIZE = 1 << TINFL_FAST_LOOKUP_BITS
+};
+
+typedef struct
+{
+    uint8_t m_code_size[TINFL_MAX_HUFF_SYMBOLS_0];
+    int16_t m_look_up[TINFL_FAST_LOOKUP_SIZE], m_tree[TINFL_MAX_HUFF_SYMBOLS_0 * 2];
+} tinfl_huff_table;
+
+#define TINFL_USE_64BIT_BITBUF 0
+
+#if TINFL_USE_64BIT_BITBUF
+typedef uint64_t tinfl_bit_buf_t;
+#define TINFL_BITBUF_SIZE (64)
+#else
+typedef uint32_t tinfl_bit_buf_t;
+#define TINFL_BITBUF_SIZE (32)
+#endif
+
+struct tinfl_decompressor_tag
+{
+    uint32_t m_state, m_num_bits, m_zhdr0, m_zhdr1, m_z_adler32, m_final, m_type, m_check_adler32, m_dist, m_counter, m_num_extra, m_table_sizes[TINFL_MAX_HUFF_TABLES];
+    tinfl_bit_buf_t m_bit_buf;
+    size_t m_dist_from_out_buf_start;
+    tinfl_huff_table m_tables[TINFL_MAX_HUFF_TABLES];
+    uint8_t m_raw_header[4], m_len_codes[TINFL_MAX_HUFF_SYMBOLS_0 + TINFL_MAX_HUFF_SYMBOLS_1 + 137];
+};
+
+
+
+
+
+
+
+
+
+// topaz addition: import of macros from miniz
+#define TINFL_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define TINFL_MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define TINFL_CLEAR_OBJ(obj) memset(&(obj), 0, sizeof(obj))
+#define TINFL_READ_LE16(p) ((uint32_t)(((const uint8_t *)(p))[0]) | ((uint32_t)(((const uint8_t *)(p))[1]) << 8U))
+#define TINFL_READ_LE32(p) ((uint32_t)(((const uint8_t *)(p))[0]) | ((uint32_t)(((const uint8_t *)(p))[1]) << 8U) | ((uint32_t)(((const uint8_t *)(p))[2]) << 16U) | ((uint32_t)(((const uint8_t *)(p))[3]) << 24U))
+#define TINFL_READ_LE64(p) (((uint64_t)TINFL_READ_LE32(p)) | (((uint64_t)TINFL_READ_LE32((const uint8_t *)(p) + sizeof(uint32_t))) << 32U))
+
+
+
+
+/* ------------------- Low-level Decompression (completely independent from all compression API's) */
+
+#define TINFL_MEMCPY(d, s, l) memcpy(d, s, l)
+#define TINFL_MEMSET(p, c, l) memset(p, c, l)
+
+#define TINFL_CR_BEGIN  \
+    switch (r->m_state) \
+    {                   \
+        case 0:
+#define TINFL_CR_RETURN(state_index, result) \
+    do                                       \
+    {                                        \
+        status = result;                     \
+        r->m_state = state_index;            \
+        goto common_exit;                    \
+        case state_index:;                   \
+    }                                        \
+    while(0)
+#define TINFL_CR_RETURN_FOREVER(state_index, result) \
+    do                                               \
+    {                                                \
+        for (;;)                                     \
+        {                                            \
+            TINFL_CR_RETURN(state_index, result);    \
+        }                                            \
+    }                                                \
+    while(0)
+#define TINFL_CR_FINISH }
+
+#define TINFL_GET_BYTE(state_index, c)                                                                                                                           \
+    do                                                                                                                                                           \
+    {                                                                                                                                                            \
+        while (pIn_buf_cur >= pIn_buf_end)                                                                                                                       \
+        {                                                                                                                                                        \
+            TINFL_CR_RETURN(state_index, (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS); \
+        }                                                                                                                                                        \
+        c = *pIn_buf_cur++;                                                                                                                                      \
+    }                                                                                                                                                            \
+    while(0)
+
+#define TINFL_NEED_BITS(state_index, n)                \
+    do                                                 \
+    {                                                  \
+        uint32_t c;                                     \
+        TINFL_GET_BYTE(state_index, c);                \
+        bit_buf |= (((tinfl_bit_buf_t)c) << num_bits); \
+        num_bits += 8;                                 \
+    } while (num_bits < (uint32_t)(n))
+#define TINFL_SKIP_BITS(state_index, n)      \
+    do                                       \
+    {                                        \
+        if (num_bits < (uint32_t)(n))         \
+        {                                    \
+            TINFL_NEED_BITS(state_index, n); \
+        }                                    \
+        bit_buf >>= (n);                     \
+        num_bits -= (n);                     \
+    }                                        \
+    while(0)
+#define TINFL_GET_BITS(state_index, b, n)    \
+    do                                       \
+    {                                        \
+        if (num_bits < (uint32_t)(n))         \
+        {                                    \
+            TINFL_NEED_BITS(state_index, n); \
+        }                                    \
+        b = bit_buf & ((1 << (n)) - 1);      \
+        bit_buf >>= (n);                     \
+        num_bits -= (n);                     \
+    }                                        \
+    while(0)
+
+/* TINFL_HUFF_BITBUF_FILL() is only used rarely, when the number of bytes remaining in the input buffer falls below 2. */
+/* It reads just enough bytes from the input stream that are needed to decode the next Huffman code (and absolutely no more). It works by trying to fully decode a */
+/* Huffman code by using whatever bits are currently present in the bit buffer. If this fails, it reads another byte, and tries again until it succeeds or until the */
+/* bit buffer contains >=15 bits (deflate's max. Huffman code size). */
+#define TINFL_HUFF_BITBUF_FILL(state_index, pHuff)                             \
+    do                                                                         \
+    {                                                                          \
+        temp = (pHuff)->m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)];     \
+        if (temp >= 0)                                                         \
+        {                                                                      \
+            code_len = temp >> 9;                                              \
+            if ((code_len) && (num_bits >= code_len))                          \
+                break;                                                         \
+        }                                                                      \
+        else if (num_bits > TINFL_FAST_LOOKUP_BITS)                            \
+        {                                                                      \
+            code_len = TINFL_FAST_LOOKUP_BITS;                                 \
+            do                                                                 \
+            {                                                                  \
+                temp = (pHuff)->m_tree[~temp + ((bit_buf >> code_len++) & 1)]; \
+            } while ((temp < 0) && (num_bits >= (code_len + 1)));              \
+            if (temp >= 0)                                                     \
+                break;                                                         \
+        }                                                                      \
+        TINFL_GET_BYTE(state_index, c);                                        \
+        bit_buf |= (((tinfl_bit_buf_t)c) << num_bits);                         \
+        num_bits += 8;                                                         \
+    } while (num_bits < 15);
+
+/* TINFL_HUFF_DECODE() decodes the next Huffman coded symbol. It's more complex than you would initially expect because the zlib API expects the decompressor to never read */
+/* beyond the final byte of the deflate stream. (In other words, when this macro wants to read another byte from the input, it REALLY needs another byte in order to fully */
+/* decode the next Huffman code.) Handling this properly is particularly important on raw deflate (non-zlib) streams, which aren't followed by a byte aligned adler-32. */
+/* The slow path is only executed at the very end of the input buffer. */
+/* v1.16: The original macro handled the case at the very end of the passed-in input buffer, but we also need to handle the case where the user passes in 1+zillion bytes */
+/* following the deflate data and our non-conservative read-ahead path won't kick in here on this code. This is much trickier. */
+#define TINFL_HUFF_DECODE(state_index, sym, pHuff)                                                                                  \
+    do                                                                                                                              \
+    {                                                                                                                               \
+        int temp;                                                                                                                   \
+        uint32_t code_len, c;                                                                                                        \
+        if (num_bits < 15)                                                                                                          \
+        {                                                                                                                           \
+            if ((pIn_buf_end - pIn_buf_cur) < 2)                                                                                    \
+            {                                                                                                                       \
+                TINFL_HUFF_BITBUF_FILL(state_index, pHuff);                                                                         \
+            }                                                                                                                       \
+            else                                                                                                                    \
+            {                                                                                                                       \
+                bit_buf |= (((tinfl_bit_buf_t)pIn_buf_cur[0]) << num_bits) | (((tinfl_bit_buf_t)pIn_buf_cur[1]) << (num_bits + 8)); \
+                pIn_buf_cur += 2;                                                                                                   \
+                num_bits += 16;                                                                                                     \
+            }                                                                                                                       \
+        }                                                                                                                           \
+        if ((temp = (pHuff)->m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)]) >= 0)                                               \
+            code_len = temp >> 9, temp &= 511;                                                                                      \
+        else                                                                                                                        \
+        {                                                                                                                           \
+            code_len = TINFL_FAST_LOOKUP_BITS;                                                                                      \
+            do                                                                                                                      \
+            {                                                                                                                       \
+                temp = (pHuff)->m_tree[~temp + ((bit_buf >> code_len++) & 1)];                                                      \
+            } while (temp < 0);                                                                                                     \
+        }                                                                                                                           \
+        sym = temp;                                                                                                                 \
+        bit_buf >>= code_len;                                                                                                       \
+        num_bits -= code_len;                                                                                                       \
+    }                                                                                                                               \
+    while(0)
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next, size_t *pIn_buf_size, uint8_t *pOut_buf_start, uint8_t *pOut_buf_next, size_t *pOut_buf_size, const uint32_t decomp_flags)
+{
+    static const int s_length_base[31] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0 };
+    static const int s_length_extra[31] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 0, 0 };
+    static const int s_dist_base[32] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 0, 0 };
+    static const int s_dist_extra[32] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    static const uint8_t s_length_dezigzag[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    static const int s_min_table_sizes[3] = { 257, 1, 4 };
+
+    tinfl_status status = TINFL_STATUS_FAILED;
+    uint32_t num_bits, dist, counter, num_extra;
+    tinfl_bit_buf_t bit_buf;
+    const uint8_t *pIn_buf_cur = pIn_buf_next, *const pIn_buf_end = pIn_buf_next + *pIn_buf_size;
+    uint8_t *pOut_buf_cur = pOut_buf_next, *const pOut_buf_end = pOut_buf_next + *pOut_buf_size;
+    size_t out_buf_size_mask = (decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF) ? (size_t)-1 : ((pOut_buf_next - pOut_buf_start) + *pOut_buf_size) - 1, dist_from_out_buf_start;
+
+    /* Ensure the output buffer's size is a power of 2, unless the output buffer is large enough to hold the entire output file (in which case it doesn't matter). */
+    if (((out_buf_size_mask + 1) & out_buf_size_mask) || (pOut_buf_next < pOut_buf_start))
+    {
+        *pIn_buf_size = *pOut_buf_size = 0;
+        return TINFL_STATUS_BAD_PARAM;
+    }
+
+    num_bits = r->m_num_bits;
+    bit_buf = r->m_bit_buf;
+    dist = r->m_dist;
+    counter = r->m_counter;
+    num_extra = r->m_num_extra;
+    dist_from_out_buf_start = r->m_dist_from_out_buf_start;
+    TINFL_CR_BEGIN
+
+    bit_buf = num_bits = dist = counter = num_extra = r->m_zhdr0 = r->m_zhdr1 = 0;
+    r->m_z_adler32 = r->m_check_adler32 = 1;
+    if (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER)
+    {
+        TINFL_GET_BYTE(1, r->m_zhdr0);
+        TINFL_GET_BYTE(2, r->m_zhdr1);
+        counter = (((r->m_zhdr0 * 256 + r->m_zhdr1) % 31 != 0) || (r->m_zhdr1 & 32) || ((r->m_zhdr0 & 15) != 8));
+        if (!(decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF))
+            counter |= (((1U << (8U + (r->m_zhdr0 >> 4))) > 32768U) || ((out_buf_size_mask + 1) < (size_t)(1U << (8U + (r->m_zhdr0 >> 4)))));
+        if (counter)
+        {
+            TINFL_CR_RETURN_FOREVER(36, TINFL_STATUS_FAILED);
+        }
+    }
+
+    do
+    {
+        TINFL_GET_BITS(3, r->m_final, 3);
+        r->m_type = r->m_final >> 1;
+        if (r->m_type == 0)
+        {
+            TINFL_SKIP_BITS(5, num_bits & 7);
+            for (counter = 0; counter < 4; ++counter)
+            {
+                if (num_bits)
+                    TINFL_GET_BITS(6, r->m_raw_header[counter], 8);
+                else
+                    TINFL_GET_BYTE(7, r->m_raw_header[counter]);
+            }
+            if ((counter = (r->m_raw_header[0] | (r->m_raw_header[1] << 8))) != (uint32_t)(0xFFFF ^ (r->m_raw_header[2] | (r->m_raw_header[3] << 8))))
+            {
+                TINFL_CR_RETURN_FOREVER(39, TINFL_STATUS_FAILED);
+            }
+            while ((counter) && (num_bits))
+            {
+                TINFL_GET_BITS(51, dist, 8);
+                while (pOut_buf_cur >= pOut_buf_end)
+                {
+                    TINFL_CR_RETURN(52, TINFL_STATUS_HAS_MORE_OUTPUT);
+                }
+                *pOut_buf_cur++ = (uint8_t)dist;
+                counter--;
+            }
+            while (counter)
+            {
+                size_t n;
+                while (pOut_buf_cur >= pOut_buf_end)
+                {
+                    TINFL_CR_RETURN(9, TINFL_STATUS_HAS_MORE_OUTPUT);
+                }
+                while (pIn_buf_cur >= pIn_buf_end)
+                {
+                    TINFL_CR_RETURN(38, (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS);
+                }
+                n = TINFL_MIN(TINFL_MIN((size_t)(pOut_buf_end - pOut_buf_cur), (size_t)(pIn_buf_end - pIn_buf_cur)), counter);
+                TINFL_MEMCPY(pOut_buf_cur, pIn_buf_cur, n);
+                pIn_buf_cur += n;
+                pOut_buf_cur += n;
+                counter -= (uint32_t)n;
+            }
+        }
+        else if (r->m_type == 3)
+        {
+            TINFL_CR_RETURN_FOREVER(10, TINFL_STATUS_FAILED);
+        }
+        else
+        {
+            if (r->m_type == 1)
             {
                 uint8_t *p = r->m_tables[0].m_code_size;
                 uint32_t i;
@@ -1673,380 +6654,1595 @@ tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *pIn_buf_next
                 next_code[0] = next_code[1] = 0;
                 for (i = 1; i <= 15; ++i)
                 {
-                    used_syms += total_syms[i];
-                    next_code[i + 1] = (total = ((total + total_syms[i]) << 1));
+                    used_syms += total_syms[i];
+                    next_code[i + 1] = (total = ((total + total_syms[i]) << 1));
+                }
+                if ((65536 != total) && (used_syms > 1))
+                {
+                    TINFL_CR_RETURN_FOREVER(35, TINFL_STATUS_FAILED);
+                }
+                for (tree_next = -1, sym_index = 0; sym_index < r->m_table_sizes[r->m_type]; ++sym_index)
+                {
+                    uint32_t rev_code = 0, l, cur_code, code_size = pTable->m_code_size[sym_index];
+                    if (!code_size)
+                        continue;
+                    cur_code = next_code[code_size]++;
+                    for (l = code_size; l > 0; l--, cur_code >>= 1)
+                        rev_code = (rev_code << 1) | (cur_code & 1);
+                    if (code_size <= TINFL_FAST_LOOKUP_BITS)
+                    {
+                        int16_t k = (int16_t)((code_size << 9) | sym_index);
+                        while (rev_code < TINFL_FAST_LOOKUP_SIZE)
+                        {
+                            pTable->m_look_up[rev_code] = k;
+                            rev_code += (1 << code_size);
+                        }
+                        continue;
+                    }
+                    if (0 == (tree_cur = pTable->m_look_up[rev_code & (TINFL_FAST_LOOKUP_SIZE - 1)]))
+                    {
+                        pTable->m_look_up[rev_code & (TINFL_FAST_LOOKUP_SIZE - 1)] = (int16_t)tree_next;
+                        tree_cur = tree_next;
+                        tree_next -= 2;
+                    }
+                    rev_code >>= (TINFL_FAST_LOOKUP_BITS - 1);
+                    for (j = code_size; j > (TINFL_FAST_LOOKUP_BITS + 1); j--)
+                    {
+                        tree_cur -= ((rev_code >>= 1) & 1);
+                        if (!pTable->m_tree[-tree_cur - 1])
+                        {
+                            pTable->m_tree[-tree_cur - 1] = (int16_t)tree_next;
+                            tree_cur = tree_next;
+                            tree_next -= 2;
+                        }
+                        else
+                            tree_cur = pTable->m_tree[-tree_cur - 1];
+                    }
+                    tree_cur -= ((rev_code >>= 1) & 1);
+                    pTable->m_tree[-tree_cur - 1] = (int16_t)sym_index;
+                }
+                if (r->m_type == 2)
+                {
+                    for (counter = 0; counter < (r->m_table_sizes[0] + r->m_table_sizes[1]);)
+                    {
+                        uint32_t s;
+                        TINFL_HUFF_DECODE(16, dist, &r->m_tables[2]);
+                        if (dist < 16)
+                        {
+                            r->m_len_codes[counter++] = (uint8_t)dist;
+                            continue;
+                        }
+                        if ((dist == 16) && (!counter))
+                        {
+                            TINFL_CR_RETURN_FOREVER(17, TINFL_STATUS_FAILED);
+                        }
+                        num_extra = "\02\03\07"[dist - 16];
+                        TINFL_GET_BITS(18, s, num_extra);
+                        s += "\03\03\013"[dist - 16];
+                        TINFL_MEMSET(r->m_len_codes + counter, (dist == 16) ? r->m_len_codes[counter - 1] : 0, s);
+                        counter += s;
+                    }
+                    if ((r->m_table_sizes[0] + r->m_table_sizes[1]) != counter)
+                    {
+                        TINFL_CR_RETURN_FOREVER(21, TINFL_STATUS_FAILED);
+                    }
+                    TINFL_MEMCPY(r->m_tables[0].m_code_size, r->m_len_codes, r->m_table_sizes[0]);
+                    TINFL_MEMCPY(r->m_tables[1].m_code_size, r->m_len_codes + r->m_table_sizes[0], r->m_table_sizes[1]);
+                }
+            }
+            for (;;)
+            {
+                uint8_t *pSrc;
+                for (;;)
+                {
+                    if (((pIn_buf_end - pIn_buf_cur) < 4) || ((pOut_buf_end - pOut_buf_cur) < 2))
+                    {
+                        TINFL_HUFF_DECODE(23, counter, &r->m_tables[0]);
+                        if (counter >= 256)
+                            break;
+                        while (pOut_buf_cur >= pOut_buf_end)
+                        {
+                            TINFL_CR_RETURN(24, TINFL_STATUS_HAS_MORE_OUTPUT);
+                        }
+                        *pOut_buf_cur++ = (uint8_t)counter;
+                    }
+                    else
+                    {
+                        int sym2;
+                        uint32_t code_len;
+#if TINFL_USE_64BIT_BITBUF
+                        if (num_bits < 30)
+                        {
+                            bit_buf |= (((tinfl_bit_buf_t)TINFL_READ_LE32(pIn_buf_cur)) << num_bits);
+                            pIn_buf_cur += 4;
+                            num_bits += 32;
+                        }
+#else
+                        if (num_bits < 15)
+                        {
+                            bit_buf |= (((tinfl_bit_buf_t)TINFL_READ_LE16(pIn_buf_cur)) << num_bits);
+                            pIn_buf_cur += 2;
+                            num_bits += 16;
+                        }
+#endif
+                        if ((sym2 = r->m_tables[0].m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)]) >= 0)
+                            code_len = sym2 >> 9;
+                        else
+                        {
+                            code_len = TINFL_FAST_LOOKUP_BITS;
+                            do
+                            {
+                                sym2 = r->m_tables[0].m_tree[~sym2 + ((bit_buf >> code_len++) & 1)];
+                            } while (sym2 < 0);
+                        }
+                        counter = sym2;
+                        bit_buf >>= code_len;
+                        num_bits -= code_len;
+                        if (counter & 256)
+                            break;
+
+#if !TINFL_USE_64BIT_BITBUF
+                        if (num_bits < 15)
+                        {
+                            bit_buf |= (((tinfl_bit_buf_t)TINFL_READ_LE16(pIn_buf_cur)) << num_bits);
+                            pIn_buf_cur += 2;
+                            num_bits += 16;
+                        }
+#endif
+                        if ((sym2 = r->m_tables[0].m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)]) >= 0)
+                            code_len = sym2 >> 9;
+                        else
+                        {
+                            code_len = TINFL_FAST_LOOKUP_BITS;
+                            do
+                            {
+                                sym2 = r->m_tables[0].m_tree[~sym2 + ((bit_buf >> code_len++) & 1)];
+                            } while (sym2 < 0);
+                        }
+                        bit_buf >>= code_len;
+                        num_bits -= code_len;
+
+                        pOut_buf_cur[0] = (uint8_t)counter;
+                        if (sym2 & 256)
+                        {
+                            pOut_buf_cur++;
+                            counter = sym2;
+                            break;
+                        }
+                        pOut_buf_cur[1] = (uint8_t)sym2;
+                        pOut_buf_cur += 2;
+                    }
+                }
+                if ((counter &= 511) == 256)
+                    break;
+
+                num_extra = s_length_extra[counter - 257];
+                counter = s_length_base[counter - 257];
+                if (num_extra)
+                {
+                    uint32_t extra_bits;
+                    TINFL_GET_BITS(25, extra_bits, num_extra);
+                    counter += extra_bits;
                 }
-                if ((65536 != total) && (used_syms > 1))
+
+                TINFL_HUFF_DECODE(26, dist, &r->m_tables[1]);
+                num_extra = s_dist_extra[dist];
+                dist = s_dist_base[dist];
+                if (num_extra)
                 {
-                    TINFL_CR_RETURN_FOREVER(35, TINFL_STATUS_FAILED);
+                    uint32_t extra_bits;
+                    TINFL_GET_BITS(27, extra_bits, num_extra);
+                    dist += extra_bits;
                 }
-                for (tree_next = -1, sym_index = 0; sym_index < r->m_table_sizes[r->m_type]; ++sym_index)
+
+                dist_from_out_buf_start = pOut_buf_cur - pOut_buf_start;
+                if ((dist == 0 || dist > dist_from_out_buf_start || dist_from_out_buf_start == 0) && (decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF))
                 {
-                    uint32_t rev_code = 0, l, cur_code, code_size = pTable->m_code_size[sym_index];
-                    if (!code_size)
-                        continue;
-                    cur_code = next_code[code_size]++;
-                    for (l = code_size; l > 0; l--, cur_code >>= 1)
-                        rev_code = (rev_code << 1) | (cur_code & 1);
-                    if (code_size <= TINFL_FAST_LOOKUP_BITS)
+                    TINFL_CR_RETURN_FOREVER(37, TINFL_STATUS_FAILED);
+                }
+
+                pSrc = pOut_buf_start + ((dist_from_out_buf_start - dist) & out_buf_size_mask);
+
+                if ((TINFL_MAX(pOut_buf_cur, pSrc) + counter) > pOut_buf_end)
+                {
+                    while (counter--)
                     {
-                        int16_t k = (int16_t)((code_size << 9) | sym_index);
-                        while (rev_code < TINFL_FAST_LOOKUP_SIZE)
+                        while (pOut_buf_cur >= pOut_buf_end)
                         {
-                            pTable->m_look_up[rev_code] = k;
-                            rev_code += (1 << code_size);
+                            TINFL_CR_RETURN(53, TINFL_STATUS_HAS_MORE_OUTPUT);
                         }
-                        continue;
+                        *pOut_buf_cur++ = pOut_buf_start[(dist_from_out_buf_start++ - dist) & out_buf_size_mask];
                     }
-                    if (0 == (tree_cur = pTable->m_look_up[rev_code & (TINFL_FAST_LOOKUP_SIZE - 1)]))
+                    continue;
+                }
+#if MINIZ_USE_UNALIGNED_LOADS_AND_STORES
+                else if ((counter >= 9) && (counter <= dist))
+                {
+                    const uint8_t *pSrc_end = pSrc + (counter & ~7);
+                    do
                     {
-                        pTable->m_look_up[rev_code & (TINFL_FAST_LOOKUP_SIZE - 1)] = (int16_t)tree_next;
-                        tree_cur = tree_next;
-                        tree_next -= 2;
-                    }
-                    rev_code >>= (TINFL_FAST_LOOKUP_BITS - 1);
-                    for (j = code_size; j > (TINFL_FAST_LOOKUP_BITS + 1); j--)
+#ifdef MINIZ_UNALIGNED_USE_MEMCPY
+						memcpy(pOut_buf_cur, pSrc, sizeof(uint32_t)*2);
+#else
+                        ((uint32_t *)pOut_buf_cur)[0] = ((const uint32_t *)pSrc)[0];
+                        ((uint32_t *)pOut_buf_cur)[1] = ((const uint32_t *)pSrc)[1];
+#endif
+                        pOut_buf_cur += 8;
+                    } while ((pSrc += 8) < pSrc_end);
+                    if ((counter &= 7) < 3)
                     {
-                        tree_cur -= ((rev_code >>= 1) & 1);
-                        if (!pTable->m_tree[-tree_cur - 1])
+                        if (counter)
                         {
-                            pTable->m_tree[-tree_cur - 1] = (int16_t)tree_next;
-                            tree_cur = tree_next;
-                            tree_next -= 2;
+                            pOut_buf_cur[0] = pSrc[0];
+                            if (counter > 1)
+                                pOut_buf_cur[1] = pSrc[1];
+                            pOut_buf_cur += counter;
                         }
-                        else
-                            tree_cur = pTable->m_tree[-tree_cur - 1];
+                        continue;
                     }
-                    tree_cur -= ((rev_code >>= 1) & 1);
-                    pTable->m_tree[-tree_cur - 1] = (int16_t)sym_index;
                 }
-                if (r->m_type == 2)
+#endif
+                while(counter>2)
                 {
-                    for (counter = 0; counter < (r->m_table_sizes[0] + r->m_table_sizes[1]);)
-                    {
-                        uint32_t s;
-                        TINFL_HUFF_DECODE(16, dist, &r->m_tables[2]);
-                        if (dist < 16)
-                        {
-                            r->m_len_codes[counter++] = (uint8_t)dist;
-                            continue;
-                        }
-                        if ((dist == 16) && (!counter))
-                        {
-                            TINFL_CR_RETURN_FOREVER(17, TINFL_STATUS_FAILED);
-                        }
-                        num_extra = "\02\03\07"[dist - 16];
-                        TINFL_GET_BITS(18, s, num_extra);
-                        s += "\03\03\013"[dist - 16];
-                        TINFL_MEMSET(r->m_len_codes + counter, (dist == 16) ? r->m_len_codes[counter - 1] : 0, s);
-                        counter += s;
-                    }
-                    if ((r->m_table_sizes[0] + r->m_table_sizes[1]) != counter)
-                    {
-                        TINFL_CR_RETURN_FOREVER(21, TINFL_STATUS_FAILED);
-                    }
-                    TINFL_MEMCPY(r->m_tables[0].m_code_size, r->m_len_codes, r->m_table_sizes[0]);
-                    TINFL_MEMCPY(r->m_tables[1].m_code_size, r->m_len_codes + r->m_table_sizes[0], r->m_table_sizes[1]);
+                    pOut_buf_cur[0] = pSrc[0];
+                    pOut_buf_cur[1] = pSrc[1];
+                    pOut_buf_cur[2] = pSrc[2];
+                    pOut_buf_cur += 3;
+                    pSrc += 3;
+					counter -= 3;
+                }
+                if (counter > 0)
+                {
+                    pOut_buf_cur[0] = pSrc[0];
+                    if (counter > 1)
+                        pOut_buf_cur[1] = pSrc[1];
+                    pOut_buf_cur += counter;
                 }
             }
-            for (;;)
+        }
+    } while (!(r->m_final & 1));
+
+    /* Ensure byte alignment and put back any bytes from the bitbuf if we've looked ahead too far on gzip, or other Deflate streams followed by arbitrary data. */
+    /* I'm being super conservative here. A number of simplifications can be made to the byte alignment part, and the Adler32 check shouldn't ever need to worry about reading from the bitbuf now. */
+    TINFL_SKIP_BITS(32, num_bits & 7);
+    while ((pIn_buf_cur > pIn_buf_next) && (num_bits >= 8))
+    {
+        --pIn_buf_cur;
+        num_bits -= 8;
+    }
+    bit_buf &= (tinfl_bit_buf_t)((((uint64_t)1) << num_bits) - (uint64_t)1);
+    //assert(!num_bits); /* if this assert fires then we've read beyond the end of non-deflate/zlib streams with following data (such as gzip streams). */
+
+    if (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER)
+    {
+        for (counter = 0; counter < 4; ++counter)
+        {
+            uint32_t s;
+            if (num_bits)
+                TINFL_GET_BITS(41, s, 8);
+            else
+                TINFL_GET_BYTE(42, s);
+            r->m_z_adler32 = (r->m_z_adler32 << 8) | s;
+        }
+    }
+    TINFL_CR_RETURN_FOREVER(34, TINFL_STATUS_DONE);
+
+    TINFL_CR_FINISH
+
+common_exit:
+    /* As long as we aren't telling the caller that we NEED more input to make forward progress: */
+    /* Put back any bytes from the bitbuf in case we've looked ahead too far on gzip, or other Deflate streams followed by arbitrary data. */
+    /* We need to be very careful here to NOT push back any bytes we definitely know we need to make forward progress, though, or we'll lock the caller up into an inf loop. */
+    if ((status != TINFL_STATUS_NEEDS_MORE_INPUT) && (status != TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS))
+    {
+        while ((pIn_buf_cur > pIn_buf_next) && (num_bits >= 8))
+        {
+            --pIn_buf_cur;
+            num_bits -= 8;
+        }
+    }
+    r->m_num_bits = num_bits;
+    r->m_bit_buf = bit_buf & (tinfl_bit_buf_t)((((uint64_t)1) << num_bits) - (uint64_t)1);
+    r->m_dist = dist;
+    r->m_counter = counter;
+    r->m_num_extra = num_extra;
+    r->m_dist_from_out_buf_start = dist_from_out_buf_start;
+    *pIn_buf_size = pIn_buf_cur - pIn_buf_next;
+    *pOut_buf_size = pOut_buf_cur - pOut_buf_next;
+    if ((decomp_flags & (TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32)) && (status >= 0))
+    {
+        const uint8_t *ptr = pOut_buf_next;
+        size_t buf_len = *pOut_buf_size;
+        uint32_t i, s1 = r->m_check_adler32 & 0xffff, s2 = r->m_check_adler32 >> 16;
+        size_t block_len = buf_len % 5552;
+        while (buf_len)
+        {
+            for (i = 0; i + 7 < block_len; i += 8, ptr += 8)
+            {
+                s1 += ptr[0], s2 += s1;
+                s1 += ptr[1], s2 += s1;
+                s1 += ptr[2], s2 += s1;
+                s1 += ptr[3], s2 += s1;
+                s1 += ptr[4], s2 += s1;
+                s1 += ptr[5], s2 += s1;
+                s1 += ptr[6], s2 += s1;
+                s1 += ptr[7], s2 += s1;
+            }
+            for (; i < block_len; ++i)
+                s1 += *ptr++, s2 += s1;
+            s1 %= 65521U, s2 %= 65521U;
+            buf_len -= block_len;
+            block_len = 5552;
+        }
+        r->m_check_adler32 = (s2 << 16) + s1;
+        if ((status == TINFL_STATUS_DONE) && (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) && (r->m_check_adler32 != r->m_z_adler32))
+            status = TINFL_STATUS_ADLER32_MISMATCH;
+    }
+    return status;
+}
+
+/* High level decompression functions: */
+
+/* topaz addition: speculative parallel inflate, in the manner of pugz. */
+/* The deflate stream is cut into parts of about the same compressed size, one for each worker, and all are inflated at once. */
+/* The first part is inflated as usual. Every other part searches forward from its cut, a bit at a time, for something that */
+/* parses as the header of a dynamic Huffman block, and inflates from there without the 32 KB of output before it: bytes */
+/* copied from that unknown window are kept as references to it (markers), in 16-bit output. Once 32 KB of output go by */
+/* without a marker, no back-reference can reach one again, so the rest is inflated as plain bytes. Each part stops at the */
+/* end of the first block that ends past the next part's cut. */
+/* The parts are then stitched together in order: */
+/*  - If a part's block was found right where the part before it stopped, it's a real block, so its output is right once */
+/*    its markers are replaced from the window, which is known by then. */
+/*  - Otherwise the search was fooled, or went past a stored or fixed block, so the part is inflated again from where the */
+/*    part before it stopped, with the window known, going back to the speculative output if that reaches the block found. */
+/* Returns NULL if the stream couldn't be inflated this way; the caller should fall back to serial inflate. */
+
+/* Minimum compressed bytes for each part. */
+#define TINFL_PARALLEL_MIN_PART (1 << 18)
+
+/* Codes of up to this many bits are decoded with one table lookup. */
+#define TINFL_SPEC_FAST_BITS 10
+
+/* The window a part doesn't know, which its markers refer to. */
+#define TINFL_SPEC_WINDOW 32768
+
+/* Longest match. */
+#define TINFL_SPEC_MAX_MATCH 258
+
+typedef struct
+{
+    uint16_t fast[1 << TINFL_SPEC_FAST_BITS]; /* (length << 9) | symbol, by the next bits of input; 0 for longer codes */
+    uint16_t count[16];                       /* codes of each length */
+    uint16_t symbol[TINFL_MAX_HUFF_SYMBOLS_0]; /* symbols in code order */
+} tinfl_spec_huff;
+
+typedef struct
+{
+    const uint8_t *pIn;
+    size_t in_bits;
+    size_t bit;          /* next bit to read */
+    int final;           /* set once the last block is inflated */
+    int symbolic;        /* whether output still goes to pSym */
+    uint16_t *pSym;      /* output from 0 while markers may appear: bytes, or 256 + the window position copied */
+    size_t sym_len, sym_capacity;
+    size_t last_marker;  /* output just past the last marker */
+    uint8_t *pOut;       /* output from out_base on, once plain */
+    size_t out_base, out_capacity;
+    int owns_out;        /* whether pOut is the part's own, and can be grown */
+    size_t out_len;      /* output so far */
+    size_t max_out;
+    tinfl_spec_huff lit, dist;
+} tinfl_spec;
+
+/* Returns the next 57 or more bits of pIn from bit, as 0s past its in_len bytes. */
+/* That's enough for a length and distance, with their extra bits. */
+static uint64_t tinfl_spec_peek_at(const uint8_t *pIn, size_t in_len, size_t bit)
+{
+    size_t byte = bit >> 3, i;
+    uint64_t v = 0;
+    if (byte + 8 <= in_len)
+        v = TINFL_READ_LE64(pIn + byte);
+    else
+    {
+        for (i = 0; (i < 8) && (byte + i < in_len); ++i)
+            v |= (uint64_t)pIn[byte + i] << (8 * i);
+    }
+    return v >> (bit & 7);
+}
+
+static uint64_t tinfl_spec_peek(const tinfl_spec *s)
+{
+    return tinfl_spec_peek_at(s->pIn, s->in_bits >> 3, s->bit);
+}
+
+static uint32_t tinfl_spec_bits(tinfl_spec *s, int n)
+{
+    uint32_t v = (uint32_t)tinfl_spec_peek(s) & ((1U << n) - 1);
+    s->bit += n;
+    return v;
+}
+
+/* Builds a code from its code lengths. Returns -1 if it's over-subscribed, else the number of unused codes. */
+/* Incomplete codes of more than one code can't be used, so aren't built: most guesses while searching fail here. */
+static int tinfl_spec_build(tinfl_spec_huff *h, const uint8_t *pLengths, int n)
+{
+    uint16_t offs[16], next[16];
+    int len, sym, left = 1, code = 0, codes, i;
+    TINFL_CLEAR_OBJ(h->count);
+    for (sym = 0; sym < n; ++sym)
+        h->count[pLengths[sym]]++;
+    codes = n - h->count[0];
+    h->count[0] = 0;
+    for (len = 1; len < 16; ++len)
+    {
+        left = (left << 1) - h->count[len];
+        if (left < 0)
+            return -1;
+    }
+    if (left && (codes > 1))
+        return left;
+    TINFL_CLEAR_OBJ(h->fast);
+    offs[1] = 0;
+    for (len = 1; len < 15; ++len)
+        offs[len + 1] = offs[len] + h->count[len];
+    for (len = 1; len < 16; ++len)
+    {
+        code = (code + h->count[len - 1]) << 1;
+        next[len] = (uint16_t)code;
+    }
+    for (sym = 0; sym < n; ++sym)
+    {
+        len = pLengths[sym];
+        if (!len)
+            continue;
+        h->symbol[offs[len]++] = (uint16_t)sym;
+        code = next[len]++;
+        if (len <= TINFL_SPEC_FAST_BITS)
+        {
+            /* codes are sent from their top bit */
+            int rev = 0;
+            for (i = 0; i < len; ++i)
+                rev |= ((code >> i) & 1) << (len - 1 - i);
+            for (i = rev; i < (1 << TINFL_SPEC_FAST_BITS); i += 1 << len)
+                h->fast[i] = (uint16_t)((len << 9) | sym);
+        }
+    }
+    return left;
+}
+
+/* Whether a built code can be used: complete, or a single code (or none, if allowed). */
+static int tinfl_spec_usable(const tinfl_spec_huff *h, int left, int allow_empty)
+{
+    int len, codes = 0;
+    if (!left)
+        return 1;
+    if (left < 0)
+        return 0;
+    for (len = 1; len < 16; ++len)
+        codes += h->count[len];
+    return (codes == 1) || (!codes && allow_empty);
+}
+
+/* Decodes a symbol from the next bits of input, setting *pUsed to its length. Returns -1 for a code that isn't in the table. */
+static int tinfl_spec_decode(const tinfl_spec_huff *h, uint64_t bits, int *pUsed)
+{
+    int entry = h->fast[bits & ((1 << TINFL_SPEC_FAST_BITS) - 1)], len, code = 0, first = 0, index = 0;
+    if (entry)
+    {
+        *pUsed = entry >> 9;
+        return entry & 511;
+    }
+    for (len = 1; len < 16; ++len)
+    {
+        code |= (int)(bits >> (len - 1)) & 1;
+        if (code - first < h->count[len])
+        {
+            *pUsed = len;
+            return h->symbol[index + code - first];
+        }
+        index += h->count[len];
+        first = (first + h->count[len]) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+/* Makes room for n more bytes of output. Returns 0 if the output would be longer than max_out. */
+static int tinfl_spec_reserve(tinfl_spec *s, size_t n)
+{
+    size_t capacity;
+    if (s->out_len + n > s->max_out)
+        return 0;
+    if (s->symbolic)
+    {
+        uint16_t *pSym;
+        if (s->out_len + n <= s->sym_capacity)
+            return 1;
+        capacity = TINFL_MIN(TINFL_MAX(s->sym_capacity * 2, s->out_len + n), s->max_out);
+        pSym = (uint16_t *)TPNG_MALLOC(capacity * sizeof(uint16_t));
+        if (!pSym)
+            return 0;
+        if (s->out_len)
+            TINFL_MEMCPY(pSym, s->pSym, s->out_len * sizeof(uint16_t));
+        TPNG_FREE(s->pSym);
+        s->pSym = pSym;
+        s->sym_capacity = capacity;
+    }
+    else
+    {
+        uint8_t *pOut;
+        if (s->out_len + n <= s->out_base + s->out_capacity)
+            return 1;
+        if (!s->owns_out)
+            return 0;
+        capacity = TINFL_MIN(TINFL_MAX(s->out_capacity * 2, s->out_len + n - s->out_base), s->max_out - s->out_base);
+        pOut = (uint8_t *)TPNG_MALLOC(capacity);
+        if (!pOut)
+            return 0;
+        TINFL_MEMCPY(pOut, s->pOut, s->out_len - s->out_base);
+        TPNG_FREE(s->pOut);
+        s->pOut = pOut;
+        s->out_capacity = capacity;
+    }
+    return 1;
+}
+
+/* With the last window of output free of markers, goes on in plain bytes. */
+static int tinfl_spec_go_plain(tinfl_spec *s)
+{
+    size_t i;
+    s->out_base = s->out_len - TINFL_SPEC_WINDOW;
+    if (s->out_capacity < TINFL_SPEC_WINDOW * 4)
+    {
+        TPNG_FREE(s->pOut);
+        s->out_capacity = TINFL_MIN((size_t)TINFL_SPEC_WINDOW * 4, s->max_out - s->out_base);
+        s->pOut = (uint8_t *)TPNG_MALLOC(s->out_capacity);
+        if (!s->pOut)
+            return 0;
+    }
+    for (i = 0; i < TINFL_SPEC_WINDOW; ++i)
+        s->pOut[i] = (uint8_t)s->pSym[s->out_base + i];
+    s->sym_len = s->out_len;
+    s->symbolic = 0;
+    return 1;
+}
+
+/* Copies len bytes from dist back, in markers. */
+static int tinfl_spec_copy(tinfl_spec *s, size_t len, size_t dist)
+{
+    uint16_t *pDst;
+    size_t pos = s->out_len, i;
+    if (!tinfl_spec_reserve(s, len))
+        return 0;
+    pDst = s->pSym + pos;
+    for (i = 0; i < len; ++i, ++pos)
+    {
+        uint16_t v;
+        if (dist > pos)
+        {
+            /* from before the part: a marker */
+            if (dist - pos > TINFL_SPEC_WINDOW)
+                return 0;
+            v = (uint16_t)(256 + TINFL_SPEC_WINDOW - (dist - pos));
+        }
+        else
+            v = s->pSym[pos - dist];
+        if (v >= 256)
+            s->last_marker = pos + 1;
+        pDst[i] = v;
+    }
+    s->out_len += len;
+    return 1;
+}
+
+static const uint16_t tinfl_spec_length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t tinfl_spec_length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t tinfl_spec_dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t tinfl_spec_dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/* Looks at the next bits of input in tinfl_spec_codes_plain(). */
+#define TINFL_SPEC_LOOK(bits, bit) bits = (((bit) >> 3) + 8 <= in_len) ? TINFL_READ_LE64(pIn + ((bit) >> 3)) >> ((bit) & 7) : tinfl_spec_peek_at(pIn, in_len, bit)
+
+/* Decodes a symbol from bits, with the fast table looked up in place. */
+#define TINFL_SPEC_DECODE(h, bits, sym, used)              \
+    do                                                     \
+    {                                                      \
+        int entry_ = (h)->fast[(bits) & ((1 << TINFL_SPEC_FAST_BITS) - 1)]; \
+        if (entry_)                                        \
+        {                                                  \
+            used = entry_ >> 9;                            \
+            sym = entry_ & 511;                            \
+        }                                                  \
+        else                                               \
+            sym = tinfl_spec_decode(h, bits, &used);       \
+    } while (0)
+
+/* Inflates the codes of a Huffman block in plain bytes, up to its end-of-block code. */
+/* Nearly all the time goes here, so the state is kept in locals: stores to the output could alias it. */
+static int tinfl_spec_codes_plain(tinfl_spec *s)
+{
+    const uint8_t *pIn = s->pIn;
+    const tinfl_spec_huff *pLit = &s->lit, *pDist = &s->dist;
+    size_t in_len = s->in_bits >> 3, bit = s->bit;
+    uint8_t *pCur = s->pOut + (s->out_len - s->out_base);
+    uint8_t *pLimit = s->pOut + TINFL_MIN(s->out_capacity, s->max_out - s->out_base);
+    int ok = 0, grow = s->owns_out;
+    for (;;)
+    {
+        uint64_t bits;
+        int used, sym;
+        if (grow && ((size_t)(pLimit - pCur) < TINFL_SPEC_MAX_MATCH))
+        {
+            s->out_len = s->out_base + (size_t)(pCur - s->pOut);
+            if (!tinfl_spec_reserve(s, TINFL_MIN((size_t)TINFL_SPEC_MAX_MATCH, s->max_out - s->out_len)))
+                break;
+            pCur = s->pOut + (s->out_len - s->out_base);
+            pLimit = s->pOut + TINFL_MIN(s->out_capacity, s->max_out - s->out_base);
+        }
+        /* one look at the input covers a literal, or a length and distance */
+        TINFL_SPEC_LOOK(bits, bit);
+        TINFL_SPEC_DECODE(pLit, bits, sym, used);
+        if (sym < 0)
+            break;
+        bits >>= used;
+        bit += used;
+        if (sym < 256)
+        {
+            if (pCur == pLimit)
+                break;
+            *pCur++ = (uint8_t)sym;
+            /* what's left of the look covers one more code, which is most often another literal */
+            TINFL_SPEC_DECODE(pLit, bits, sym, used);
+            if ((sym >= 0) && (sym < 256) && (pCur != pLimit))
+            {
+                *pCur++ = (uint8_t)sym;
+                bit += used;
+            }
+        }
+        else if (sym == 256)
+        {
+            ok = 1;
+            break;
+        }
+        else
+        {
+            size_t len, dist;
+            const uint8_t *pSrc;
+            sym -= 257;
+            if (sym >= 29)
+                break;
+            len = tinfl_spec_length_base[sym] + (size_t)(bits & ((1U << tinfl_spec_length_extra[sym]) - 1));
+            bits >>= tinfl_spec_length_extra[sym];
+            bit += tinfl_spec_length_extra[sym];
+            TINFL_SPEC_DECODE(pDist, bits, sym, used);
+            if ((sym < 0) || (sym >= 30))
+                break;
+            bits >>= used;
+            dist = tinfl_spec_dist_base[sym] + (size_t)(bits & ((1U << tinfl_spec_dist_extra[sym]) - 1));
+            bit += used + tinfl_spec_dist_extra[sym];
+            if ((dist > (size_t)(pCur - s->pOut)) || (len > (size_t)(pLimit - pCur)))
+                break;
+            pSrc = pCur - dist;
+            if ((dist >= 8) && ((size_t)(pLimit - pCur) >= len + 8))
             {
-                uint8_t *pSrc;
-                for (;;)
+                /* 8 bytes at a time, writing up to 7 past the end */
+                uint8_t *pEnd = pCur + len;
+                do
                 {
-                    if (((pIn_buf_end - pIn_buf_cur) < 4) || ((pOut_buf_end - pOut_buf_cur) < 2))
-                    {
-                        TINFL_HUFF_DECODE(23, counter, &r->m_tables[0]);
-                        if (counter >= 256)
-                            break;
-                        while (pOut_buf_cur >= pOut_buf_end)
-                        {
-                            TINFL_CR_RETURN(24, TINFL_STATUS_HAS_MORE_OUTPUT);
-                        }
-                        *pOut_buf_cur++ = (uint8_t)counter;
-                    }
-                    else
-                    {
-                        int sym2;
-                        uint32_t code_len;
-#if TINFL_USE_64BIT_BITBUF
-                        if (num_bits < 30)
-                        {
-                            bit_buf |= (((tinfl_bit_buf_t)TINFL_READ_LE32(pIn_buf_cur)) << num_bits);
-                            pIn_buf_cur += 4;
-                            num_bits += 32;
-                        }
-#else
-                        if (num_bits < 15)
-                        {
-                            bit_buf |= (((tinfl_bit_buf_t)TINFL_READ_LE16(pIn_buf_cur)) << num_bits);
-                            pIn_buf_cur += 2;
-                            num_bits += 16;
-                        }
-#endif
-                        if ((sym2 = r->m_tables[0].m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)]) >= 0)
-                            code_len = sym2 >> 9;
-                        else
-                        {
-                            code_len = TINFL_FAST_LOOKUP_BITS;
-                            do
-                            {
-                                sym2 = r->m_tables[0].m_tree[~sym2 + ((bit_buf >> code_len++) & 1)];
-                            } while (sym2 < 0);
-                        }
-                        counter = sym2;
-                        bit_buf >>= code_len;
-                        num_bits -= code_len;
-                        if (counter & 256)
-                            break;
+                    TINFL_MEMCPY(pCur, pSrc, 8);
+                    pCur += 8;
+                    pSrc += 8;
+                } while (pCur < pEnd);
+                pCur = pEnd;
+            }
+            else
+            {
+                while (len--)
+                    *pCur++ = *pSrc++;
+            }
+        }
+    }
+    s->bit = bit;
+    s->out_len = s->out_base + (size_t)(pCur - s->pOut);
+    return ok && (bit <= s->in_bits);
+}
 
-#if !TINFL_USE_64BIT_BITBUF
-                        if (num_bits < 15)
-                        {
-                            bit_buf |= (((tinfl_bit_buf_t)TINFL_READ_LE16(pIn_buf_cur)) << num_bits);
-                            pIn_buf_cur += 2;
-                            num_bits += 16;
-                        }
-#endif
-                        if ((sym2 = r->m_tables[0].m_look_up[bit_buf & (TINFL_FAST_LOOKUP_SIZE - 1)]) >= 0)
-                            code_len = sym2 >> 9;
-                        else
-                        {
-                            code_len = TINFL_FAST_LOOKUP_BITS;
-                            do
-                            {
-                                sym2 = r->m_tables[0].m_tree[~sym2 + ((bit_buf >> code_len++) & 1)];
-                            } while (sym2 < 0);
-                        }
-                        bit_buf >>= code_len;
-                        num_bits -= code_len;
+/* Inflates the codes of a Huffman block, up to its end-of-block code: in markers until the window is clear of them. */
+static int tinfl_spec_codes(tinfl_spec *s)
+{
+    while (s->symbolic)
+    {
+        uint64_t bits = tinfl_spec_peek(s);
+        int used, sym = tinfl_spec_decode(&s->lit, bits, &used);
+        if (sym < 0)
+            return 0;
+        bits >>= used;
+        s->bit += used;
+        if (sym < 256)
+        {
+            if (!tinfl_spec_reserve(s, 1))
+                return 0;
+            s->pSym[s->out_len++] = (uint16_t)sym;
+        }
+        else if (sym == 256)
+            return s->bit <= s->in_bits;
+        else
+        {
+            size_t len, dist;
+            sym -= 257;
+            if (sym >= 29)
+                return 0;
+            len = tinfl_spec_length_base[sym] + (size_t)(bits & ((1U << tinfl_spec_length_extra[sym]) - 1));
+            bits >>= tinfl_spec_length_extra[sym];
+            s->bit += tinfl_spec_length_extra[sym];
+            sym = tinfl_spec_decode(&s->dist, bits, &used);
+            if ((sym < 0) || (sym >= 30))
+                return 0;
+            bits >>= used;
+            dist = tinfl_spec_dist_base[sym] + (size_t)(bits & ((1U << tinfl_spec_dist_extra[sym]) - 1));
+            s->bit += used + tinfl_spec_dist_extra[sym];
+            if (!tinfl_spec_copy(s, len, dist))
+                return 0;
+        }
+        if ((s->bit > s->in_bits) || ((s->out_len - s->last_marker >= TINFL_SPEC_WINDOW) && !tinfl_spec_go_plain(s)))
+            return 0;
+    }
+    return tinfl_spec_codes_plain(s);
+}
 
-                        pOut_buf_cur[0] = (uint8_t)counter;
-                        if (sym2 & 256)
-                        {
-                            pOut_buf_cur++;
-                            counter = sym2;
-                            break;
-                        }
-                        pOut_buf_cur[1] = (uint8_t)sym2;
-                        pOut_buf_cur += 2;
-                    }
-                }
-                if ((counter &= 511) == 256)
+/* Inflates a stored block, after its first 3 bits. */
+static int tinfl_spec_stored(tinfl_spec *s)
+{
+    size_t len, i;
+    const uint8_t *pSrc;
+    s->bit = (s->bit + 7) & ~(size_t)7;
+    len = tinfl_spec_bits(s, 16);
+    if ((tinfl_spec_bits(s, 16) ^ len) != 0xFFFF)
+        return 0;
+    if ((s->bit + len * 8 > s->in_bits) || !tinfl_spec_reserve(s, len))
+        return 0;
+    pSrc = s->pIn + (s->bit >> 3);
+    if (s->symbolic)
+    {
+        for (i = 0; i < len; ++i)
+            s->pSym[s->out_len + i] = pSrc[i];
+    }
+    else
+        TINFL_MEMCPY(s->pOut + (s->out_len - s->out_base), pSrc, len);
+    s->out_len += len;
+    s->bit += len * 8;
+    if (s->symbolic && (s->out_len - s->last_marker >= TINFL_SPEC_WINDOW))
+        return tinfl_spec_go_plain(s);
+    return 1;
+}
+
+/* Reads the code lengths of a dynamic block, after its first 3 bits, and builds its codes. */
+static int tinfl_spec_dynamic(tinfl_spec *s)
+{
+    static const uint8_t s_order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t lengths[TINFL_MAX_HUFF_SYMBOLS_0 + TINFL_MAX_HUFF_SYMBOLS_1];
+    int nlen = (int)tinfl_spec_bits(s, 5) + 257, ndist = (int)tinfl_spec_bits(s, 5) + 1, ncode = (int)tinfl_spec_bits(s, 4) + 4, i;
+    if ((nlen > 286) || (ndist > 30))
+        return 0;
+    TINFL_CLEAR_OBJ(lengths);
+    for (i = 0; i < ncode; ++i)
+        lengths[s_order[i]] = (uint8_t)tinfl_spec_bits(s, 3);
+    if (tinfl_spec_build(&s->lit, lengths, 19))
+        return 0;
+    for (i = 0; i < nlen + ndist;)
+    {
+        int used, sym = tinfl_spec_decode(&s->lit, tinfl_spec_peek(s), &used), len = 0, rep;
+        if (sym < 0)
+            return 0;
+        s->bit += used;
+        if (sym < 16)
+        {
+            lengths[i++] = (uint8_t)sym;
+            continue;
+        }
+        if (sym == 16)
+        {
+            if (!i)
+                return 0;
+            len = lengths[i - 1];
+            rep = 3 + (int)tinfl_spec_bits(s, 2);
+        }
+        else if (sym == 17)
+            rep = 3 + (int)tinfl_spec_bits(s, 3);
+        else
+            rep = 11 + (int)tinfl_spec_bits(s, 7);
+        if (i + rep > nlen + ndist)
+            return 0;
+        while (rep--)
+            lengths[i++] = (uint8_t)len;
+    }
+    if ((s->bit > s->in_bits) || !lengths[256])
+        return 0;
+    return tinfl_spec_usable(&s->lit, tinfl_spec_build(&s->lit, lengths, nlen), 0) &&
+           tinfl_spec_usable(&s->dist, tinfl_spec_build(&s->dist, lengths + nlen, ndist), 1);
+}
+
+/* Inflates the next block. Returns 0 if it's corrupt, or the output would be too long. */
+static int tinfl_spec_block(tinfl_spec *s)
+{
+    int type;
+    s->final = (int)tinfl_spec_bits(s, 1);
+    type = (int)tinfl_spec_bits(s, 2);
+    if (type == 0)
+        return tinfl_spec_stored(s);
+    if (type == 1)
+    {
+        uint8_t lengths[TINFL_MAX_HUFF_SYMBOLS_0];
+        TINFL_MEMSET(lengths, 8, 144);
+        TINFL_MEMSET(lengths + 144, 9, 112);
+        TINFL_MEMSET(lengths + 256, 7, 24);
+        TINFL_MEMSET(lengths + 280, 8, 8);
+        tinfl_spec_build(&s->lit, lengths, TINFL_MAX_HUFF_SYMBOLS_0);
+        /* with the two unused codes, so that it's complete */
+        TINFL_MEMSET(lengths, 5, 32);
+        tinfl_spec_build(&s->dist, lengths, 32);
+    }
+    else if ((type != 2) || !tinfl_spec_dynamic(s))
+        return 0;
+    return tinfl_spec_codes(s);
+}
+
+/* Inflates blocks until the last one, or one that ends at or past stop_bit. */
+static int tinfl_spec_run(tinfl_spec *s, size_t stop_bit)
+{
+    do
+    {
+        if (!tinfl_spec_block(s))
+            return 0;
+    } while (!s->final && (s->bit < stop_bit));
+    return 1;
+}
+
+/* Starts inflating at bit: in plain bytes into pOut (whose first out_len bytes come before), or in markers if pOut is NULL. */
+static void tinfl_spec_init(tinfl_spec *s, const uint8_t *pIn, size_t in_len, size_t bit, uint8_t *pOut, size_t out_len, size_t max_out)
+{
+    s->pIn = pIn;
+    s->in_bits = in_len * 8;
+    s->bit = bit;
+    s->final = 0;
+    s->symbolic = !pOut;
+    s->sym_len = 0;
+    s->last_marker = 0;
+    s->out_len = pOut ? out_len : 0;
+    s->max_out = max_out;
+    if (pOut)
+    {
+        s->pOut = pOut;
+        s->out_base = 0;
+        s->out_capacity = max_out;
+        s->owns_out = 0;
+    }
+    else
+    {
+        s->out_base = 0;
+        s->owns_out = 1;
+    }
+}
+
+/* Fills pKraft with the Kraft sum of each 4 code length code lengths, in 128ths, saturated at 255. */
+static void tinfl_spec_init_kraft(uint8_t *pKraft)
+{
+    int i, j;
+    for (i = 0; i < (1 << 12); ++i)
+    {
+        int kraft = 0;
+        for (j = 0; j < 4; ++j)
+        {
+            int len = (i >> (3 * j)) & 7;
+            kraft += len ? 128 >> len : 0;
+        }
+        pKraft[i] = (uint8_t)TINFL_MIN(kraft, 255);
+    }
+}
+
+/* Whether the next bits could start a dynamic block, with counts in range and a complete code length code. */
+/* Rules out nearly every bit that doesn't without building anything. The bits are as good as random, so it doesn't */
+/* branch on them. */
+static int tinfl_spec_maybe_dynamic(const tinfl_spec *s, const uint8_t *pKraft)
+{
+    uint64_t bits = tinfl_spec_peek(s);
+    /* a look has at least 57 bits: all 19 lengths */
+    uint64_t lengths = tinfl_spec_peek_at(s->pIn, s->in_bits >> 3, s->bit + 17) & ((1ULL << (3 * (((bits >> 13) & 15) + 4))) - 1);
+    int kraft = pKraft[lengths & 4095] + pKraft[(lengths >> 12) & 4095] + pKraft[(lengths >> 24) & 4095] +
+                pKraft[(lengths >> 36) & 4095] + pKraft[(lengths >> 48) & 4095];
+    return ((bits & 6) == 4) & (((bits >> 3) & 31) <= 29) & (((bits >> 8) & 31) <= 29) & (kraft == 128);
+}
+
+typedef struct
+{
+    const uint8_t *pData;
+    size_t len;
+    uint32_t adler;
+} tinfl_adler;
+
+static void tinfl_adler_task(void *pData)
+{
+    tinfl_adler *a = (tinfl_adler *)pData;
+    a->adler = tpng_adler32(1, a->pData, (uint32_t)a->len);
+}
+
+/* Returns the adler32 of two blocks joined, from each one's and the second's length, as zlib's adler32_combine() does. */
+static uint32_t tinfl_adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2)
+{
+    uint32_t rem = (uint32_t)(len2 % 65521), sum1 = adler1 & 0xffff, sum2 = (uint32_t)((uint64_t)rem * sum1 % 65521);
+    sum1 += (adler2 & 0xffff) + 65521 - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + 65521 - rem;
+    sum1 %= 65521;
+    sum2 %= 65521;
+    return sum1 | (sum2 << 16);
+}
+
+typedef struct
+{
+    tinfl_spec spec;
+    size_t first, end; /* where to look for the first block, in bits; first is the real start for the first part */
+    size_t stop;       /* the next part's cut, in bits */
+    size_t start;      /* where the block found starts */
+    const uint8_t *pKraft; /* shared table for tinfl_spec_maybe_dynamic() */
+    int found;         /* whether a block was found and inflated through to stop */
+    tinfl_adler adler; /* the part's slice of the output, once known */
+} tinfl_part;
+
+static void tinfl_part_task(void *pData)
+{
+    tinfl_part *p = (tinfl_part *)pData;
+    size_t bit;
+    if (!p->spec.symbolic)
+    {
+        p->start = p->first;
+        p->found = tinfl_spec_run(&p->spec, p->stop);
+        return;
+    }
+    for (bit = p->first; bit < p->end; ++bit)
+    {
+        p->spec.bit = bit;
+        if (!tinfl_spec_maybe_dynamic(&p->spec, p->pKraft))
+            continue;
+        p->spec.final = 0;
+        p->spec.symbolic = 1;
+        p->spec.out_len = 0;
+        p->spec.last_marker = 0;
+        p->spec.sym_len = 0;
+        if (tinfl_spec_run(&p->spec, p->stop))
+        {
+            p->start = bit;
+            p->found = 1;
+            return;
+        }
+    }
+}
+
+/* Writes a part's output at pos, with its markers replaced from the output before it. */
+static int tinfl_part_resolve(const tinfl_part *p, uint8_t *pOut, size_t pos)
+{
+    const tinfl_spec *s = &p->spec;
+    size_t n = s->symbolic ? s->out_len : s->sym_len, i;
+    for (i = 0; i < n; ++i)
+    {
+        uint16_t v = s->pSym[i];
+        if (v < 256)
+            pOut[pos + i] = (uint8_t)v;
+        else if (pos + v - 256 < TINFL_SPEC_WINDOW)
+            return 0;
+        else
+            pOut[pos + i] = pOut[pos + v - 256 - TINFL_SPEC_WINDOW];
+    }
+    if (n < s->out_len)
+        TINFL_MEMCPY(pOut + pos + n, s->pOut + (n - s->out_base), s->out_len - n);
+    return 1;
+}
+
+static uint8_t *tinfl_decompress_parallel(const uint8_t *pIn, size_t in_len, size_t expectedLen, size_t *pOut_len, const tpng_scheduler_t *scheduler)
+{
+    size_t i, nparts, pos, bit, adler_pos;
+    tinfl_part *parts;
+    uint8_t *pOut, kraft[1 << 12];
+    int final, ok = 1;
+    *pOut_len = 0;
+
+    /* zlib header: deflate, no preset dictionary */
+    if ((in_len < 6) || ((pIn[0] * 256 + pIn[1]) % 31) || ((pIn[0] & 15) != 8) || (pIn[1] & 32))
+        return NULL;
+
+    nparts = TINFL_MIN((size_t)tpng_scheduler_get_worker_count(scheduler), in_len / TINFL_PARALLEL_MIN_PART);
+    if (nparts < 2)
+        return NULL;
+    pOut = (uint8_t *)TPNG_MALLOC(expectedLen);
+    parts = (tinfl_part *)TPNG_CALLOC(nparts, sizeof(tinfl_part));
+    if (!pOut || !parts)
+    {
+        TPNG_FREE(pOut);
+        TPNG_FREE(parts);
+        return NULL;
+    }
+    tinfl_spec_init_kraft(kraft);
+    for (i = 0; i < nparts; ++i)
+    {
+        tinfl_part *p = parts + i;
+        p->first = i ? in_len / nparts * i * 8 : 16;
+        p->end = (i + 1 < nparts) ? in_len / nparts * (i + 1) * 8 : in_len * 8;
+        p->stop = (i + 1 < nparts) ? p->end : (size_t)-1;
+        p->pKraft = kraft;
+        /* the first part starts with nothing before it, so inflates straight into the output */
+        tinfl_spec_init(&p->spec, pIn, in_len, p->first, i ? NULL : pOut, 0, expectedLen);
+    }
+    tpng_parallel_run(scheduler, tinfl_part_task, parts, sizeof(tinfl_part), (int)nparts);
+
+    pos = parts[0].spec.out_len;
+    bit = parts[0].spec.bit;
+    final = parts[0].spec.final;
+    ok = parts[0].found;
+    for (i = 1; ok && !final && (i < nparts); ++i)
+    {
+        tinfl_part *p = parts + i;
+        if (!p->found || (p->start != bit))
+        {
+            /* speculation failed: inflate from where the last part stopped, up to the block found if it's real */
+            tinfl_spec serial;
+            tinfl_spec_init(&serial, pIn, in_len, bit, pOut, pos, expectedLen);
+            while (ok && !(p->found && (serial.bit == p->start)))
+            {
+                ok = tinfl_spec_block(&serial);
+                if (serial.final || (serial.bit >= p->stop))
                     break;
+            }
+            pos = serial.out_len;
+            bit = serial.bit;
+            final = serial.final;
+            if (!ok || final || !p->found || (p->start != bit))
+                continue;
+        }
+        ok = (pos + p->spec.out_len <= expectedLen) && tinfl_part_resolve(p, pOut, pos);
+        pos += p->spec.out_len;
+        bit = p->spec.bit;
+        final = p->spec.final;
+    }
 
-                num_extra = s_length_extra[counter - 257];
-                counter = s_length_base[counter - 257];
-                if (num_extra)
-                {
-                    uint32_t extra_bits;
-                    TINFL_GET_BITS(25, extra_bits, num_extra);
-                    counter += extra_bits;
-                }
+    /* with the whole output known, check the zlib adler32, a slice per part */
+    adler_pos = (bit + 7) >> 3;
+    ok = ok && final && (adler_pos + 4 <= in_len);
+    if (ok)
+    {
+        uint32_t adler = 1;
+        for (i = 0; i < nparts; ++i)
+        {
+            parts[i].adler.pData = pOut + pos / nparts * i;
+            parts[i].adler.len = (i + 1 < nparts) ? pos / nparts : pos - pos / nparts * i;
+        }
+        tpng_parallel_run(scheduler, tinfl_adler_task, &parts[0].adler, sizeof(tinfl_part), (int)nparts);
+        for (i = 0; i < nparts; ++i)
+            adler = tinfl_adler32_combine(adler, parts[i].adler.adler, parts[i].adler.len);
+        ok = adler == (((uint32_t)pIn[adler_pos] << 24) | ((uint32_t)pIn[adler_pos + 1] << 16) | ((uint32_t)pIn[adler_pos + 2] << 8) | pIn[adler_pos + 3]);
+    }
 
-                TINFL_HUFF_DECODE(26, dist, &r->m_tables[1]);
-                num_extra = s_dist_extra[dist];
-                dist = s_dist_base[dist];
-                if (num_extra)
-                {
-                    uint32_t extra_bits;
-                    TINFL_GET_BITS(27, extra_bits, num_extra);
-                    dist += extra_bits;
-                }
+    for (i = 1; i < nparts; ++i)
+    {
+        TPNG_FREE(parts[i].spec.pSym);
+        TPNG_FREE(parts[i].spec.pOut);
+    }
+    TPNG_FREE(parts);
+    if (!ok)
+    {
+        TPNG_FREE(pOut);
+        return NULL;
+    }
+    *pOut_len = pos;
+    return pOut;
+}
+
+
+
+/* topaz addition: tinfl_stream inflates a zlib stream split across spans (IDAT chunks) into a single block, */
+/* resuming where it left off on each call to tinfl_stream_step(). Used by the pipe and by tpng_decoder_t. */
+struct tinfl_stream
+{
+    tinfl_decompressor decomp;
+    const tpng_span_t *spans;
+    uint32_t nspans;
+    uint32_t span;   /* the span being read */
+    size_t span_ofs; /* bytes of that span already read */
+    uint8_t *pOut_buf;
+    size_t out_buf_len;
+    size_t out_len;  /* bytes of pOut_buf inflated so far */
+    int finished;    /* 0 while inflating, 1 once done, 2 if the stream was corrupt or ran out of input */
+};
 
-                dist_from_out_buf_start = pOut_buf_cur - pOut_buf_start;
-                if ((dist == 0 || dist > dist_from_out_buf_start || dist_from_out_buf_start == 0) && (decomp_flags & TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF))
-                {
-                    TINFL_CR_RETURN_FOREVER(37, TINFL_STATUS_FAILED);
-                }
+static void tinfl_stream_init(tinfl_stream *s, const tpng_span_t *spans, uint32_t nspans, uint8_t *pOut_buf, size_t out_buf_len)
+{
+    /* cleared, so tables not built yet are saved as zeros rather than whatever was on the heap */
+    TINFL_MEMSET(&s->decomp, 0, sizeof(tinfl_decompressor));
+    tinfl_init(&s->decomp);
+    s->spans = spans;
+    s->nspans = nspans;
+    s->span = 0;
+    s->span_ofs = 0;
+    s->pOut_buf = pOut_buf;
+    s->out_buf_len = out_buf_len;
+    s->out_len = 0;
+    s->finished = out_buf_len ? 0 : 1;
+}
 
-                pSrc = pOut_buf_start + ((dist_from_out_buf_start - dist) & out_buf_size_mask);
+static tinfl_stream *tinfl_stream_create(const tpng_span_t *spans, uint32_t nspans, uint8_t *pOut_buf, size_t out_buf_len)
+{
+    tinfl_stream *s = (tinfl_stream *)TPNG_MALLOC(sizeof(tinfl_stream));
+    if (s)
+        tinfl_stream_init(s, spans, nspans, pOut_buf, out_buf_len);
+    return s;
+}
 
-                if ((TINFL_MAX(pOut_buf_cur, pSrc) + counter) > pOut_buf_end)
-                {
-                    while (counter--)
-                    {
-                        while (pOut_buf_cur >= pOut_buf_end)
-                        {
-                            TINFL_CR_RETURN(53, TINFL_STATUS_HAS_MORE_OUTPUT);
-                        }
-                        *pOut_buf_cur++ = pOut_buf_start[(dist_from_out_buf_start++ - dist) & out_buf_size_mask];
-                    }
-                    continue;
-                }
-#if MINIZ_USE_UNALIGNED_LOADS_AND_STORES
-                else if ((counter >= 9) && (counter <= dist))
-                {
-                    const uint8_t *pSrc_end = pSrc + (counter & ~7);
-                    do
-                    {
-#ifdef MINIZ_UNALIGNED_USE_MEMCPY
-						memcpy(pOut_buf_cur, pSrc, sizeof(uint32_t)*2);
-#else
-                        ((uint32_t *)pOut_buf_cur)[0] = ((const uint32_t *)pSrc)[0];
-                        ((uint32_t *)pOut_buf_cur)[1] = ((const uint32_t *)pSrc)[1];
-#endif
-                        pOut_buf_cur += 8;
-                    } while ((pSrc += 8) < pSrc_end);
-                    if ((counter &= 7) < 3)
-                    {
-                        if (counter)
-                        {
-                            pOut_buf_cur[0] = pSrc[0];
-                            if (counter > 1)
-                                pOut_buf_cur[1] = pSrc[1];
-                            pOut_buf_cur += counter;
-                        }
-                        continue;
-                    }
-                }
-#endif
-                while(counter>2)
-                {
-                    pOut_buf_cur[0] = pSrc[0];
-                    pOut_buf_cur[1] = pSrc[1];
-                    pOut_buf_cur[2] = pSrc[2];
-                    pOut_buf_cur += 3;
-                    pSrc += 3;
-					counter -= 3;
-                }
-                if (counter > 0)
+static int tinfl_stream_step(tinfl_stream *s, size_t max_out)
+{
+    size_t end = s->out_len + TINFL_MIN(max_out, s->out_buf_len - s->out_len);
+    while (!s->finished && (s->out_len < end))
+    {
+        const tpng_span_t *pSpan;
+        size_t src_buf_size, dst_buf_size = end - s->out_len;
+        tinfl_status status;
+        if (s->span == s->nspans)
+        {
+            /* ran out of input */
+            s->finished = 2;
+            break;
+        }
+        pSpan = s->spans + s->span;
+        src_buf_size = pSpan->length - s->span_ofs;
+        status = tinfl_decompress(&s->decomp, pSpan->data + s->span_ofs, &src_buf_size, s->pOut_buf, s->pOut_buf + s->out_len, &dst_buf_size,
+                                  TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF | ((s->span + 1 < s->nspans) ? TINFL_FLAG_HAS_MORE_INPUT : 0));
+        s->span_ofs += src_buf_size;
+        s->out_len += dst_buf_size;
+        if (status < 0)
+            s->finished = 2;
+        else if ((status == TINFL_STATUS_DONE) || (s->out_len == s->out_buf_len))
+            s->finished = 1; /* the rest, if any, is for tinfl_stream_finish() */
+        else if (status == TINFL_STATUS_NEEDS_MORE_INPUT)
+        {
+            s->span++;
+            s->span_ofs = 0;
+        }
+    }
+    return s->finished;
+}
+
+static int tinfl_stream_finish(tinfl_stream *s, const size_t *pCancel)
+{
+    /* topaz addition: tinfl_decompress() only asks for more room once it has a byte to write, so with none it reads */
+    /* on to the end of the stream and checks the adler32 there. If it does ask, the rest of the output goes to a ring */
+    /* that starts with the last TINFL_LZ_DICT_SIZE bytes of pOut_buf, in wrapping mode, just so the adler32 sees it. */
+    uint8_t *pRing = NULL;
+    size_t ring_pos = 0;
+    while (s->finished == 1)
+    {
+        const tpng_span_t *pSpan;
+        size_t src_buf_size, dst_buf_size = 0;
+        uint32_t flags = TINFL_FLAG_PARSE_ZLIB_HEADER | ((s->span + 1 < s->nspans) ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+        tinfl_status status;
+        if ((s->span == s->nspans) || (pCancel && TPNG_ATOMIC_LOAD(pCancel)))
+        {
+            s->finished = 2;
+            break;
+        }
+        pSpan = s->spans + s->span;
+        src_buf_size = pSpan->length - s->span_ofs;
+        if (pRing)
+        {
+            dst_buf_size = TINFL_LZ_DICT_SIZE - (ring_pos & (TINFL_LZ_DICT_SIZE - 1));
+            status = tinfl_decompress(&s->decomp, pSpan->data + s->span_ofs, &src_buf_size, pRing, pRing + (ring_pos & (TINFL_LZ_DICT_SIZE - 1)), &dst_buf_size, flags);
+            ring_pos += dst_buf_size;
+        }
+        else
+            status = tinfl_decompress(&s->decomp, pSpan->data + s->span_ofs, &src_buf_size, s->pOut_buf, s->pOut_buf + s->out_len, &dst_buf_size, flags | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+        s->span_ofs += src_buf_size;
+        if (status < 0)
+            s->finished = 2;
+        else if (status == TINFL_STATUS_DONE)
+            break;
+        else if (status == TINFL_STATUS_HAS_MORE_OUTPUT)
+        {
+            if (!pRing)
+            {
+                size_t i;
+                /* cleared, so a match reaching back before the stream began reads zeros */
+                pRing = (uint8_t *)TPNG_CALLOC(1, TINFL_LZ_DICT_SIZE);
+                if (!pRing)
                 {
-                    pOut_buf_cur[0] = pSrc[0];
-                    if (counter > 1)
-                        pOut_buf_cur[1] = pSrc[1];
-                    pOut_buf_cur += counter;
+                    s->finished = 2;
+                    break;
                 }
+                for (i = (s->out_len > TINFL_LZ_DICT_SIZE) ? s->out_len - TINFL_LZ_DICT_SIZE : 0; i < s->out_len; ++i)
+                    pRing[i & (TINFL_LZ_DICT_SIZE - 1)] = s->pOut_buf[i];
+                ring_pos = s->out_len;
             }
         }
-    } while (!(r->m_final & 1));
+        else
+        {
+            s->span++;
+            s->span_ofs = 0;
+        }
+    }
+    TPNG_FREE(pRing);
+    return s->finished;
+}
 
-    /* Ensure byte alignment and put back any bytes from the bitbuf if we've looked ahead too far on gzip, or other Deflate streams followed by arbitrary data. */
-    /* I'm being super conservative here. A number of simplifications can be made to the byte alignment part, and the Adler32 check shouldn't ever need to worry about reading from the bitbuf now. */
-    TINFL_SKIP_BITS(32, num_bits & 7);
-    while ((pIn_buf_cur > pIn_buf_next) && (num_bits >= 8))
+static size_t tinfl_stream_get_length(const tinfl_stream *s)
+{
+    return s->out_len;
+}
+
+static int tinfl_stream_get_finished(const tinfl_stream *s)
+{
+    return s->finished;
+}
+
+/* topaz addition: the decompressor holds no pointers, so its state can be copied out and back in as is. */
+/* Only m_dist_from_out_buf_start depends on where the output buffer begins, so it's rebased onto the window. */
+static size_t tinfl_stream_get_state_size()
+{
+    return sizeof(tinfl_decompressor);
+}
+
+static void tinfl_stream_save(const tinfl_stream *s, size_t window_len, uint8_t *pState, uint32_t *pSpan, uint32_t *pSpan_ofs)
+{
+    tinfl_decompressor decomp = s->decomp;
+    decomp.m_dist_from_out_buf_start -= s->out_len - window_len;
+    TINFL_MEMCPY(pState, &decomp, sizeof(tinfl_decompressor));
+    *pSpan = s->span;
+    *pSpan_ofs = (uint32_t)s->span_ofs;
+}
+
+/* topaz addition: checks a Huffman tree node, a pair of entries reached after TINFL_FAST_LOOKUP_BITS + depth bits, */
+/* so a forged table can't index past m_tree, loop, or make a code longer than 15 bits. */
+static int tinfl_huff_node_is_valid(const tinfl_huff_table *pTable, int node, uint32_t num_syms, int depth)
+{
+    int i;
+    if ((depth > 15 - TINFL_FAST_LOOKUP_BITS) || (~node + 1 >= TINFL_MAX_HUFF_SYMBOLS_0 * 2))
+        return 0;
+    for (i = 0; i < 2; ++i)
     {
-        --pIn_buf_cur;
-        num_bits -= 8;
+        int child = pTable->m_tree[~node + i];
+        if ((child >= 0) ? ((uint32_t)child >= num_syms) : !tinfl_huff_node_is_valid(pTable, child, num_syms, depth + 1))
+            return 0;
     }
-    bit_buf &= (tinfl_bit_buf_t)((((uint64_t)1) << num_bits) - (uint64_t)1);
-    //assert(!num_bits); /* if this assert fires then we've read beyond the end of non-deflate/zlib streams with following data (such as gzip streams). */
+    return 1;
+}
 
-    if (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER)
+/* topaz addition: checks that each field of a saved decompressor is in the range tinfl_decompress() leaves it in, */
+/* for the state it stopped in, and that its tables only hold codes and symbols it could have built. */
+static int tinfl_decompressor_is_valid(const tinfl_decompressor *r, size_t window_len)
+{
+    static const uint8_t s_states[] = { 0, 1, 2, 3, 5, 6, 7, 9, 10, 11, 14, 16, 17, 18, 21, 23, 24, 25, 26, 27, 32, 34, 35, 36, 37, 38, 39, 41, 42, 51, 52, 53 };
+    static const uint32_t s_max_syms[TINFL_MAX_HUFF_TABLES] = { TINFL_MAX_HUFF_SYMBOLS_0, TINFL_MAX_HUFF_SYMBOLS_1, TINFL_MAX_HUFF_SYMBOLS_2 };
+    uint32_t i, j, known = 0;
+    for (i = 0; i < sizeof(s_states); ++i)
+        known |= (r->m_state == s_states[i]);
+    if (!known || (r->m_num_bits > TINFL_BITBUF_SIZE - 2) || ((r->m_type > 2) && (r->m_type != (uint32_t)-1)) ||
+        (r->m_dist > 32768) || (r->m_num_extra > 13))
+        return 0;
+
+    for (i = 0; i < TINFL_MAX_HUFF_TABLES; ++i)
     {
-        for (counter = 0; counter < 4; ++counter)
+        const tinfl_huff_table *pTable = &r->m_tables[i];
+        if (r->m_table_sizes[i] > s_max_syms[i])
+            return 0;
+        for (j = 0; j < TINFL_MAX_HUFF_SYMBOLS_0; ++j)
         {
-            uint32_t s;
-            if (num_bits)
-                TINFL_GET_BITS(41, s, 8);
-            else
-                TINFL_GET_BYTE(42, s);
-            r->m_z_adler32 = (r->m_z_adler32 << 8) | s;
+            if (pTable->m_code_size[j] > 15)
+                return 0;
+        }
+        for (j = 0; j < TINFL_FAST_LOOKUP_SIZE; ++j)
+        {
+            int k = pTable->m_look_up[j];
+            if ((k >= 0) ? (((k >> 9) > TINFL_FAST_LOOKUP_BITS) || ((uint32_t)(k & 511) >= s_max_syms[i])) : !tinfl_huff_node_is_valid(pTable, k, s_max_syms[i], 1))
+                return 0;
         }
     }
-    TINFL_CR_RETURN_FOREVER(34, TINFL_STATUS_DONE);
+    for (j = 0; j < sizeof(r->m_len_codes); ++j)
+    {
+        if (r->m_len_codes[j] > 15)
+            return 0;
+    }
 
-    TINFL_CR_FINISH
+    /* the states that index with counter, dist or num_extra, or copy from the window */
+    switch (r->m_state)
+    {
+        case 6:
+        case 7:
+            return r->m_counter < 4;
+        case 11:
+            return r->m_counter < 3;
+        case 14:
+            return r->m_counter < r->m_table_sizes[2];
+        case 16:
+            return (r->m_type == 2) && (r->m_counter < r->m_table_sizes[0] + r->m_table_sizes[1]);
+        case 18:
+            return (r->m_type == 2) && (r->m_counter < r->m_table_sizes[0] + r->m_table_sizes[1]) &&
+                   (r->m_dist >= 16) && (r->m_dist <= 18) && (r->m_num_extra == (uint32_t)"\02\03\07"[r->m_dist - 16]) &&
+                   ((r->m_dist != 16) || r->m_counter);
+        case 53:
+            return (r->m_dist >= 1) && (r->m_dist <= r->m_dist_from_out_buf_start) && (r->m_dist_from_out_buf_start <= window_len);
+    }
+    return 1;
+}
 
-common_exit:
-    /* As long as we aren't telling the caller that we NEED more input to make forward progress: */
-    /* Put back any bytes from the bitbuf in case we've looked ahead too far on gzip, or other Deflate streams followed by arbitrary data. */
-    /* We need to be very careful here to NOT push back any bytes we definitely know we need to make forward progress, though, or we'll lock the caller up into an inf loop. */
-    if ((status != TINFL_STATUS_NEEDS_MORE_INPUT) && (status != TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS))
+static int tinfl_stream_can_resume(const tpng_span_t *spans, uint32_t nspans, const uint8_t *pState, uint32_t span, uint32_t span_ofs, size_t window_len)
+{
+    tinfl_decompressor *r;
+    int valid;
+    if ((span > nspans) || ((span < nspans) && (span_ofs > spans[span].length)))
+        return 0;
+    /* copied out, as the state in an index needn't be aligned */
+    r = (tinfl_decompressor *)TPNG_MALLOC(sizeof(tinfl_decompressor));
+    if (!r)
+        return 0;
+    TINFL_MEMCPY(r, pState, sizeof(tinfl_decompressor));
+    valid = tinfl_decompressor_is_valid(r, window_len);
+    TPNG_FREE(r);
+    return valid;
+}
+
+static tinfl_stream *tinfl_stream_resume(const tpng_span_t *spans, uint32_t nspans, const uint8_t *pState, uint32_t span, uint32_t span_ofs, uint8_t *pOut_buf, size_t window_len, size_t out_buf_len)
+{
+    tinfl_stream *s;
+    if ((span > nspans) || ((span < nspans) && (span_ofs > spans[span].length)) || (window_len > out_buf_len))
+        return NULL;
+    s = tinfl_stream_create(spans, nspans, pOut_buf, out_buf_len);
+    if (!s)
+        return NULL;
+    TINFL_MEMCPY(&s->decomp, pState, sizeof(tinfl_decompressor));
+    s->span = span;
+    s->span_ofs = span_ofs;
+    s->out_len = window_len;
+    s->finished = (window_len < out_buf_len) ? 0 : 1;
+    return s;
+}
+
+/* topaz addition: like tinfl_stream_save(), rebases the decompressor onto what's left of the output, */
+/* which must keep at least the last 32KB for matches to reach back into. */
+static void tinfl_stream_slide(tinfl_stream *s, size_t discard)
+{
+    memmove(s->pOut_buf, s->pOut_buf + discard, s->out_len - discard);
+    s->decomp.m_dist_from_out_buf_start -= discard;
+    s->out_len -= discard;
+    s->out_buf_len -= discard;
+}
+
+static void tinfl_stream_destroy(tinfl_stream *s)
+{
+    TPNG_FREE(s);
+}
+
+
+
+/* topaz addition: tinfl_pipe inflates a zlib stream split across spans as a scheduler task, into a single */
+/* heap block of expectedLen bytes, while another thread reads the output as it becomes available. */
+/* The producer inflates at most TINFL_PIPE_STEP bytes per call and publishes its progress with a */
+/* release store, so the reader only takes the lock when it has caught up with the inflater. */
+/* If the reader catches up before the task has started, it inflates the stream itself, so a busy */
+/* scheduler can't leave it waiting. */
+#define TINFL_PIPE_STEP (1 << 16)
+
+#if TPNG_THREADS
+struct tinfl_pipe
+{
+    tinfl_stream stream;
+    uint8_t *pBuf;
+    size_t produced; /* bytes of pBuf inflated so far, published from stream */
+    size_t finished; /* 0 while inflating, 1 once done, 2 if the stream was corrupt or cancelled */
+    const size_t *pCancel;
+    int claimed;     /* set by whichever of the task and the reader inflates; under lock */
+    tpng_mutex_t lock;
+    tpng_cond_t ready;
+    const tpng_scheduler_t *scheduler;
+    void *group;
+};
+
+static void tinfl_pipe_publish(tinfl_pipe *pipe, size_t produced, size_t finished)
+{
+    tpng_mutex_lock(&pipe->lock);
+    TPNG_ATOMIC_STORE(&pipe->produced, produced);
+    if (finished)
+        TPNG_ATOMIC_STORE(&pipe->finished, finished);
+    tpng_cond_signal(&pipe->ready);
+    tpng_mutex_unlock(&pipe->lock);
+}
+
+static void tinfl_pipe_run(tinfl_pipe *pipe)
+{
+    int finished;
+    while (!(finished = tinfl_stream_step(&pipe->stream, TINFL_PIPE_STEP)))
     {
-        while ((pIn_buf_cur > pIn_buf_next) && (num_bits >= 8))
+        if (pipe->pCancel && TPNG_ATOMIC_LOAD(pipe->pCancel))
         {
-            --pIn_buf_cur;
-            num_bits -= 8;
+            finished = 2;
+            break;
         }
+        tinfl_pipe_publish(pipe, pipe->stream.out_len, 0);
     }
-    r->m_num_bits = num_bits;
-    r->m_bit_buf = bit_buf & (tinfl_bit_buf_t)((((uint64_t)1) << num_bits) - (uint64_t)1);
-    r->m_dist = dist;
-    r->m_counter = counter;
-    r->m_num_extra = num_extra;
-    r->m_dist_from_out_buf_start = dist_from_out_buf_start;
-    *pIn_buf_size = pIn_buf_cur - pIn_buf_next;
-    *pOut_buf_size = pOut_buf_cur - pOut_buf_next;
-    if ((decomp_flags & (TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32)) && (status >= 0))
+    /* the reader may already have every row, but only hears the stream was good once the adler32 is checked */
+    if (finished == 1)
+        finished = tinfl_stream_finish(&pipe->stream, pipe->pCancel);
+    tinfl_pipe_publish(pipe, pipe->stream.out_len, finished);
+}
+
+/* The scheduler task: inflates unless the reader already is. */
+static void tinfl_pipe_task(void *pData)
+{
+    tinfl_pipe *pipe = (tinfl_pipe *)pData;
+    int claimed;
+    tpng_mutex_lock(&pipe->lock);
+    claimed = pipe->claimed;
+    pipe->claimed = 1;
+    tpng_mutex_unlock(&pipe->lock);
+    if (!claimed)
+        tinfl_pipe_run(pipe);
+}
+
+static tinfl_pipe *tinfl_pipe_start(const tpng_span_t *spans, uint32_t nspans, size_t expectedLen, const tpng_scheduler_t *scheduler, const size_t *pCancel)
+{
+    tinfl_pipe *pipe;
+    /* a task isn't worth it for a few steps of output */
+    if ((expectedLen < 4 * TINFL_PIPE_STEP) || (tpng_scheduler_get_worker_count(scheduler) < 2))
+        return NULL;
+    pipe = (tinfl_pipe *)TPNG_CALLOC(1, sizeof(tinfl_pipe));
+    pipe->pBuf = (uint8_t *)TPNG_MALLOC(expectedLen);
+    if (!pipe->pBuf)
     {
-        const uint8_t *ptr = pOut_buf_next;
-        size_t buf_len = *pOut_buf_size;
-        uint32_t i, s1 = r->m_check_adler32 & 0xffff, s2 = r->m_check_adler32 >> 16;
-        size_t block_len = buf_len % 5552;
-        while (buf_len)
-        {
-            for (i = 0; i + 7 < block_len; i += 8, ptr += 8)
-            {
-                s1 += ptr[0], s2 += s1;
-                s1 += ptr[1], s2 += s1;
-                s1 += ptr[2], s2 += s1;
-                s1 += ptr[3], s2 += s1;
-                s1 += ptr[4], s2 += s1;
-                s1 += ptr[5], s2 += s1;
-                s1 += ptr[6], s2 += s1;
-                s1 += ptr[7], s2 += s1;
-            }
-            for (; i < block_len; ++i)
-                s1 += *ptr++, s2 += s1;
-            s1 %= 65521U, s2 %= 65521U;
-            buf_len -= block_len;
-            block_len = 5552;
-        }
-        r->m_check_adler32 = (s2 << 16) + s1;
-        if ((status == TINFL_STATUS_DONE) && (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) && (r->m_check_adler32 != r->m_z_adler32))
-            status = TINFL_STATUS_ADLER32_MISMATCH;
+        TPNG_FREE(pipe);
+        return NULL;
     }
-    return status;
+    tinfl_stream_init(&pipe->stream, spans, nspans, pipe->pBuf, expectedLen);
+    pipe->scheduler = scheduler;
+    pipe->pCancel = pCancel;
+    tpng_mutex_init(&pipe->lock);
+    tpng_cond_init(&pipe->ready);
+    pipe->group = scheduler->createGroup(scheduler->userData);
+    scheduler->submit(scheduler->userData, pipe->group, tinfl_pipe_task, pipe);
+    return pipe;
 }
 
-/* High level decompression functions: */
-/* tinfl_decompress_mem_to_heap() decompresses a block in memory to a heap block allocated via TPNG_MALLOC(). */
-/* On entry: */
-/*  pSrc_buf, src_buf_len: Pointer and size of the Deflate or zlib source data to decompress. */
+static const uint8_t *tinfl_pipe_wait(tinfl_pipe *pipe, size_t end)
+{
+    if (TPNG_ATOMIC_LOAD(&pipe->produced) >= end)
+        return pipe->pBuf;
+    tpng_mutex_lock(&pipe->lock);
+    if (!pipe->claimed)
+    {
+        /* the task hasn't started: inflate everything here instead */
+        pipe->claimed = 1;
+        tpng_mutex_unlock(&pipe->lock);
+        tinfl_pipe_run(pipe);
+        tpng_mutex_lock(&pipe->lock);
+    }
+    while ((pipe->produced < end) && !pipe->finished)
+        tpng_cond_wait(&pipe->ready, &pipe->lock);
+    tpng_mutex_unlock(&pipe->lock);
+    /* a corrupt stream is reported by tinfl_pipe_finish(), like an inflate up front shows no rows */
+    return (TPNG_ATOMIC_LOAD(&pipe->produced) >= end) ? pipe->pBuf : NULL;
+}
+
+static int tinfl_pipe_finish(tinfl_pipe *pipe)
+{
+    int ok;
+    pipe->scheduler->wait(pipe->scheduler->userData, pipe->group);
+    ok = (pipe->finished == 1);
+    tpng_cond_destroy(&pipe->ready);
+    tpng_mutex_destroy(&pipe->lock);
+    TPNG_FREE(pipe->pBuf);
+    TPNG_FREE(pipe);
+    return ok;
+}
+#else
+struct tinfl_pipe
+{
+    int unused;
+};
+
+static tinfl_pipe *tinfl_pipe_start(const tpng_span_t *spans, uint32_t nspans, size_t expectedLen, const tpng_scheduler_t *scheduler, const size_t *pCancel)
+{
+    return NULL;
+}
+
+static const uint8_t *tinfl_pipe_wait(tinfl_pipe *pipe, size_t end)
+{
+    return NULL;
+}
+
+static int tinfl_pipe_finish(tinfl_pipe *pipe)
+{
+    return 0;
+}
+#endif
+
+
+
+/* topaz addition: tinfl_decompress_spans_to_heap() decompresses a zlib stream split across several buffers (IDAT chunks), */
+/* without joining them first, into a single heap block of expectedLen bytes allocated via TPNG_MALLOC(). */
+/* If scheduler runs tasks on more than one thread, large streams are first tried with tinfl_decompress_parallel(). */
+/* If pCancel is not NULL, decompression fails early once *pCancel is nonzero. */
 /* On return: */
 /*  Function returns a pointer to the decompressed data, or NULL on failure. */
-/*  *pOut_len will be set to the decompressed data's size, which could be larger than src_buf_len on uncompressible data. */
-/*  The caller must call mz_TPNG_FREE() on the returned block when it's no longer needed. */
+/*  *pOut_len will be set to the decompressed data's size. Any data past expectedLen is ignored. */
+/*  The caller must call TPNG_FREE() on the returned block when it's no longer needed. */
 
-void *tinfl_decompress_mem_to_heap(const void *pSrc_buf, size_t src_buf_len, size_t *pOut_len, int flags)
+uint8_t *tinfl_decompress_spans_to_heap(const tpng_span_t *spans, uint32_t nspans, size_t expectedLen, size_t *pOut_len, const tpng_scheduler_t *scheduler, const size_t *pCancel)
 {
-    tinfl_decompressor decomp;
-    void *pBuf = NULL, *pNew_buf;
-    size_t src_buf_ofs = 0, out_buf_capacity = 0;
+    uint8_t *pBuf;
+    uint32_t span;
+    size_t len;
     *pOut_len = 0;
-    tinfl_init(&decomp);
-    for (;;)
+    if (!expectedLen)
+        return NULL;
+
+    if (tpng_scheduler_get_worker_count(scheduler) > 1)
     {
-        size_t src_buf_size = src_buf_len - src_buf_ofs, dst_buf_size = out_buf_capacity - *pOut_len, new_out_buf_capacity;
-        tinfl_status status = tinfl_decompress(&decomp, (const uint8_t *)pSrc_buf + src_buf_ofs, &src_buf_size, (uint8_t *)pBuf, pBuf ? (uint8_t *)pBuf + *pOut_len : NULL, &dst_buf_size,
-                                               (flags & ~TINFL_FLAG_HAS_MORE_INPUT) | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
-        if ((status < 0) || (status == TINFL_STATUS_NEEDS_MORE_INPUT))
-        {
-            TPNG_FREE(pBuf);
-            *pOut_len = 0;
-            return NULL;
-        }
-        src_buf_ofs += src_buf_size;
-        *pOut_len += dst_buf_size;
-        if (status == TINFL_STATUS_DONE)
-            break;
-        new_out_buf_capacity = out_buf_capacity * 2;
-        if (new_out_buf_capacity < 128)
-            new_out_buf_capacity = 128;
-        pNew_buf = realloc(pBuf, new_out_buf_capacity);
-        if (!pNew_buf)
+        size_t total = 0;
+        for (span = 0; span < nspans; ++span)
+            total += spans[span].length;
+        if (total >= 2 * TINFL_PARALLEL_MIN_PART)
         {
-            TPNG_FREE(pBuf);
-            *pOut_len = 0;
-            return NULL;
+            const uint8_t *pJoined = nspans ? spans[0].data : NULL;
+            uint8_t *pCopy = NULL;
+            if (nspans > 1)
+            {
+                /* parts are found by scanning, so the input must be contiguous */
+                pCopy = (uint8_t *)TPNG_MALLOC(total);
+                total = 0;
+                for (span = 0; pCopy && span < nspans; ++span)
+                {
+                    TINFL_MEMCPY(pCopy + total, spans[span].data, spans[span].length);
+                    total += spans[span].length;
+                }
+                pJoined = pCopy;
+            }
+            pBuf = pJoined ? tinfl_decompress_parallel(pJoined, total, expectedLen, pOut_len, scheduler) : NULL;
+            TPNG_FREE(pCopy);
+            if (pBuf && pCancel && TPNG_ATOMIC_LOAD(pCancel))
+            {
+                TPNG_FREE(pBuf);
+                *pOut_len = 0;
+                return NULL;
+            }
+            if (pBuf)
+                return pBuf;
         }
-        pBuf = pNew_buf;
-        out_buf_capacity = new_out_buf_capacity;
     }
+
+    pBuf = (uint8_t *)TPNG_MALLOC(expectedLen);
+    if (!pBuf)
+        return NULL;
+    len = tinfl_decompress_spans_to_mem(spans, nspans, pBuf, expectedLen, pCancel);
+    if (len == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED)
+    {
+        TPNG_FREE(pBuf);
+        return NULL;
+    }
+    *pOut_len = len;
     return pBuf;
 }
 
+/* topaz addition: tinfl_decompress_spans_to_mem() decompresses a zlib stream split across several buffers (IDAT chunks) */
+/* into the given block. Any data past out_buf_len is ignored, but for the adler32, which is checked over the whole */
+/* stream. If pCancel is not NULL, output is made at most TINFL_PIPE_STEP bytes at a time, and decompression fails */
+/* once *pCancel is nonzero. */
+/* Returns TINFL_DECOMPRESS_MEM_TO_MEM_FAILED on failure, or the number of bytes written on success. */
+size_t tinfl_decompress_spans_to_mem(const tpng_span_t *spans, uint32_t nspans, uint8_t *pOut_buf, size_t out_buf_len, const size_t *pCancel)
+{
+    tinfl_stream stream;
+    tinfl_stream_init(&stream, spans, nspans, pOut_buf, out_buf_len);
+    while (!tinfl_stream_step(&stream, pCancel ? (size_t)TINFL_PIPE_STEP : out_buf_len))
+    {
+        if (pCancel && TPNG_ATOMIC_LOAD(pCancel))
+            return TINFL_DECOMPRESS_MEM_TO_MEM_FAILED;
+    }
+    if (tinfl_stream_finish(&stream, pCancel) == 2)
+        return TINFL_DECOMPRESS_MEM_TO_MEM_FAILED;
+    return stream.out_len;
+}
+
 
 
 
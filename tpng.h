@@ -39,6 +39,7 @@ extern "C" {
 #define TPNG_H_INCLUDED
 
 #include <stdint.h>
+#include <stddef.h>
 
 // Returns a raw data buffer containing 
 // 32-bit RGBA data buffer. Must be freed.
@@ -63,6 +64,805 @@ uint8_t * tpng_get_rgba(
 );
 
 
+
+
+// A task scheduler that tPNG's parallel work can run on, 
+// instead of threads that tPNG starts itself. Every function
+// gets userData as its first argument.
+typedef struct {
+    // Passed to every function below.
+    void * userData;
+
+    // Returns a new wait group with no tasks.
+    void * (*createGroup)(void * userData);
+
+    // Runs task(data) on any thread, as part of the group.
+    // Tasks may submit more tasks and wait on their groups.
+    void (*submit)(void * userData, void * group, void (*task)(void * data), void * data);
+
+    // Returns once every task submitted to the group has 
+    // finished, then frees the group. Called from tasks too,
+    // so it should run other tasks while it waits.
+    void (*wait)(void * userData, void * group);
+
+    // Returns the number of threads that run tasks, 
+    // including one that waits.
+    int (*getWorkerCount)(void * userData);
+} tpng_scheduler_t;
+
+
+
+
+// Filters that tpng_options_t.resampleFilter can be.
+enum {
+    // Each pixel is blended from the 4 pixels of the 
+    // image nearest to its center.
+    TPNG_RESAMPLE_BILINEAR,
+
+    // Each pixel is the average of the part of the 
+    // image it covers. Best for shrinking.
+    TPNG_RESAMPLE_AREA
+};
+
+
+// Pixel formats that tpng_options_t.format can be.
+enum {
+    // 8 bits each of red, green, blue and alpha.
+    TPNG_FORMAT_RGBA8,
+
+    // A 32-bit float for each channel, from 0 to 1 
+    // before the scale and bias are applied.
+    TPNG_FORMAT_FLOAT32,
+
+    // Same as TPNG_FORMAT_FLOAT32, but in 16-bit 
+    // IEEE half floats.
+    TPNG_FORMAT_FLOAT16,
+
+    // 8 bits each of blue, green, red and alpha.
+    TPNG_FORMAT_BGRA8,
+
+    // 8 bits each of red, green and blue.
+    TPNG_FORMAT_RGB8,
+
+    // 8 bits each of alpha, red, green and blue.
+    TPNG_FORMAT_ARGB8,
+
+    // 8 bits of luma (0.299 R + 0.587 G + 0.114 B).
+    TPNG_FORMAT_GRAY8,
+
+    // 8 bits of luma, then 8 bits of alpha.
+    TPNG_FORMAT_GRAY_ALPHA8,
+
+    // 16 bits each of red, green, blue and alpha, in the 
+    // machine's byte order. 16-bit images keep all their 
+    // precision, unless downscaled or resampled.
+    TPNG_FORMAT_RGBA16,
+
+    // The 16-bit formats below are each pixel packed into 
+    // one 16-bit value in the machine's byte order, from 
+    // the high bits down, and can be dithered.
+
+    // 5 bits of red, 6 of green and 5 of blue.
+    TPNG_FORMAT_RGB565,
+
+    // 4 bits each of red, green, blue and alpha.
+    TPNG_FORMAT_RGBA4444,
+
+    // 5 bits each of red, green and blue, then 1 of alpha.
+    TPNG_FORMAT_RGBA5551,
+
+    // The image's own samples, at its own bit depth and color 
+    // type: each row unfiltered (and put back in place if 
+    // interlaced), then padded to rowAlignment bytes. The 
+    // whole image is always decoded, without downscaling, 
+    // resampling or premultiplying (except the palette). 
+    // tpng_decode_native() also describes the samples.
+    TPNG_FORMAT_NATIVE,
+
+    // BC1 (DXT1) blocks: each 4x4 block of pixels in 8 bytes, 
+    // without alpha. Blocks go left to right, then top to 
+    // bottom, and edge blocks repeat the last row and column.
+    TPNG_FORMAT_BC1,
+
+    // BC3 (DXT5) blocks: each 4x4 block of pixels in 16 bytes, 
+    // 8 of alpha and then 8 of color as in BC1.
+    TPNG_FORMAT_BC3
+};
+
+
+// How pixels are laid out in the output.
+enum {
+    // Row after row, left to right.
+    TPNG_LAYOUT_LINEAR,
+
+    // In square tiles of tileSize pixels, left to right, then 
+    // top to bottom, each tile row after row. The image is 
+    // padded with 0 out to a whole number of tiles.
+    TPNG_LAYOUT_TILED,
+
+    // Same as TPNG_LAYOUT_TILED, but with each tile in Z-order 
+    // (Morton order): x and y's bits interleaved, x lowest.
+    TPNG_LAYOUT_MORTON
+};
+
+
+// How the output is flipped or rotated. The first 8 are 
+// in the order of the EXIF orientations, less 1.
+enum {
+    // As stored.
+    TPNG_ORIENT_NONE,
+
+    // Mirrored left to right.
+    TPNG_ORIENT_FLIP_X,
+
+    // Turned halfway around.
+    TPNG_ORIENT_ROTATE_180,
+
+    // Mirrored top to bottom, such as for OpenGL.
+    TPNG_ORIENT_FLIP_Y,
+
+    // Mirrored across the top-left to bottom-right diagonal.
+    TPNG_ORIENT_TRANSPOSE,
+
+    // Turned a quarter clockwise.
+    TPNG_ORIENT_ROTATE_90,
+
+    // Mirrored across the top-right to bottom-left diagonal.
+    TPNG_ORIENT_TRANSVERSE,
+
+    // Turned three quarters clockwise.
+    TPNG_ORIENT_ROTATE_270,
+
+    // Whatever the orientation in the image's eXIf 
+    // chunk says, or as stored without one.
+    TPNG_ORIENT_EXIF
+};
+
+
+// How the 16-bit packed formats are dithered. Only 
+// color is dithered; alpha is rounded.
+enum {
+    // Each channel is rounded to the nearest value.
+    TPNG_DITHER_NONE,
+
+    // A 4x4 ordered (Bayer) dither. Rows don't 
+    // depend on each other.
+    TPNG_DITHER_ORDERED,
+
+    // Floyd-Steinberg error diffusion, carrying 
+    // error from each row to the next.
+    TPNG_DITHER_DIFFUSION
+};
+
+
+
+// Options that change how tpng_decode() reads a PNG file.
+// A zero'd tpng_options_t behaves exactly like tpng_get_rgba().
+typedef struct {
+    // If nonzero, the CRC of every chunk is verified.
+    // Any chunk with a mismatched CRC fails the entire decode.
+    int strict;
+
+    // The number of threads the parallel options below may use,
+    // including the calling thread. 0 uses one per processor.
+    // Has no effect if tPNG was built without threads.
+    int threads;
+
+    // If nonzero, large IDAT streams are inflated on several 
+    // threads at once. The stream is cut into equal parts, and 
+    // each part guesses where the first deflate block after its 
+    // cut starts, inflating from there with the data before it 
+    // left as references until that data is known. Parts that 
+    // guessed wrong are inflated again, so any stream works, 
+    // but it's fastest for the dynamic blocks most encoders write.
+    int parallelInflate;
+
+    // If nonzero, large IDAT streams are inflated on a second 
+    // thread while the calling thread unfilters and expands 
+    // the rows already inflated. Needs threads to allow 2 or 
+    // more, and is not used together with parallelInflate.
+    int pipeline;
+
+    // If nonzero, images with at least parallelExpandPixels 
+    // pixels are unfiltered and converted to RGBA on several 
+    // threads. Non-interlaced images are split at rows that 
+    // don't depend on the row above (filter None or Sub), or 
+    // failing that, only conversion is split into bands of rows.
+    // Interlaced images have their seven passes decoded at once.
+    int parallelExpand;
+
+    // The pixel count (width * height) at which parallelExpand
+    // starts being used. 0 uses a default of 262144 (512x512).
+    uint32_t parallelExpandPixels;
+
+    // If not NULL, all parallel work (including batches) is 
+    // submitted to this scheduler, and threads is ignored.
+    // Has no effect if tPNG was built without threads.
+    const tpng_scheduler_t * scheduler;
+
+    // If 2, 4 or 8, the image is shrunk by that much as it's 
+    // decoded, each pixel the average of a box of pixels. 
+    // The output size rounds up. The full size image is never 
+    // held at once, and the parallel options are not used.
+    int downscale;
+
+    // If 1 to 6, only that many adam7 passes of interlaced 
+    // images are decoded, and nothing after them is inflated. 
+    // Each pixel not yet decoded takes the value of the decoded 
+    // one above and to the left of it, as in a progressive 
+    // display, so 1 pass with a downscale of 8 gives each 
+    // decoded pixel of the first pass once. 
+    int previewPasses;
+
+    // If both are nonzero, the image is resampled to this size 
+    // as it's decoded, keeping only the rows of the image that 
+    // the filter still needs (interlaced images keep the output 
+    // size of sums instead). downscale is then not used, and 
+    // neither are the parallel options.
+    uint32_t resampleW;
+    uint32_t resampleH;
+
+    // How to resample: one of TPNG_RESAMPLE_*.
+    int resampleFilter;
+
+    // The format of the output: one of TPNG_FORMAT_*. Each row 
+    // is converted as it's decoded. The 8-bit formats and 
+    // TPNG_FORMAT_RGBA16 still use the parallel options; the 
+    // float, packed, native and block formats don't. 
+    int format;
+
+    // If nonzero, float formats are written a plane per 
+    // channel (CHW), instead of a pixel at a time (HWC).
+    int planar;
+
+    // If nonzero, float formats leave out alpha.
+    int dropAlpha;
+
+    // For float formats, each channel is multiplied by its 
+    // scale, then has its bias added, such as to normalize by 
+    // a mean and standard deviation: scale = 1/std and 
+    // bias = -mean/std. A scale of all 0 is taken as all 1.
+    float scale[4];
+    float bias[4];
+
+    // If nonzero, color channels are multiplied by alpha as 
+    // each row is expanded, rounded to the nearest value. 
+    // Palette images have their palette multiplied once 
+    // instead, and images without alpha are left alone.
+    int premultiply;
+
+    // For the 16-bit packed formats, how to dither: 
+    // one of TPNG_DITHER_*.
+    int dither;
+
+    // For TPNG_FORMAT_NATIVE, each row is padded to a 
+    // multiple of this many bytes. 0 is the same as 1.
+    uint32_t rowAlignment;
+
+    // If nonzero, the output is the whole mip chain: the image, 
+    // then each level half the size of the one before, down 
+    // to 1 by 1, laid out as tpng_get_mip_chain() says. Each 
+    // level is made from the one before as its rows come out. 
+    // Only used with TPNG_FORMAT_RGBA8.
+    int mipmaps;
+
+    // How pixels are laid out: one of TPNG_LAYOUT_*. Not used 
+    // with planes, mipmaps, blocks or native samples.
+    int layout;
+
+    // The width and height of tiles: a power of 2 from 4 
+    // to 256. 0 for 8.
+    uint32_t tileSize;
+
+    // How to flip or rotate the output: one of TPNG_ORIENT_*. 
+    // Each row is written straight to where it ends up. Rotating 
+    // a quarter swaps the width and height given back. Not used 
+    // with planes, mipmaps, blocks, native samples or tiled 
+    // layouts, and regions are still of the image as stored.
+    int orientation;
+
+    // If nonzero, float formats are in linear light: color is 
+    // decoded with the sRGB curve if there's an sRGB chunk (or 
+    // no gAMA chunk either), else with the gAMA chunk's gamma, 
+    // through tables made once per decode. Alpha stays as is. 
+    // With premultiply, color is multiplied by alpha after the 
+    // curve, so it's linear(color)*alpha.
+    int linear;
+} tpng_options_t;
+
+
+
+// Same as tpng_get_rgba(), but with options.
+// Returns a raw data buffer containing
+// 32-bit RGBA data buffer, or pixels in 
+// options->format if set. Must be freed.
+uint8_t * tpng_decode(
+
+    // The raw data to interpret.
+    // This should be the entire data buffer of
+    // a valid PNG file.
+    const uint8_t * rawData,
+
+    // The number of bytes of the rawData.
+    uint32_t        rawSize,
+
+
+    // On success, outputs the width of the
+    // image.
+    uint32_t * w,
+
+    // On success, outputs the height of the
+    // image.
+    uint32_t * h,
+
+    // The options to decode with. If NULL,
+    // the defaults are used.
+    const tpng_options_t * options
+);
+
+
+
+
+// Result of decoding one image of a batch.
+enum {
+    // The image was decoded.
+    TPNG_STATUS_OK,
+
+    // The data is not a PNG file.
+    TPNG_STATUS_NOT_PNG,
+
+    // The file has no usable image header (IHDR).
+    TPNG_STATUS_NO_IMAGE,
+
+    // Strict mode found a chunk with a mismatched CRC.
+    TPNG_STATUS_CORRUPT,
+
+    // The decode was cancelled before it finished.
+    TPNG_STATUS_CANCELLED
+};
+
+
+// One image of a tpng_decode_batch() call.
+typedef struct {
+    // The raw data to interpret, as for tpng_get_rgba().
+    const uint8_t * rawData;
+
+    // The number of bytes of the rawData.
+    uint32_t        rawSize;
+
+
+    // Set by tpng_decode_batch(): the 32-bit RGBA 
+    // data buffer, or NULL on failure. Must be freed.
+    uint8_t * rgba;
+
+    // Set by tpng_decode_batch(): the width of the image.
+    uint32_t w;
+
+    // Set by tpng_decode_batch(): the height of the image.
+    uint32_t h;
+
+    // Set by tpng_decode_batch(): one of TPNG_STATUS_*.
+    int status;
+} tpng_batch_item_t;
+
+
+
+// Decodes many images at once on a pool of threads.
+// Larger images are started first, and images with at 
+// least parallelExpandPixels pixels are split into bands 
+// of rows that idle threads can pick up.
+// Returns the number of images decoded successfully.
+int tpng_decode_batch(
+
+    // The images to decode. The results are written 
+    // into each item.
+    tpng_batch_item_t * items,
+
+    // The number of items.
+    uint32_t count,
+
+    // The options to decode each image with. options->threads 
+    // sets the size of the pool, unless options->scheduler 
+    // is given. If NULL, the defaults are used, with one 
+    // thread per processor.
+    const tpng_options_t * options
+);
+
+
+
+// Decodes many images at once, as tpng_decode_batch() does, 
+// into one tensor of count images, resampled to options->resampleW 
+// by options->resampleH (unless already that size) and written in 
+// options->format, which must be a float format. With 
+// options->planar, the tensor is NCHW, otherwise NHWC. No item 
+// gets a buffer of its own, and the slots of images that failed 
+// are left as 0. Returns the number of images decoded successfully.
+int tpng_decode_tensor_batch(
+
+    // The images to decode. Each item gets its status, 
+    // and the size of its slot.
+    tpng_batch_item_t * items,
+
+    // The number of items.
+    uint32_t count,
+
+    // The options to decode each image with.
+    const tpng_options_t * options,
+
+    // Where to write the images, count * channels * 
+    // resampleH * resampleW floats (or half floats) long.
+    void * tensor
+);
+
+
+
+// A queue of decodes that run in the background on a pool 
+// of threads (or options->scheduler), most urgent first.
+typedef struct tpng_queue_t tpng_queue_t;
+
+// One decode submitted to a tpng_queue_t.
+typedef struct tpng_request_t tpng_request_t;
+
+// Called on the decoding thread once a request has finished,
+// whether it was decoded, failed, or cancelled.
+typedef void (*tpng_request_callback_t)(
+    // The request that finished.
+    tpng_request_t * request, 
+
+    // The userData given to tpng_queue_submit().
+    void * userData
+);
+
+
+// Creates a new queue. options->threads sets the number of 
+// threads decoding in the background, unless options->scheduler 
+// is given. The options are also used for every decode.
+// If NULL, the defaults are used, with one thread per processor.
+// Without threads, requests are decoded within tpng_queue_submit().
+// A given scheduler runs the requests whenever it runs tasks, 
+// and tpng_queue_destroy() waits on it for any left over.
+tpng_queue_t * tpng_queue_create(const tpng_options_t * options);
+
+// Cancels every request that hasn't finished, waits for 
+// the rest, then frees the queue and all its requests, 
+// including ones not yet released.
+void tpng_queue_destroy(tpng_queue_t * queue);
+
+
+// Adds a decode to the queue. Requests with a higher priority 
+// are started first; requests with the same priority are 
+// started in the order they were submitted.
+// rawData must stay valid until the request has finished.
+tpng_request_t * tpng_queue_submit(
+    // The queue to decode on.
+    tpng_queue_t * queue,
+
+    // The raw data to interpret, as for tpng_get_rgba().
+    const uint8_t * rawData,
+
+    // The number of bytes of the rawData.
+    uint32_t        rawSize,
+
+    // How urgent the decode is. Can be changed later with 
+    // tpng_request_set_priority().
+    int priority,
+
+    // If not NULL, called once the request has finished.
+    tpng_request_callback_t callback,
+
+    // Passed to the callback.
+    void * userData
+);
+
+// Changes the priority of a request that hasn't started.
+void tpng_request_set_priority(tpng_request_t * request, int priority);
+
+// Asks for the request to stop. A request that hasn't started 
+// is never decoded; one that has stops at its next row or 
+// block of inflated data. Either way, it finishes with 
+// TPNG_STATUS_CANCELLED unless it was already done.
+void tpng_request_cancel(tpng_request_t * request);
+
+// Returns whether the request has finished, without waiting.
+int tpng_request_is_finished(const tpng_request_t * request);
+
+// Waits for the request to finish, then returns 
+// its status, one of TPNG_STATUS_*.
+int tpng_request_wait(tpng_request_t * request);
+
+// Once the request has finished, returns its 32-bit RGBA data 
+// buffer (or NULL on failure), which must then be freed by the 
+// caller, and outputs the width and height of the image.
+// Later calls return NULL.
+uint8_t * tpng_request_take_rgba(tpng_request_t * request, uint32_t * w, uint32_t * h);
+
+// Frees the request once it has finished, cancelling it 
+// if needed. The request can't be used afterwards, but the 
+// callback is still called. Pixels not taken are freed.
+void tpng_request_release(tpng_request_t * request);
+
+
+
+
+
+// A decode that's done a little at a time, for when a 
+// whole image can't be decoded without stalling the caller.
+// All of its state is kept between steps. The parallel 
+// options are not used.
+typedef struct tpng_decoder_t tpng_decoder_t;
+
+// Creates a new decoder. rawData must stay valid 
+// until the decoder is destroyed.
+tpng_decoder_t * tpng_decoder_create(
+    // The raw data to interpret, as for tpng_get_rgba().
+    const uint8_t * rawData,
+
+    // The number of bytes of the rawData.
+    uint32_t        rawSize,
+
+    // The options to decode with. If NULL,
+    // the defaults are used.
+    const tpng_options_t * options
+);
+
+// Does the next part of the decode, then returns nonzero if 
+// there's more to do, or 0 once the decode has finished.
+int tpng_decoder_step(
+    // The decoder to advance.
+    tpng_decoder_t * decoder,
+
+    // The most rows (of any adam7 pass) to unfilter and 
+    // convert to RGBA. 0 for no limit.
+    uint32_t maxRows,
+
+    // The most bytes to inflate, or in strict mode, to 
+    // check the CRC of. 0 for no limit.
+    uint32_t maxBytes
+);
+
+// Once finished, returns the status of the 
+// decode, one of TPNG_STATUS_*.
+int tpng_decoder_get_status(const tpng_decoder_t * decoder);
+
+// Limits the decode to the w by h rectangle at (x, y), clipped 
+// to the image, which is then all the decoder outputs. Rows 
+// and columns outside it aren't converted, and inflating stops 
+// after its last row. Only has an effect before the first step.
+void tpng_decoder_set_region(tpng_decoder_t * decoder, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
+
+// Returns the 32-bit RGBA data (or the options' format) decoded 
+// so far, with rows not yet decoded left as 0, or NULL if there 
+// isn't any. Owned by the decoder. Outputs the width and height 
+// of the image, or of the region if one was set.
+const uint8_t * tpng_decoder_get_rgba(const tpng_decoder_t * decoder, uint32_t * w, uint32_t * h);
+
+// Once finished, returns the 32-bit RGBA data buffer (or NULL 
+// on failure), which must then be freed by the caller, and 
+// outputs the width and height of the image.
+uint8_t * tpng_decoder_take_rgba(tpng_decoder_t * decoder, uint32_t * w, uint32_t * h);
+
+// Returns the bytes the decoder holds for its work, besides the 
+// pixels it gives back: about 64KB of the inflated stream plus 
+// a row, rows on their way to the output, and any tables. 
+// Interlaced images also hold every pixel, unless shrunk, as 
+// rows arrive a pass at a time. 0 until every chunk is read.
+size_t tpng_decoder_get_working_size(const tpng_decoder_t * decoder);
+
+// Frees the decoder, along with pixels not taken.
+void tpng_decoder_destroy(tpng_decoder_t * decoder);
+
+
+
+
+
+// Same as tpng_decode(), but also builds an index of the image 
+// that lets tpng_decode_rows() decode any of its rows later 
+// without inflating everything before them. The index can be 
+// saved alongside the file; it's only valid for that file, and 
+// for the same build of tPNG. The parallel options are not used.
+uint8_t * tpng_decode_indexed(
+    // The raw data to interpret, as for tpng_get_rgba().
+    const uint8_t * rawData,
+
+    // The number of bytes of the rawData.
+    uint32_t        rawSize,
+
+    // On success, outputs the width of the image.
+    uint32_t * w,
+
+    // On success, outputs the height of the image.
+    uint32_t * h,
+
+    // The options to decode with. If NULL,
+    // the defaults are used.
+    const tpng_options_t * options,
+
+    // How many rows apart to save where inflating was. Each 
+    // of these checkpoints takes about 43KB plus one row.
+    uint32_t rowsPerCheckpoint,
+
+    // On success, outputs the index, which must be freed. 
+    // Interlaced images can't be indexed, and output NULL.
+    uint8_t ** index,
+
+    // Outputs the number of bytes of the index.
+    uint32_t * indexSize
+);
+
+// Decodes only rows [y0, y1) of a non-interlaced image, 
+// inflating from the index's last checkpoint at or before y0.
+// Returns a buffer of 32-bit RGBA data, (y1-y0) rows tall, 
+// which must be freed. If the index is NULL, doesn't belong 
+// to the file, or its checkpoint is damaged, inflating starts 
+// from the first row.
+// Corrupt data past y1 isn't looked at, so it doesn't blank 
+// the rows as it would for tpng_decode().
+uint8_t * tpng_decode_rows(
+    // The raw data to interpret, as for tpng_get_rgba().
+    const uint8_t * rawData,
+
+    // The number of bytes of the rawData.
+    uint32_t        rawSize,
+
+    // The index from tpng_decode_indexed(), or NULL.
+    const uint8_t * index,
+
+    // The number of bytes of the index.
+    uint32_t indexSize,
+
+    // The first row to decode.
+    uint32_t y0,
+
+    // The row after the last to decode. At most 
+    // the height of the image.
+    uint32_t y1,
+
+    // On success, outputs the width of the image.
+    uint32_t * w
+);
+
+// Decodes only the w by h rectangle at (x, y) of the image, 
+// clipped to its bounds. Returns a buffer of 32-bit RGBA data 
+// for just that rectangle, which must be freed, and outputs 
+// its size. Nothing past its last row is inflated, so as with 
+// tpng_decode_rows(), corrupt data there goes unnoticed. 
+// The parallel options are not used.
+uint8_t * tpng_decode_region(
+    // The raw data to interpret, as for tpng_get_rgba().
+    const uint8_t * rawData,
+
+    // The number of bytes of the rawData.
+    uint32_t        rawSize,
+
+    // The left column of the rectangle.
+    uint32_t x,
+
+    // The top row of the rectangle.
+    uint32_t y,
+
+    // The width of the rectangle.
+    uint32_t w,
+
+    // The height of the rectangle.
+    uint32_t h,
+
+    // On success, outputs the width of the clipped rectangle.
+    uint32_t * regionW,
+
+    // On success, outputs the height of the clipped rectangle.
+    uint32_t * regionH,
+
+    // The options to decode with. If NULL,
+    // the defaults are used.
+    const tpng_options_t * options
+);
+
+
+
+// Describes the samples of TPNG_FORMAT_NATIVE.
+typedef struct {
+    // The width and height of the image, in pixels.
+    uint32_t w;
+    uint32_t h;
+
+    // The PNG color type (0 gray, 2 RGB, 3 palette, 
+    // 4 gray and alpha, 6 RGBA) and bits per sample.
+    int colorType;
+    int bitDepth;
+
+    // The bytes of samples in a row, and the bytes from 
+    // one row to the next, after padding.
+    uint32_t rowBytes;
+    uint32_t stride;
+
+    // For palette images, the palette as 8-bit RGBA, with 
+    // the alpha from tRNS (255 without one).
+    uint32_t paletteSize;
+    uint8_t palette[256*4];
+
+    // For gray and RGB images, the sample values that are 
+    // transparent (gray uses only the first), or -1 if 
+    // there's no tRNS chunk.
+    int transparent[3];
+} tpng_native_format_t;
+
+// Fills in format for the decoder's image once every chunk 
+// has been read. Returns 0 (leaving format alone) until then.
+int tpng_decoder_get_native_format(const tpng_decoder_t * decoder, tpng_native_format_t * format);
+
+// Returns the image's samples in TPNG_FORMAT_NATIVE, or NULL 
+// on failure, describing them in format. Must be freed.
+uint8_t * tpng_decode_native(
+    // The raw data to interpret, as for tpng_get_rgba().
+    const uint8_t * rawData,
+
+    // The number of bytes of the rawData.
+    uint32_t        rawSize,
+
+    // On success, outputs what the samples are.
+    tpng_native_format_t * format,
+
+    // The options to decode with, such as rowAlignment. 
+    // If NULL, the defaults are used. The format is 
+    // always TPNG_FORMAT_NATIVE.
+    const tpng_options_t * options
+);
+
+
+
+// The color space chunks of an image.
+typedef struct {
+    // The gamma the samples were encoded with, from the 
+    // gAMA chunk (such as 0.45455), or 0 without one.
+    float gamma;
+
+    // The rendering intent from the sRGB chunk, or -1 
+    // without one.
+    int srgbIntent;
+
+    // If nonzero, the white point and primaries from the 
+    // cHRM chunk, as CIE x and y.
+    int hasChromaticities;
+    float whiteX, whiteY;
+    float redX, redY;
+    float greenX, greenY;
+    float blueX, blueY;
+} tpng_color_info_t;
+
+// Fills in info for the decoder's image once every chunk 
+// has been read. Returns 0 (leaving info alone) until then.
+int tpng_decoder_get_color_info(const tpng_decoder_t * decoder, tpng_color_info_t * info);
+
+
+
+// The most levels a mip chain can have.
+#define TPNG_MIP_LIMIT 32
+
+// Where each level of a mip chain of 32-bit RGBA is. Each 
+// level is half the size of the one before (rounded down, 
+// but at least 1), and each of its pixels is the average 
+// of the 2x2 pixels it covers. Odd last rows and columns 
+// are left out.
+typedef struct {
+    // The number of levels, including the image itself.
+    uint32_t levels;
+
+    // The width and height of each level.
+    uint32_t w[TPNG_MIP_LIMIT];
+    uint32_t h[TPNG_MIP_LIMIT];
+
+    // The byte offset of each level from the start.
+    size_t offset[TPNG_MIP_LIMIT];
+
+    // The bytes of the whole chain.
+    size_t size;
+} tpng_mip_chain_t;
+
+// Fills in chain for an image of w by h, which is 
+// what options.mipmaps outputs for it.
+void tpng_get_mip_chain(uint32_t w, uint32_t h, tpng_mip_chain_t * chain);
+
+
 #endif
 
 